@@ -114,6 +114,8 @@
 #define HAVE_STDLIB_H 1
 #define HAVE_STRDUP 1
 #define HAVE_STRERROR 1
+#define HAVE_STRERROR_R 1
+#define HAVE_DECL_STRERROR_R 1
 #define HAVE_STRINGS_H 1
 #define HAVE_STRING_H 1
 /* #undef HAVE_SUN_AUDIOIO_H */
@@ -26,6 +26,7 @@ my @instances =
 		libmpg123/optimize
 		libmpg123/parse
 		libmpg123/reader
+		libmpg123/stats
 		libout123/module
 		libout123/buffer
 		libout123/xfermem
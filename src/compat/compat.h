@@ -111,6 +111,9 @@ void *safe_realloc(void *ptr, size_t size);
 #ifndef HAVE_STRERROR
 const char *strerror(int errnum);
 #endif
+/* Thread-safe variant of strerror(), storing the (possibly cut) message
+   in buf. Returns buf, or an empty string if there is no room at all. */
+const char *compat_strerror(int errnum, char *buf, size_t size);
 
 /* Roll our own strdup() that does not depend on libc feature test macros
    and returns NULL on NULL input instead of crashing. */
@@ -29,6 +29,42 @@ const char *strerror(int errnum)
 }
 #endif
 
+/* Copy a message, cut to the buffer size. */
+static void copy_message(char *buf, size_t size, const char *msg)
+{
+	size_t len = strlen(msg);
+	if(len >= size)
+		len = size-1;
+	memcpy(buf, msg, len);
+	buf[len] = 0;
+}
+
+const char *compat_strerror(int errnum, char *buf, size_t size)
+{
+	if(buf == NULL || size < 1)
+		return "";
+#if defined(HAVE_STRERROR_R) && HAVE_DECL_STRERROR_R
+#ifdef STRERROR_R_CHAR_P
+	{
+		/* The GNU one may return a static string instead of filling buf. */
+		const char *msg = strerror_r(errnum, buf, size);
+		if(msg != buf)
+			copy_message(buf, size, msg ? msg : "unknown error");
+	}
+#else
+	if(strerror_r(errnum, buf, size))
+		copy_message(buf, size, "unknown error");
+#endif
+#elif defined(_MSC_VER)
+	if(strerror_s(buf, size, errnum))
+		copy_message(buf, size, "unknown error");
+#else
+	/* Nothing better around, hope that this one is thread-safe. */
+	copy_message(buf, size, strerror(errnum));
+#endif
+	return buf;
+}
+
 char* compat_strdup(const char *src)
 {
 	char *dest = NULL;
@@ -8,6 +8,7 @@
 #define pnts INT123_pnts
 #define catchsignal INT123_catchsignal
 #define safe_realloc INT123_safe_realloc
+#define compat_strerror INT123_compat_strerror
 #define compat_strdup INT123_compat_strdup
 #define compat_getenv INT123_compat_getenv
 #define compat_open INT123_compat_open
@@ -30,6 +31,7 @@
 #define unintr_read INT123_unintr_read
 #define ntom_set_ntom INT123_ntom_set_ntom
 #define synth_1to1 INT123_synth_1to1
+#define synth_1to1_planar INT123_synth_1to1_planar
 #define synth_1to1_dither INT123_synth_1to1_dither
 #define synth_1to1_i386 INT123_synth_1to1_i386
 #define synth_1to1_i586 INT123_synth_1to1_i586
@@ -85,6 +87,7 @@
 #define synth_ntom_8bit_mono INT123_synth_ntom_8bit_mono
 #define synth_ntom_8bit_m2s INT123_synth_ntom_8bit_m2s
 #define synth_1to1_real INT123_synth_1to1_real
+#define synth_1to1_real_planar INT123_synth_1to1_real_planar
 #define synth_1to1_real_i386 INT123_synth_1to1_real_i386
 #define synth_1to1_real_sse INT123_synth_1to1_real_sse
 #define synth_1to1_real_stereo_sse INT123_synth_1to1_real_stereo_sse
@@ -112,6 +115,7 @@
 #define synth_ntom_real_mono INT123_synth_ntom_real_mono
 #define synth_ntom_real_m2s INT123_synth_ntom_real_m2s
 #define synth_1to1_s32 INT123_synth_1to1_s32
+#define synth_1to1_s32_planar INT123_synth_1to1_s32_planar
 #define synth_1to1_s32_i386 INT123_synth_1to1_s32_i386
 #define synth_1to1_s32_sse INT123_synth_1to1_s32_sse
 #define synth_1to1_s32_stereo_sse INT123_synth_1to1_s32_stereo_sse
@@ -150,23 +154,28 @@
 #define dct36_avx INT123_dct36_avx
 #define dct36_neon INT123_dct36_neon
 #define dct36_neon64 INT123_dct36_neon64
+#define antialias INT123_antialias
+#define antialias_x86_64 INT123_antialias_x86_64
+#define antialias_avx INT123_antialias_avx
+#define midside INT123_midside
+#define midside_x86_64 INT123_midside_x86_64
+#define midside_avx INT123_midside_avx
 #define synth_ntom_set_step INT123_synth_ntom_set_step
 #define ntom_val INT123_ntom_val
 #define ntom_frame_outsamples INT123_ntom_frame_outsamples
 #define ntom_frmouts INT123_ntom_frmouts
 #define ntom_ins2outs INT123_ntom_ins2outs
 #define ntom_frameoff INT123_ntom_frameoff
+#define synth_batch_begin INT123_synth_batch_begin
+#define synth_batch_run INT123_synth_batch_run
+#define synth_batch_free INT123_synth_batch_free
 #define init_layer3 INT123_init_layer3
-#define init_layer3_gainpow2 INT123_init_layer3_gainpow2
 #define init_layer3_stuff INT123_init_layer3_stuff
 #define init_layer12 INT123_init_layer12
-#define init_layer12_table INT123_init_layer12_table
 #define init_layer12_stuff INT123_init_layer12_stuff
 #define prepare_decode_tables INT123_prepare_decode_tables
 #define make_decode_tables INT123_make_decode_tables
 #define make_decode_tables_mmx INT123_make_decode_tables_mmx
-#define init_layer3_gainpow2_mmx INT123_init_layer3_gainpow2_mmx
-#define init_layer12_table_mmx INT123_init_layer12_table_mmx
 #define make_conv16to8_table INT123_make_conv16to8_table
 #define do_layer3 INT123_do_layer3
 #define do_layer2 INT123_do_layer2
@@ -183,10 +192,13 @@
 #define frame_reset INT123_frame_reset
 #define frame_buffers_reset INT123_frame_buffers_reset
 #define frame_exit INT123_frame_exit
+#define frame_prealloc INT123_frame_prealloc
+#define frame_reuse INT123_frame_reuse
 #define frame_index_find INT123_frame_index_find
 #define frame_index_setup INT123_frame_index_setup
 #define do_volume INT123_do_volume
 #define do_rva INT123_do_rva
+#define synth_scale INT123_synth_scale
 #define frame_gapless_init INT123_frame_gapless_init
 #define frame_gapless_realinit INT123_frame_gapless_realinit
 #define frame_gapless_update INT123_frame_gapless_update
@@ -211,6 +223,7 @@
 #define exit_id3 INT123_exit_id3
 #define reset_id3 INT123_reset_id3
 #define id3_link INT123_id3_link
+#define id3_process_lazy INT123_id3_process_lazy
 #define parse_new_id3 INT123_parse_new_id3
 #define id3_to_utf8 INT123_id3_to_utf8
 #define fi_init INT123_fi_init
@@ -218,7 +231,17 @@
 #define fi_resize INT123_fi_resize
 #define fi_add INT123_fi_add
 #define fi_set INT123_fi_set
+#define fi_copy INT123_fi_copy
+#define fi_get INT123_fi_get
+#define fi_plain INT123_fi_plain
 #define fi_reset INT123_fi_reset
+#define fi_put_uvar INT123_fi_put_uvar
+#define fi_put_svar INT123_fi_put_svar
+#define fi_get_uvar INT123_fi_get_uvar
+#define fi_get_svar INT123_fi_get_svar
+#define fi_pack_size INT123_fi_pack_size
+#define fi_pack INT123_fi_pack
+#define fi_unpack INT123_fi_unpack
 #define decode_update INT123_decode_update
 #define decoder_synth_bytes INT123_decoder_synth_bytes
 #define samples_to_bytes INT123_samples_to_bytes
@@ -227,6 +250,7 @@
 #define postprocess_buffer INT123_postprocess_buffer
 #define frame_cpu_opt INT123_frame_cpu_opt
 #define set_synth_functions INT123_set_synth_functions
+#define synth_planar INT123_synth_planar
 #define dectype INT123_dectype
 #define defdec INT123_defdec
 #define decclass INT123_decclass
@@ -236,6 +260,9 @@
 #define frame_freq INT123_frame_freq
 #define read_frame_recover INT123_read_frame_recover
 #define read_frame INT123_read_frame
+#define scan_frame INT123_scan_frame
+#define head_compatible INT123_head_compatible
+#define restore_header INT123_restore_header
 #define set_pointer INT123_set_pointer
 #define position_info INT123_position_info
 #define compute_bpf INT123_compute_bpf
@@ -249,9 +276,14 @@
 #define open_stream_handle INT123_open_stream_handle
 #define open_feed INT123_open_feed
 #define feed_more INT123_feed_more
+#define feed_more_ref INT123_feed_more_ref
 #define feed_forget INT123_feed_forget
 #define feed_set_pos INT123_feed_set_pos
+#define reader_set_pos INT123_reader_set_pos
 #define open_bad INT123_open_bad
+#define stats_now INT123_stats_now
+#define stats_reset INT123_stats_reset
+#define stats_wrap_synth INT123_stats_wrap_synth
 #define open_module INT123_open_module
 #define close_module INT123_close_module
 #define list_modules INT123_list_modules
@@ -276,7 +308,10 @@
 #define read_buf INT123_read_buf
 #define xfer_write_string INT123_xfer_write_string
 #define xfer_read_string INT123_xfer_read_string
+#define xfer_read_string_buf INT123_xfer_read_string_buf
 #define xfermem_init INT123_xfermem_init
+#define xfermem_init_thread INT123_xfermem_init_thread
+#define xfermem_reader_sleep INT123_xfermem_reader_sleep
 #define xfermem_init_writer INT123_xfermem_init_writer
 #define xfermem_init_reader INT123_xfermem_init_reader
 #define xfermem_get_freespace INT123_xfermem_get_freespace
@@ -286,6 +321,7 @@
 #define xfermem_putcmd INT123_xfermem_putcmd
 #define xfermem_writer_block INT123_xfermem_writer_block
 #define xfermem_write INT123_xfermem_write
+#define xfermem_set_readindex INT123_xfermem_set_readindex
 #define xfermem_done INT123_xfermem_done
 #define au_open INT123_au_open
 #define cdr_open INT123_cdr_open
@@ -303,6 +339,9 @@
 #define write_parameters INT123_write_parameters
 #define read_parameters INT123_read_parameters
 #define stringlists_add INT123_stringlists_add
+#define simd_conv INT123_simd_conv
+#define simd_mix INT123_simd_mix
+#define simd_amp INT123_simd_amp
 #define check_neon INT123_check_neon
 #define dct64_3dnow INT123_dct64_3dnow
 #define dct64_3dnowext INT123_dct64_3dnowext
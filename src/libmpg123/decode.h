@@ -40,6 +40,7 @@ void ntom_set_ntom(mpg123_handle *fr, off_t num);
 #ifndef NO_16BIT
 /* The signed-16bit-producing variants. */
 int synth_1to1            (real*, int, mpg123_handle*, int);
+int synth_1to1_planar     (real*, int, mpg123_handle*, int);
 int synth_1to1_dither     (real*, int, mpg123_handle*, int);
 int synth_1to1_i386       (real*, int, mpg123_handle*, int);
 int synth_1to1_i586       (real*, int, mpg123_handle*, int);
@@ -125,6 +126,7 @@ int synth_ntom_8bit_m2s(real*, mpg123_handle*);
 #ifndef NO_REAL
 /* The real-producing variants. */
 int synth_1to1_real            (real*, int, mpg123_handle*, int);
+int synth_1to1_real_planar     (real*, int, mpg123_handle*, int);
 int synth_1to1_real_i386       (real*, int, mpg123_handle*, int);
 int synth_1to1_real_sse        (real*, int, mpg123_handle*, int);
 int synth_1to1_real_stereo_sse (real*, real*, mpg123_handle*);
@@ -160,6 +162,7 @@ int synth_ntom_real_m2s(real*, mpg123_handle*);
 #ifndef NO_32BIT
 /* 32bit integer */
 int synth_1to1_s32            (real*, int, mpg123_handle*, int);
+int synth_1to1_s32_planar     (real*, int, mpg123_handle*, int);
 int synth_1to1_s32_i386       (real*, int, mpg123_handle*, int);
 int synth_1to1_s32_sse        (real*, int, mpg123_handle*, int);
 int synth_1to1_s32_stereo_sse (real*, real*, mpg123_handle*);
@@ -213,6 +216,14 @@ void dct36_avx     (real *,real *,real *,real *,real *);
 void dct36_neon    (real *,real *,real *,real *,real *);
 void dct36_neon64  (real *,real *,real *,real *,real *);
 
+/* More of the layer 3 decoder: alias reduction and MS stereo. */
+void antialias       (real *xr, int sblim, real *cs, real *ca);
+void antialias_x86_64(real *xr, int sblim, real *cs, real *ca);
+void antialias_avx   (real *xr, int sblim, real *cs, real *ca);
+void midside       (real *xr0, real *xr1, int n);
+void midside_x86_64(real *xr0, real *xr1, int n);
+void midside_avx   (real *xr0, real *xr1, int n);
+
 /* Tools for NtoM resampling synth, defined in ntom.c . */
 int synth_ntom_set_step(mpg123_handle *fr); /* prepare ntom decoding */
 unsigned long ntom_val(mpg123_handle *fr, off_t frame); /* compute ntom_val for frame offset */
@@ -229,17 +240,36 @@ off_t ntom_ins2outs(mpg123_handle *fr, off_t ins);
 off_t ntom_frameoff(mpg123_handle *fr, off_t soff);
 #endif
 
+/* Synthesis for several handles at once, see synth_batch.c.
+   synth_batch_begin() redirects the synth calls of the next frame into a
+   recording if the handle qualifies and returns 1, synth_batch_run() does
+   the recorded synthesis for all given handles and restores the synths. */
+int  synth_batch_begin(mpg123_handle *fr);
+void synth_batch_run(mpg123_handle **fr, int count);
+void synth_batch_free(mpg123_handle *fr);
+
+/* The layer tables are shared between handles, but scaled differently
+   for the MMX/SSE synths. */
+enum table_variant
+{
+	tables_plain = 0
+#ifdef OPT_MMXORSSE
+,	tables_mmx      /* MMX/SSE scaling */
+,	tables_mmx_down /* MMX/SSE scaling with MPG123_DOWN_SAMPLE */
+#endif
+,	tables_variants
+};
+
 /* Initialization of any static data that majy be needed at runtime.
    Make sure you call these once before it is too late. */
 #ifndef NO_LAYER3
 void init_layer3(void);
-real init_layer3_gainpow2(mpg123_handle *fr, int i);
-void init_layer3_stuff(mpg123_handle *fr, real (*gainpow2)(mpg123_handle *fr, int i));
+/* Point the handle to the shared tables. */
+void init_layer3_stuff(mpg123_handle *fr, enum table_variant variant);
 #endif
 #ifndef NO_LAYER12
 void  init_layer12(void);
-real* init_layer12_table(mpg123_handle *fr, real *table, int m);
-void  init_layer12_stuff(mpg123_handle *fr, real* (*init_table)(mpg123_handle *fr, real *table, int m));
+void  init_layer12_stuff(mpg123_handle *fr, enum table_variant variant);
 #endif
 
 void prepare_decode_tables(void);
@@ -253,12 +283,6 @@ void make_decode_tables(mpg123_handle *fr); /* For every volume change. */
 #ifdef OPT_MMXORSSE
 /* Special treatment for mmx-like decoders, these functions go into the slots below. */
 void make_decode_tables_mmx(mpg123_handle *fr);
-#ifndef NO_LAYER3
-real init_layer3_gainpow2_mmx(mpg123_handle *fr, int i);
-#endif
-#ifndef NO_LAYER12
-real* init_layer12_table_mmx(mpg123_handle *fr, real *table, int m);
-#endif
 #endif
 
 #ifndef NO_8BIT
@@ -113,6 +113,13 @@ int mpg123_feature(const enum mpg123_feature_set key)
 		return 0;
 #endif
 
+		case MPG123_FEATURE_THREADS:
+#ifdef HAVE_PTHREAD
+		return 1;
+#else
+		return 0;
+#endif
+
 		default: return 0;
 	}
 }
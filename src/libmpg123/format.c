@@ -514,56 +514,125 @@ off_t outblock_bytes(mpg123_handle *fr, off_t s)
 	return s * encsize * fr->af.channels;
 }
 
+/*
+	The conversions below each do all the work for one pair of decoder and
+	output encoding in a single pass over the buffer: offset to unsigned,
+	widening, dropping of the lowest byte for 24 bit and swapping of the byte
+	order happen per sample in registers. Wider output is written from the
+	back, narrower from the front, so that all of them work in place.
+*/
+
+/* Byte order swap of a 32 bit word, recognized by compilers as bswap. */
+#define SWAP32(x) ( ((x)>>24) | (((x)>>8)&0xff00UL) \
+	| (((x)<<8)&0xff0000UL) | (((x)<<24)&0xff000000UL) )
+#define SWAP16(x) (uint16_t)( ((x)>>8) | ((x)<<8) )
+
+/* Store the upper three bytes of 32 bit word x at p, in little or big endian order. */
+#define STORE24LE(p, x) { (p)[0]=(unsigned char)((x)>>8);  (p)[1]=(unsigned char)((x)>>16); (p)[2]=(unsigned char)((x)>>24); }
+#define STORE24BE(p, x) { (p)[0]=(unsigned char)((x)>>24); (p)[1]=(unsigned char)((x)>>16); (p)[2]=(unsigned char)((x)>>8);  }
+
+/* We always assume that whole numbers are written!
+   partials will be cut out. */
+
+static const char *bufsizeerr = "Fatal: Buffer too small for postprocessing!";
+
 #ifndef NO_32BIT
 
-/* Remove every fourth byte, facilitating conversion from 32 bit to 24 bit integers.
-   This has to be aware of endianness, of course. */
-static void chop_fourth_byte(struct outbuffer *buf)
+/* 32 bit integers to 24 bit by dropping the lowest byte, with flip being the
+   sign bit for unsigned output. */
+static void conv_s32_to_24(struct outbuffer *buf, uint32_t flip, int big)
 {
-	unsigned char *wpos = buf->data;
-	unsigned char *rpos = buf->data;
-	size_t blocks = buf->fill/4;
-	size_t i;
-	for(i=0; i<blocks; ++i,wpos+=3,rpos+=4)
-		DROP4BYTE(wpos, rpos)
-	buf->fill = wpos-buf->data;
+	int32_t *in = (int32_t*)buf->data;
+	unsigned char *out = buf->data;
+	size_t count = buf->fill/sizeof(int32_t);
+	size_t i = 0;
+
+	if(big)
+	{
+		for(; i<count; ++i, out+=3)
+		{
+			uint32_t x = (uint32_t)in[i] ^ flip;
+			STORE24BE(out, x)
+		}
+	}
+	else
+	{
+#ifndef WORDS_BIGENDIAN
+		/* Four samples fit into three native words. */
+		for(; i+4<=count; i+=4, out+=12)
+		{
+			uint32_t a = (uint32_t)in[i]   ^ flip;
+			uint32_t b = (uint32_t)in[i+1] ^ flip;
+			uint32_t c = (uint32_t)in[i+2] ^ flip;
+			uint32_t d = (uint32_t)in[i+3] ^ flip;
+			uint32_t w0 = (a>>8)  | ((b<<16) & 0xff000000UL);
+			uint32_t w1 = (b>>16) | ((c<<8)  & 0xffff0000UL);
+			uint32_t w2 = (c>>24) | (d & 0xffffff00UL);
+			memcpy(out,   &w0, sizeof(w0));
+			memcpy(out+4, &w1, sizeof(w1));
+			memcpy(out+8, &w2, sizeof(w2));
+		}
+#endif
+		for(; i<count; ++i, out+=3)
+		{
+			uint32_t x = (uint32_t)in[i] ^ flip;
+			STORE24LE(out, x)
+		}
+	}
+	buf->fill = count*3;
 }
 
-static void conv_s32_to_u32(struct outbuffer *buf)
+static void conv_s32_to_u32(struct outbuffer *buf, int swap)
 {
 	size_t i;
-	int32_t  *ssamples = (int32_t*)  buf->data;
-	uint32_t *usamples = (uint32_t*) buf->data;
-	size_t count = buf->fill/sizeof(int32_t);
+	uint32_t *samples = (uint32_t*) buf->data;
+	size_t count = buf->fill/sizeof(uint32_t);
 
-	for(i=0; i<count; ++i)
-		usamples[i] = CONV_SU32(ssamples[i]);
+	/* The offset of CONV_SU32() is just a flip of the sign bit. */
+	if(swap) for(i=0; i<count; ++i)
+	{
+		uint32_t x = samples[i] ^ 0x80000000UL;
+		samples[i] = SWAP32(x);
+	}
+	else for(i=0; i<count; ++i)
+		samples[i] ^= 0x80000000UL;
 }
 
 #endif
 
-
-/* We always assume that whole numbers are written!
-   partials will be cut out. */
-
-static const char *bufsizeerr = "Fatal: Buffer too small for postprocessing!";
-
-
 #ifndef NO_16BIT
 
-static void conv_s16_to_u16(struct outbuffer *buf)
+static void conv_s16_to_u16(struct outbuffer *buf, int swap)
 {
 	size_t i;
-	int16_t  *ssamples = (int16_t*) buf->data;
-	uint16_t *usamples = (uint16_t*)buf->data;
-	size_t count = buf->fill/sizeof(int16_t);
+	unsigned char *p = buf->data;
+	size_t words = buf->fill/sizeof(uint32_t);
 
-	for(i=0; i<count; ++i)
-		usamples[i] = CONV_SU16(ssamples[i]);
+	/* The offset of CONV_SU16() is just a flip of the sign bit, done for two
+	   samples in one word. This also avoids 16 bit immediates that stall
+	   the instruction decoder of x86. */
+	for(i=0; i<words; ++i, p+=4)
+	{
+		uint32_t x;
+		memcpy(&x, p, sizeof(x));
+		x ^= 0x80008000UL;
+		if(swap)
+			x = ((x>>8) & 0x00ff00ffUL) | ((x<<8) & 0xff00ff00UL);
+		memcpy(p, &x, sizeof(x));
+	}
+	if(buf->fill % sizeof(uint32_t) >= sizeof(uint16_t))
+	{
+		uint16_t x;
+		memcpy(&x, p, sizeof(x));
+		x ^= 0x8000;
+		if(swap)
+			x = SWAP16(x);
+		memcpy(p, &x, sizeof(x));
+	}
 }
 
 #ifndef NO_REAL
-static void conv_s16_to_f32(struct outbuffer *buf)
+static void conv_s16_to_f32(struct outbuffer *buf, int swap)
 {
 	ssize_t i;
 	int16_t *in = (int16_t*) buf->data;
@@ -581,19 +650,31 @@ static void conv_s16_to_f32(struct outbuffer *buf)
 	}
 
 	/* Work from the back since output is bigger. */
-	for(i=count-1; i>=0; --i)
-	out[i] = (float)in[i] * scale;
+	if(swap) for(i=count-1; i>=0; --i)
+	{
+		float f = (float)in[i] * scale;
+		uint32_t x;
+		memcpy(&x, &f, sizeof(x));
+		x = SWAP32(x);
+		memcpy(out+i, &x, sizeof(x));
+	}
+	else for(i=count-1; i>=0; --i)
+		out[i] = (float)in[i] * scale;
 
 	buf->fill = count*sizeof(float);
 }
 #endif
 
 #ifndef NO_32BIT
-static void conv_s16_to_s32(struct outbuffer *buf)
+/* Scaled to 32 bit by shifting the bits up (the same as multiplying with
+   S32_RESCALE), with flip being the sign bit for unsigned output. */
+#define S16_TO_U32(s, flip) ( ((uint32_t)(uint16_t)(s)<<16) ^ (flip) )
+
+static void conv_s16_to_32(struct outbuffer *buf, uint32_t flip, int swap)
 {
 	ssize_t i;
 	int16_t  *in = (int16_t*) buf->data;
-	int32_t *out = (int32_t*) buf->data;
+	uint32_t *out = (uint32_t*) buf->data;
 	size_t count = buf->fill/sizeof(int16_t);
 
 	if(buf->size < count*sizeof(int32_t))
@@ -603,15 +684,43 @@ static void conv_s16_to_s32(struct outbuffer *buf)
 	}
 
 	/* Work from the back since output is bigger. */
-	for(i=count-1; i>=0; --i)
+	if(swap) for(i=count-1; i>=0; --i)
 	{
-		out[i] = in[i];
-		/* Could just shift bytes, but would have to mess with sign bit. */
-		out[i] *= S32_RESCALE;
+		uint32_t x = S16_TO_U32(in[i], flip);
+		out[i] = SWAP32(x);
 	}
+	else for(i=count-1; i>=0; --i)
+		out[i] = S16_TO_U32(in[i], flip);
 
 	buf->fill = count*sizeof(int32_t);
 }
+
+static void conv_s16_to_24(struct outbuffer *buf, uint32_t flip, int big)
+{
+	ssize_t i;
+	int16_t *in = (int16_t*) buf->data;
+	size_t count = buf->fill/sizeof(int16_t);
+
+	if(buf->size < count*3)
+	{
+		error1("%s", bufsizeerr);
+		return;
+	}
+
+	/* Work from the back since output is bigger. */
+	if(big) for(i=count-1; i>=0; --i)
+	{
+		uint32_t x = S16_TO_U32(in[i], flip);
+		STORE24BE(buf->data+3*i, x)
+	}
+	else for(i=count-1; i>=0; --i)
+	{
+		uint32_t x = S16_TO_U32(in[i], flip);
+		STORE24LE(buf->data+3*i, x)
+	}
+
+	buf->fill = count*3;
+}
 #endif
 #endif
 
@@ -628,14 +737,123 @@ void swap_endian(struct outbuffer *buf, int block)
 	}
 }
 
+/*
+	The output gain of MPG123_SMOOTH_VOLUME on the decoder samples, with
+	<block> values per sample frame. It goes linearly from gain.current to
+	gain.target over the buffer, to be settled by the caller afterwards.
+	Integers work in fixed point with GAIN_SHIFT fractional bits, to be free
+	of floating point in the fixed point decoder builds, round to nearest
+	and saturate. Rounding twice (synth and gain), 16 bit output stays
+	within 1 of the volume in the tables for gains below 2.
+	Returns the number of clipped samples.
+*/
+#define GAIN_SHIFT 24
+#define GAIN_HALF  ((int64_t)1<<(GAIN_SHIFT-1)) /* round to nearest */
+#define GAIN_MAX   127. /* Keeps 32 bit samples times gain in 64 bits. */
+
+static int64_t fixed_gain(double gain)
+{
+	if(gain > GAIN_MAX)
+		gain = GAIN_MAX;
+	if(gain < -GAIN_MAX)
+		gain = -GAIN_MAX;
+	return (int64_t)(gain*((int64_t)1<<GAIN_SHIFT));
+}
+
+#define GAIN_INT_LOOP(type, min, max) \
+{ \
+	type *samples = (type*)buf->data; \
+	int64_t g = fixed_gain(fr->gain.current); \
+	int64_t step = fixed_gain((fr->gain.target-fr->gain.current)/frames); \
+	for(i=0; i<frames; ++i, g+=step) \
+	for(c=0; c<block; ++c) \
+	{ \
+		int64_t v = ((int64_t)*samples * g + GAIN_HALF) >> GAIN_SHIFT; \
+		if(v > max){ v = max; ++clipped; } \
+		else if(v < min){ v = min; ++clipped; } \
+		*samples++ = (type)v; \
+	} \
+}
+
+#define GAIN_FLOAT_LOOP(type) \
+{ \
+	type *samples = (type*)buf->data; \
+	type g = (type)fr->gain.current; \
+	type step = (type)((fr->gain.target-fr->gain.current)/frames); \
+	if(step == 0) for(i=0; i<frames*block; ++i) \
+		samples[i] *= g; \
+	else for(i=0; i<frames; ++i) \
+	for(c=0; c<block; ++c) \
+		samples[i*block+c] *= g + step*(type)i; \
+}
+
+static long apply_gain(mpg123_handle *fr, struct outbuffer *buf, int block)
+{
+	long clipped = 0;
+	size_t frames = buf->fill/(block*fr->af.dec_encsize);
+	size_t i;
+	int c;
+
+	if(!frames)
+		return 0;
+	switch(fr->af.dec_enc)
+	{
+#ifndef NO_16BIT
+	case MPG123_ENC_SIGNED_16:
+		GAIN_INT_LOOP(int16_t, -32768, 32767)
+	break;
+#endif
+#ifndef NO_32BIT
+	case MPG123_ENC_SIGNED_32:
+		GAIN_INT_LOOP(int32_t, -2147483647-1, 2147483647)
+	break;
+#endif
+#ifndef NO_REAL
+	case MPG123_ENC_FLOAT_32:
+		GAIN_FLOAT_LOOP(float)
+	break;
+	case MPG123_ENC_FLOAT_64:
+		GAIN_FLOAT_LOOP(double)
+	break;
+#endif
+	}
+	return clipped;
+}
+
 void postprocess_buffer(mpg123_handle *fr)
 {
+	/* The byte order is swapped together with conversions, only alone else. */
+	int swap = FALSE;
+	/* Swapping for 24 bit output just means writing big endian on little
+	   endian machines and the other way round. */
+	int big;
+
+	if(fr->gain.current != 1. || fr->gain.target != 1.)
+		fr->clip += apply_gain(fr, &fr->buffer, fr->planar.plane[0] ? 1 : fr->af.channels);
 	/*
 		This caters for the final output formats that are never produced by
 		decoder synth directly (wide unsigned and 24 bit formats) or that are
 		missing because of limited decoder precision (16 bit synth but 32 or
 		24 bit output).
 	*/
+	if(fr->p.flags & MPG123_FORCE_ENDIAN)
+	{
+		if(
+#ifdef WORDS_BIGENDIAN
+			!(
+#endif
+				fr->p.flags & MPG123_BIG_ENDIAN
+#ifdef WORDS_BIGENDIAN
+			)
+#endif
+		)
+			swap = TRUE;
+	}
+#ifdef WORDS_BIGENDIAN
+	big = !swap;
+#else
+	big = swap;
+#endif
 	switch(fr->af.dec_enc)
 	{
 #ifndef NO_32BIT
@@ -643,15 +861,14 @@ void postprocess_buffer(mpg123_handle *fr)
 		switch(fr->af.encoding)
 		{
 		case MPG123_ENC_UNSIGNED_32:
-			conv_s32_to_u32(&fr->buffer);
-		break;
+			conv_s32_to_u32(&fr->buffer, swap);
+			return;
 		case MPG123_ENC_UNSIGNED_24:
-			conv_s32_to_u32(&fr->buffer);
-			chop_fourth_byte(&fr->buffer);
-		break;
+			conv_s32_to_24(&fr->buffer, 0x80000000UL, big);
+			return;
 		case MPG123_ENC_SIGNED_24:
-			chop_fourth_byte(&fr->buffer);
-		break;
+			conv_s32_to_24(&fr->buffer, 0, big);
+			return;
 		}
 	break;
 #endif
@@ -660,46 +877,31 @@ void postprocess_buffer(mpg123_handle *fr)
 		switch(fr->af.encoding)
 		{
 		case MPG123_ENC_UNSIGNED_16:
-			conv_s16_to_u16(&fr->buffer);
-		break;
+			conv_s16_to_u16(&fr->buffer, swap);
+			return;
 #ifndef NO_REAL
 		case MPG123_ENC_FLOAT_32:
-			conv_s16_to_f32(&fr->buffer);
-		break;
+			conv_s16_to_f32(&fr->buffer, swap);
+			return;
 #endif
 #ifndef NO_32BIT
 		case MPG123_ENC_SIGNED_32:
-			conv_s16_to_s32(&fr->buffer);
-		break;
+			conv_s16_to_32(&fr->buffer, 0, swap);
+			return;
 		case MPG123_ENC_UNSIGNED_32:
-			conv_s16_to_s32(&fr->buffer);
-			conv_s32_to_u32(&fr->buffer);
-		break;
+			conv_s16_to_32(&fr->buffer, 0x80000000UL, swap);
+			return;
 		case MPG123_ENC_UNSIGNED_24:
-			conv_s16_to_s32(&fr->buffer);
-			conv_s32_to_u32(&fr->buffer);
-			chop_fourth_byte(&fr->buffer);
-		break;
+			conv_s16_to_24(&fr->buffer, 0x80000000UL, big);
+			return;
 		case MPG123_ENC_SIGNED_24:
-			conv_s16_to_s32(&fr->buffer);
-			chop_fourth_byte(&fr->buffer);
-		break;
+			conv_s16_to_24(&fr->buffer, 0, big);
+			return;
 #endif
 		}
 	break;
 #endif
 	}
-	if(fr->p.flags & MPG123_FORCE_ENDIAN)
-	{
-		if(
-#ifdef WORDS_BIGENDIAN
-			!(
-#endif
-				fr->p.flags & MPG123_BIG_ENDIAN
-#ifdef WORDS_BIGENDIAN
-			)
-#endif
-		)
-			swap_endian(&fr->buffer, mpg123_encsize(fr->af.encoding));
-	}
+	if(swap)
+		swap_endian(&fr->buffer, mpg123_encsize(fr->af.encoding));
 }
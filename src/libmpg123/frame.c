@@ -77,6 +77,7 @@ void frame_init_par(mpg123_handle *fr, mpg123_pars *mp)
 	fr->own_buffer = TRUE;
 	fr->buffer.data = NULL;
 	fr->buffer.rdata = NULL;
+	fr->buffer.rsize = 0;
 	fr->buffer.fill = 0;
 	fr->buffer.size = 0;
 	fr->rawbuffs = NULL;
@@ -89,7 +90,20 @@ void frame_init_par(mpg123_handle *fr, mpg123_pars *mp)
 #ifdef OPT_DITHER
 	fr->dithernoise = NULL;
 #endif
-	fr->layerscratch = NULL;
+#ifndef NO_LAYER1
+	fr->layer1.scratch = NULL;
+#endif
+#ifndef NO_LAYER2
+	fr->layer2.scratch = NULL;
+#endif
+#ifndef NO_LAYER3
+	fr->layer3.scratch = NULL;
+	fr->layer3.hybrid_block = NULL;
+	fr->gainpow2 = NULL;
+#endif
+#ifndef NO_LAYER12
+	fr->muls = NULL;
+#endif
 	fr->xing_toc = NULL;
 	fr->cpu_opts.type = defdec();
 	fr->cpu_opts.class = decclass(fr->cpu_opts.type);
@@ -129,6 +143,10 @@ void frame_init_par(mpg123_handle *fr, mpg123_pars *mp)
 	frame_fixed_reset(fr); /* Reset only the fixed data, dynamic buffers are not there yet! */
 	fr->synth = NULL;
 	fr->synth_mono = NULL;
+	fr->planar.plane[0] = fr->planar.plane[1] = NULL;
+	fr->planar.synth = NULL;
+	fr->batch = NULL;
+	fr->gain.current = fr->gain.target = 1.;
 	fr->make_decode_tables = NULL;
 #ifdef FRAME_INDEX
 	fi_init(&fr->index);
@@ -195,7 +213,9 @@ int frame_outbuffer(mpg123_handle *fr)
 	}
 
 	debug1("need frame buffer of %"SIZE_P, (size_p)size);
-	if(fr->buffer.rdata != NULL && fr->buffer.size != size)
+	/* Only ever grow the buffer, format changes back and forth do not
+	   need new memory each time. */
+	if(fr->buffer.rdata != NULL && fr->buffer.rsize < size)
 	{
 		free(fr->buffer.rdata);
 		fr->buffer.rdata = NULL;
@@ -203,7 +223,11 @@ int frame_outbuffer(mpg123_handle *fr)
 	fr->buffer.size = size;
 	fr->buffer.data = NULL;
 	/* be generous: use 16 byte alignment */
-	if(fr->buffer.rdata == NULL) fr->buffer.rdata = (unsigned char*) malloc(fr->buffer.size+15);
+	if(fr->buffer.rdata == NULL)
+	{
+		fr->buffer.rdata = (unsigned char*) malloc(fr->buffer.size+15);
+		fr->buffer.rsize = fr->buffer.size;
+	}
 	if(fr->buffer.rdata == NULL)
 	{
 		fr->err = MPG123_OUT_OF_MEM;
@@ -243,7 +267,7 @@ int frame_index_setup(mpg123_handle *fr)
 		fr->index.grow_size = 0;
 		debug1("resizing index to %li", fr->p.index_size);
 		ret = fi_resize(&fr->index, (size_t)fr->p.index_size);
-		debug2("index resized... %lu at %p", (unsigned long)fr->index.size, (void*)fr->index.data);
+		debug1("index resized... %lu", (unsigned long)fr->index.size);
 	}
 	else
 	{ /* A growing index. We give it a start, though. */
@@ -265,6 +289,68 @@ static void frame_decode_buffers_reset(mpg123_handle *fr)
 		memset(fr->rawbuffs, 0, fr->rawbuffss);
 }
 
+/*
+	Allocate specific layer1/2/3 buffers, so that we know they'll work for SSE.
+	We need 16 byte minimum, smallest unit of the blocks is 2*SBLIMIT*sizeof(real),
+	which is 64*4=256. Let's do 64 bytes as heuristic for cache line (as proven
+	useful in buffs above).
+	Those funky pointer casts silence compilers... One might change the code at
+	hand to really just use 1D arrays, but in practice, that would not make a
+	(positive) difference.
+	Note: These buffers don't need resetting here, apart from the layer 3
+	hybrid block that carries overlap between frames.
+*/
+static real* layer_scratch(void **scratch, size_t size)
+{
+	if(*scratch == NULL)
+		*scratch = malloc(size+63);
+	return *scratch == NULL ? NULL : aligned_pointer(*scratch,real,64);
+}
+
+static int frame_layer_scratch(mpg123_handle *fr, int lay)
+{
+	real *scratcher;
+	switch(lay)
+	{
+#ifndef NO_LAYER1
+		case 1:
+			if(fr->layer1.scratch != NULL) break;
+			scratcher = layer_scratch(&fr->layer1.scratch
+			,	sizeof(real) * 2 * SBLIMIT );
+			if(scratcher == NULL) return -1;
+			fr->layer1.fraction = (real(*)[SBLIMIT])scratcher;
+		break;
+#endif
+#ifndef NO_LAYER2
+		case 2:
+			if(fr->layer2.scratch != NULL) break;
+			scratcher = layer_scratch(&fr->layer2.scratch
+			,	sizeof(real) * 2 * 4 * SBLIMIT );
+			if(scratcher == NULL) return -1;
+			fr->layer2.fraction = (real(*)[4][SBLIMIT])scratcher;
+		break;
+#endif
+#ifndef NO_LAYER3
+		case 3:
+			if(fr->layer3.scratch != NULL) break;
+			scratcher = layer_scratch(&fr->layer3.scratch
+			,	sizeof(real) * 2 * SBLIMIT * SSLIMIT   /* hybrid_in */
+			+	sizeof(real) * 2 * SSLIMIT * SBLIMIT   /* hybrid_out */
+			+	sizeof(real) * 2 * 2 * SBLIMIT * SSLIMIT ); /* hybrid_block */
+			if(scratcher == NULL) return -1;
+			fr->layer3.hybrid_in = (real(*)[SBLIMIT][SSLIMIT])scratcher;
+			scratcher += 2 * SBLIMIT * SSLIMIT;
+			fr->layer3.hybrid_out = (real(*)[SSLIMIT][SBLIMIT])scratcher;
+			scratcher += 2 * SSLIMIT * SBLIMIT;
+			fr->layer3.hybrid_block = (real(*)[2][SBLIMIT*SSLIMIT])scratcher;
+			memset(fr->layer3.hybrid_block, 0, sizeof(real)*2*2*SBLIMIT*SSLIMIT);
+			fr->hybrid_blc[0] = fr->hybrid_blc[1] = 0;
+		break;
+#endif
+	}
+	return 0;
+}
+
 int frame_buffers(mpg123_handle *fr)
 {
 	int buffssize = 0;
@@ -387,49 +473,9 @@ int frame_buffers(mpg123_handle *fr)
 #endif
 	}
 
-	/* Layer scratch buffers are of compile-time fixed size, so allocate only once. */
-	if(fr->layerscratch == NULL)
-	{
-		/* Allocate specific layer1/2/3 buffers, so that we know they'll work for SSE. */
-		size_t scratchsize = 0;
-		real *scratcher;
-#ifndef NO_LAYER1
-		scratchsize += sizeof(real) * 2 * SBLIMIT;
-#endif
-#ifndef NO_LAYER2
-		scratchsize += sizeof(real) * 2 * 4 * SBLIMIT;
-#endif
-#ifndef NO_LAYER3
-		scratchsize += sizeof(real) * 2 * SBLIMIT * SSLIMIT; /* hybrid_in */
-		scratchsize += sizeof(real) * 2 * SSLIMIT * SBLIMIT; /* hybrid_out */
-#endif
-		/*
-			Now figure out correct alignment:
-			We need 16 byte minimum, smallest unit of the blocks is 2*SBLIMIT*sizeof(real), which is 64*4=256. Let's do 64bytes as heuristic for cache line (as proven useful in buffs above).
-		*/
-		fr->layerscratch = malloc(scratchsize+63);
-		if(fr->layerscratch == NULL) return -1;
-
-		/* Get aligned part of the memory, then divide it up. */
-		scratcher = aligned_pointer(fr->layerscratch,real,64);
-		/* Those funky pointer casts silence compilers...
-		   One might change the code at hand to really just use 1D arrays, but in practice, that would not make a (positive) difference. */
-#ifndef NO_LAYER1
-		fr->layer1.fraction = (real(*)[SBLIMIT])scratcher;
-		scratcher += 2 * SBLIMIT;
-#endif
-#ifndef NO_LAYER2
-		fr->layer2.fraction = (real(*)[4][SBLIMIT])scratcher;
-		scratcher += 2 * 4 * SBLIMIT;
-#endif
-#ifndef NO_LAYER3
-		fr->layer3.hybrid_in = (real(*)[SBLIMIT][SSLIMIT])scratcher;
-		scratcher += 2 * SBLIMIT * SSLIMIT;
-		fr->layer3.hybrid_out = (real(*)[SSLIMIT][SBLIMIT])scratcher;
-		scratcher += 2 * SSLIMIT * SBLIMIT;
-#endif
-		/* Note: These buffers don't need resetting here. */
-	}
+	/* Layer scratch buffers are of compile-time fixed size, so allocate only
+	   once, and only for the layer that is actually being decoded. */
+	if(frame_layer_scratch(fr, fr->lay) != 0) return -1;
 
 	/* Only reset the buffers we created just now. */
 	frame_decode_buffers_reset(fr);
@@ -438,6 +484,73 @@ int frame_buffers(mpg123_handle *fr)
 	return 0;
 }
 
+int frame_prealloc(mpg123_handle *fr)
+{
+	int lay;
+	/* The largest output without resampling: real is the widest sample. */
+	size_t outsize = sizeof(real)*2*1152;
+
+	if(frame_buffers(fr) != 0)
+		return -1;
+	for(lay=1; lay<=3; ++lay)
+		if(frame_layer_scratch(fr, lay) != 0)
+			return -1;
+	if(fr->own_buffer && fr->buffer.rdata == NULL)
+	{
+		/* frame_outbuffer() will find that and set up the rest. */
+		fr->buffer.rdata = (unsigned char*) malloc(outsize+15);
+		if(fr->buffer.rdata == NULL)
+			return -1;
+		fr->buffer.rsize = outsize;
+	}
+	return 0;
+}
+
+void frame_reuse(mpg123_handle *fr, mpg123_pars *mp)
+{
+	/* A replaced output buffer belongs to the former user. */
+	if(!fr->own_buffer)
+	{
+		fr->own_buffer = TRUE;
+		fr->buffer.data = NULL;
+		fr->buffer.size = 0;
+		fr->buffer.fill = 0;
+	}
+#ifndef NO_NTOM
+	fr->ntom_val[0] = NTOM_MUL>>1;
+	fr->ntom_val[1] = NTOM_MUL>>1;
+	fr->ntom_step = NTOM_MUL;
+#endif
+	mpg123_reset_eq(fr);
+	invalidate_format(&fr->af);
+	fr->rdat.r_read = NULL;
+	fr->rdat.r_lseek = NULL;
+	fr->rdat.iohandle = NULL;
+	fr->rdat.r_read_handle = NULL;
+	fr->rdat.r_lseek_handle = NULL;
+	fr->rdat.cleanup_handle = NULL;
+	if(fr->wrapperclean != NULL)
+	{
+		fr->wrapperclean(fr->wrapperdata);
+		fr->wrapperdata = NULL;
+		fr->wrapperclean = NULL;
+	}
+	fr->decoder_change = 1;
+	fr->err = MPG123_OK;
+	if(mp == NULL) frame_default_pars(&fr->p);
+	else memcpy(&fr->p, mp, sizeof(struct mpg123_pars_struct));
+#ifndef NO_FEEDER
+	bc_poolsize(&fr->rdat.buffer, fr->p.feedpool, fr->p.feedbuffer);
+#endif
+	fr->down_sample = 0;
+#ifdef FRAME_INDEX
+	frame_index_setup(fr);
+#endif
+#ifndef NO_MOREINFO
+	fr->pinfo = NULL;
+#endif
+}
+
 int frame_buffers_reset(mpg123_handle *fr)
 {
 	fr->buffer.fill = 0; /* hm, reset buffer fill... did we do a flush? */
@@ -445,12 +558,16 @@ int frame_buffers_reset(mpg123_handle *fr)
 	/* Wondering: could it be actually _wanted_ to retain buffer contents over different files? (special gapless / cut stuff) */
 	fr->bsbuf = fr->bsspace[1];
 	fr->bsbufold = fr->bsbuf;
+	fr->bsref = FALSE;
 	fr->bitreservoir = 0;
 	frame_decode_buffers_reset(fr);
 	memset(fr->bsspace, 0, 2*(MAXFRAMESIZE+512));
 	memset(fr->ssave, 0, 34);
 	fr->hybrid_blc[0] = fr->hybrid_blc[1] = 0;
-	memset(fr->hybrid_block, 0, sizeof(real)*2*2*SBLIMIT*SSLIMIT);
+#ifndef NO_LAYER3
+	if(fr->layer3.hybrid_block)
+		memset(fr->layer3.hybrid_block, 0, sizeof(real)*2*2*SBLIMIT*SSLIMIT);
+#endif
 	return 0;
 }
 
@@ -508,6 +625,7 @@ static void frame_fixed_reset(mpg123_handle *fr)
 {
 	frame_icy_reset(fr);
 	open_bad(fr);
+	stats_reset(fr);
 	fr->to_decode = FALSE;
 	fr->to_ignore = FALSE;
 	fr->metaflags = 0;
@@ -531,6 +649,7 @@ static void frame_fixed_reset(mpg123_handle *fr)
 	fr->mean_framesize = 0;
 	fr->freesize = 0;
 	fr->lastscale = -1;
+	fr->tablescale = -1;
 	fr->rva.level[0] = -1;
 	fr->rva.level[1] = -1;
 	fr->rva.gain[0] = 0;
@@ -587,7 +706,20 @@ static void frame_free_buffers(mpg123_handle *fr)
 	if(fr->conv16to8_buf != NULL) free(fr->conv16to8_buf);
 	fr->conv16to8_buf = NULL;
 #endif
-	if(fr->layerscratch != NULL) free(fr->layerscratch);
+#ifndef NO_LAYER1
+	if(fr->layer1.scratch != NULL) free(fr->layer1.scratch);
+	fr->layer1.scratch = NULL;
+#endif
+#ifndef NO_LAYER2
+	if(fr->layer2.scratch != NULL) free(fr->layer2.scratch);
+	fr->layer2.scratch = NULL;
+#endif
+#ifndef NO_LAYER3
+	if(fr->layer3.scratch != NULL) free(fr->layer3.scratch);
+	fr->layer3.scratch = NULL;
+	fr->layer3.hybrid_block = NULL;
+#endif
+	synth_batch_free(fr);
 }
 
 void frame_exit(mpg123_handle *fr)
@@ -730,7 +862,7 @@ off_t frame_index_find(mpg123_handle *fr, off_t want_frame, off_t* get_frame)
 		}
 		/* We have index position, that yields frame and byte offsets. */
 		*get_frame = fi*fr->index.step;
-		gopos = fr->index.data[fi];
+		gopos = fi_get(&fr->index, fi);
 		fr->state_flags |= FRAME_ACCURATE; /* When using the frame index, we are accurate. */
 	}
 	else
@@ -1026,11 +1158,27 @@ void do_rva(mpg123_handle *fr)
 	{
 		debug3("changing scale value from %f to %f (peak estimated to %f)", fr->lastscale != -1 ? fr->lastscale : fr->p.outscale, newscale, (double) (newscale*peak));
 		fr->lastscale = newscale;
+	}
+	/* Unity tables mean that the volume ramps in as output gain. */
+	fr->gain.target = synth_scale(fr) == 1. ? newscale : 1.;
+	if(synth_scale(fr) != fr->tablescale || fr->decoder_change)
+	{
+		fr->tablescale = synth_scale(fr);
+		/* The tables switch right away, so does the gain. */
+		fr->gain.current = fr->gain.target;
 		/* It may be too early, actually. */
 		if(fr->make_decode_tables != NULL) fr->make_decode_tables(fr); /* the actual work */
 	}
 }
 
+double synth_scale(mpg123_handle *fr)
+{
+	/* The 8 bit synths come with their own conversion, keep the volume there. */
+	if(fr->p.flags & MPG123_SMOOTH_VOLUME && !(fr->af.dec_enc & MPG123_ENC_8))
+		return 1.;
+	return fr->lastscale < 0 ? fr->p.outscale : fr->lastscale;
+}
+
 
 int attribute_align_arg mpg123_getvolume(mpg123_handle *mh, double *base, double *really, double *rva_db)
 {
@@ -43,6 +43,7 @@ struct outbuffer
 	size_t fill; /* fill from read pointer */
 	size_t size;
 	unsigned char *rdata; /* unaligned base pointer */
+	size_t rsize; /* allocated size at rdata, minus alignment reserve */
 };
 
 struct audioformat
@@ -94,12 +95,24 @@ enum frame_state_flags
 	,FRAME_FRESH_DECODER = 0x4  /**<     0100 Decoder is fleshly initialized. */
 };
 
+#ifndef NO_ID3V2
+/* An ID3v2 frame waiting to be processed, either in the stored raw tag
+   or still in the stream (seekable input, read again when asked for). */
+struct id3_lazy_frame
+{
+	char id[5]; /* empty once processed */
+	int unsync; /* tag or frame is unsynchronized */
+	int stored; /* frame data is in id3v2_raw */
+	off_t pos; /* offset of frame data in id3v2_raw or in the stream */
+	unsigned long size;
+};
+#endif
+
 /* There is a lot to condense here... many ints can be merged as flags; though the main space is still consumed by buffers. */
 struct mpg123_handle_struct
 {
 	int fresh; /* to be moved into flags */
 	int new_format;
-	real hybrid_block[2][2][SBLIMIT*SSLIMIT];
 	int hybrid_blc[2];
 	/* the scratch vars for the decoders, sometimes real, sometimes short... sometimes int/long */ 
 	short *short_buffs[2][2];
@@ -134,15 +147,13 @@ struct mpg123_handle_struct
 	unsigned char *conv16to8_buf;
 	unsigned char *conv16to8;
 #endif
-	/* There's some possible memory saving for stuff that is not _really_ dynamic. */
+	/* Constant tables shared by all handles, see init_layer*_stuff(). */
 
 	/* layer3 */
-	int longLimit[9][23];
-	int shortLimit[9][14];
-	real gainpow2[256+118+4]; /* not really dynamic, just different for mmx */
+	const real *gainpow2; /* [256+118+4], just different for mmx */
 
 	/* layer2 */
-	real muls[27][64];	/* also used by layer 1 */
+	const real (*muls)[64]; /* [27][64], also used by layer 1 */
 
 #ifndef NO_NTOM
 	/* decode_ntom */
@@ -166,6 +177,10 @@ struct mpg123_handle_struct
 #if (defined OPT_3DNOW_VINTAGE || defined OPT_3DNOWEXT_VINTAGE || defined OPT_SSE || defined OPT_X86_64 || defined OPT_AVX || defined OPT_NEON || defined OPT_NEON64)
 		void (*the_dct36)(real *,real *,real *,real *,real *);
 #endif
+#if (defined OPT_X86_64 || defined OPT_AVX)
+		void (*the_antialias)(real *, int, real *, real *);
+		void (*the_midside)(real *, real *, int);
+#endif
 #endif
 
 #endif
@@ -180,6 +195,24 @@ struct mpg123_handle_struct
 	func_synth synth;
 	func_synth_stereo synth_stereo;
 	func_synth_mono synth_mono;
+	/* Planar output for mpg123_read_planar(), see synth_planar(). */
+	struct
+	{
+		unsigned char *plane[2]; /* Channel buffers while decoding planar, else NULL. */
+		func_synth synth; /* Native planar 1to1 synth, if there is one for the decoder. */
+		/* The plain interleaving synths (without stats wrappers) ... */
+		func_synth_stereo stereo;
+		func_synth_mono mono;
+		/* ... and the active ones, set aside while decoding planar. */
+		func_synth_stereo keep_stereo;
+		func_synth_mono keep_mono;
+		func_synth_stereo keep_stats_stereo;
+		func_synth_mono keep_stats_mono;
+		/* Interleaved output of one synth call, to be split into the planes. */
+		real scratch[64*NTOM_MAX];
+	} planar;
+	/* Recorded synth calls for mpg123_decode_frames(), see synth_batch.c. */
+	struct synth_batch *batch;
 	/* Yes, this function is runtime-switched, too. */
 	void (*make_decode_tables)(mpg123_handle *fr); /* That is the volume control. */
 
@@ -235,6 +268,14 @@ struct mpg123_handle_struct
 
 	double maxoutburst; /* The maximum amplitude in current sample represenation. */
 	double lastscale;
+	double tablescale; /* The scale the synth tables were made with, see synth_scale(). */
+	/* The output gain for MPG123_SMOOTH_VOLUME, ramping linearly from current
+	   to target over a decoded frame. */
+	struct
+	{
+		double current;
+		double target;
+	} gain;
 	struct
 	{
 		int level[2];
@@ -254,6 +295,7 @@ struct mpg123_handle_struct
 	unsigned char *bsbuf;
 	unsigned char *bsbufold;
 	int bsnum;
+	int bsref; /* bsbuf points into reader memory, not bsspace (layer I/II only) */
 	/* That is the header matching the last read frame body. */
 	unsigned long oldhead;
 	/* That is the header that is supposedly the first of the stream. */
@@ -296,6 +338,10 @@ struct mpg123_handle_struct
 	unsigned char id3buf[128];
 #ifndef NO_ID3V2
 	mpg123_id3v2 id3v2;
+	/* MPG123_LAZY_ID3: frames in id3v2_raw that are still to be processed */
+	struct id3_lazy_frame *id3v2_lazy;
+	size_t id3v2_lazies;
+	off_t id3v2_pos; /* stream position of the last parsed tag, -1 if none */
 #endif
 	unsigned char *id3v2_raw;
 	size_t id3v2_size;
@@ -308,19 +354,20 @@ struct mpg123_handle_struct
 		We do not require the compiler to align stuff for our hand-written assembly. We only hope that it's able to align stuff for SSE and similar ops it generates itself.
 	*/
 	/*
-		Those layer-specific structs could actually share memory, as they are not in use simultaneously. One might allocate on decoder switch, too.
-		They all reside in one lump of memory (after each other), allocated to layerscratch.
+		Those layer-specific structs could actually share memory, as they are not in use simultaneously.
+		Each one is allocated by frame_buffers() only when its layer is met in the stream.
 	*/
-	real *layerscratch;
 #ifndef NO_LAYER1
 	struct
 	{
+		void *scratch;
 		real (*fraction)[SBLIMIT]; /* ALIGNED(16) real fraction[2][SBLIMIT]; */
 	} layer1;
 #endif
 #ifndef NO_LAYER2
 	struct
 	{
+		void *scratch;
 		real (*fraction)[4][SBLIMIT]; /* ALIGNED(16) real fraction[2][4][SBLIMIT] */
 	} layer2;
 #endif
@@ -328,8 +375,10 @@ struct mpg123_handle_struct
 	/* These are significant chunks of memory already... */
 	struct
 	{
+		void *scratch;
 		real (*hybrid_in)[SBLIMIT][SSLIMIT];  /* ALIGNED(16) real hybridIn[2][SBLIMIT][SSLIMIT]; */
 		real (*hybrid_out)[SSLIMIT][SBLIMIT]; /* ALIGNED(16) real hybridOut[2][SSLIMIT][SBLIMIT]; */
+		real (*hybrid_block)[2][SBLIMIT*SSLIMIT]; /* real hybrid_block[2][2][SBLIMIT*SSLIMIT]; */
 	} layer3;
 #endif
 	/* A place for storing additional data for the large file wrapper.
@@ -342,6 +391,24 @@ struct mpg123_handle_struct
 #ifndef NO_MOREINFO
 	struct mpg123_moreinfo *pinfo;
 #endif
+	/* Accounting for mpg123_getstate(), see stats.c. The times (in seconds)
+	   are only taken with MPG123_STATS, the counters are cheap enough. */
+	struct
+	{
+		double parse;
+		double decode;
+		double synth;
+		double postprocess;
+		long resyncs;
+		long resync_bytes;
+		long junk_bytes;
+		long zero_frames;
+		/* The real synth functions behind the timing wrappers. */
+		func_synth real_synth;
+		func_synth_stereo real_synth_stereo;
+		func_synth_mono real_synth_mono;
+		int in_synth;
+	} stats;
 };
 
 /* generic init, does not include dynamic buffers */
@@ -355,6 +422,12 @@ int frame_buffers(mpg123_handle *fr); /* various decoder buffers, needed once */
 int frame_reset(mpg123_handle* fr);   /* reset for next track */
 int frame_buffers_reset(mpg123_handle *fr);
 void frame_exit(mpg123_handle *fr);   /* end, free all buffers */
+/* Allocate the decoder buffers for all layers and the usual output size
+   right away, not waiting for the first frame. */
+int frame_prealloc(mpg123_handle *fr);
+/* Settings of a closed handle back to the state of frame_init_par(),
+   keeping allocated buffers and the decoder choice. */
+void frame_reuse(mpg123_handle *fr, mpg123_pars *mp);
 
 /* Index functions... */
 /* Well... print it... */
@@ -366,6 +439,9 @@ int frame_index_setup(mpg123_handle *fr);
 
 void do_volume(mpg123_handle *fr, double factor);
 void do_rva(mpg123_handle *fr);
+/* The scale to build the synth tables with: the volume or just unity when
+   it is applied as output gain. */
+double synth_scale(mpg123_handle *fr);
 
 /* samples per frame ...
 Layer I
@@ -61,6 +61,9 @@ void init_id3(mpg123_handle *fr)
 	fr->id3v2.extra    = NULL;
 	fr->id3v2.pictures   = 0;
 	fr->id3v2.picture    = NULL;
+	fr->id3v2_lazy       = NULL;
+	fr->id3v2_lazies     = 0;
+	fr->id3v2_pos        = -1;
 }
 
 /* Managing of the text, comment and extra lists. */
@@ -198,6 +201,15 @@ static void pop_id3_picture(mpg123_picture **list, size_t *size)
 	}
 }
 
+/* Forget about deferred frames (MPG123_LAZY_ID3). */
+static void free_lazy(mpg123_handle *fr)
+{
+	if(fr->id3v2_lazy)
+		free(fr->id3v2_lazy);
+	fr->id3v2_lazy = NULL;
+	fr->id3v2_lazies = 0;
+}
+
 /* OK, back to the higher level functions. */
 
 void exit_id3(mpg123_handle *fr)
@@ -206,6 +218,7 @@ void exit_id3(mpg123_handle *fr)
 	free_comment(fr);
 	free_extra(fr);
 	free_text(fr);
+	free_lazy(fr);
 }
 
 void reset_id3(mpg123_handle *fr)
@@ -658,6 +671,228 @@ static int promote_framename(mpg123_handle *fr, char *id) /* fr because of VERBO
 	return -1;
 }
 
+/* Interpret one frame, de-unsyncing its data if flagged so. */
+static void process_frame( mpg123_handle *fr, char *id
+,	unsigned char *data, unsigned long framesize, int unsync )
+{
+	int i;
+	/* level 1,2,3 - 0 is info from lame/info tag! */
+	/* rva tags with ascending significance, then general frames */
+	enum frame_types tt = unknown;
+	for(i = 0; i < KNOWN_FRAMES; ++i)
+	if(!strncmp(frame_type[i], id, 4)){ tt = i; break; }
+
+	if(id[0] == 'T' && tt != extra) tt = text;
+
+	if(tt == unknown)
+		return;
+	{
+		int rva_mode = -1; /* mix / album */
+		unsigned long realsize = framesize;
+		unsigned char* realdata = data;
+		unsigned char* unsyncbuffer = NULL;
+		unsigned long pos = 0;
+		if(unsync && framesize > 0)
+		{
+			unsigned long ipos = 0;
+			unsigned long opos = 0;
+			debug("Id3v2: going to de-unsync the frame data");
+			/* de-unsync: FF00 -> FF; real FF00 is simply represented as FF0000 ... */
+			/* damn, that means I have to delete bytes from withing the data block... thus need temporal storage */
+			/* standard mandates that de-unsync should always be safe if flag is set */
+			realdata = unsyncbuffer = malloc(framesize+1); /* will need <= bytes, plus a safety zero */
+			if(realdata == NULL)
+			{
+				if(NOQUIET) error("ID3v2: unable to allocate working buffer for de-unsync");
+				return;
+			}
+			/* now going byte per byte through the data... */
+			realdata[0] = data[0];
+			opos = 1;
+			for(ipos = 1; ipos < framesize; ++ipos)
+			{
+				if(!((data[ipos] == 0) && (data[ipos-1] == 0xff)))
+				{
+					realdata[opos++] = data[ipos];
+				}
+			}
+			realsize = opos;
+			/* Append a zero to keep strlen() safe. */
+			realdata[realsize] = 0;
+			debug2("ID3v2: de-unsync made %lu out of %lu bytes", realsize, framesize);
+		}
+		/* Avoid reading over boundary, even if there is a */
+		/* zero byte of padding for safety. */
+		if(realsize) switch(tt)
+		{
+			case comment:
+			case uslt:
+				process_comment(fr, tt, realdata, realsize, comment+1, id);
+			break;
+			case extra: /* perhaps foobar2000's work */
+				process_extra(fr, realdata, realsize, extra+1, id);
+			break;
+			case rva2: /* "the" RVA tag */
+			{
+				/* starts with null-terminated identification */
+				if(VERBOSE3) fprintf(stderr, "Note: RVA2 identification \"%s\"\n", realdata);
+				/* default: some individual value, mix mode */
+				rva_mode = 0;
+				if( !strncasecmp((char*)realdata, "album", 5)
+					 || !strncasecmp((char*)realdata, "audiophile", 10)
+					 || !strncasecmp((char*)realdata, "user", 4))
+				rva_mode = 1;
+				if(fr->rva.level[rva_mode] <= rva2+1)
+				{
+					pos += strlen((char*) realdata) + 1;
+					debug2("got my pos: %zu - %zu", realsize, pos);
+					// channel and two bytes for RVA value
+					// pos possibly just past the safety zero, so one more than realsize
+					if(pos > realsize || realsize-pos < 3)
+					{
+						if(NOQUIET)
+							error("bad RVA2 tag (truncated?)");
+					}
+					else if(realdata[pos] == 1)
+					{
+						++pos;
+						/* only handle master channel */
+						debug("ID3v2: it is for the master channel");
+						/* two bytes adjustment, one byte for bits representing peak - n bytes, eh bits, for peak */
+						/* 16 bit signed integer = dB * 512. Do not shift signed integers! Multiply instead.
+						   Also no implementation-defined casting. Reinterpret the pointer to signed char, then do
+						   proper casting. */
+						fr->rva.gain[rva_mode] = (float) (
+							((short)((signed char*)realdata)[pos]) * 256 + (short)realdata[pos+1] ) / 512;
+						pos += 2;
+						if(VERBOSE3) fprintf(stderr, "Note: RVA value %fdB\n", fr->rva.gain[rva_mode]);
+						/* heh, the peak value is represented by a number of bits - but in what manner? Skipping that part */
+						fr->rva.peak[rva_mode] = 0;
+						fr->rva.level[rva_mode] = rva2+1;
+					}
+				}
+			}
+			break;
+			/* non-rva metainfo, simply store... */
+			case text:
+				process_text(fr, realdata, realsize, id);
+			break;
+			case picture:
+				if (fr->p.flags & MPG123_PICTURE)
+				process_picture(fr, realdata, realsize);
+
+				break;
+			default: if(NOQUIET) error1("ID3v2: unknown frame type %i", tt);
+		}
+		if(unsyncbuffer)
+			free(unsyncbuffer);
+	}
+}
+
+/*
+	Lazy parsing (MPG123_LAZY_ID3): Frames that only matter to the client,
+	not to decoding (RVA), are just noted with their position and processed
+	once asked for. With seekable input, that is the position in the stream
+	and the tag is not stored at all. Otherwise, the raw tag stays in memory.
+*/
+
+static int lazy_frame(const char *id)
+{
+	return (id[0] == 'T' && strncmp(id, "TXXX", 4))
+	||	!strncmp(id, "USLT", 4) || !strncmp(id, "APIC", 4);
+}
+
+static int add_lazy( mpg123_handle *fr, const char *id
+,	int stored, off_t pos, unsigned long framesize, int unsync )
+{
+	struct id3_lazy_frame *x = safe_realloc( fr->id3v2_lazy
+	,	sizeof(struct id3_lazy_frame)*(fr->id3v2_lazies+1) );
+	if(x == NULL)
+		return -1;
+	fr->id3v2_lazy = x;
+	x += fr->id3v2_lazies++;
+	memcpy(x->id, id, 5);
+	x->unsync = unsync;
+	x->stored = stored;
+	x->pos  = pos;
+	x->size = framesize;
+	return 0;
+}
+
+/* Read a deferred frame from the stream and process it, then return to
+   the current position. Only failing to get back is an error. */
+static int process_stream_frame(mpg123_handle *fr, struct id3_lazy_frame *lf)
+{
+	off_t here = fr->rd->tell(fr);
+	/* One byte more for a closing zero, as with the stored tag. */
+	unsigned char *data = malloc(lf->size+1);
+	if(data == NULL)
+	{
+		if(NOQUIET)
+			error2( "ID3v2: unable to allocate %lu bytes for deferred %s frame"
+			,	lf->size+1, lf->id );
+		return 0;
+	}
+	if( fr->rd->skip_bytes(fr, lf->pos-here) != lf->pos
+	||	fr->rd->read_frame_body(fr, data, (int)lf->size) != (int)lf->size )
+	{
+		if(NOQUIET)
+			error1("ID3v2: unable to read deferred %s frame", lf->id);
+	}
+	else
+	{
+		data[lf->size] = 0;
+		process_frame(fr, lf->id, data, lf->size, lf->unsync);
+	}
+	free(data);
+	if(fr->rd->skip_bytes(fr, here-fr->rd->tell(fr)) != here)
+	{
+		if(NOQUIET)
+			error("ID3v2: unable to return to stream position after deferred frame");
+		fr->err = MPG123_LSEEK_FAILED;
+		return MPG123_ERR;
+	}
+	return 0;
+}
+
+/* Process pending frames with given ID, or all of them for NULL. */
+int id3_process_lazy(mpg123_handle *fr, const char *id)
+{
+	size_t i;
+	size_t pending = 0;
+	size_t stored = 0;
+	int ret = 0;
+	for(i=0; i<fr->id3v2_lazies; ++i)
+	{
+		struct id3_lazy_frame *lf = fr->id3v2_lazy+i;
+		if(!lf->id[0])
+			continue;
+		if(ret || (id && strncmp(lf->id, id, 4)))
+		{
+			++pending;
+			if(lf->stored)
+				++stored;
+			continue;
+		}
+		debug1("ID3v2: processing deferred %s frame", lf->id);
+		if(lf->stored)
+			process_frame(fr, lf->id, fr->id3v2_raw+lf->pos, lf->size, lf->unsync);
+		else
+			ret = process_stream_frame(fr, lf);
+		lf->id[0] = 0;
+	}
+	if(!pending)
+		free_lazy(fr);
+	/* The raw data was only kept for the frames. */
+	if(!stored && fr->id3v2_raw && !(fr->p.flags & MPG123_STORE_RAW_ID3))
+	{
+		free(fr->id3v2_raw);
+		fr->id3v2_raw = NULL;
+		fr->id3v2_size = 0;
+	}
+	return ret;
+}
+
 #endif /* NO_ID3V2 */
 
 int store_id3v2( mpg123_handle *fr
@@ -704,6 +939,54 @@ int store_id3v2( mpg123_handle *fr
 	return ret;
 }
 
+#ifndef NO_ID3V2
+/*
+	The tag data after the header, either stored in id3v2_raw or read from
+	the stream piece by piece as the parser goes along (lazy parsing of
+	seekable input). The parser only moves forward.
+*/
+struct tag_source
+{
+	unsigned char *data; /* stored tag data, NULL when reading the stream */
+	unsigned long done; /* bytes of tag data passed in the stream */
+	unsigned char head[11]; /* frame header or size of extended header */
+	unsigned char *body; /* frame body read from the stream */
+};
+
+/* Point to n bytes of tag data at pos, returns < 0 on reader error. */
+static int tag_bytes( mpg123_handle *fr, struct tag_source *ts
+,	unsigned long pos, unsigned long n, unsigned char **bytes )
+{
+	off_t ret;
+	unsigned char *buf = ts->head;
+	if(ts->data)
+	{
+		*bytes = ts->data+pos;
+		return 0;
+	}
+	if(pos > ts->done && (ret = fr->rd->skip_bytes(fr, pos-ts->done)) < 0)
+		return (int)ret;
+	ts->done = pos;
+	if(n >= sizeof(ts->head))
+	{
+		if(ts->body)
+			free(ts->body);
+		/* One byte more for a closing zero, as with the stored tag. */
+		if(!(ts->body = buf = malloc(n+1)))
+		{
+			fr->err = MPG123_OUT_OF_MEM;
+			return READER_ERROR;
+		}
+	}
+	if((ret = fr->rd->read_frame_body(fr, buf, (int)n)) < 0)
+		return (int)ret;
+	buf[n] = 0;
+	ts->done += n;
+	*bytes = buf;
+	return 0;
+}
+#endif
+
 /*
 	trying to parse ID3v2.3 and ID3v2.4 tags...
 
@@ -727,6 +1010,9 @@ int parse_new_id3(mpg123_handle *fr, unsigned long first4bytes)
 	unsigned int footlen = 0;
 #ifndef NO_ID3V2
 	int skiptag = 0;
+	int ondemand = 0;
+	/* The 4 bytes of tag header are already read. */
+	off_t tagstart = fr->rd->tell(fr) - 4;
 #endif
 	unsigned char major = first4bytes & 0xff;
 	debug1("ID3v2: major tag version: %i", major);
@@ -806,8 +1092,25 @@ int parse_new_id3(mpg123_handle *fr, unsigned long first4bytes)
 			warning1("ID3v2: unrealistic small tag lengh %lu, skipping", length);
 		skiptag = 1;
 	}
-	if(!skiptag)
+	/* Seeking back to the start of the stream shall not result in */
+	/* deferring the frames of the same tag again. */
+	if(fr->p.flags & MPG123_LAZY_ID3 && !skiptag && tagstart == fr->id3v2_pos)
+	{
+		debug1("ID3v2: skipping tag at %"OFF_P" that is known already", (off_p)tagstart);
+		if((ret2=fr->rd->skip_bytes(fr,length+footlen))<0)
+			return ret2;
+		return 0;
+	}
+	/* Deferred frames of seekable input are read again from the stream, */
+	/* no need to store the tag for them. */
+	if(!skiptag && !storetag && fr->p.flags & MPG123_LAZY_ID3
+	&&	fr->rdat.flags & READER_SEEKABLE && !(fr->rdat.flags & READER_BUFFERED))
+		ondemand = 1;
+	if(!skiptag && !ondemand)
 		storetag = 1;
+	/* Frames of a previous tag still refer to its raw data. */
+	if(storetag && fr->id3v2_lazies && id3_process_lazy(fr, NULL))
+		return READER_ERROR;
 #endif
 	if(storetag)
 	{
@@ -825,7 +1128,12 @@ int parse_new_id3(mpg123_handle *fr, unsigned long first4bytes)
 	}
 	else
 	{
-		unsigned char* tagdata = fr->id3v2_raw+10;
+		struct tag_source ts;
+		/* Frame data positions for deferral. */
+		off_t tagbase = ondemand ? tagstart+10 : 10;
+		ts.data = ondemand ? NULL : fr->id3v2_raw+10;
+		ts.done = 0;
+		ts.body = NULL;
 		fr->id3v2.version = major;
 		/* try to interpret that beast */
 		debug("ID3v2: analysing frames...");
@@ -841,14 +1149,20 @@ int parse_new_id3(mpg123_handle *fr, unsigned long first4bytes)
 			debug1("ID3v2: have read at all %lu bytes for the tag now", (unsigned long)length+6);
 			if(flags & EXTHEAD_FLAG)
 			{
+				unsigned char *exthead;
 				debug("ID3v2: skipping extended header");
-				if(!bytes_to_long(tagdata, tagpos) || tagpos >= length)
+				if((ret2 = tag_bytes(fr, &ts, 0, 4, &exthead)) < 0)
+				{
+					ret = ret2;
+					goto tagparse_cleanup;
+				}
+				if(!bytes_to_long(exthead, tagpos) || tagpos >= length)
 				{
 					ret = 0;
 					if(NOQUIET)
 						error4( "Bad (non-synchsafe/too large) tag offset:"
 							"0x%02x%02x%02x%02x"
-						,	tagdata[0], tagdata[1], tagdata[2], tagdata[3] );
+						,	exthead[0], exthead[1], exthead[2], exthead[3] );
 				}
 			}
 			if(ret > 0)
@@ -865,29 +1179,34 @@ int parse_new_id3(mpg123_handle *fr, unsigned long first4bytes)
 				{
 					int i = 0;
 					unsigned long pos = tagpos;
-					/* level 1,2,3 - 0 is info from lame/info tag! */
-					/* rva tags with ascending significance, then general frames */
-					enum frame_types tt = unknown;
+					int unsync;
+					unsigned char *fhead;
+					unsigned char *body;
+					if((ret2 = tag_bytes(fr, &ts, tagpos, framebegin, &fhead)) < 0)
+					{
+						ret = ret2;
+						goto tagparse_cleanup;
+					}
 					/* we may have entered the padding zone or any other strangeness: check if we have valid frame id characters */
 					for(i=0; i< head_part; ++i)
-					if( !( ((tagdata[tagpos+i] > 47) && (tagdata[tagpos+i] < 58))
-						 || ((tagdata[tagpos+i] > 64) && (tagdata[tagpos+i] < 91)) ) )
+					if( !( ((fhead[i] > 47) && (fhead[i] < 58))
+						 || ((fhead[i] > 64) && (fhead[i] < 91)) ) )
 					{
-						debug5("ID3v2: real tag data apparently ended after %lu bytes with 0x%02x%02x%02x%02x", tagpos, tagdata[tagpos], tagdata[tagpos+1], tagdata[tagpos+2], tagdata[tagpos+3]);
+						debug5("ID3v2: real tag data apparently ended after %lu bytes with 0x%02x%02x%02x%02x", tagpos, fhead[0], fhead[1], fhead[2], fhead[3]);
 						/* This is no hard error... let's just hope that we got something meaningful already (ret==1 in that case). */
 						goto tagparse_cleanup; /* Need to escape two loops here. */
 					}
 					if(ret > 0)
 					{
 						/* 4 or 3 bytes id */
-						strncpy(id, (char*) tagdata+pos, head_part);
+						strncpy(id, (char*) fhead, head_part);
 						id[head_part] = 0; /* terminate for 3 or 4 bytes */
 						pos += head_part;
 						tagpos += head_part;
 						/* size as 32 bits or 28 bits */
-						if(fr->id3v2.version == 2) threebytes_to_long(tagdata+pos, framesize);
+						if(fr->id3v2.version == 2) threebytes_to_long(fhead+head_part, framesize);
 						else
-						if(!bytes_to_long(tagdata+pos, framesize))
+						if(!bytes_to_long(fhead+head_part, framesize))
 						{
 							/* Just assume that up to now there was some good data. */
 							if(NOQUIET) error1("ID3v2: non-syncsafe size of %s frame, skipping the remainder of tag", id);
@@ -898,7 +1217,7 @@ int parse_new_id3(mpg123_handle *fr, unsigned long first4bytes)
 						pos += head_part;
 						if(fr->id3v2.version > 2)
 						{
-							fflags  = (((unsigned long) tagdata[pos]) << 8) | ((unsigned long) tagdata[pos+1]);
+							fflags  = (((unsigned long) fhead[2*head_part]) << 8) | ((unsigned long) fhead[2*head_part+1]);
 							pos    += 2;
 							tagpos += 2;
 						}
@@ -931,113 +1250,19 @@ int parse_new_id3(mpg123_handle *fr, unsigned long first4bytes)
 							continue;
 						}
 
-						for(i = 0; i < KNOWN_FRAMES; ++i)
-						if(!strncmp(frame_type[i], id, 4)){ tt = i; break; }
-
-						if(id[0] == 'T' && tt != extra) tt = text;
-
-						if(tt != unknown)
+						unsync = (flags & UNSYNC_FLAG) || (fflags & UNSYNC_FFLAG);
+						if(fr->p.flags & MPG123_LAZY_ID3 && lazy_frame(id))
 						{
-							int rva_mode = -1; /* mix / album */
-							unsigned long realsize = framesize;
-							unsigned char* realdata = tagdata+pos;
-							unsigned char* unsyncbuffer = NULL;
-							if(((flags & UNSYNC_FLAG) || (fflags & UNSYNC_FFLAG)) && framesize > 0)
-							{
-								unsigned long ipos = 0;
-								unsigned long opos = 0;
-								debug("Id3v2: going to de-unsync the frame data");
-								/* de-unsync: FF00 -> FF; real FF00 is simply represented as FF0000 ... */
-								/* damn, that means I have to delete bytes from withing the data block... thus need temporal storage */
-								/* standard mandates that de-unsync should always be safe if flag is set */
-								realdata = unsyncbuffer = malloc(framesize+1); /* will need <= bytes, plus a safety zero */
-								if(realdata == NULL)
-								{
-									if(NOQUIET) error("ID3v2: unable to allocate working buffer for de-unsync");
-									continue;
-								}
-								/* now going byte per byte through the data... */
-								realdata[0] = tagdata[pos];
-								opos = 1;
-								for(ipos = pos+1; ipos < pos+framesize; ++ipos)
-								{
-									if(!((tagdata[ipos] == 0) && (tagdata[ipos-1] == 0xff)))
-									{
-										realdata[opos++] = tagdata[ipos];
-									}
-								}
-								realsize = opos;
-								/* Append a zero to keep strlen() safe. */
-								realdata[realsize] = 0;
-								debug2("ID3v2: de-unsync made %lu out of %lu bytes", realsize, framesize);
-							}
-							pos = 0; /* now at the beginning again... */
-							/* Avoid reading over boundary, even if there is a */
-							/* zero byte of padding for safety. */
-							if(realsize) switch(tt)
-							{
-								case comment:
-								case uslt:
-									process_comment(fr, tt, realdata, realsize, comment+1, id);
-								break;
-								case extra: /* perhaps foobar2000's work */
-									process_extra(fr, realdata, realsize, extra+1, id);
-								break;
-								case rva2: /* "the" RVA tag */
-								{
-									/* starts with null-terminated identification */
-									if(VERBOSE3) fprintf(stderr, "Note: RVA2 identification \"%s\"\n", realdata);
-									/* default: some individual value, mix mode */
-									rva_mode = 0;
-									if( !strncasecmp((char*)realdata, "album", 5)
-										 || !strncasecmp((char*)realdata, "audiophile", 10)
-										 || !strncasecmp((char*)realdata, "user", 4))
-									rva_mode = 1;
-									if(fr->rva.level[rva_mode] <= rva2+1)
-									{
-										pos += strlen((char*) realdata) + 1;
-										debug2("got my pos: %zu - %zu", realsize, pos);
-										// channel and two bytes for RVA value
-										// pos possibly just past the safety zero, so one more than realsize
-										if(pos > realsize || realsize-pos < 3)
-										{
-											if(NOQUIET)
-												error("bad RVA2 tag (truncated?)");
-										}
-										else if(realdata[pos] == 1)
-										{
-											++pos;
-											/* only handle master channel */
-											debug("ID3v2: it is for the master channel");
-											/* two bytes adjustment, one byte for bits representing peak - n bytes, eh bits, for peak */
-											/* 16 bit signed integer = dB * 512. Do not shift signed integers! Multiply instead.
-											   Also no implementation-defined casting. Reinterpret the pointer to signed char, then do
-											   proper casting. */
-											fr->rva.gain[rva_mode] = (float) (
-												((short)((signed char*)realdata)[pos]) * 256 + (short)realdata[pos+1] ) / 512;
-											pos += 2;
-											if(VERBOSE3) fprintf(stderr, "Note: RVA value %fdB\n", fr->rva.gain[rva_mode]);
-											/* heh, the peak value is represented by a number of bits - but in what manner? Skipping that part */
-											fr->rva.peak[rva_mode] = 0;
-											fr->rva.level[rva_mode] = rva2+1;
-										}
-									}
-								}
-								break;
-								/* non-rva metainfo, simply store... */
-								case text:
-									process_text(fr, realdata, realsize, id);
-								break;
-								case picture:
-									if (fr->p.flags & MPG123_PICTURE)
-									process_picture(fr, realdata, realsize);
-
-									break;
-								default: if(NOQUIET) error1("ID3v2: unknown frame type %i", tt);
-							}
-							if(unsyncbuffer)
-								free(unsyncbuffer);
+							if(!add_lazy(fr, id, !ondemand, tagbase+pos, framesize, unsync))
+								continue;
+							if(NOQUIET) error("ID3v2: unable to defer frame, processing now");
 						}
+						if((ret2 = tag_bytes(fr, &ts, pos, framesize, &body)) < 0)
+						{
+							ret = ret2;
+							goto tagparse_cleanup;
+						}
+						process_frame(fr, id, body, framesize, unsync);
 						#undef BAD_FFLAGS
 						#undef PRES_TAG_FFLAG
 						#undef PRES_FILE_FFLAG
@@ -1054,8 +1279,15 @@ int parse_new_id3(mpg123_handle *fr, unsigned long first4bytes)
 			}
 		}
 tagparse_cleanup:
+		if(ts.body)
+			free(ts.body);
+		/* Get past the rest of the tag in the stream. */
+		if(ondemand && ret >= 0
+		&&	(ret2 = fr->rd->skip_bytes(fr, length+footlen-ts.done)) < 0)
+			ret = ret2;
+		fr->id3v2_pos = tagstart;
 		/* Get rid of stored raw data that should not be kept. */
-		if(!(fr->p.flags & MPG123_STORE_RAW_ID3))
+		if(!fr->id3v2_lazies && !(fr->p.flags & MPG123_STORE_RAW_ID3))
 		{
 			free(fr->id3v2_raw);
 			fr->id3v2_raw = NULL;
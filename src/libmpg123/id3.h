@@ -29,11 +29,18 @@
 #  undef id3_link
 # endif
 # define id3_link(fr)
+# ifdef id3_process_lazy
+#  undef id3_process_lazy
+# endif
+# define id3_process_lazy(fr, id) 0
 #else
 void init_id3(mpg123_handle *fr);
 void exit_id3(mpg123_handle *fr);
 void reset_id3(mpg123_handle *fr);
 void id3_link(mpg123_handle *fr);
+/* Process frames deferred by MPG123_LAZY_ID3 with given ID, NULL for all.
+   Returns MPG123_ERR if the stream position got lost on the way. */
+int id3_process_lazy(mpg123_handle *fr, const char *id);
 #endif
 int  parse_new_id3(mpg123_handle *fr, unsigned long first4bytes);
 /* Convert text from some ID3 encoding to UTf-8.
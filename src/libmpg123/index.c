@@ -17,28 +17,196 @@ static off_t fi_next(struct frame_index *fi)
 	return (off_t)fi->fill*fi->step;
 }
 
-/* Shrink down the used index to the half.
-   Be careful with size = 1 ... there's no shrinking possible there. */
-static void fi_shrink(struct frame_index *fi)
+/* Difference of positions, without overflow for odd values given
+   via mpg123_set_index(). Adding it back in unsigned arithmetic always
+   restores the original. */
+static off_t fi_diff(off_t a, off_t b)
+{
+	return (off_t)((uint64_t)a-(uint64_t)b);
+}
+
+/* Bit fields in the packed storage, least significant bits first. */
+static void put_bits(unsigned char *buf, size_t pos, uint64_t val, unsigned int bits)
+{
+	while(bits)
+	{
+		unsigned int shift = pos & 7;
+		unsigned int take  = 8-shift < bits ? 8-shift : bits;
+		buf[pos>>3] |= (unsigned char)((val & ((1u<<take)-1)) << shift);
+		val  >>= take;
+		pos  += take;
+		bits -= take;
+	}
+}
+
+static uint64_t get_bits(const unsigned char *buf, size_t pos, unsigned int bits)
+{
+	uint64_t val = 0;
+	unsigned int got = 0;
+	while(got < bits)
+	{
+		unsigned int shift = pos & 7;
+		unsigned int take  = 8-shift < bits-got ? 8-shift : bits-got;
+		val |= (uint64_t)((buf[pos>>3] >> shift) & ((1u<<take)-1)) << got;
+		pos += take;
+		got += take;
+	}
+	return val;
+}
+
+/* Decode block b (the tail after the complete ones) into out,
+   return number of entries. */
+static size_t fi_block_get(struct frame_index *fi, size_t b, off_t *out)
 {
-	if(fi->fill < 2) return; /* Won't shrink below 1. */
-	else
-	{ /* Double the step, half the fill. Should work as well for fill%2 = 1 */
-		size_t c;
-		debug2("shrink index with fill %lu and step %lu", (unsigned long)fi->fill, (unsigned long)fi->step);
-		fi->step *= 2;
-		fi->fill /= 2;
-		/* Move the data down. */
-		for(c = 0; c < fi->fill; ++c)
-		fi->data[c] = fi->data[2*c];
+	struct fi_block *blk;
+	uint64_t pos;
+	size_t i;
+
+	if(b >= fi->blocks)
+	{
+		size_t count = fi->fill - fi->blocks*FI_BLOCK;
+		memcpy(out, fi->tail, count*sizeof(off_t));
+		return count;
+	}
+	blk = fi->block+b;
+	pos = (uint64_t)blk->base;
+	out[0] = blk->base;
+	/* Unsigned arithmetic to get back whatever has been stored. */
+	for(i=1; i<FI_BLOCK; ++i)
+	{
+		pos += (uint64_t)blk->min
+		+	get_bits(fi->packed+blk->start, (i-1)*blk->bits, blk->bits);
+		out[i] = (off_t)pos;
 	}
+	return FI_BLOCK;
+}
+
+/* Pack the full tail into a new block. */
+static int fi_block_add(struct frame_index *fi)
+{
+	struct fi_block *blk;
+	uint64_t range;
+	size_t bytes;
+	off_t min, max;
+	size_t i;
 
+	if(fi->blocks == fi->block_size)
+	{
+		size_t newsize = fi->block_size ? 2*fi->block_size : 16;
+		struct fi_block *newblock = safe_realloc(fi->block, newsize*sizeof(*newblock));
+		if(!newblock)
+			return -1;
+		fi->block = newblock;
+		fi->block_size = newsize;
+	}
+	min = max = fi_diff(fi->tail[1], fi->tail[0]);
+	for(i=2; i<FI_BLOCK; ++i)
+	{
+		off_t diff = fi_diff(fi->tail[i], fi->tail[i-1]);
+		if(diff < min) min = diff;
+		if(diff > max) max = diff;
+	}
+	blk = fi->block+fi->blocks;
+	blk->base  = fi->tail[0];
+	blk->min   = min;
+	blk->start = fi->packed_fill;
+	range = (uint64_t)max-(uint64_t)min;
+	for(blk->bits = 0; blk->bits < 64 && range >> blk->bits; ++blk->bits);
+	bytes = ((FI_BLOCK-1)*blk->bits+7)/8;
+	if(fi->packed_fill + bytes > fi->packed_size)
+	{
+		size_t newsize = fi->packed_size ? 2*fi->packed_size : 1024;
+		unsigned char *newpacked;
+		while(newsize < fi->packed_fill + bytes)
+			newsize *= 2;
+		newpacked = safe_realloc(fi->packed, newsize);
+		if(!newpacked)
+			return -1;
+		fi->packed = newpacked;
+		fi->packed_size = newsize;
+	}
+	memset(fi->packed+fi->packed_fill, 0, bytes);
+	for(i=1; i<FI_BLOCK; ++i)
+		put_bits( fi->packed+blk->start, (i-1)*blk->bits
+		,	(uint64_t)fi_diff(fi->tail[i], fi->tail[i-1])-(uint64_t)min, blk->bits );
+	fi->packed_fill += bytes;
+	++fi->blocks;
+	return 0;
+}
+
+/* Append an entry regardless of size. */
+static int fi_push(struct frame_index *fi, off_t pos)
+{
+	fi->tail[fi->fill % FI_BLOCK] = pos;
+	if(fi->fill % FI_BLOCK == FI_BLOCK-1 && fi_block_add(fi))
+		return -1;
+	++fi->fill;
+	return 0;
+}
+
+/* Drop all entries, also freeing memory. */
+static void fi_clear(struct frame_index *fi)
+{
+	free(fi->block);
+	free(fi->packed);
+	free(fi->plain);
+	fi->block  = NULL;
+	fi->packed = NULL;
+	fi->plain  = NULL;
+	fi->blocks = fi->block_size = 0;
+	fi->packed_fill = fi->packed_size = 0;
+	fi->fill = 0;
+}
+
+/* Shrink down the used index to the half.
+   Be careful with size = 1 ... there's no shrinking possible there.
+   The entries need to be packed anew, which needs some memory. If that
+   fails, the index stays as it is. */
+static int fi_shrink(struct frame_index *fi)
+{
+	struct frame_index half;
+	off_t buf[FI_BLOCK];
+	size_t b, i;
+
+	if(fi->fill < 2) return -1; /* Won't shrink below 1. */
+	/* Double the step, half the fill. Should work as well for fill%2 = 1 */
+	debug2("shrink index with fill %lu and step %lu", (unsigned long)fi->fill, (unsigned long)fi->step);
+	fi_init(&half);
+	for(b=0; b*FI_BLOCK < fi->fill; ++b)
+	{
+		size_t count = fi_block_get(fi, b, buf);
+		/* FI_BLOCK is even, so every block starts with a wanted entry. */
+		for(i=0; i<count; i+=2)
+		{
+			if(fi_push(&half, buf[i]))
+			{
+				fi_clear(&half);
+				return -1;
+			}
+		}
+	}
+	/* Only the stored entries change, keep the rest. */
+	fi_clear(fi);
+	fi->block  = half.block;
+	fi->blocks = half.blocks;
+	fi->block_size  = half.block_size;
+	fi->packed      = half.packed;
+	fi->packed_fill = half.packed_fill;
+	fi->packed_size = half.packed_size;
+	memcpy(fi->tail, half.tail, sizeof(fi->tail));
+	fi->fill = half.fill;
+	fi->step *= 2;
 	fi->next = fi_next(fi);
+	return 0;
 }
 
 void fi_init(struct frame_index *fi)
 {
-	fi->data = NULL;
+	fi->block  = NULL;
+	fi->packed = NULL;
+	fi->plain  = NULL;
+	fi->blocks = fi->block_size = 0;
+	fi->packed_fill = fi->packed_size = 0;
 	fi->step = 1;
 	fi->fill = 0;
 	fi->size = 0;
@@ -48,38 +216,33 @@ void fi_init(struct frame_index *fi)
 
 void fi_exit(struct frame_index *fi)
 {
-	debug2("fi_exit: %p and %lu", (void*)fi->data, (unsigned long)fi->size);
-	if(fi->size && fi->data != NULL) free(fi->data);
+	debug2("fi_exit: %p and %lu", (void*)fi->block, (unsigned long)fi->size);
+	fi_clear(fi);
 
 	fi_init(fi); /* Be prepared for further fun, still. */
 }
 
 int fi_resize(struct frame_index *fi, size_t newsize)
 {
-	off_t *newdata = NULL;
 	if(newsize == fi->size) return 0;
 
-	if(newsize > 0 && newsize < fi->size)
+	if(newsize > 0 && newsize < fi->fill)
 	{ /* When we reduce buffer size a bit, shrink stuff. */
-		while(fi->fill > newsize){ fi_shrink(fi); }
-	}
-
-	newdata = safe_realloc(fi->data, newsize*sizeof(off_t));
-	if(newsize == 0 || newdata != NULL)
-	{
-		fi->data = newdata;
-		fi->size = newsize;
-		if(fi->fill > fi->size) fi->fill = fi->size;
-
-		fi->next = fi_next(fi);
-		debug2("new index of size %lu at %p", (unsigned long)fi->size, (void*)fi->data);
-		return 0;
-	}
-	else
-	{
-		error("failed to resize index!");
-		return -1;
+		while(fi->fill > newsize)
+		{
+			if(fi_shrink(fi))
+			{
+				error("failed to resize index!");
+				return -1;
+			}
+		}
 	}
+	if(newsize == 0)
+		fi_clear(fi);
+	fi->size = newsize;
+	fi->next = fi_next(fi);
+	debug2("new index of size %lu at %p", (unsigned long)fi->size, (void*)fi->block);
+	return 0;
 }
 
 void fi_add(struct frame_index *fi, off_t pos)
@@ -99,9 +262,13 @@ void fi_add(struct frame_index *fi, off_t pos)
 	/* When we are here, we want that frame. */
 	if(fi->fill < fi->size) /* safeguard for size=1, or just generally */
 	{
-		debug1("adding to index at %p", (void*)(fi->data+fi->fill));
-		fi->data[fi->fill] = pos;
-		++fi->fill;
+		if(fi_push(fi, pos))
+		{
+			error("failed to grow index!");
+			/* Do not try again, stay at this resolution. */
+			fi->size = fi->fill;
+			return;
+		}
 		fi->next = fi_next(fi);
 		debug3("added pos %li to index with fill %lu and step %lu", (long) pos, (unsigned long)fi->fill, (unsigned long)fi->step);
 	}
@@ -109,28 +276,197 @@ void fi_add(struct frame_index *fi, off_t pos)
 
 int fi_set(struct frame_index *fi, off_t *offsets, off_t step, size_t fill)
 {
-	if(fi_resize(fi, fill) == -1) return -1;
+	size_t i;
+	fi_clear(fi);
+	fi->size = fill;
 	fi->step = step;
 	if(offsets != NULL)
 	{
-		memcpy(fi->data, offsets, fill*sizeof(off_t));
-		fi->fill = fill;
-	}
-	else
-	{
-		/* allocation only, no entries in index yet */
-		fi->fill = 0;
+		for(i=0; i<fill; ++i)
+		{
+			if(fi_push(fi, offsets[i]))
+			{
+				fi_clear(fi);
+				fi->next = fi_next(fi);
+				return -1;
+			}
+		}
 	}
+	/* else allocation only, no entries in index yet */
 	fi->next = fi_next(fi);
 	debug3("set new index of fill %lu, size %lu at %p",
-	(unsigned long)fi->fill, (unsigned long)fi->size, (void*)fi->data);
+	(unsigned long)fi->fill, (unsigned long)fi->size, (void*)fi->block);
+	return 0;
+}
+
+int fi_copy(struct frame_index *dest, struct frame_index *src)
+{
+	fi_clear(dest);
+	if(src->blocks)
+	{
+		dest->block  = malloc(src->blocks*sizeof(*dest->block));
+		dest->packed = malloc(src->packed_fill ? src->packed_fill : 1);
+		if(!dest->block || !dest->packed)
+		{
+			fi_clear(dest);
+			return -1;
+		}
+		memcpy(dest->block, src->block, src->blocks*sizeof(*dest->block));
+		memcpy(dest->packed, src->packed, src->packed_fill);
+		dest->blocks = dest->block_size = src->blocks;
+		dest->packed_fill = dest->packed_size = src->packed_fill;
+	}
+	memcpy(dest->tail, src->tail, sizeof(dest->tail));
+	dest->fill = src->fill;
+	dest->size = src->size;
+	dest->step = src->step;
+	dest->next = src->next;
 	return 0;
 }
 
+off_t fi_get(struct frame_index *fi, size_t i)
+{
+	struct fi_block *blk;
+	uint64_t pos;
+	size_t b = i / FI_BLOCK;
+	size_t j;
+
+	if(b >= fi->blocks)
+		return fi->tail[i % FI_BLOCK];
+	blk = fi->block+b;
+	pos = (uint64_t)blk->base;
+	for(j=0; j < i % FI_BLOCK; ++j)
+		pos += (uint64_t)blk->min
+		+	get_bits(fi->packed+blk->start, j*blk->bits, blk->bits);
+	return (off_t)pos;
+}
+
+off_t *fi_plain(struct frame_index *fi)
+{
+	off_t *plain;
+	size_t b, n;
+
+	if(!fi->fill)
+		return NULL;
+	plain = safe_realloc(fi->plain, fi->fill*sizeof(off_t));
+	if(!plain)
+		return NULL;
+	fi->plain = plain;
+	for(b=0, n=0; n < fi->fill; ++b)
+		n += fi_block_get(fi, b, plain+n);
+	return plain;
+}
+
 void fi_reset(struct frame_index *fi)
 {
 	debug1("reset with size %"SIZE_P, (size_p)fi->size);
 	fi->fill = 0;
+	fi->blocks = 0;
+	fi->packed_fill = 0;
 	fi->step = 1;
 	fi->next = fi_next(fi);
 }
+
+size_t fi_put_uvar(unsigned char *buf, uint64_t val)
+{
+	size_t n = 0;
+	while(val >= 0x80)
+	{
+		buf[n++] = (unsigned char)(val & 0x7f) | 0x80;
+		val >>= 7;
+	}
+	buf[n++] = (unsigned char)val;
+	return n;
+}
+
+size_t fi_put_svar(unsigned char *buf, int64_t val)
+{
+	uint64_t uval = val < 0 ? ~((uint64_t)val<<1) : (uint64_t)val<<1;
+	return fi_put_uvar(buf, uval);
+}
+
+size_t fi_get_uvar(const unsigned char *buf, size_t size, uint64_t *val)
+{
+	size_t n = 0;
+	*val = 0;
+	while(n < size && n < FI_VARINT_MAX)
+	{
+		*val |= (uint64_t)(buf[n] & 0x7f) << (7*n);
+		if(!(buf[n++] & 0x80))
+			return n;
+	}
+	return 0;
+}
+
+size_t fi_get_svar(const unsigned char *buf, size_t size, int64_t *val)
+{
+	uint64_t uval;
+	size_t n = fi_get_uvar(buf, size, &uval);
+	*val = (uval & 1) ? (int64_t)~(uval>>1) : (int64_t)(uval>>1);
+	return n;
+}
+
+size_t fi_pack_size(struct frame_index *fi)
+{
+	return (2+fi->fill)*FI_VARINT_MAX;
+}
+
+size_t fi_pack(struct frame_index *fi, unsigned char *buf)
+{
+	off_t entry[FI_BLOCK];
+	off_t prev = 0;
+	size_t n = 0;
+	size_t b, i;
+	n += fi_put_uvar(buf+n, (uint64_t)fi->step);
+	n += fi_put_uvar(buf+n, (uint64_t)fi->fill);
+	for(b=0; b*FI_BLOCK < fi->fill; ++b)
+	{
+		size_t count = fi_block_get(fi, b, entry);
+		for(i=0; i<count; ++i)
+		{
+			n += fi_put_svar(buf+n, (int64_t)fi_diff(entry[i], prev));
+			prev = entry[i];
+		}
+	}
+	return n;
+}
+
+size_t fi_unpack(struct frame_index *fi, const unsigned char *buf, size_t size)
+{
+	uint64_t step, fill;
+	int64_t val;
+	off_t pos = 0;
+	size_t n, i, m;
+
+	if(!(n = fi_get_uvar(buf, size, &step)))
+		return 0;
+	if(!(m = fi_get_uvar(buf+n, size-n, &fill)))
+		return 0;
+	n += m;
+	/* Each entry needs at least one byte, anything else is bogus. */
+	if( step < 1 || (uint64_t)(off_t)step != step || fill < 1 || fill > size-n
+	||	(uint64_t)(off_t)(fill*step) != fill*step )
+		return 0;
+	fi_reset(fi);
+	for(i=0; i<fill; ++i)
+	{
+		if(!(m = fi_get_svar(buf+n, size-n, &val)))
+			break;
+		n += m;
+		/* Offsets only go forward, starting from a valid position. */
+		if((i ? val <= 0 : val < 0) || (int64_t)(off_t)val != val || pos+(off_t)val < pos)
+			break;
+		pos += (off_t)val;
+		if(fi_push(fi, pos))
+			break;
+	}
+	if(i < fill)
+	{
+		fi_reset(fi);
+		return 0;
+	}
+	fi->size = (size_t)fill;
+	fi->step = (off_t)step;
+	fi->next = fi_next(fi);
+	return n;
+}
@@ -23,9 +23,35 @@
 #include "config.h"
 #include "compat.h"
 
+/*
+	The positions are not stored as plain array of off_t. Entries are
+	grouped in blocks of FI_BLOCK. Each block stores its first position
+	as absolute anchor and the differences between the following ones
+	minus the smallest difference in the block, packed with just as many
+	bits as the largest of those needs. Including the anchors, a CBR
+	stream needs about 3 bits per frame, a VBR stream around 12. The block
+	that is still being filled is kept as plain offsets until complete.
+*/
+#define FI_BLOCK 128
+
+struct fi_block
+{
+	off_t  base;  /* position of the first entry */
+	off_t  min;   /* smallest difference between entries in the block */
+	size_t start; /* byte offset of the packed differences */
+	unsigned char bits; /* bits per packed difference, 0 to 64 */
+};
+
 struct frame_index
 {
-	off_t *data; /* actual data, the frame positions */
+	struct fi_block *block; /* complete blocks */
+	size_t blocks;          /* number of complete blocks */
+	size_t block_size;      /* allocated block entries */
+	unsigned char *packed;  /* bit storage for the differences */
+	size_t packed_fill;
+	size_t packed_size;
+	off_t tail[FI_BLOCK];   /* entries after the complete blocks */
+	off_t *plain; /* plain copy of all entries for mpg123_index() */
 	off_t  step; /* advancement in frame number per index point */
 	off_t  next; /* frame offset supposed to come next into the index */
 	size_t size; /* total number of possible entries */
@@ -42,8 +68,9 @@ void fi_init(struct frame_index *fi);
 /* Deallocate/zero things. */
 void fi_exit(struct frame_index *fi);
 
-/* Prepare a given size, preserving current fill, if possible.
+/* Set a given size, preserving current fill, if possible.
    If the new size is smaller than fill, the entry density is reduced.
+   Memory is only used for actually stored entries.
    Return 0 on success. */
 int fi_resize(struct frame_index *fi, size_t newsize);
 
@@ -53,7 +80,41 @@ void fi_add(struct frame_index *fi, off_t pos);
 /* Replace the frame index */
 int fi_set(struct frame_index *fi, off_t *offsets, off_t step, size_t fill);
 
+/* Make dest an exact copy of src. Return 0 on success. */
+int fi_copy(struct frame_index *dest, struct frame_index *src);
+
+/* The position stored at index entry i < fill. */
+off_t fi_get(struct frame_index *fi, size_t i);
+
+/* All entries as plain array (valid until the next change of the index),
+   NULL if empty or out of memory. */
+off_t *fi_plain(struct frame_index *fi);
+
 /* Empty the index (setting fill=0 and step=1), but keep current size. */
 void fi_reset(struct frame_index *fi);
 
+/*
+	Serialization of the index for storage outside of libmpg123.
+	Integers are stored in 7-bit groups, least significant first, with the
+	high bit marking that another byte follows. Signed values are mapped to
+	unsigned ones before that (0, -1, 1, -2, ... to 0, 1, 2, 3, ...).
+	The index itself is stored as step, fill, first offset and the
+	differences to the following offsets.
+*/
+#define FI_VARINT_MAX 10
+/* Write value to buf (at least FI_VARINT_MAX bytes), return used bytes. */
+size_t fi_put_uvar(unsigned char *buf, uint64_t val);
+size_t fi_put_svar(unsigned char *buf, int64_t val);
+/* Read value from buf, return consumed bytes, 0 on error. */
+size_t fi_get_uvar(const unsigned char *buf, size_t size, uint64_t *val);
+size_t fi_get_svar(const unsigned char *buf, size_t size, int64_t *val);
+/* Worst-case number of bytes for fi_pack(). */
+size_t fi_pack_size(struct frame_index *fi);
+/* Store the index in buf, return used bytes. */
+size_t fi_pack(struct frame_index *fi, unsigned char *buf);
+/* Replace the index with the stored one, return consumed bytes.
+   Returns 0 on invalid data or memory trouble, the index is emptied
+   if it had been touched already. */
+size_t fi_unpack(struct frame_index *fi, const unsigned char *buf, size_t size);
+
 #endif
@@ -36,6 +36,43 @@ static const double mulmul[27] =
 };
 #endif
 
+/* The multiplier tables are identical for all handles, only the MMX/SSE
+   synths want them scaled differently. Computed once in init_layer12(). */
+static real layer12_muls[tables_variants][27][64];
+
+static real* init_layer12_table(real *table, int m)
+{
+#if defined(REAL_IS_FIXED) && defined(PRECALC_TABLES)
+	int i;
+	for(i=0;i<63;i++)
+	*table++ = layer12_table[m][i];
+#else
+	int i,j;
+	for(j=3,i=0;i<63;i++,j--)
+	*table++ = DOUBLE_TO_REAL_SCALE_LAYER12(mulmul[m] * pow(2.0,(double) j / 3.0));
+#endif
+
+	return table;
+}
+
+#ifdef OPT_MMXORSSE
+static real* init_layer12_table_mmx(real *table, int m, int down_sample)
+{
+	int i,j;
+	if(!down_sample) 
+	{
+		for(j=3,i=0;i<63;i++,j--)
+			*table++ = DOUBLE_TO_REAL(16384 * mulmul[m] * pow(2.0,(double) j / 3.0));
+	}
+	else
+	{
+		for(j=3,i=0;i<63;i++,j--)
+		*table++ = DOUBLE_TO_REAL(mulmul[m] * pow(2.0,(double) j / 3.0));
+	}
+	return table;
+}
+#endif
+
 void init_layer12(void)
 {
 	const int base[3][9] =
@@ -62,51 +99,24 @@ void init_layer12(void)
 			*itable++ = base[i][j];
 		}
 	}
-}
 
-void init_layer12_stuff(mpg123_handle *fr, real* (*init_table)(mpg123_handle *fr, real *table, int m))
-{
-	int k;
-	real *table;
 	for(k=0;k<27;k++)
 	{
-		table = init_table(fr, fr->muls[k], k);
+		real *table = init_layer12_table(layer12_muls[tables_plain][k], k);
+		*table++ = 0.0;
+#ifdef OPT_MMXORSSE
+		table = init_layer12_table_mmx(layer12_muls[tables_mmx][k], k, 0);
+		*table++ = 0.0;
+		table = init_layer12_table_mmx(layer12_muls[tables_mmx_down][k], k, 1);
 		*table++ = 0.0;
-	}
-}
-
-real* init_layer12_table(mpg123_handle *fr, real *table, int m)
-{
-#if defined(REAL_IS_FIXED) && defined(PRECALC_TABLES)
-	int i;
-	for(i=0;i<63;i++)
-	*table++ = layer12_table[m][i];
-#else
-	int i,j;
-	for(j=3,i=0;i<63;i++,j--)
-	*table++ = DOUBLE_TO_REAL_SCALE_LAYER12(mulmul[m] * pow(2.0,(double) j / 3.0));
 #endif
-
-	return table;
+	}
 }
 
-#ifdef OPT_MMXORSSE
-real* init_layer12_table_mmx(mpg123_handle *fr, real *table, int m)
+void init_layer12_stuff(mpg123_handle *fr, enum table_variant variant)
 {
-	int i,j;
-	if(!fr->p.down_sample) 
-	{
-		for(j=3,i=0;i<63;i++,j--)
-			*table++ = DOUBLE_TO_REAL(16384 * mulmul[m] * pow(2.0,(double) j / 3.0));
-	}
-	else
-	{
-		for(j=3,i=0;i<63;i++,j--)
-		*table++ = DOUBLE_TO_REAL(mulmul[m] * pow(2.0,(double) j / 3.0));
-	}
-	return table;
+	fr->muls = (const real (*)[64])layer12_muls[variant];
 }
-#endif
 
 #endif /* NO_LAYER12 */
 
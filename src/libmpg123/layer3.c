@@ -51,6 +51,24 @@ static real pow1_1[2][32],pow2_1[2][32],pow1_2[2][32],pow2_2[2][32];
 #endif
 #endif
 
+#ifdef USE_NEW_HUFFTABLE
+/*
+	Direct lookup for the big_values pairs: The next HUFF_FAST_BITS bits of
+	the stream give code length, both values and their sign bits in one go,
+	if all that fits. Zero entries mean: use the table walk (long codes or
+	linbits escapes). Layout: length in bits 10 to 13, sign of x and y in
+	bits 9 and 8, x and y in the low nibbles.
+*/
+#define HUFF_FAST_BITS 10
+#define HUFF_LEN(e)  ((e)>>10)
+#define HUFF_XSIGN   0x200
+#define HUFF_YSIGN   0x100
+#define HUFF_X(e)    (((e)>>4)&0xf)
+#define HUFF_Y(e)    ((e)&0xf)
+static unsigned short huff_fast[16][1<<HUFF_FAST_BITS];
+static const unsigned short *huff_fast_tab[32];
+#endif
+
 /* Decoder state data, living on the stack of do_layer3. */
 
 struct gr_info_s
@@ -71,8 +89,8 @@ struct gr_info_s
 	unsigned preflag;
 	unsigned scalefac_scale;
 	unsigned count1table_select;
-	real *full_gain[3];
-	real *pow2gain;
+	const real *full_gain[3];
+	const real *pow2gain;
 };
 
 struct III_sideinfo
@@ -161,15 +179,24 @@ static unsigned int i_slen2[256]; /* MPEG 2.0 slen for intensity stereo */
 
 /* Some helpers used in init_layer3 */
 
+/*
+	Tables that only depend on the synth variant, not on the stream or the
+	handle, shared by all handles. The scale factor band limits are stored
+	for full sampling rate; decoding clips them to down_sample_sblimit.
+*/
+static real gainpow2_tab[tables_variants][256+118+4];
+static int longLimit[9][23];
+static int shortLimit[9][14];
+
 #ifdef OPT_MMXORSSE
-real init_layer3_gainpow2_mmx(mpg123_handle *fr, int i)
+static real init_layer3_gainpow2_mmx(int down_sample, int i)
 {
-	if(!fr->p.down_sample) return DOUBLE_TO_REAL(16384.0 * pow((double)2.0,-0.25 * (double) (i+210) ));
+	if(!down_sample) return DOUBLE_TO_REAL(16384.0 * pow((double)2.0,-0.25 * (double) (i+210) ));
 	else return DOUBLE_TO_REAL(pow((double)2.0,-0.25 * (double) (i+210)));
 }
 #endif
 
-real init_layer3_gainpow2(mpg123_handle *fr, int i)
+static real init_layer3_gainpow2(int i)
 {
 #if defined(REAL_IS_FIXED) && defined(PRECALC_TABLES)
 	return gainpow2[i+256];
@@ -180,6 +207,51 @@ real init_layer3_gainpow2(mpg123_handle *fr, int i)
 
 
 /* init tables for layer-3 ... specific with the downsampling... */
+#ifdef USE_NEW_HUFFTABLE
+/* Decode each possible bit pattern once with the table walk. */
+static void init_huff_fast(unsigned short *fast, const struct newhuff *h)
+{
+	uint32_t p;
+	for(p=0; p < 1<<HUFF_FAST_BITS; ++p)
+	{
+		uint32_t bits = p<<(32-HUFF_FAST_BITS);
+		const short *val = h->table;
+		unsigned int len = 0;
+		unsigned short e;
+		short y;
+		int x;
+
+		fast[p] = 0;
+		while((y=val[bits>>28])<0)
+		{
+			val -= y;
+			len += 4;
+			bits <<= 4;
+		}
+		len  += y>>8;
+		bits <<= y>>8;
+		x = (y>>4) & 0xf;
+		y &= 0xf;
+		if(h->linbits && (x == 15 || y == 15))
+			continue;
+		e = (x<<4) | y;
+		if(x)
+		{
+			if(bits & 0x80000000UL) e |= HUFF_XSIGN;
+			bits <<= 1;
+			++len;
+		}
+		if(y)
+		{
+			if(bits & 0x80000000UL) e |= HUFF_YSIGN;
+			++len;
+		}
+		if(len && len <= HUFF_FAST_BITS)
+			fast[p] = e | (len<<10);
+	}
+}
+#endif
+
 void init_layer3(void)
 {
 	int i,j,k,l;
@@ -266,6 +338,22 @@ void init_layer3(void)
 	}
 #endif
 
+#ifdef USE_NEW_HUFFTABLE
+	/* Tables with different linbits share the code table. */
+	for(i=0,k=0;i<32;i++)
+	{
+		for(j=0;j<i;j++)
+			if(ht[j].table == ht[i].table) break;
+		if(j < i)
+			huff_fast_tab[i] = huff_fast_tab[j];
+		else
+		{
+			init_huff_fast(huff_fast[k], ht+i);
+			huff_fast_tab[i] = huff_fast[k++];
+		}
+	}
+#endif
+
 	for(j=0;j<4;j++)
 	{
 		const int len[4] = { 36,36,12,36 };
@@ -370,32 +458,31 @@ void init_layer3(void)
 		int n = k + j * 4 + i * 20;
 		n_slen2[n+400] = i|(j<<3)|(k<<6)|(1<<12);
 	}
-}
-
 
-void init_layer3_stuff(mpg123_handle *fr, real (*gainpow2)(mpg123_handle *fr, int i))
-{
-	int i,j;
-
-	for(i=-256;i<118+4;i++)	fr->gainpow2[i+256] = gainpow2(fr,i);
+	for(i=-256;i<118+4;i++)
+	{
+		gainpow2_tab[tables_plain][i+256] = init_layer3_gainpow2(i);
+#ifdef OPT_MMXORSSE
+		gainpow2_tab[tables_mmx][i+256] = init_layer3_gainpow2_mmx(0, i);
+		gainpow2_tab[tables_mmx_down][i+256] = init_layer3_gainpow2_mmx(1, i);
+#endif
+	}
 
 	for(j=0;j<9;j++)
 	{
 		for(i=0;i<23;i++)
-		{
-			fr->longLimit[j][i] = (bandInfo[j].longIdx[i] - 1 + 8) / 18 + 1;
-			if(fr->longLimit[j][i] > (fr->down_sample_sblimit) )
-			fr->longLimit[j][i] = fr->down_sample_sblimit;
-		}
+			longLimit[j][i] = (bandInfo[j].longIdx[i] - 1 + 8) / 18 + 1;
 		for(i=0;i<14;i++)
-		{
-			fr->shortLimit[j][i] = (bandInfo[j].shortIdx[i] - 1) / 18 + 1;
-			if(fr->shortLimit[j][i] > (fr->down_sample_sblimit) )
-			fr->shortLimit[j][i] = fr->down_sample_sblimit;
-		}
+			shortLimit[j][i] = (bandInfo[j].shortIdx[i] - 1) / 18 + 1;
 	}
 }
 
+
+void init_layer3_stuff(mpg123_handle *fr, enum table_variant variant)
+{
+	fr->gainpow2 = gainpow2_tab[variant];
+}
+
 /*
 	Observe!
 	Now come the actualy decoding routines.
@@ -883,6 +970,9 @@ static int III_dequantize_sample(mpg123_handle *fr, real xr[SBLIMIT][SSLIMIT],in
 		{
 			int lp = l[i];
 			const struct newhuff *h = ht+gr_info->table_select[i];
+#ifdef USE_NEW_HUFFTABLE
+			const unsigned short *fast = huff_fast_tab[gr_info->table_select[i]];
+#endif
 			for(;lp;lp--,mc--)
 			{
 				register MASK_STYPE x,y;
@@ -910,6 +1000,36 @@ static int III_dequantize_sample(mpg123_handle *fr, real xr[SBLIMIT][SSLIMIT],in
 						step = 3;
 					}
 				}
+#ifdef USE_NEW_HUFFTABLE
+				REFRESH_MASK;
+				{
+					unsigned short e = fast[(MASK_UTYPE)mask>>(BITSHIFT+8-HUFF_FAST_BITS)];
+					if(e)
+					{
+						num  -= HUFF_LEN(e);
+						mask <<= HUFF_LEN(e);
+						CHECK_XRPNT;
+						if(HUFF_X(e))
+						{
+							max[lwin] = cb;
+							if(e & HUFF_XSIGN) *xrpnt = REAL_MUL_SCALE_LAYER3(-ispow[HUFF_X(e)], v, gainpow2_scale_idx);
+							else               *xrpnt = REAL_MUL_SCALE_LAYER3( ispow[HUFF_X(e)], v, gainpow2_scale_idx);
+						}
+						else *xrpnt = DOUBLE_TO_REAL(0.0);
+						xrpnt += step;
+						CHECK_XRPNT;
+						if(HUFF_Y(e))
+						{
+							max[lwin] = cb;
+							if(e & HUFF_YSIGN) *xrpnt = REAL_MUL_SCALE_LAYER3(-ispow[HUFF_Y(e)], v, gainpow2_scale_idx);
+							else               *xrpnt = REAL_MUL_SCALE_LAYER3( ispow[HUFF_Y(e)], v, gainpow2_scale_idx);
+						}
+						else *xrpnt = DOUBLE_TO_REAL(0.0);
+						xrpnt += step;
+						continue;
+					}
+				}
+#endif
 				{
 					const short *val = h->table;
 					REFRESH_MASK;
@@ -1091,7 +1211,9 @@ static int III_dequantize_sample(mpg123_handle *fr, real xr[SBLIMIT][SSLIMIT],in
 		{
 			int rmax = max[0] > max[1] ? max[0] : max[1];
 			rmax = (rmax > max[2] ? rmax : max[2]) + 1;
-			gr_info->maxb = rmax ? fr->shortLimit[sfreq][rmax] : fr->longLimit[sfreq][max[3]+1];
+			gr_info->maxb = rmax ? shortLimit[sfreq][rmax] : longLimit[sfreq][max[3]+1];
+			if(gr_info->maxb > (unsigned int)fr->down_sample_sblimit)
+				gr_info->maxb = fr->down_sample_sblimit;
 		}
 
 	}
@@ -1110,6 +1232,9 @@ static int III_dequantize_sample(mpg123_handle *fr, real xr[SBLIMIT][SSLIMIT],in
 		{
 			int lp = l[i];
 			const struct newhuff *h = ht+gr_info->table_select[i];
+#ifdef USE_NEW_HUFFTABLE
+			const unsigned short *fast = huff_fast_tab[gr_info->table_select[i]];
+#endif
 
 			for(;lp;lp--,mc--)
 			{
@@ -1130,6 +1255,34 @@ static int III_dequantize_sample(mpg123_handle *fr, real xr[SBLIMIT][SSLIMIT],in
 						v = gr_info->pow2gain[(*(scf++) + (*pretab++)) << shift];
 					}
 				}
+#ifdef USE_NEW_HUFFTABLE
+				REFRESH_MASK;
+				{
+					unsigned short e = fast[(MASK_UTYPE)mask>>(BITSHIFT+8-HUFF_FAST_BITS)];
+					if(e)
+					{
+						num  -= HUFF_LEN(e);
+						mask <<= HUFF_LEN(e);
+						CHECK_XRPNT;
+						if(HUFF_X(e))
+						{
+							max = cb;
+							if(e & HUFF_XSIGN) *xrpnt++ = REAL_MUL_SCALE_LAYER3(-ispow[HUFF_X(e)], v, gainpow2_scale_idx);
+							else               *xrpnt++ = REAL_MUL_SCALE_LAYER3( ispow[HUFF_X(e)], v, gainpow2_scale_idx);
+						}
+						else *xrpnt++ = DOUBLE_TO_REAL(0.0);
+						CHECK_XRPNT;
+						if(HUFF_Y(e))
+						{
+							max = cb;
+							if(e & HUFF_YSIGN) *xrpnt++ = REAL_MUL_SCALE_LAYER3(-ispow[HUFF_Y(e)], v, gainpow2_scale_idx);
+							else               *xrpnt++ = REAL_MUL_SCALE_LAYER3( ispow[HUFF_Y(e)], v, gainpow2_scale_idx);
+						}
+						else *xrpnt++ = DOUBLE_TO_REAL(0.0);
+						continue;
+					}
+				}
+#endif
 				{
 					const short *val = h->table;
 					REFRESH_MASK;
@@ -1268,7 +1421,9 @@ static int III_dequantize_sample(mpg123_handle *fr, real xr[SBLIMIT][SSLIMIT],in
 		}
 
 		gr_info->maxbandl = max+1;
-		gr_info->maxb = fr->longLimit[sfreq][gr_info->maxbandl];
+		gr_info->maxb = longLimit[sfreq][gr_info->maxbandl];
+		if(gr_info->maxb > (unsigned int)fr->down_sample_sblimit)
+			gr_info->maxb = fr->down_sample_sblimit;
 	}
 
 	part2remain += num;
@@ -1479,7 +1634,32 @@ maybe still wrong??? (copy 12 to 13?) */
 }
 
 
-static void III_antialias(real xr[SBLIMIT][SSLIMIT],struct gr_info_s *gr_info)
+/* Alias reduction between the first sblim+1 subbands, with
+   the coefficient tables aa_cs and aa_ca. */
+void antialias(real *xr, int sblim, real *cs_tab, real *ca_tab)
+{
+	/* 31 alias-reduction operations between each pair of sub-bands */
+	/* with 8 butterflies between each pair                         */
+
+	int sb;
+	real *xr1=xr+SSLIMIT;
+
+	for(sb=sblim; sb>0; sb--,xr1+=10)
+	{
+		int ss;
+		real *cs=cs_tab,*ca=ca_tab;
+		real *xr2 = xr1;
+
+		for(ss=7;ss>=0;ss--)
+		{ /* upper and lower butterfly inputs */
+			register real bu = *--xr2,bd = *xr1;
+			*xr2   = REAL_MUL(bu, *cs) - REAL_MUL(bd, *ca);
+			*xr1++ = REAL_MUL(bd, *cs++) + REAL_MUL(bu, *ca++);
+		}
+	}
+}
+
+static void III_antialias(mpg123_handle *fr, real xr[SBLIMIT][SSLIMIT],struct gr_info_s *gr_info)
 {
 	int sblim;
 
@@ -1491,26 +1671,19 @@ static void III_antialias(real xr[SBLIMIT][SSLIMIT],struct gr_info_s *gr_info)
 	}
 	else sblim = gr_info->maxb-1;
 
-	/* 31 alias-reduction operations between each pair of sub-bands */
-	/* with 8 butterflies between each pair                         */
+	opt_antialias(fr)((real *) xr, sblim, aa_cs, aa_ca);
+}
 
+/* Turn mid/side into left/right channels (the 1/sqrt(2) is in the dequantization). */
+void midside(real *xr0, real *xr1, int n)
+{
+	int i;
+	for(i=0;i<n;i++)
 	{
-		int sb;
-		real *xr1=(real *) xr[1];
-
-		for(sb=sblim; sb; sb--,xr1+=10)
-		{
-			int ss;
-			real *cs=aa_cs,*ca=aa_ca;
-			real *xr2 = xr1;
-
-			for(ss=7;ss>=0;ss--)
-			{ /* upper and lower butterfly inputs */
-				register real bu = *--xr2,bd = *xr1;
-				*xr2   = REAL_MUL(bu, *cs) - REAL_MUL(bd, *ca);
-				*xr1++ = REAL_MUL(bd, *cs++) + REAL_MUL(bu, *ca++);
-			}
-		}
+		real tmp0 = xr0[i];
+		real tmp1 = xr1[i];
+		xr0[i] = tmp0 + tmp1;
+		xr1[i] = tmp0 - tmp1;
 	}
 }
 
@@ -1974,7 +2147,7 @@ static void dct12(real *in,real *rawout1,real *rawout2,register real *wi,registe
 
 static void III_hybrid(real fsIn[SBLIMIT][SSLIMIT], real tsOut[SSLIMIT][SBLIMIT], int ch,struct gr_info_s *gr_info, mpg123_handle *fr)
 {
-	real (*block)[2][SBLIMIT*SSLIMIT] = fr->hybrid_block;
+	real (*block)[2][SBLIMIT*SSLIMIT] = fr->layer3.hybrid_block;
 	int *blc = fr->hybrid_blc;
 
 	real *tspnt = (real *) tsOut;
@@ -2237,17 +2410,10 @@ int do_layer3(mpg123_handle *fr)
 
 			if(ms_stereo)
 			{
-				int i;
 				unsigned int maxb = sideinfo.ch[0].gr[gr].maxb;
 				if(sideinfo.ch[1].gr[gr].maxb > maxb) maxb = sideinfo.ch[1].gr[gr].maxb;
 
-				for(i=0;i<SSLIMIT*(int)maxb;i++)
-				{
-					real tmp0 = ((real *)hybridIn[0])[i];
-					real tmp1 = ((real *)hybridIn[1])[i];
-					((real *)hybridIn[0])[i] = tmp0 + tmp1;
-					((real *)hybridIn[1])[i] = tmp0 - tmp1;
-				}
+				opt_midside(fr)((real *)hybridIn[0], (real *)hybridIn[1], SSLIMIT*(int)maxb);
 			}
 
 			if(i_stereo) III_i_stereo(hybridIn,scalefacs[1],gr_info,sfreq,ms_stereo,fr->lsf);
@@ -2289,7 +2455,7 @@ int do_layer3(mpg123_handle *fr)
 		for(ch=0;ch<stereo1;ch++)
 		{
 			struct gr_info_s *gr_info = &(sideinfo.ch[ch].gr[gr]);
-			III_antialias(hybridIn[ch],gr_info);
+			III_antialias(fr, hybridIn[ch],gr_info);
 			III_hybrid(hybridIn[ch], hybridOut[ch], ch,gr_info, fr);
 		}
 
@@ -119,7 +119,10 @@ int attribute_align_arg mpg123_decoder(mpg123_handle *mh, const char* decoder)
 		frame_exit(mh);
 		return MPG123_ERR;
 	}
-	/* Do _not_ call decode_update here! That is only allowed after a first MPEG frame has been met. */
+	/* Do _not_ call decode_update here! That is only allowed after a first MPEG frame has been met.
+	   The old table setup does not fit the new decoder's buffers, so leave
+	   that to set_synth_functions() instead of a do_rva() in between. */
+	mh->make_decode_tables = NULL;
 	mh->decoder_change = 1;
 	return MPG123_OK;
 }
@@ -127,12 +130,17 @@ int attribute_align_arg mpg123_decoder(mpg123_handle *mh, const char* decoder)
 int attribute_align_arg mpg123_param(mpg123_handle *mh, enum mpg123_parms key, long val, double fval)
 {
 	int r;
+	long smooth;
 
 	if(mh == NULL) return MPG123_BAD_HANDLE;
+	smooth = mh->p.flags & MPG123_SMOOTH_VOLUME;
 	r = mpg123_par(&mh->p, key, val, fval);
 	if(r != MPG123_OK){ mh->err = r; r = MPG123_ERR; }
 	else
 	{ /* Special treatment for some settings. */
+		/* Moving the volume between synth tables and output gain. */
+		if((mh->p.flags & MPG123_SMOOTH_VOLUME) != smooth)
+			do_rva(mh);
 #ifdef FRAME_INDEX
 		if(key == MPG123_INDEX_SIZE)
 		{ /* Apply frame index size and grow property on the fly. */
@@ -401,6 +409,30 @@ int attribute_align_arg mpg123_getstate(mpg123_handle *mh, enum mpg123_state key
 		case MPG123_DEC_DELAY:
 			theval = mh->lay == 3 ? GAPLESS_DELAY : -1;
 		break;
+		case MPG123_STATS_PARSE:
+			thefval = mh->stats.parse;
+		break;
+		case MPG123_STATS_DECODE:
+			thefval = mh->stats.decode;
+		break;
+		case MPG123_STATS_SYNTH:
+			thefval = mh->stats.synth;
+		break;
+		case MPG123_STATS_POSTPROCESS:
+			thefval = mh->stats.postprocess;
+		break;
+		case MPG123_STATS_RESYNCS:
+			theval = mh->stats.resyncs;
+		break;
+		case MPG123_STATS_RESYNC_BYTES:
+			theval = mh->stats.resync_bytes;
+		break;
+		case MPG123_STATS_JUNK_BYTES:
+			theval = mh->stats.junk_bytes;
+		break;
+		case MPG123_STATS_ZERO_FRAMES:
+			theval = mh->stats.zero_frames;
+		break;
 		default:
 			mh->err = MPG123_BAD_KEY;
 			ret = MPG123_ERR;
@@ -582,6 +614,7 @@ int decode_update(mpg123_handle *mh)
 	}
 	else mh->single = (mh->p.flags & MPG123_FORCE_MONO)-1;
 	if(set_synth_functions(mh) != 0) return -1;;
+	if(STATS_ON(mh)) stats_wrap_synth(mh);
 
 	/* The needed size of output buffer may have changed. */
 	if(frame_outbuffer(mh) != MPG123_OK) return -1;
@@ -606,6 +639,20 @@ size_t attribute_align_arg mpg123_outblock(mpg123_handle *mh)
 	else return mpg123_safe_buffer();
 }
 
+/* Run the layer decoder, accounting for the time with MPG123_STATS. */
+static int decode_layer(mpg123_handle *fr)
+{
+	double synth, start;
+	int clip;
+	if(!STATS_ON(fr)) return (fr->do_layer)(fr);
+	/* The synth wrappers count their part separately. */
+	synth = fr->stats.synth;
+	start = stats_now();
+	clip = (fr->do_layer)(fr);
+	fr->stats.decode += stats_now()-start-(fr->stats.synth-synth);
+	return clip;
+}
+
 /* Read in the next frame we actually want for decoding.
    This includes skipping/ignoring frames, in additon to skipping junk in the parser. */
 static int get_next_frame(mpg123_handle *mh)
@@ -631,7 +678,7 @@ static int get_next_frame(mpg123_handle *mh)
 		{
 			debug1("ignoring frame %li", (long)mh->num);
 			/* Decoder structure must be current! decode_update has been called before... */
-			(mh->do_layer)(mh); mh->buffer.fill = 0;
+			decode_layer(mh); mh->buffer.fill = 0;
 #ifndef NO_NTOM
 			/* The ignored decoding may have failed. Make sure ntom stays consistent. */
 			if(mh->down_sample == 3) ntom_set_ntom(mh, mh->num+1);
@@ -641,6 +688,13 @@ static int get_next_frame(mpg123_handle *mh)
 		/* Read new frame data; possibly breaking out here for MPG123_NEED_MORE. */
 		debug("read frame");
 		mh->to_decode = FALSE;
+		if(STATS_ON(mh))
+		{
+			double start = stats_now();
+			b = read_frame(mh);
+			mh->stats.parse += stats_now()-start;
+		}
+		else
 		b = read_frame(mh); /* That sets to_decode only if a full frame was read. */
 		debug4("read of frame %li returned %i (to_decode=%i) at sample %li", (long)mh->num, b, mh->to_decode, (long)mpg123_tell(mh));
 		if(b == MPG123_NEED_MORE) return MPG123_NEED_MORE; /* need another call with data */
@@ -718,14 +772,39 @@ static int zero_byte(mpg123_handle *fr)
 #endif
 }
 
+/* Post-processing for the frame buffer or, with planar decoding, each of the channel planes. */
+static void postprocess_output(mpg123_handle *fr)
+{
+	struct outbuffer keep;
+	size_t fill = 0;
+	int c;
+
+	if(!fr->planar.plane[0])
+		postprocess_buffer(fr);
+	else
+	{
+		keep = fr->buffer;
+		for(c=0; c<2; ++c)
+		{
+			fr->buffer.data = fr->planar.plane[c];
+			fr->buffer.fill = keep.fill/2;
+			fr->buffer.size = keep.size/2;
+			postprocess_buffer(fr);
+			fill += fr->buffer.fill;
+		}
+		fr->buffer = keep;
+		fr->buffer.fill = fill;
+	}
+	/* A volume change has ramped in over this frame. */
+	fr->gain.current = fr->gain.target;
+}
+
 /*
-	Not part of the api. This just decodes the frame and fills missing bits with zeroes.
-	There can be frames that are broken and thus make do_layer() fail.
+	The rest of decode_the_frame() after the layer decoding: Fill missing bits
+	with zeroes up to the <needed_bytes> of the frame, then post-process.
 */
-static void decode_the_frame(mpg123_handle *fr)
+static void finish_the_frame(mpg123_handle *fr, size_t needed_bytes)
 {
-	size_t needed_bytes = decoder_synth_bytes(fr, frame_expect_outsamples(fr));
-	fr->clip += (fr->do_layer)(fr);
 	/*fprintf(stderr, "frame %"OFF_P": got %"SIZE_P" / %"SIZE_P"\n", fr->num,(size_p)fr->buffer.fill, (size_p)needed_bytes);*/
 	/* There could be less data than promised.
 	   Also, then debugging, we look out for coding errors that could result in _more_ data than expected. */
@@ -744,9 +823,16 @@ static void decode_the_frame(mpg123_handle *fr)
 				but we have funny 8bit formats that have a different opinion on zero...
 				Unsigned 16 or 32 bit formats are handled later.
 			*/
+			if(fr->planar.plane[0])
+			{
+				memset( fr->planar.plane[0] + fr->buffer.fill/2, zero_byte(fr), (needed_bytes - fr->buffer.fill)/2 );
+				memset( fr->planar.plane[1] + fr->buffer.fill/2, zero_byte(fr), (needed_bytes - fr->buffer.fill)/2 );
+			}
+			else
 			memset( fr->buffer.data + fr->buffer.fill, zero_byte(fr), needed_bytes - fr->buffer.fill );
 
 			fr->buffer.fill = needed_bytes;
+			++fr->stats.zero_frames;
 #ifndef NO_NTOM
 			/* ntom_val will be wrong when the decoding wasn't carried out completely */
 			ntom_set_ntom(fr, fr->num+1);
@@ -760,7 +846,25 @@ static void decode_the_frame(mpg123_handle *fr)
 		}
 	}
 #endif
-	postprocess_buffer(fr);
+	if(STATS_ON(fr))
+	{
+		double start = stats_now();
+		postprocess_output(fr);
+		fr->stats.postprocess += stats_now()-start;
+	}
+	else
+	postprocess_output(fr);
+}
+
+/*
+	Not part of the api. This just decodes the frame and fills missing bits with zeroes.
+	There can be frames that are broken and thus make do_layer() fail.
+*/
+static void decode_the_frame(mpg123_handle *fr)
+{
+	size_t needed_bytes = decoder_synth_bytes(fr, frame_expect_outsamples(fr));
+	fr->clip += decode_layer(fr);
+	finish_the_frame(fr, needed_bytes);
 }
 
 /*
@@ -888,6 +992,82 @@ int attribute_align_arg mpg123_decode_frame(mpg123_handle *mh, off_t *num, unsig
 	}
 }
 
+/* How many handles mpg123_decode_frames() works on at a time. */
+#define DECODE_FRAMES_CHUNK 64
+
+/* Get to the next frame to decode, as mpg123_decode_frame() does. */
+static int next_frame_to_decode(mpg123_handle *mh)
+{
+	if(mh == NULL) return MPG123_BAD_HANDLE;
+	if(mh->buffer.size < mh->outblock) return MPG123_NO_SPACE;
+	mh->buffer.fill = 0; /* always start fresh */
+	while(!mh->to_decode)
+	{
+		int b = get_next_frame(mh);
+		if(b < 0) return b;
+		debug1("got next frame, %i", mh->to_decode);
+	}
+	if(mh->new_format)
+	{
+		debug("notifiying new format");
+		mh->new_format = 0;
+		return MPG123_NEW_FORMAT;
+	}
+	if(mh->decoder_change && decode_update(mh) < 0)
+		return MPG123_ERR;
+	return MPG123_OK;
+}
+
+int attribute_align_arg mpg123_decode_frames( mpg123_handle **mh, int count
+,	int *ret, unsigned char **audio, size_t *bytes )
+{
+	mpg123_handle *batch[DECODE_FRAMES_CHUNK];
+	size_t needed[DECODE_FRAMES_CHUNK];
+	int first, i, n;
+
+	if(mh == NULL || ret == NULL) return MPG123_ERR_NULL;
+	if(count < 0) return MPG123_BAD_PARS;
+	for(first=0; first<count; first+=DECODE_FRAMES_CHUNK)
+	{
+		int end = count-first > DECODE_FRAMES_CHUNK ? first+DECODE_FRAMES_CHUNK : count;
+		/* Layer decoding, with the synth calls recorded where possible ... */
+		n = 0;
+		for(i=first; i<end; ++i)
+		{
+			if(audio) audio[i] = NULL;
+			if(bytes) bytes[i] = 0;
+			ret[i] = next_frame_to_decode(mh[i]);
+			if(ret[i] != MPG123_OK)
+				continue;
+			debug("decoding");
+			if(synth_batch_begin(mh[i]))
+			{
+				needed[n] = decoder_synth_bytes(mh[i], frame_expect_outsamples(mh[i]));
+				mh[i]->clip += decode_layer(mh[i]);
+				batch[n++] = mh[i];
+			}
+			else
+				decode_the_frame(mh[i]);
+		}
+		/* ... the synthesis for all of those together ... */
+		synth_batch_run(batch, n);
+		for(i=0; i<n; ++i)
+			finish_the_frame(batch[i], needed[i]);
+		/* ... and the handing out. */
+		for(i=first; i<end; ++i)
+		{
+			if(ret[i] != MPG123_OK)
+				continue;
+			mh[i]->to_decode = mh[i]->to_ignore = FALSE;
+			mh[i]->buffer.p = mh[i]->buffer.data;
+			FRAME_BUFFERCHECK(mh[i]);
+			if(audio) audio[i] = mh[i]->buffer.p;
+			if(bytes) bytes[i] = mh[i]->buffer.fill;
+		}
+	}
+	return MPG123_OK;
+}
+
 int attribute_align_arg mpg123_read(mpg123_handle *mh, unsigned char *out, size_t size, size_t *done)
 {
 	return mpg123_decode(mh, NULL, 0, out, size, done);
@@ -924,6 +1104,35 @@ int attribute_align_arg mpg123_feed(mpg123_handle *mh, const unsigned char *in,
 #endif
 }
 
+int attribute_align_arg mpg123_feed_ref( mpg123_handle *mh
+,	const unsigned char *in, size_t size
+,	void (*release)(void *), void *handle )
+{
+	if(mh == NULL) return MPG123_BAD_HANDLE;
+#ifndef NO_FEEDER
+	if(in == NULL)
+	{
+		mh->err = MPG123_NULL_BUFFER;
+		return MPG123_ERR;
+	}
+	if(size > 0)
+	{
+		if(feed_more_ref(mh, in, size, release, handle) != 0)
+		{
+			mh->err = MPG123_OUT_OF_MEM;
+			return MPG123_ERR;
+		}
+		if(mh->err == MPG123_ERR_READER) mh->err = MPG123_OK;
+	}
+	else if(release != NULL)
+		release(handle);
+	return MPG123_OK;
+#else
+	mh->err = MPG123_MISSING_FEATURE;
+	return MPG123_ERR;
+#endif
+}
+
 /*
 	The old picture:
 	while(1) {
@@ -938,6 +1147,49 @@ int attribute_align_arg mpg123_feed(mpg123_handle *mh, const unsigned char *in,
 	}
 */
 
+/*
+	Alignment needed for the output memory: post-processing may widen the
+	decoder's samples in place (16 to 32 bit or float), 24 bit output is
+	produced from 32 bit words.
+*/
+static int direct_align(mpg123_handle *fr)
+{
+	int align = fr->af.encoding & MPG123_ENC_24 ? 4 : fr->af.encsize;
+	return fr->af.dec_encsize > align ? fr->af.dec_encsize : align;
+}
+
+/*
+	Decode the pending frame right into the caller's memory, if there is room
+	for a full output block and the address is aligned as direct_align() says.
+	The frame buffer is just pointed there for the time being, so all
+	post-processing happens in place. The decoded bytes are counted in
+	fr->buffer.fill, to be taken over by the caller.
+	Returns 1 if decoded, 0 if the usual way through the frame buffer is needed.
+*/
+static int direct_decode(mpg123_handle *fr, unsigned char *out, size_t space)
+{
+	struct outbuffer keep;
+	int own_buffer;
+
+	if( fr->buffer.fill || space < fr->outblock
+	||	(uintptr_t)out % direct_align(fr) )
+		return 0;
+	keep = fr->buffer;
+	own_buffer = fr->own_buffer;
+	fr->buffer.data = fr->buffer.p = out;
+	fr->buffer.size = space;
+	/* Cutting of leading samples shall move the data to the start. */
+	fr->own_buffer = FALSE;
+	decode_the_frame(fr);
+	fr->to_decode = fr->to_ignore = FALSE;
+	debug2("decoded frame %li directly, got %li samples", (long)fr->num, (long)(fr->buffer.fill / (samples_to_bytes(fr, 1))));
+	FRAME_BUFFERCHECK(fr);
+	fr->own_buffer = own_buffer;
+	fr->buffer.data = fr->buffer.p = keep.data;
+	fr->buffer.size = keep.size;
+	return 1;
+}
+
 int attribute_align_arg mpg123_decode(mpg123_handle *mh, const unsigned char *inmemory, size_t inmemsize, unsigned char *outmemory, size_t outmemsize, size_t *done)
 {
 	int ret = MPG123_OK;
@@ -976,6 +1228,15 @@ int attribute_align_arg mpg123_decode(mpg123_handle *mh, const unsigned char *in
 				ret = MPG123_ERR;
 				goto decodeend;
 			}
+			/* With enough space left, skip the frame buffer and its copy. */
+			if(direct_decode(mh, outmemory, outmemsize-mdone))
+			{
+				outmemory += mh->buffer.fill;
+				mdone += mh->buffer.fill;
+				mh->buffer.fill = 0;
+				if(!(outmemsize > mdone)) goto decodeend;
+				continue;
+			}
 			decode_the_frame(mh);
 			mh->to_decode = mh->to_ignore = FALSE;
 			mh->buffer.p = mh->buffer.data;
@@ -1006,6 +1267,121 @@ decodeend:
 	return ret;
 }
 
+/*
+	Like direct_decode(), but with the channels going to separate buffers,
+	<space> bytes each. Frames that need leading samples cut off take the
+	way through the frame buffer.
+*/
+static int planar_decode(mpg123_handle *fr, unsigned char **plane, size_t space)
+{
+	struct outbuffer keep;
+	int own_buffer;
+	int align = direct_align(fr);
+
+	if(fr->af.channels == 1)
+		return direct_decode(fr, plane[0], space);
+	if( fr->buffer.fill || space < fr->outblock/2
+	||	(uintptr_t)plane[0] % align || (uintptr_t)plane[1] % align )
+		return 0;
+#ifdef GAPLESS
+	if(fr->firstoff && fr->num == fr->firstframe)
+		return 0;
+#endif
+	keep = fr->buffer;
+	own_buffer = fr->own_buffer;
+	fr->buffer.data = fr->buffer.p = plane[0];
+	fr->buffer.size = 2*space;
+	fr->own_buffer = FALSE;
+	synth_planar(fr, plane);
+	decode_the_frame(fr);
+	synth_planar(fr, NULL);
+	fr->to_decode = fr->to_ignore = FALSE;
+	debug2("decoded frame %li planar, got %li samples", (long)fr->num, (long)(fr->buffer.fill / (samples_to_bytes(fr, 1))));
+	FRAME_BUFFERCHECK(fr);
+	fr->own_buffer = own_buffer;
+	fr->buffer.data = fr->buffer.p = keep.data;
+	fr->buffer.size = keep.size;
+	return 1;
+}
+
+int attribute_align_arg mpg123_read_planar(mpg123_handle *mh, void **outbufs, size_t samples, size_t *done)
+{
+	int ret = MPG123_OK;
+	size_t sdone = 0;
+
+	if(done != NULL) *done = 0;
+	if(mh == NULL) return MPG123_BAD_HANDLE;
+	if(outbufs == NULL) samples = 0;
+
+	while(ret == MPG123_OK)
+	{
+		unsigned char *plane[2];
+		int c;
+
+		for(c=0; c<mh->af.channels; ++c)
+			plane[c] = (unsigned char*)outbufs[c] + sdone*mh->af.encsize;
+		if(mh->to_decode)
+		{
+			if(mh->new_format)
+			{
+				debug("notifiying new format");
+				mh->new_format = 0;
+				ret = MPG123_NEW_FORMAT;
+				goto readend;
+			}
+			if(mh->buffer.size - mh->buffer.fill < mh->outblock)
+			{
+				ret = MPG123_NO_SPACE;
+				goto readend;
+			}
+			if(mh->decoder_change && decode_update(mh) < 0)
+			{
+				ret = MPG123_ERR;
+				goto readend;
+			}
+			/* Channel count could have changed with the decoder update. */
+			for(c=0; c<mh->af.channels; ++c)
+				plane[c] = (unsigned char*)outbufs[c] + sdone*mh->af.encsize;
+			if(planar_decode(mh, plane, (samples-sdone)*mh->af.encsize))
+			{
+				sdone += bytes_to_samples(mh, mh->buffer.fill);
+				mh->buffer.fill = 0;
+				if(!(samples > sdone)) goto readend;
+				continue;
+			}
+			decode_the_frame(mh);
+			mh->to_decode = mh->to_ignore = FALSE;
+			mh->buffer.p = mh->buffer.data;
+			FRAME_BUFFERCHECK(mh);
+		}
+		if(mh->buffer.fill) /* Distribute (part of) the decoded data to the channels. */
+		{
+			size_t n = bytes_to_samples(mh, mh->buffer.fill);
+			size_t i;
+			if(n > samples-sdone)
+				n = samples-sdone;
+			for(i=0; i<n; ++i)
+			for(c=0; c<mh->af.channels; ++c)
+			{
+				memcpy(plane[c], mh->buffer.p, mh->af.encsize);
+				plane[c] += mh->af.encsize;
+				mh->buffer.p += mh->af.encsize;
+			}
+			mh->buffer.fill -= samples_to_bytes(mh, n);
+			sdone += n;
+			if(!(samples > sdone)) goto readend;
+		}
+		else /* If we didn't have data, get a new frame. */
+		{
+			int b = get_next_frame(mh);
+			if(b < 0){ ret = b; goto readend; }
+		}
+	}
+readend:
+	if(done != NULL) *done = sdone;
+	return ret;
+}
+
 long attribute_align_arg mpg123_clip(mpg123_handle *mh)
 {
 	long ret = 0;
@@ -1195,6 +1571,9 @@ static int do_the_seek(mpg123_handle *mh)
 	}
 	debug1("seek_frame returned: %i", b);
 	if(b<0) return b;
+	/* Put the synth buffer offset where continuous decoding from the start
+	   would have it (one step per 32 samples), to get identical rounding. */
+	mh->bo = (1 - (int)((mh->num*(mh->spf>>5)) & 0xf)) & 0xf;
 	/* Only mh->to_ignore is TRUE. */
 	if(mh->num < mh->firstframe) mh->to_decode = FALSE;
 
@@ -1353,6 +1732,14 @@ int attribute_align_arg mpg123_set_filesize(mpg123_handle *mh, off_t size)
 	return MPG123_OK;
 }
 
+/* File length without the leading ID3v2 tag (or junk) for estimates. */
+static off_t audio_bytes(mpg123_handle *mh)
+{
+	return mh->rdat.filelen > mh->audio_start
+	?	mh->rdat.filelen - mh->audio_start
+	:	mh->rdat.filelen;
+}
+
 off_t attribute_align_arg mpg123_framelength(mpg123_handle *mh)
 {
 	int b;
@@ -1364,11 +1751,11 @@ off_t attribute_align_arg mpg123_framelength(mpg123_handle *mh)
 	if(mh->track_frames > 0)
 		return mh->track_frames;
 	if(mh->rdat.filelen > 0)
-	{ /* A bad estimate. Ignoring tags 'n stuff. */
+	{ /* A bad estimate. Ignoring trailing tags 'n stuff. */
 		double bpf = mh->mean_framesize > 0.
 			? mh->mean_framesize
 			: compute_bpf(mh);
-		return (off_t)((double)(mh->rdat.filelen)/bpf+0.5);
+		return (off_t)((double)(audio_bytes(mh))/bpf+0.5);
 	}
 	/* Last resort: No view of the future, can at least count the frames that
 	   were already parsed. */
@@ -1390,9 +1777,9 @@ off_t attribute_align_arg mpg123_length(mpg123_handle *mh)
 	else if(mh->track_frames > 0) length = mh->track_frames*mh->spf;
 	else if(mh->rdat.filelen > 0) /* Let the case of 0 length just fall through. */
 	{
-		/* A bad estimate. Ignoring tags 'n stuff. */
+		/* A bad estimate. Ignoring trailing tags 'n stuff. */
 		double bpf = mh->mean_framesize ? mh->mean_framesize : compute_bpf(mh);
-		length = (off_t)((double)(mh->rdat.filelen)/bpf*mh->spf);
+		length = (off_t)((double)(audio_bytes(mh))/bpf*mh->spf);
 	}
 	else if(mh->rdat.filelen == 0) return mpg123_tell(mh); /* we could be in feeder mode */
 	else return MPG123_ERR; /* No length info there! */
@@ -1433,7 +1820,8 @@ int attribute_align_arg mpg123_scan(mpg123_handle *mh)
 	debug("TODO: We should disable gapless code when encountering inconsistent mh->spf!");
 	debug("      ... at least unset MPG123_ACCURATE.");
 	/* Do not increment mh->track_frames in the loop as tha would confuse Frankenstein detection. */
-	while(read_frame(mh) == 1)
+	/* Only the headers are needed, scan_frame() skips the bodies where it can. */
+	while(scan_frame(mh) == 1)
 	{
 		++track_frames;
 		track_samples += mh->spf;
@@ -1470,6 +1858,8 @@ int attribute_align_arg mpg123_id3(mpg123_handle *mh, mpg123_id3v1 **v1, mpg123_
 
 	if(mh->metaflags & MPG123_ID3)
 	{
+		if(id3_process_lazy(mh, NULL))
+			return MPG123_ERR;
 		id3_link(mh);
 		if(v1 != NULL && mh->rdat.flags & READER_ID3TAG) *v1 = (mpg123_id3v1*) mh->id3buf;
 		if(v2 != NULL)
@@ -1485,6 +1875,30 @@ int attribute_align_arg mpg123_id3(mpg123_handle *mh, mpg123_id3v1 **v1, mpg123_
 	return MPG123_OK;
 }
 
+int attribute_align_arg mpg123_id3_frame( mpg123_handle *mh
+,	const char *id, mpg123_id3v2 **v2 )
+{
+	if(v2 != NULL) *v2 = NULL;
+	if(mh == NULL) return MPG123_BAD_HANDLE;
+	if(id == NULL)
+	{
+		mh->err = MPG123_NULL_POINTER;
+		return MPG123_ERR;
+	}
+
+#ifndef NO_ID3V2
+	if(mh->metaflags & MPG123_ID3)
+	{
+		if(id3_process_lazy(mh, id))
+			return MPG123_ERR;
+		id3_link(mh);
+		if(v2 != NULL)
+			*v2 = &mh->id3v2;
+	}
+#endif
+	return MPG123_OK;
+}
+
 int attribute_align_arg mpg123_id3_raw( mpg123_handle *mh
 ,	unsigned char **v1, size_t *v1_size
 ,	unsigned char **v2, size_t *v2_size )
@@ -1607,7 +2021,12 @@ int attribute_align_arg mpg123_index(mpg123_handle *mh, off_t **offsets, off_t *
 		return MPG123_ERR;
 	}
 #ifdef FRAME_INDEX
-	*offsets = mh->index.data;
+	*offsets = fi_plain(&mh->index);
+	if(*offsets == NULL && mh->index.fill)
+	{
+		mh->err = MPG123_OUT_OF_MEM;
+		return MPG123_ERR;
+	}
 	*step    = mh->index.step;
 	*fill    = mh->index.fill;
 #else
@@ -1639,6 +2058,636 @@ int attribute_align_arg mpg123_set_index(mpg123_handle *mh, off_t *offsets, off_
 #endif
 }
 
+#ifdef FRAME_INDEX
+/*
+	Layout of the stored index:
+	"MPGI", version byte, then variable-length integers (see index.h):
+	file length, audio start, first header, FNV-1a hash of the first
+	INDEX_HASH_BYTES of audio data, track frames, track samples,
+	gapless frames (-1 if unknown, 0 if none), begin and end sample,
+	then the packed index, followed by a 4-byte little-endian FNV-1a
+	checksum of all preceding bytes.
+*/
+#define INDEX_BLOB_MAGIC "MPGI"
+#define INDEX_BLOB_VERSION 3
+#define INDEX_BLOB_HEAD (4+1+9*FI_VARINT_MAX)
+#define INDEX_HASH_BYTES (64*1024)
+#endif
+
+#define BLOB_SUM_INIT 2166136261UL
+
+/* FNV-1a checksum for stored index and decoder state, continuing sum. */
+static unsigned long blob_sum_more(unsigned long sum, const unsigned char *data, size_t size)
+{
+	size_t i;
+	for(i=0; i<size; ++i)
+		sum = ((sum ^ data[i]) * 16777619UL) & 0xffffffffUL;
+	return sum;
+}
+
+static unsigned long blob_sum(const unsigned char *data, size_t size)
+{
+	return blob_sum_more(BLOB_SUM_INIT, data, size);
+}
+
+static void blob_put_sum(unsigned char *data, size_t size)
+{
+	unsigned long sum = blob_sum(data, size);
+	data[size]   = sum & 0xff;
+	data[size+1] = (sum >> 8) & 0xff;
+	data[size+2] = (sum >> 16) & 0xff;
+	data[size+3] = (sum >> 24) & 0xff;
+}
+
+/* Check the trailing sum, returns size of data before it, 0 if bad. */
+static size_t blob_check_sum(const unsigned char *data, size_t size)
+{
+	if(size < 4)
+		return 0;
+	size -= 4;
+	return blob_sum(data, size) == ( (unsigned long)data[size]
+	|	(unsigned long)data[size+1]<<8 | (unsigned long)data[size+2]<<16
+	|	(unsigned long)data[size+3]<<24 ) ? size : 0;
+}
+
+#ifdef FRAME_INDEX
+/*
+	Hash the first INDEX_HASH_BYTES (or less, up to the end of the file)
+	after the start of audio data, to tell apart streams of the same size
+	and first header. Streams that cannot seek back are not read, leaving
+	the hash of nothing. The stream position is restored afterwards.
+	Returns 0 on success, -1 if reading failed, MPG123_ERR if the old
+	position cannot be restored (mh->err is set then).
+*/
+static int index_hash(mpg123_handle *mh, unsigned long *sum)
+{
+	unsigned char buf[4096];
+	off_t here, left, end;
+	int ret = 0;
+
+	*sum = BLOB_SUM_INIT;
+	if( !(mh->rdat.flags & READER_SEEKABLE) || (mh->rdat.flags & READER_BUFFERED)
+	||	mh->rdat.filelen <= mh->audio_start )
+		return 0;
+	left = mh->rdat.filelen - mh->audio_start;
+	if(left > INDEX_HASH_BYTES)
+		left = INDEX_HASH_BYTES;
+	here = mh->rd->tell(mh);
+	if(mh->rd->skip_bytes(mh, mh->audio_start-here) != mh->audio_start)
+		ret = -1;
+	while(!ret && left > 0)
+	{
+		int chunk = left > (off_t)sizeof(buf) ? (int)sizeof(buf) : (int)left;
+		if(mh->rd->read_frame_body(mh, buf, chunk) != chunk)
+			ret = -1;
+		else
+		{
+			*sum = blob_sum_more(*sum, buf, chunk);
+			left -= chunk;
+		}
+	}
+	end = mh->rd->tell(mh);
+	if(end < 0 || mh->rd->skip_bytes(mh, here-end) != here)
+	{
+		mh->err = MPG123_LSEEK_FAILED;
+		return MPG123_ERR;
+	}
+	return ret;
+}
+#endif
+
+int attribute_align_arg mpg123_index_save(mpg123_handle *mh, unsigned char **blob, size_t *size)
+{
+#ifdef FRAME_INDEX
+	unsigned char *buf;
+	unsigned long hash;
+	size_t n = 0;
+	int b;
+#endif
+	if(mh == NULL) return MPG123_BAD_HANDLE;
+	if(blob == NULL || size == NULL)
+	{
+		mh->err = MPG123_BAD_INDEX_PAR;
+		return MPG123_ERR;
+	}
+	*blob = NULL;
+	*size = 0;
+#ifdef FRAME_INDEX
+	b = init_track(mh);
+	if(b < 0)
+	{
+		if(b == MPG123_DONE) mh->err = MPG123_INDEX_FAIL;
+		return MPG123_ERR;
+	}
+	if(mh->index.fill < 1)
+	{
+		mh->err = MPG123_INDEX_FAIL;
+		return MPG123_ERR;
+	}
+	if((b = index_hash(mh, &hash)))
+	{
+		if(b == -1) mh->err = MPG123_INDEX_FAIL;
+		return MPG123_ERR;
+	}
+	buf = malloc(INDEX_BLOB_HEAD + fi_pack_size(&mh->index) + 4);
+	if(buf == NULL)
+	{
+		mh->err = MPG123_OUT_OF_MEM;
+		return MPG123_ERR;
+	}
+	memcpy(buf, INDEX_BLOB_MAGIC, 4);
+	n = 4;
+	buf[n++] = INDEX_BLOB_VERSION;
+	n += fi_put_svar(buf+n, (int64_t)mh->rdat.filelen);
+	n += fi_put_svar(buf+n, (int64_t)mh->audio_start);
+	n += fi_put_uvar(buf+n, (uint64_t)mh->firsthead);
+	n += fi_put_uvar(buf+n, (uint64_t)hash);
+	n += fi_put_svar(buf+n, (int64_t)mh->track_frames);
+	n += fi_put_svar(buf+n, (int64_t)mh->track_samples);
+	/* Gapless offsets after the scan, which may have dropped them. */
+#ifdef GAPLESS
+	if(mh->p.flags & MPG123_GAPLESS)
+	{
+		n += fi_put_svar(buf+n, mh->gapless_frames > 0 ? (int64_t)mh->gapless_frames : 0);
+		n += fi_put_svar(buf+n, (int64_t)mh->begin_s);
+		n += fi_put_svar(buf+n, (int64_t)mh->end_s);
+	}
+	else
+#endif
+	{
+		n += fi_put_svar(buf+n, -1);
+		n += fi_put_svar(buf+n, 0);
+		n += fi_put_svar(buf+n, 0);
+	}
+	n += fi_pack(&mh->index, buf+n);
+	blob_put_sum(buf, n);
+	*blob = buf;
+	*size = n+4;
+	return MPG123_OK;
+#else
+	mh->err = MPG123_MISSING_FEATURE;
+	return MPG123_ERR;
+#endif
+}
+
+int attribute_align_arg mpg123_index_load(mpg123_handle *mh, const unsigned char *blob, size_t size)
+{
+#ifdef FRAME_INDEX
+	int64_t filelen, audio_start, frames, samples;
+	int64_t gapless_frames, begin_s, end_s;
+	uint64_t firsthead, stored_hash;
+	unsigned long hash;
+	size_t n, m;
+	int b;
+#endif
+	if(mh == NULL) return MPG123_BAD_HANDLE;
+	if(blob == NULL)
+	{
+		mh->err = MPG123_BAD_INDEX_PAR;
+		return MPG123_ERR;
+	}
+#ifdef FRAME_INDEX
+	b = init_track(mh);
+	if(b < 0)
+	{
+		if(b == MPG123_DONE) mh->err = MPG123_INDEX_MISMATCH;
+		return MPG123_ERR;
+	}
+	if( size < 4+1+4 || memcmp(blob, INDEX_BLOB_MAGIC, 4)
+	||	blob[4] != INDEX_BLOB_VERSION || !(size = blob_check_sum(blob, size)) )
+		goto index_load_bad;
+	n = 5;
+#define INDEX_GET(type, var) \
+	if(!(m = fi_get_##type(blob+n, size-n, &var))) goto index_load_bad; \
+	n += m;
+	INDEX_GET(svar, filelen)
+	INDEX_GET(svar, audio_start)
+	INDEX_GET(uvar, firsthead)
+	INDEX_GET(uvar, stored_hash)
+	INDEX_GET(svar, frames)
+	INDEX_GET(svar, samples)
+	INDEX_GET(svar, gapless_frames)
+	INDEX_GET(svar, begin_s)
+	INDEX_GET(svar, end_s)
+#undef INDEX_GET
+	/* Only accept data for the very same stream. */
+	if( filelen != (int64_t)mh->rdat.filelen
+	||	audio_start != (int64_t)mh->audio_start
+	||	firsthead != (uint64_t)mh->firsthead
+	||	frames < 0 || samples < 0
+	||	(int64_t)(off_t)frames != frames || (int64_t)(off_t)samples != samples
+	||	gapless_frames < -1 || begin_s < 0 || end_s < begin_s
+	||	(int64_t)(off_t)gapless_frames != gapless_frames
+	||	(int64_t)(off_t)end_s != end_s )
+		goto index_load_bad;
+	/* Finally, look at the audio data itself. */
+	if((b = index_hash(mh, &hash)) == MPG123_ERR)
+		return MPG123_ERR;
+	if(b || stored_hash != (uint64_t)hash)
+		goto index_load_bad;
+	m = fi_unpack(&mh->index, blob+n, size-n);
+	if(!m)
+		goto index_load_bad;
+	if( n+m != size || fi_get(&mh->index, 0) < mh->audio_start
+	||	(filelen > 0 && fi_get(&mh->index, mh->index.fill-1) > filelen)
+	||	(frames > 0 && (mh->index.fill-1)*mh->index.step >= frames) )
+	{
+		fi_reset(&mh->index);
+		goto index_load_bad;
+	}
+	mh->track_frames  = (off_t)frames;
+	mh->track_samples = (off_t)samples;
+#ifdef GAPLESS
+	if(mh->p.flags & MPG123_GAPLESS)
+	{
+		/* Take the offsets as stored, or derive them like mpg123_scan(). */
+		if(gapless_frames >= 0)
+		{
+			mh->gapless_frames = gapless_frames > 0 ? (off_t)gapless_frames : -1;
+			mh->begin_s = gapless_frames > 0 ? (off_t)begin_s : 0;
+			mh->end_s   = gapless_frames > 0 ? (off_t)end_s : 0;
+			frame_gapless_realinit(mh);
+			if(mh->gapless_frames < 1)
+			{
+				mh->lastframe = -1;
+				mh->lastoff = 0;
+			}
+		}
+		else if(mh->track_samples > 0)
+			frame_gapless_update(mh, mh->track_samples);
+	}
+#endif
+	return MPG123_OK;
+index_load_bad:
+	mh->err = MPG123_INDEX_MISMATCH;
+	return MPG123_ERR;
+#else
+	mh->err = MPG123_MISSING_FEATURE;
+	return MPG123_ERR;
+#endif
+}
+
+/*
+	Layout of the stored decoder state:
+	"MPGS", version byte, then variable-length integers (see index.h):
+	file length, audio start and first header of the stream, decoder type,
+	output rate, channels, encoding and downsampling mode, then the input
+	offset of the next frame, frame number, play count, first frame,
+	ignore frame and first offset (gapless), header and size of the last
+	frame, free format frame size, layer III bit reservoir and overlap
+	indices, synth buffer offsets, NtoM counters and dither index.
+	Then the blocks of layer III bit reservoir (the bytes up to the end of
+	the last frame), layer III overlap, synth history and decoded output
+	that is not returned yet, each with its length up front.
+	A 4-byte little-endian FNV-1a checksum of all preceding bytes closes it.
+*/
+#define STATE_BLOB_MAGIC "MPGS"
+#define STATE_BLOB_VERSION 1
+#define STATE_BLOB_HEAD (4+1+26*FI_VARINT_MAX)
+/* Bytes of the last frame available for the bit reservoir of the next. */
+#define STATE_RESERVOIR 512
+
+/* The synth history: All decoders work on the rawbuffs, most of them aligned. */
+static unsigned char *state_synth(mpg123_handle *mh, size_t *size)
+{
+	if(mh->rawbuffs == NULL)
+	{
+		*size = 0;
+		return NULL;
+	}
+	*size = mh->rawbuffss-15;
+#if defined(OPT_I486) || defined(OPT_ALTIVEC)
+	if(mh->cpu_opts.type == ivier || mh->cpu_opts.type == altivec)
+		return mh->rawbuffs;
+#endif
+	return (unsigned char*)mh->real_buffs[0][0];
+}
+
+static size_t state_hybrid_size(mpg123_handle *mh)
+{
+#ifndef NO_LAYER3
+	if(mh->layer3.hybrid_block != NULL)
+		return sizeof(real)*2*2*SBLIMIT*SSLIMIT;
+#endif
+	return 0;
+}
+
+/* The decoder setup the stored state fits to. */
+struct state_setup
+{
+	uint64_t dectype, channels, encoding, down_sample;
+	int64_t rate;
+	size_t synthsize, hybridsize, outputsize;
+};
+
+static int state_setup_match(mpg123_handle *mh, struct state_setup *ss)
+{
+	size_t synthsize;
+	state_synth(mh, &synthsize);
+	return ss->dectype == (uint64_t)mh->cpu_opts.type
+	&&	ss->rate == (int64_t)mh->af.rate
+	&&	ss->channels == (uint64_t)mh->af.channels
+	&&	ss->encoding == (uint64_t)mh->af.encoding
+	&&	ss->down_sample == (uint64_t)mh->down_sample
+	&&	ss->synthsize == synthsize
+	&&	(!ss->hybridsize || ss->hybridsize == state_hybrid_size(mh))
+	&&	ss->outputsize <= mh->buffer.size;
+}
+
+static size_t state_put_block(unsigned char *buf, const void *data, size_t size)
+{
+	size_t n = fi_put_uvar(buf, (uint64_t)size);
+	if(size)
+		memcpy(buf+n, data, size);
+	return n+size;
+}
+
+static size_t state_get_block( const unsigned char *buf, size_t size
+,	const unsigned char **data, size_t *len )
+{
+	uint64_t val;
+	size_t n = fi_get_uvar(buf, size, &val);
+	if(!n || val > size-n)
+		return 0;
+	*data = buf+n;
+	*len  = (size_t)val;
+	return n+*len;
+}
+
+int attribute_align_arg mpg123_state_save(mpg123_handle *mh, unsigned char **blob, size_t *size)
+{
+	unsigned char *buf, *synth;
+	const unsigned char *reservoir = NULL;
+	const unsigned char *bsend;
+	size_t n, synthsize, hybridsize, pending = 0;
+	off_t pos, num, playnum;
+	int framesize;
+	int b;
+
+	if(mh == NULL) return MPG123_BAD_HANDLE;
+	if(blob == NULL || size == NULL)
+	{
+		mh->err = MPG123_ERR_NULL;
+		return MPG123_ERR;
+	}
+	*blob = NULL;
+	*size = 0;
+	b = init_track(mh);
+	if(b < 0) return b;
+	/* The decoder would be updated (and the synth history reset) before
+	   decoding the next frame, anyway. */
+	if(mh->decoder_change && decode_update(mh) < 0)
+		return MPG123_ERR;
+	pos = mh->rd->tell(mh);
+	if(pos < 0)
+	{
+		mh->err = MPG123_ERR_READER;
+		return MPG123_ERR;
+	}
+	if(mh->to_decode || mh->to_ignore)
+	{
+		/* The current frame is still to be decoded (or ignored after a seek):
+		   Store the state before it and let it be read again. */
+		pos -= mh->framesize+4;
+		num = mh->num-1;
+		playnum = mh->playnum-1;
+		framesize = mh->fsizeold;
+		if(mh->lay == 3)
+			reservoir = mh->bsbufold + framesize - STATE_RESERVOIR;
+	}
+	else
+	{
+		num = mh->num;
+		playnum = mh->playnum;
+		framesize = mh->framesize;
+		if(mh->lay == 3)
+			reservoir = mh->bsbuf + framesize - STATE_RESERVOIR;
+		pending = mh->buffer.fill;
+	}
+	/* Before the first frame, there is no reservoir in bsspace. */
+	bsend = mh->bsspace[1] + sizeof(mh->bsspace[1]);
+	if( reservoir != NULL && (reservoir < mh->bsspace[0]
+	||	reservoir > bsend - STATE_RESERVOIR) )
+		reservoir = NULL;
+	synth = state_synth(mh, &synthsize);
+	hybridsize = mh->lay == 3 ? state_hybrid_size(mh) : 0;
+
+	buf = malloc( STATE_BLOB_HEAD + 4*FI_VARINT_MAX
+	+	(reservoir ? STATE_RESERVOIR : 0) + hybridsize + synthsize + pending + 4 );
+	if(buf == NULL)
+	{
+		mh->err = MPG123_OUT_OF_MEM;
+		return MPG123_ERR;
+	}
+	memcpy(buf, STATE_BLOB_MAGIC, 4);
+	n = 4;
+	buf[n++] = STATE_BLOB_VERSION;
+	n += fi_put_svar(buf+n, (int64_t)mh->rdat.filelen);
+	n += fi_put_svar(buf+n, (int64_t)mh->audio_start);
+	n += fi_put_uvar(buf+n, (uint64_t)mh->firsthead);
+	n += fi_put_uvar(buf+n, (uint64_t)mh->cpu_opts.type);
+	n += fi_put_svar(buf+n, (int64_t)mh->af.rate);
+	n += fi_put_uvar(buf+n, (uint64_t)mh->af.channels);
+	n += fi_put_uvar(buf+n, (uint64_t)mh->af.encoding);
+	n += fi_put_uvar(buf+n, (uint64_t)mh->down_sample);
+	n += fi_put_svar(buf+n, (int64_t)pos);
+	n += fi_put_svar(buf+n, (int64_t)num);
+	n += fi_put_svar(buf+n, (int64_t)playnum);
+	n += fi_put_svar(buf+n, (int64_t)mh->firstframe);
+	n += fi_put_svar(buf+n, (int64_t)mh->ignoreframe);
+#ifdef GAPLESS
+	n += fi_put_svar(buf+n, (int64_t)mh->firstoff);
+#else
+	n += fi_put_svar(buf+n, 0);
+#endif
+	n += fi_put_uvar(buf+n, (uint64_t)mh->oldhead);
+	n += fi_put_uvar(buf+n, (uint64_t)framesize);
+	n += fi_put_svar(buf+n, (int64_t)mh->freeformat_framesize);
+	n += fi_put_uvar(buf+n, (uint64_t)mh->bitreservoir);
+	n += fi_put_uvar(buf+n, (uint64_t)mh->hybrid_blc[0]);
+	n += fi_put_uvar(buf+n, (uint64_t)mh->hybrid_blc[1]);
+	n += fi_put_uvar(buf+n, (uint64_t)mh->bo);
+#ifdef OPT_I486
+	n += fi_put_uvar(buf+n, (uint64_t)mh->i486bo[0]);
+	n += fi_put_uvar(buf+n, (uint64_t)mh->i486bo[1]);
+#else
+	n += fi_put_uvar(buf+n, 0);
+	n += fi_put_uvar(buf+n, 0);
+#endif
+#ifndef NO_NTOM
+	n += fi_put_uvar(buf+n, (uint64_t)mh->ntom_val[0]);
+	n += fi_put_uvar(buf+n, (uint64_t)mh->ntom_val[1]);
+#else
+	n += fi_put_uvar(buf+n, 0);
+	n += fi_put_uvar(buf+n, 0);
+#endif
+#ifdef OPT_DITHER
+	n += fi_put_uvar(buf+n, (uint64_t)mh->ditherindex);
+#else
+	n += fi_put_uvar(buf+n, 0);
+#endif
+	n += state_put_block(buf+n, reservoir, reservoir ? STATE_RESERVOIR : 0);
+#ifndef NO_LAYER3
+	n += state_put_block(buf+n, mh->layer3.hybrid_block, hybridsize);
+#else
+	n += state_put_block(buf+n, NULL, 0);
+#endif
+	n += state_put_block(buf+n, synth, synthsize);
+	n += state_put_block(buf+n, mh->buffer.p, pending);
+	blob_put_sum(buf, n);
+	*blob = buf;
+	*size = n+4;
+	return MPG123_OK;
+}
+
+int attribute_align_arg mpg123_state_restore(mpg123_handle *mh, const unsigned char *blob, size_t size)
+{
+	int64_t filelen, audio_start, pos, num, playnum;
+	int64_t firstframe, ignoreframe, firstoff, freeformat_framesize;
+	uint64_t firsthead, head, framesize, bitreservoir;
+	uint64_t blc[2], bo[3], ntom[2], dither;
+	struct state_setup ss;
+	const unsigned char *reservoir, *hybrid, *synth, *output;
+	size_t reservoirsize, n, m;
+	int b;
+
+	if(mh == NULL) return MPG123_BAD_HANDLE;
+	if(blob == NULL)
+	{
+		mh->err = MPG123_ERR_NULL;
+		return MPG123_ERR;
+	}
+	b = init_track(mh);
+	if(b < 0) return b;
+	if( size < 4+1+4 || memcmp(blob, STATE_BLOB_MAGIC, 4)
+	||	blob[4] != STATE_BLOB_VERSION || !(size = blob_check_sum(blob, size)) )
+		goto state_restore_bad;
+	n = 5;
+#define STATE_GET(type, var) \
+	if(!(m = fi_get_##type(blob+n, size-n, &var))) goto state_restore_bad; \
+	n += m;
+#define STATE_BLOCK(var, len) \
+	if(!(m = state_get_block(blob+n, size-n, &var, &len))) goto state_restore_bad; \
+	n += m;
+	STATE_GET(svar, filelen)
+	STATE_GET(svar, audio_start)
+	STATE_GET(uvar, firsthead)
+	STATE_GET(uvar, ss.dectype)
+	STATE_GET(svar, ss.rate)
+	STATE_GET(uvar, ss.channels)
+	STATE_GET(uvar, ss.encoding)
+	STATE_GET(uvar, ss.down_sample)
+	STATE_GET(svar, pos)
+	STATE_GET(svar, num)
+	STATE_GET(svar, playnum)
+	STATE_GET(svar, firstframe)
+	STATE_GET(svar, ignoreframe)
+	STATE_GET(svar, firstoff)
+	STATE_GET(uvar, head)
+	STATE_GET(uvar, framesize)
+	STATE_GET(svar, freeformat_framesize)
+	STATE_GET(uvar, bitreservoir)
+	STATE_GET(uvar, blc[0])
+	STATE_GET(uvar, blc[1])
+	STATE_GET(uvar, bo[0])
+	STATE_GET(uvar, bo[1])
+	STATE_GET(uvar, bo[2])
+	STATE_GET(uvar, ntom[0])
+	STATE_GET(uvar, ntom[1])
+	STATE_GET(uvar, dither)
+	STATE_BLOCK(reservoir, reservoirsize)
+	STATE_BLOCK(hybrid, ss.hybridsize)
+	STATE_BLOCK(synth, ss.synthsize)
+	STATE_BLOCK(output, ss.outputsize)
+#undef STATE_BLOCK
+#undef STATE_GET
+	/* Only accept data for the very same stream, with sane values. */
+	if( n != size || filelen != (int64_t)mh->rdat.filelen
+	||	audio_start != (int64_t)mh->audio_start
+	||	firsthead != (uint64_t)mh->firsthead
+	||	pos < 0 || (int64_t)(off_t)pos != pos || num < -1
+	||	(int64_t)(off_t)num != num || (int64_t)(off_t)playnum != playnum
+	||	(int64_t)(off_t)firstframe != firstframe
+	||	(int64_t)(off_t)ignoreframe != ignoreframe
+	||	(int64_t)(off_t)firstoff != firstoff
+	||	head > 0xffffffffUL || framesize > MAXFRAMESIZE
+	||	freeformat_framesize > MAXFRAMESIZE || bitreservoir > 511
+	||	blc[0] > 1 || blc[1] > 1 || bo[0] > 15 || bo[1] > 15 || bo[2] > 15
+	||	ntom[0] > ULONG_MAX || ntom[1] > ULONG_MAX
+	||	(reservoirsize && reservoirsize != STATE_RESERVOIR) )
+		goto state_restore_bad;
+#ifdef OPT_DITHER
+	if(dither >= DITHERSIZE)
+		goto state_restore_bad;
+#endif
+	/* Without a change of the decoder, it can be checked before touching
+	   anything. Otherwise, only after the decoder update. */
+	if( !mh->decoder_change && head_compatible(mh->oldhead, (unsigned long)head)
+	&&	!state_setup_match(mh, &ss) )
+		goto state_restore_bad;
+
+	/* Now change the handle, beginning with the input. */
+	if(reader_set_pos(mh, (off_t)pos) < 0)
+		return MPG123_ERR;
+	if(freeformat_framesize >= 0)
+		mh->freeformat_framesize = (long)freeformat_framesize;
+	if(!restore_header(mh, (unsigned long)head))
+		goto state_restore_bad;
+	if(mh->header_change > 1 || mh->decoder_change)
+	{
+		if(decode_update(mh) < 0)
+			return MPG123_ERR;
+		if(!state_setup_match(mh, &ss))
+			goto state_restore_bad;
+	}
+	mh->header_change = 0;
+
+	mh->num = (off_t)num;
+	mh->playnum = (off_t)playnum;
+	mh->firstframe = (off_t)firstframe;
+	mh->ignoreframe = (off_t)ignoreframe;
+#ifdef GAPLESS
+	mh->firstoff = (off_t)firstoff;
+#endif
+	mh->framesize = (int)framesize;
+	mh->halfphase = 0;
+	/* The next frame is read after this one. */
+	mh->bsbuf = mh->bsspace[(mh->bsnum+1)&1]+512;
+	mh->bsref = FALSE;
+	if(reservoirsize)
+		memcpy(mh->bsbuf+mh->framesize-STATE_RESERVOIR, reservoir, reservoirsize);
+	mh->bitreservoir = (unsigned int)bitreservoir;
+	mh->hybrid_blc[0] = (int)blc[0];
+	mh->hybrid_blc[1] = (int)blc[1];
+#ifndef NO_LAYER3
+	if(ss.hybridsize)
+		memcpy(mh->layer3.hybrid_block, hybrid, ss.hybridsize);
+#endif
+	if(ss.synthsize)
+		memcpy(state_synth(mh, &n), synth, ss.synthsize);
+	mh->bo = (int)bo[0];
+#ifdef OPT_I486
+	mh->i486bo[0] = (int)bo[1];
+	mh->i486bo[1] = (int)bo[2];
+#endif
+#ifndef NO_NTOM
+	mh->ntom_val[0] = (unsigned long)ntom[0];
+	mh->ntom_val[1] = (unsigned long)ntom[1];
+#endif
+#ifdef OPT_DITHER
+	mh->ditherindex = (int)dither;
+#endif
+	mh->to_decode = mh->to_ignore = FALSE;
+	if(ss.outputsize)
+		memcpy(mh->buffer.data, output, ss.outputsize);
+	mh->buffer.p = mh->buffer.data;
+	mh->buffer.fill = ss.outputsize;
+	return MPG123_OK;
+state_restore_bad:
+	mh->err = MPG123_STATE_MISMATCH;
+	return MPG123_ERR;
+}
+
 int attribute_align_arg mpg123_close(mpg123_handle *mh)
 {
 	if(mh == NULL) return MPG123_BAD_HANDLE;
@@ -1672,6 +2721,155 @@ void attribute_align_arg mpg123_free(void *ptr)
 	free(ptr);
 }
 
+int attribute_align_arg mpg123_reset_handle(mpg123_handle *mh, mpg123_pars *mp)
+{
+	if(mh == NULL) return MPG123_BAD_HANDLE;
+	mpg123_close(mh);
+	frame_reuse(mh, mp);
+	return MPG123_OK;
+}
+
+struct mpg123_handle_pool_struct
+{
+	mpg123_pars *p;      /* parameters applied to each handle on release */
+	char *decoder;       /* decoder choice, NULL for default */
+	enum optdec type;    /* the decoder that choice resolved to, once known */
+	size_t size;         /* maximum number of idle handles */
+	size_t fill;         /* current number of idle handles */
+	mpg123_handle **idle;
+};
+
+/* A fresh handle for the pool, with decoder buffers allocated up front. */
+static mpg123_handle *pool_handle( mpg123_handle_pool *pool
+,	const char *decoder, int *error )
+{
+	int err = MPG123_OK;
+	mpg123_handle *mh = mpg123_parnew(pool->p, decoder, &err);
+	if(mh != NULL && frame_prealloc(mh))
+	{
+		mpg123_delete(mh);
+		mh = NULL;
+		err = MPG123_OUT_OF_MEM;
+	}
+	if(mh != NULL && pool->type == autodec && decoder == pool->decoder)
+		pool->type = mh->cpu_opts.type;
+	if(error != NULL) *error = err;
+	return mh;
+}
+
+mpg123_handle_pool attribute_align_arg *mpg123_new_pool( mpg123_pars *mp
+,	const char *decoder, size_t count, int *error )
+{
+	mpg123_handle_pool *pool = NULL;
+	int err = MPG123_OK;
+
+	if(!initialized)
+		err = MPG123_NOT_INITIALIZED;
+	else if(dectype(decoder) == nodec)
+		err = MPG123_BAD_DECODER;
+	else if(!(pool = malloc(sizeof(mpg123_handle_pool))))
+		err = MPG123_OUT_OF_MEM;
+	if(pool != NULL)
+	{
+		pool->p = mpg123_new_pars(&err);
+		pool->decoder = decoder ? compat_strdup(decoder) : NULL;
+		pool->type = dectype(decoder);
+		pool->size = count;
+		pool->fill = 0;
+		pool->idle = count ? malloc(count*sizeof(mpg123_handle*)) : NULL;
+		if( pool->p == NULL || (decoder && !pool->decoder)
+		||	(count && !pool->idle) )
+		{
+			mpg123_delete_pool(pool);
+			pool = NULL;
+			err = MPG123_OUT_OF_MEM;
+		}
+	}
+	if(pool != NULL && mp != NULL)
+		memcpy(pool->p, mp, sizeof(mpg123_pars));
+	/* Warm up the pool. */
+	while(pool != NULL && pool->fill < pool->size)
+	{
+		mpg123_handle *mh = pool_handle(pool, pool->decoder, &err);
+		if(mh == NULL)
+		{
+			mpg123_delete_pool(pool);
+			pool = NULL;
+		}
+		else
+			pool->idle[pool->fill++] = mh;
+	}
+	if(error != NULL) *error = err;
+	return pool;
+}
+
+void attribute_align_arg mpg123_delete_pool(mpg123_handle_pool *pool)
+{
+	if(pool == NULL)
+		return;
+	while(pool->fill)
+		mpg123_delete(pool->idle[--pool->fill]);
+	free(pool->idle);
+	mpg123_delete_pars(pool->p);
+	free(pool->decoder);
+	free(pool);
+}
+
+mpg123_handle attribute_align_arg *mpg123_pool_acquire( mpg123_handle_pool *pool
+,	const char *decoder, int *error )
+{
+	mpg123_handle *mh;
+	enum optdec want;
+	size_t i;
+
+	if(pool == NULL)
+	{
+		if(error != NULL) *error = MPG123_BAD_HANDLE;
+		return NULL;
+	}
+	if(decoder == NULL)
+		decoder = pool->decoder;
+	want = dectype(decoder);
+	if(want == nodec)
+	{
+		if(error != NULL) *error = MPG123_BAD_DECODER;
+		return NULL;
+	}
+	if(want == autodec)
+		want = pool->type;
+	if(!pool->fill)
+		return pool_handle(pool, decoder, error);
+	/* Prefer the most recently released handle with the wanted decoder,
+	   so that nothing needs to be rebuilt. */
+	for(i=pool->fill; i>0; --i)
+		if(pool->idle[i-1]->cpu_opts.type == want)
+			break;
+	if(i == 0)
+		i = pool->fill;
+	mh = pool->idle[i-1];
+	pool->idle[i-1] = pool->idle[--pool->fill];
+	if(mh->cpu_opts.type != want && mpg123_decoder(mh, decoder) != MPG123_OK)
+	{
+		if(error != NULL) *error = mh->err;
+		mpg123_delete(mh);
+		return NULL;
+	}
+	if(error != NULL) *error = MPG123_OK;
+	return mh;
+}
+
+int attribute_align_arg mpg123_pool_release(mpg123_handle_pool *pool, mpg123_handle *mh)
+{
+	if(pool == NULL || mh == NULL)
+		return MPG123_BAD_HANDLE;
+	mpg123_reset_handle(mh, pool->p);
+	if(pool->fill < pool->size)
+		pool->idle[pool->fill++] = mh;
+	else
+		mpg123_delete(mh);
+	return MPG123_OK;
+}
+
 static const char *mpg123_error[] =
 {
 	"No error... (code 0)",
@@ -1718,6 +2916,8 @@ static const char *mpg123_error[] =
 	,"Custom I/O obviously not prepared."
 	,"Overflow in LFS (large file support) conversion."
 	,"Overflow in integer conversion."
+	,"Stored frame index data invalid or not matching the stream."
+	,"Stored decoder state invalid or not matching the stream or decoder setup."
 };
 
 const char* attribute_align_arg mpg123_plain_strerror(int errcode)
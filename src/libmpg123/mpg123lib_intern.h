@@ -285,6 +285,7 @@ static inline int32_t scale_rounded(int32_t x, int shift)
 #include "decode.h"
 #include "parse.h"
 #include "frame.h"
+#include "stats.h"
 
 /* fr is a mpg123_handle* by convention here... */
 #define NOQUIET  (!(fr->p.flags & MPG123_QUIET))
@@ -76,6 +76,119 @@ static int synth_stereo_wrap(real *bandPtr_l, real *bandPtr_r, mpg123_handle *fr
 	return clip;
 }
 
+/* Planar output (see mpg123_read_planar()): While fr->planar.plane[] is set,
+   the channels go to separate buffers, each at half the fill of the frame
+   buffer. The generic 1to1 synths have variants writing there directly.
+   For all others, notably the optimized stereo synths, the interleaved
+   output of one synth call goes to a scratch block which is then split
+   right away, while it is still in cache. */
+static int synth_stereo_planar(real *bandPtr_l, real *bandPtr_r, mpg123_handle *fr)
+{
+	int clip;
+	clip  = (fr->planar.synth)(bandPtr_l, 0, fr, 0);
+	clip += (fr->planar.synth)(bandPtr_r, 1, fr, 1);
+	return clip;
+}
+
+static int synth_m2s_planar(real *bandPtr, mpg123_handle *fr)
+{
+	int clip;
+	size_t pnt = fr->buffer.fill/2;
+
+	clip = (fr->planar.synth)(bandPtr, 0, fr, 1);
+	memcpy(fr->planar.plane[1]+pnt, fr->planar.plane[0]+pnt, fr->buffer.fill/2-pnt);
+	return clip;
+}
+
+/* Move the scratch contents, fr->buffer.fill bytes, to the planes at <pnt>. */
+static void planar_split(mpg123_handle *fr, size_t pnt)
+{
+	unsigned char *in = (unsigned char*)fr->planar.scratch;
+	unsigned char *out0 = fr->planar.plane[0]+pnt/2;
+	unsigned char *out1 = fr->planar.plane[1]+pnt/2;
+	size_t count = fr->buffer.fill/(2*fr->af.dec_encsize);
+	size_t i;
+
+#define PLANAR_SPLIT(size) \
+	for(i=0; i<count; ++i) \
+	{ \
+		memcpy(out0, in, size); \
+		memcpy(out1, in+size, size); \
+		in += 2*size; \
+		out0 += size; \
+		out1 += size; \
+	}
+	switch(fr->af.dec_encsize)
+	{
+		case 1: PLANAR_SPLIT(1) break;
+		case 2: PLANAR_SPLIT(2) break;
+		case 4: PLANAR_SPLIT(4) break;
+		case 8: PLANAR_SPLIT(8) break;
+	}
+#undef PLANAR_SPLIT
+	fr->buffer.fill += pnt;
+}
+
+static int synth_stereo_split(real *bandPtr_l, real *bandPtr_r, mpg123_handle *fr)
+{
+	int clip;
+	unsigned char *samples = fr->buffer.data;
+	size_t pnt = fr->buffer.fill;
+
+	fr->buffer.data = (unsigned char*) fr->planar.scratch;
+	fr->buffer.fill = 0;
+	clip = (fr->planar.stereo)(bandPtr_l, bandPtr_r, fr);
+	fr->buffer.data = samples;
+	planar_split(fr, pnt);
+	return clip;
+}
+
+static int synth_m2s_split(real *bandPtr, mpg123_handle *fr)
+{
+	int clip;
+	unsigned char *samples = fr->buffer.data;
+	size_t pnt = fr->buffer.fill;
+
+	fr->buffer.data = (unsigned char*) fr->planar.scratch;
+	fr->buffer.fill = 0;
+	clip = (fr->planar.mono)(bandPtr, fr);
+	fr->buffer.data = samples;
+	planar_split(fr, pnt);
+	return clip;
+}
+
+void synth_planar(mpg123_handle *fr, unsigned char **plane)
+{
+	if(plane != NULL)
+	{
+		fr->planar.plane[0] = plane[0];
+		fr->planar.plane[1] = plane[1];
+		fr->planar.keep_stereo = fr->synth_stereo;
+		fr->planar.keep_mono   = fr->synth_mono;
+		fr->planar.keep_stats_stereo = fr->stats.real_synth_stereo;
+		fr->planar.keep_stats_mono   = fr->stats.real_synth_mono;
+		if(fr->planar.synth)
+		{
+			fr->synth_stereo = synth_stereo_planar;
+			fr->synth_mono   = synth_m2s_planar;
+		}
+		else
+		{
+			fr->synth_stereo = synth_stereo_split;
+			fr->synth_mono   = synth_m2s_split;
+		}
+		if(STATS_ON(fr)) stats_wrap_synth(fr);
+	}
+	else
+	{
+		fr->planar.plane[0] = fr->planar.plane[1] = NULL;
+		fr->synth_stereo = fr->planar.keep_stereo;
+		fr->synth_mono   = fr->planar.keep_mono;
+		fr->stats.real_synth_stereo = fr->planar.keep_stats_stereo;
+		fr->stats.real_synth_mono   = fr->planar.keep_stats_mono;
+	}
+}
+
 static const struct synth_s synth_base =
 {
 	{ /* plain */
@@ -420,6 +533,26 @@ int set_synth_functions(mpg123_handle *fr)
 	fr->synth_mono = fr->af.channels==2
 		? fr->synths.mono2stereo[resample][basic_format] /* Mono MPEG file decoded to stereo. */
 		: fr->synths.mono[resample][basic_format];       /* Mono MPEG file decoded to mono. */
+	fr->planar.stereo = fr->synth_stereo;
+	fr->planar.mono   = fr->synth_mono;
+	fr->planar.synth  = NULL;
+	if(resample == r_1to1)
+	{
+#ifndef NO_16BIT
+		if(fr->synth == synth_1to1)
+			fr->planar.synth = synth_1to1_planar;
+#endif
+#ifndef NO_SYNTH32
+#	ifndef NO_REAL
+		if(fr->synth == synth_1to1_real)
+			fr->planar.synth = synth_1to1_real_planar;
+#	endif
+#	ifndef NO_32BIT
+		if(fr->synth == synth_1to1_s32)
+			fr->planar.synth = synth_1to1_s32_planar;
+#	endif
+#endif
+	}
 
 	if(find_dectype(fr) != MPG123_OK) /* Actually determine the currently active decoder breed. */
 	{
@@ -467,11 +600,14 @@ int set_synth_functions(mpg123_handle *fr)
 #	endif
 	  )
 	{
+		enum table_variant variant = fr->p.down_sample
+		?	tables_mmx_down
+		:	tables_mmx;
 #ifndef NO_LAYER3
-		init_layer3_stuff(fr, init_layer3_gainpow2_mmx);
+		init_layer3_stuff(fr, variant);
 #endif
 #ifndef NO_LAYER12
-		init_layer12_stuff(fr, init_layer12_table_mmx);
+		init_layer12_stuff(fr, variant);
 #endif
 		fr->make_decode_tables = make_decode_tables_mmx;
 	}
@@ -479,10 +615,10 @@ int set_synth_functions(mpg123_handle *fr)
 #endif
 	{
 #ifndef NO_LAYER3
-		init_layer3_stuff(fr, init_layer3_gainpow2);
+		init_layer3_stuff(fr, tables_plain);
 #endif
 #ifndef NO_LAYER12
-		init_layer12_stuff(fr, init_layer12_table);
+		init_layer12_stuff(fr, tables_plain);
 #endif
 		fr->make_decode_tables = make_decode_tables;
 	}
@@ -524,6 +660,10 @@ int frame_cpu_opt(mpg123_handle *fr, const char* cpu)
 #if (defined OPT_3DNOW_VINTAGE || defined OPT_3DNOWEXT_VINTAGE || defined OPT_SSE || defined OPT_X86_64 || defined OPT_AVX || defined OPT_NEON || defined OPT_NEON64)
 	fr->cpu_opts.the_dct36 = dct36;
 #endif
+#if (defined OPT_X86_64 || defined OPT_AVX)
+	fr->cpu_opts.the_antialias = antialias;
+	fr->cpu_opts.the_midside = midside;
+#endif
 #endif
 #endif
 	/* covers any i386+ cpu; they actually differ only in the synth_1to1 function, mostly... */
@@ -742,6 +882,8 @@ int frame_cpu_opt(mpg123_handle *fr, const char* cpu)
 #ifdef OPT_MULTI
 #		ifndef NO_LAYER3
 		fr->cpu_opts.the_dct36 = dct36_avx;
+		fr->cpu_opts.the_antialias = antialias_avx;
+		fr->cpu_opts.the_midside = midside_avx;
 #		endif
 #endif
 #		ifndef NO_16BIT
@@ -768,6 +910,8 @@ int frame_cpu_opt(mpg123_handle *fr, const char* cpu)
 #ifdef OPT_MULTI
 #		ifndef NO_LAYER3
 		fr->cpu_opts.the_dct36 = dct36_x86_64;
+		fr->cpu_opts.the_antialias = antialias_x86_64;
+		fr->cpu_opts.the_midside = midside_x86_64;
 #		endif
 #endif
 #		ifndef NO_16BIT
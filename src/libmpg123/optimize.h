@@ -169,6 +169,8 @@ enum optcla { nocla=0, normal, mmxsse };
 int frame_cpu_opt(mpg123_handle *fr, const char* cpu);
 /*  - Choose, from the synth table, the synth functions to use for current output format/rate. */
 int set_synth_functions(mpg123_handle *fr);
+/*  - Switch the stereo synths to writing separate channel buffers (or back with NULL). */
+void synth_planar(mpg123_handle *fr, unsigned char **plane);
 /*  - Parse decoder name and return numerical code. */
 enum optdec dectype(const char* decoder);
 /*  - Return the default decoder type. */
@@ -331,6 +333,8 @@ extern const int costab_mmxsse[];
 #ifndef OPT_MULTI
 #	define defopt x86_64
 #	define opt_dct36(fr) dct36_x86_64
+#	define opt_antialias(fr) antialias_x86_64
+#	define opt_midside(fr) midside_x86_64
 #endif
 #endif
 
@@ -339,6 +343,8 @@ extern const int costab_mmxsse[];
 #ifndef OPT_MULTI
 #	define defopt avx
 #	define opt_dct36(fr) dct36_avx
+#	define opt_antialias(fr) antialias_avx
+#	define opt_midside(fr) midside_avx
 #endif
 #endif
 
@@ -380,12 +386,22 @@ void check_decoders(void);
 #	if (defined OPT_3DNOW_VINTAGE || defined OPT_3DNOWEXT_VINTAGE || defined OPT_SSE || defined OPT_X86_64 || defined OPT_AVX || defined OPT_NEON || defined OPT_NEON64)
 #		define opt_dct36(fr) ((fr)->cpu_opts.the_dct36)
 #	endif
+#	if (defined OPT_X86_64 || defined OPT_AVX)
+#		define opt_antialias(fr) ((fr)->cpu_opts.the_antialias)
+#		define opt_midside(fr) ((fr)->cpu_opts.the_midside)
+#	endif
 
 #endif /* OPT_MULTI else */
 
 #	ifndef opt_dct36
 #		define opt_dct36(fr) dct36
 #	endif
+#	ifndef opt_antialias
+#		define opt_antialias(fr) antialias
+#	endif
+#	ifndef opt_midside
+#		define opt_midside(fr) midside
+#	endif
 
 #endif /* MPG123_H_OPTIMIZE */
 
@@ -0,0 +1,250 @@
+/*
+	parallel: decoding of one seekable stream on multiple handles at once
+
+	copyright 2020 by the mpg123 project
+	-= free software under the terms of the LGPL 2.1 =-
+	see COPYING and AUTHORS files in distribution or http://mpg123.org
+
+	The idea is simple: After one scan of the stream, the frame index tells
+	where each frame is. The output is divided into contiguous sample ranges
+	and each handle seeks to the start of its range. The usual seek machinery
+	(ignoreframe, MPG123_PREFRAMES) takes care of priming the bit reservoir
+	and the synth/overlap-add state, so each range decodes exactly like the
+	corresponding part of a sequential decode and the pieces can just be
+	placed next to each other in the output memory.
+*/
+
+#include "mpg123lib_intern.h"
+#ifdef HAVE_PTHREAD
+#include <pthread.h>
+#endif
+
+#include "debug.h"
+
+/* Do not bother splitting up less than this many MPEG frames per handle.
+   The priming of each range costs a few frames, after all. */
+#define PARALLEL_MIN_FRAMES 32
+
+struct parallel_job
+{
+	mpg123_handle *mh;
+	off_t begin; /* output sample offset */
+	unsigned char *out;
+	size_t size;
+	size_t done;
+	int ret;
+};
+
+/* Decode one range. Stops at end of range, end of track or any trouble. */
+static void *parallel_work(void *arg)
+{
+	struct parallel_job *job = arg;
+	off_t pos;
+
+	job->done = 0;
+	job->ret = MPG123_OK;
+	pos = mpg123_seek(job->mh, job->begin, SEEK_SET);
+	if(pos != job->begin)
+	{
+		job->ret = pos < 0 ? (int)pos : MPG123_ERR;
+		if(pos >= 0) job->mh->err = MPG123_BAD_INDEX_PAR;
+		return NULL;
+	}
+	while(job->done < job->size)
+	{
+		size_t got = 0;
+		int ret = mpg123_read( job->mh
+		,	job->out+job->done, job->size-job->done, &got );
+		job->done += got;
+		if(ret == MPG123_OK) continue;
+		/* A format change in the middle is nothing we can represent. */
+		job->ret = ret == MPG123_NEW_FORMAT ? MPG123_ERR : ret;
+		if(ret == MPG123_NEW_FORMAT) job->mh->err = MPG123_BAD_OUTFORMAT;
+		break;
+	}
+	return NULL;
+}
+
+/* Repeated calls should not scan the whole stream again. If the index
+   covers all frames of the known track length, a scan happened already. */
+static int parallel_scanned(mpg123_handle *mh)
+{
+#ifdef FRAME_INDEX
+	return mh->track_frames > 0 && mh->index.fill > 0
+	&&	mh->index.next >= mh->track_frames;
+#else
+	return 0;
+#endif
+}
+
+/* Bring the helper handles to the same knowledge about the track as the
+   first one, which has been scanned. */
+static int parallel_prepare(mpg123_handle **mh, int count)
+{
+	long rate, rate0;
+	int channels, channels0, encoding, encoding0;
+	int i;
+
+	if(mpg123_getformat(mh[0], &rate0, &channels0, &encoding0) != MPG123_OK)
+		return MPG123_ERR;
+	for(i=1; i<count; ++i)
+	{
+		if(!(mh[i]->rdat.flags & READER_SEEKABLE))
+		{
+			mh[i]->err = MPG123_NO_SEEK;
+			return MPG123_ERR;
+		}
+		if(mpg123_getformat(mh[i], &rate, &channels, &encoding) != MPG123_OK)
+		{
+			mh[0]->err = mh[i]->err;
+			return MPG123_ERR;
+		}
+		if(rate != rate0 || channels != channels0 || encoding != encoding0)
+		{
+			mh[0]->err = MPG123_BAD_OUTFORMAT;
+			return MPG123_ERR;
+		}
+#ifdef FRAME_INDEX
+		if(fi_copy(&mh[i]->index, &mh[0]->index) == -1)
+		{
+			mh[0]->err = MPG123_OUT_OF_MEM;
+			return MPG123_ERR;
+		}
+#endif
+		mh[i]->track_frames  = mh[0]->track_frames;
+		mh[i]->track_samples = mh[0]->track_samples;
+#ifdef GAPLESS
+		if(mh[i]->p.flags & MPG123_GAPLESS)
+			frame_gapless_update(mh[i], mh[i]->track_samples);
+#endif
+	}
+	return MPG123_OK;
+}
+
+int attribute_align_arg mpg123_decode_parallel( mpg123_handle **mh, int count
+,	unsigned char *outmemory, size_t outmemsize, size_t *done )
+{
+	struct parallel_job *job;
+	off_t begin, length, samples;
+	size_t framesize;
+	size_t total = 0;
+	int jobs, i;
+	int ret = MPG123_OK;
+#ifdef HAVE_PTHREAD
+	pthread_t *thread;
+	int *running;
+#endif
+
+	if(done != NULL) *done = 0;
+	if(mh == NULL || count < 1 || mh[0] == NULL) return MPG123_BAD_HANDLE;
+	for(i=1; i<count; ++i)
+		if(mh[i] == NULL || mh[i] == mh[0])
+		{
+			mh[0]->err = MPG123_BAD_HANDLE;
+			return MPG123_ERR;
+		}
+	if(outmemsize && outmemory == NULL)
+	{
+		mh[0]->err = MPG123_NULL_BUFFER;
+		return MPG123_ERR;
+	}
+	if(!(mh[0]->rdat.flags & READER_SEEKABLE))
+	{
+		mh[0]->err = MPG123_NO_SEEK;
+		return MPG123_ERR;
+	}
+	begin = mpg123_tell(mh[0]);
+	if(begin < 0) return MPG123_ERR;
+	/* The scan fills the index and gives the exact length to share. */
+	if(!parallel_scanned(mh[0]) && mpg123_scan(mh[0]) != MPG123_OK)
+		return MPG123_ERR;
+	length = mpg123_length(mh[0]);
+	if(length < 0) return MPG123_ERR;
+	if(begin >= length) return MPG123_DONE;
+	if(parallel_prepare(mh, count) != MPG123_OK) return MPG123_ERR;
+
+	framesize = mh[0]->af.channels * mh[0]->af.encsize;
+	samples = length-begin;
+	if((size_t)samples > outmemsize/framesize)
+		samples = (off_t)(outmemsize/framesize);
+	if(samples < 1)
+	{
+		mh[0]->err = MPG123_NO_SPACE;
+		return MPG123_ERR;
+	}
+	/* Enough work for everyone? */
+	jobs = count;
+	if(samples/jobs < PARALLEL_MIN_FRAMES*mh[0]->spf)
+		jobs = (int)(samples/(PARALLEL_MIN_FRAMES*mh[0]->spf));
+	if(jobs < 1) jobs = 1;
+	debug3("parallel decode of %"OFF_P" samples from %"OFF_P" on %i handles"
+	,	(off_p)samples, (off_p)begin, jobs);
+
+	job = malloc(sizeof(*job)*jobs);
+#ifdef HAVE_PTHREAD
+	thread  = malloc(sizeof(*thread)*jobs);
+	running = malloc(sizeof(*running)*jobs);
+	if(job == NULL || thread == NULL || running == NULL)
+	{
+		free(running);
+		free(thread);
+#else
+	if(job == NULL)
+	{
+#endif
+		free(job);
+		mh[0]->err = MPG123_OUT_OF_MEM;
+		return MPG123_ERR;
+	}
+	for(i=0; i<jobs; ++i)
+	{
+		off_t a = begin + (off_t)((double)samples*i/jobs);
+		off_t b = begin + (off_t)((double)samples*(i+1)/jobs);
+		if(i == jobs-1) b = begin+samples;
+		job[i].mh    = mh[i];
+		job[i].begin = a;
+		job[i].out   = outmemory + (size_t)(a-begin)*framesize;
+		job[i].size  = (size_t)(b-a)*framesize;
+	}
+#ifdef HAVE_PTHREAD
+	/* The first range is decoded in the calling thread. If creation of
+	   a thread fails, that range is decoded there, too. */
+	for(i=1; i<jobs; ++i)
+		running[i] = !pthread_create(thread+i, NULL, parallel_work, job+i);
+	parallel_work(job);
+	for(i=1; i<jobs; ++i)
+	{
+		if(running[i])
+			pthread_join(thread[i], NULL);
+		else
+			parallel_work(job+i);
+	}
+	free(running);
+	free(thread);
+#else
+	for(i=0; i<jobs; ++i)
+		parallel_work(job+i);
+#endif
+	/* Only report the contiguous piece that has been decoded. */
+	for(i=0; i<jobs; ++i)
+	{
+		total += job[i].done;
+		if(job[i].ret != MPG123_OK || job[i].done < job[i].size)
+		{
+			ret = job[i].ret;
+			if(ret == MPG123_ERR && i) mh[0]->err = mh[i]->err;
+			break;
+		}
+	}
+	free(job);
+	if(done != NULL) *done = total;
+	/* Leave the main handle positioned after the decoded audio. */
+	if(ret == MPG123_OK)
+	{
+		if(mpg123_seek(mh[0], begin+samples, SEEK_SET) < 0)
+			ret = MPG123_ERR;
+	}
+	else if(ret != MPG123_ERR)
+		mpg123_seek(mh[0], begin+(off_t)(total/framesize), SEEK_SET);
+	return ret;
+}
@@ -434,7 +434,7 @@ static int header_mono(unsigned long newhead)
 }
 
 /* true if the two headers will work with the same decoding routines */
-static int head_compatible(unsigned long fred, unsigned long bret)
+int head_compatible(unsigned long fred, unsigned long bret)
 {
 	return ( (fred & HDR_CMPMASK) == (bret & HDR_CMPMASK)
 		&&       header_mono(fred) == header_mono(bret)    );
@@ -474,6 +474,44 @@ static int halfspeed_do(mpg123_handle *fr)
 	return 0;
 }
 
+/* The accounting for a frame that has been found at framepos:
+   frame counter, mean frame size, frame index. */
+static void count_frame(mpg123_handle *fr, unsigned long newhead, off_t framepos)
+{
+	/* Question: How bad does the floating point value get with repeated recomputation?
+	   Also, considering that we can play the file or parts of many times. */
+	if(++fr->mean_frames != 0)
+	{
+		fr->mean_framesize = ((fr->mean_frames-1)*fr->mean_framesize+compute_bpf(fr)) / fr->mean_frames ;
+	}
+	++fr->num; /* 0 for first frame! */
+	debug4("Frame %"OFF_P" %08lx %i, next filepos=%"OFF_P, 
+	(off_p)fr->num, newhead, fr->framesize, (off_p)fr->rd->tell(fr));
+	if(!(fr->state_flags & FRAME_FRANKENSTEIN) && (
+		(fr->track_frames > 0 && fr->num >= fr->track_frames)
+#ifdef GAPLESS
+		|| (fr->gapless_frames > 0 && fr->num >= fr->gapless_frames)
+#endif
+	))
+	{
+		fr->state_flags |= FRAME_FRANKENSTEIN;
+		if(NOQUIET) fprintf(stderr, "\nWarning: Encountered more data after announced end of track (frame %"OFF_P"/%"OFF_P"). Frankenstein!\n", (off_p)fr->num, 
+#ifdef GAPLESS
+		fr->gapless_frames > 0 ? (off_p)fr->gapless_frames : 
+#endif
+		(off_p)fr->track_frames);
+	}
+
+	/* index the position */
+	fr->input_offset = framepos;
+#ifdef FRAME_INDEX
+	/* Keep track of true frame positions in our frame index.
+	   but only do so when we are sure that the frame number is accurate... */
+	if((fr->state_flags & FRAME_ACCURATE) && FI_NEXT(fr->index, fr->num))
+	fi_add(&fr->index, framepos);
+#endif
+}
+
 /* 
 	Temporary macro until we got this worked out.
 	Idea is to filter out special return values that shall trigger direct jumps to end / resync / read again. 
@@ -558,16 +596,24 @@ init_resync:
 	/* flip/init buffer for Layer 3 */
 	{
 		unsigned char *newbuf = fr->bsspace[fr->bsnum]+512;
-		/* read main data into memory */
+		int ref = FALSE;
 		debug2("read frame body of %i at %"OFF_P, fr->framesize, framepos+4);
-		if((ret=fr->rd->read_frame_body(fr,newbuf,fr->framesize))<0)
+		/* Layers I and II only read the body, they can work on the reader's
+		   memory. Layer III needs the bit reservoir in front of it. */
+		if( fr->lay != 3 && fr->rd->ref_frame_body != NULL
+		&&	fr->rd->ref_frame_body(fr, &newbuf, fr->framesize) > 0 )
+			ref = TRUE;
+		/* read main data into memory */
+		else if((ret=fr->rd->read_frame_body(fr,newbuf,fr->framesize))<0)
 		{
 			/* if failed: flip back */
 			debug("need more?");
 			goto read_frame_bad;
 		}
-		fr->bsbufold = fr->bsbuf;
+		/* A referenced body may be gone before the next frame is decoded. */
+		fr->bsbufold = fr->bsref ? fr->bsspace[(fr->bsnum+1)&1]+512 : fr->bsbuf;
 		fr->bsbuf = newbuf;
+		fr->bsref = ref;
 	}
 	fr->bsnum = (fr->bsnum + 1) & 1;
 
@@ -597,41 +643,8 @@ init_resync:
 	}
 
 	set_pointer(fr, 0, 0);
-
-	/* Question: How bad does the floating point value get with repeated recomputation?
-	   Also, considering that we can play the file or parts of many times. */
-	if(++fr->mean_frames != 0)
-	{
-		fr->mean_framesize = ((fr->mean_frames-1)*fr->mean_framesize+compute_bpf(fr)) / fr->mean_frames ;
-	}
-	++fr->num; /* 0 for first frame! */
-	debug4("Frame %"OFF_P" %08lx %i, next filepos=%"OFF_P, 
-	(off_p)fr->num, newhead, fr->framesize, (off_p)fr->rd->tell(fr));
-	if(!(fr->state_flags & FRAME_FRANKENSTEIN) && (
-		(fr->track_frames > 0 && fr->num >= fr->track_frames)
-#ifdef GAPLESS
-		|| (fr->gapless_frames > 0 && fr->num >= fr->gapless_frames)
-#endif
-	))
-	{
-		fr->state_flags |= FRAME_FRANKENSTEIN;
-		if(NOQUIET) fprintf(stderr, "\nWarning: Encountered more data after announced end of track (frame %"OFF_P"/%"OFF_P"). Frankenstein!\n", (off_p)fr->num, 
-#ifdef GAPLESS
-		fr->gapless_frames > 0 ? (off_p)fr->gapless_frames : 
-#endif
-		(off_p)fr->track_frames);
-	}
-
 	halfspeed_prepare(fr);
-
-	/* index the position */
-	fr->input_offset = framepos;
-#ifdef FRAME_INDEX
-	/* Keep track of true frame positions in our frame index.
-	   but only do so when we are sure that the frame number is accurate... */
-	if((fr->state_flags & FRAME_ACCURATE) && FI_NEXT(fr->index, fr->num))
-	fi_add(&fr->index, framepos);
-#endif
+	count_frame(fr, newhead, framepos);
 
 	if(fr->silent_resync > 0) --fr->silent_resync;
 
@@ -692,6 +705,94 @@ read_frame_bad:
 }
 
 
+/*
+	Variant of read_frame() for mpg123_scan(): Only look at the header and
+	skip over the frame body without reading it. This covers the regular case
+	of a seekable stream with a steady sequence of headers that fit the first
+	one. Anything else (tags, junk, resync, free format, truncated end, ...)
+	is handed to the full read_frame() logic, which also means that the result
+	of scanning is the same. Note that there is no frame body to decode
+	afterwards, so a seek is needed before decoding can continue.
+*/
+int scan_frame(mpg123_handle *fr)
+{
+	int freeformat_count = 0;
+	unsigned long newhead;
+	off_t framepos;
+	int ret;
+	int oldsize = fr->framesize;
+
+	if( !fr->firsthead || !fr->oldhead || fr->p.halfspeed
+	||	(fr->rdat.flags & (READER_SEEKABLE|READER_BUFFERED)) != READER_SEEKABLE
+	||	fr->rdat.filelen < 0 )
+		return read_frame(fr);
+	framepos = fr->rd->tell(fr);
+	if(framepos < 0 || framepos+4 > fr->rdat.filelen)
+		return read_frame(fr);
+	if((ret = fr->rd->head_read(fr, &newhead)) <= 0)
+	{
+		if(fr->err == MPG123_OK) fr->err = MPG123_ERR_READER;
+		return ret;
+	}
+	if( !head_check(newhead) || !head_compatible(fr->oldhead, newhead)
+	||	!(newhead & HDR_BITRATE) )
+		goto scan_frame_fallback;
+	if(decode_header(fr, newhead, &freeformat_count) != PARSE_GOOD)
+		goto scan_frame_fallback;
+	if(framepos+4+fr->framesize > fr->rdat.filelen)
+		goto scan_frame_fallback;
+	if(fr->rd->skip_bytes(fr, fr->framesize) != framepos+4+fr->framesize)
+	{
+		if(fr->err == MPG123_OK) fr->err = MPG123_ERR_READER;
+		return READER_ERROR;
+	}
+
+	fr->fsizeold = oldsize;
+	count_frame(fr, newhead, framepos);
+	if(fr->silent_resync > 0) --fr->silent_resync;
+	/* Nothing to decode here, only the header bookkeeping. */
+	fr->to_decode = fr->to_ignore = FALSE;
+	if(fr->header_change < 2)
+		fr->header_change = fr->oldhead == newhead ? 0 : 1;
+	fr->oldhead = newhead;
+	return 1;
+
+scan_frame_fallback:
+	fr->framesize = oldsize;
+	if(fr->rd->back_bytes(fr, 4) < 0)
+	{
+		if(fr->err == MPG123_OK) fr->err = MPG123_ERR_READER;
+		return READER_ERROR;
+	}
+	return read_frame(fr);
+}
+
+/*
+	Take over the header of a frame that has been read before (restored
+	decoder state) without touching the input. Free format needs a known
+	frame size. Returns 1 on success, 0 for an unusable header.
+*/
+int restore_header(mpg123_handle *fr, unsigned long newhead)
+{
+	int freeformat_count = 0;
+
+	if( !head_check(newhead)
+	||	(!(newhead & HDR_BITRATE) && fr->freeformat_framesize < 0)
+	||	decode_header(fr, newhead, &freeformat_count) != PARSE_GOOD )
+		return 0;
+	/* Same logic as in read_frame(): The decoder needs an update if the
+	   format changes from the frame decoded before. */
+	if(fr->header_change < 2)
+	{
+		if(!fr->oldhead || fr->oldhead == newhead)
+			fr->header_change = 0;
+		else
+			fr->header_change = head_compatible(fr->oldhead, newhead) ? 1 : 2;
+	}
+	fr->oldhead = newhead;
+	return 1;
+}
+
 /*
  * read ahead and find the next MPEG header, to guess framesize
  * return value: success code
@@ -1181,6 +1282,39 @@ static int forget_head_shift(mpg123_handle *fr, unsigned long *newheadp, int for
 	return ret; /* No surprise here, error already triggered early return. */
 }
 
+/* Shift at least one and at most max bytes into the header, stopping at the
+   first one that starts with a sync word (still needing head_check()).
+   Readers that can search their buffered data in bulk do so, others just
+   shift single bytes. Buffered data is forgotten as in forget_head_shift().
+   Returns the number of shifted bytes, <= 0 on trouble like head_shift(). */
+static long forget_head_scan( mpg123_handle *fr, unsigned long *newheadp
+,	long max, unsigned int *forgetcount )
+{
+	long n = 0;
+	if(fr->rd->head_scan != NULL)
+	{
+		n = (long)fr->rd->head_scan(fr, newheadp, max);
+		if(n <= 0) return n;
+	}
+	else do
+	{
+		int ret;
+		if((ret=fr->rd->head_shift(fr,newheadp))<=0) return n ? n : ret;
+		++n;
+	} while(n < max && (*newheadp & HDR_SYNC) != HDR_SYNC);
+	*forgetcount += n;
+	if(*forgetcount > FORGET_INTERVAL && fr->rd->forget != NULL)
+	{
+		*forgetcount = 0;
+		if(!fr->rd->back_bytes(fr, 4))
+		{
+			fr->rd->forget(fr);
+			fr->rd->back_bytes(fr, -4);
+		}
+	}
+	return n;
+}
+
 /* watch out for junk/tags on beginning of stream by invalid header */
 static int skip_junk(mpg123_handle *fr, unsigned long *newheadp, long *headcount)
 {
@@ -1207,6 +1341,7 @@ static int skip_junk(mpg123_handle *fr, unsigned long *newheadp, long *headcount
 		{
 			if(++forgetcount > FORGET_INTERVAL) forgetcount = 0;
 			if((ret=forget_head_shift(fr,&newhead,!forgetcount))<=0) return ret;
+			++fr->stats.junk_bytes;
 		}
 		if((ret=fr->rd->head_read(fr,&newhead))<=0) return ret;
 
@@ -1232,11 +1367,16 @@ static int skip_junk(mpg123_handle *fr, unsigned long *newheadp, long *headcount
 
 	do
 	{
+		long n;
 		++(*headcount);
 		if(limit >= 0 && *headcount >= limit) break;				
 
-		if(++forgetcount > FORGET_INTERVAL) forgetcount = 0;
-		if((ret=forget_head_shift(fr, &newhead, !forgetcount))<=0) return ret;
+		/* The first shifted byte is the one counted above. */
+		n = forget_head_scan( fr, &newhead
+		,	limit >= 0 ? limit - *headcount : LONG_MAX, &forgetcount );
+		if(n <= 0) return (int)n;
+		*headcount += n-1;
+		fr->stats.junk_bytes += n;
 
 		if(head_check(newhead) && (ret=decode_header(fr, newhead, &freeformat_count))) break;
 	} while(1);
@@ -1306,22 +1446,27 @@ static int wetwork(mpg123_handle *fr, unsigned long *newheadp)
 
 		/* If a resync is needed the bitreservoir of previous frames is no longer valid */
 		fr->bitreservoir = 0;
+		++fr->stats.resyncs;
 
 		if(NOQUIET && fr->silent_resync == 0) fprintf(stderr, "Note: Trying to resync...\n");
 
-		do /* ... shift the header with additional single bytes until be found something that could be a header. */
+		do /* ... shift the header with additional bytes until be found something that could be a header. */
 		{
+			long n;
 			++try;
 			if(limit >= 0 && try >= limit) break;				
 
-			if(++forgetcount > FORGET_INTERVAL) forgetcount = 0;
-			if((ret=forget_head_shift(fr,&newhead,!forgetcount)) <= 0)
+			n = forget_head_scan( fr, &newhead
+			,	limit >= 0 ? limit - try : LONG_MAX, &forgetcount );
+			if(n <= 0)
 			{
 				*newheadp = newhead;
 				if(NOQUIET) fprintf (stderr, "Note: Hit end of (available) data during resync.\n");
 
-				return ret ? ret : PARSE_END;
+				return n ? (int)n : PARSE_END;
 			}
+			try += n-1;
+			fr->stats.resync_bytes += n;
 			if(VERBOSE3) debug3("resync try %li at %"OFF_P", got newhead 0x%08lx", try, (off_p)fr->rd->tell(fr),  newhead);
 		} while(!head_check(newhead));
 
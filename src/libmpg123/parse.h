@@ -16,6 +16,10 @@ int frame_bitrate(mpg123_handle *fr);
 long frame_freq(mpg123_handle *fr);
 int read_frame_recover(mpg123_handle* fr); /* dead? */
 int read_frame(mpg123_handle *fr);
+int scan_frame(mpg123_handle *fr);
+/* True if the two headers work with the same decoder setup. */
+int head_compatible(unsigned long fred, unsigned long bret);
+int restore_header(mpg123_handle *fr, unsigned long newhead);
 void set_pointer(mpg123_handle *fr, int part2, long backstep);
 int position_info(mpg123_handle* fr, unsigned long no, long buffsize, unsigned long* frames_left, double* current_seconds, double* seconds_left);
 double compute_bpf(mpg123_handle *fr);
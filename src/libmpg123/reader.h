@@ -12,6 +12,17 @@
 #include "config.h"
 #include "mpg123.h"
 
+/* Memory-mapped reading of plain files, see MPG123_MMAP. */
+#if defined(HAVE_MMAP) && defined(HAVE_SYS_MMAN_H)
+#define MMAP_READER
+#endif
+
+/* Contiguous feed buffer mapped twice in a row, see MPG123_FEED_RING. */
+#if defined(MMAP_READER) && defined(HAVE_SHM_OPEN) && defined(HAVE_FTRUNCATE) \
+&&	!defined(NO_FEEDER)
+#define FEED_RING
+#endif
+
 #ifndef NO_FEEDER
 struct buffy
 {
@@ -19,6 +30,10 @@ struct buffy
 	ssize_t size;
 	ssize_t realsize;
 	struct buffy *next;
+	/* Caller-owned data that is just referenced (see mpg123_feed_ref()). */
+	int borrowed;
+	void (*release)(void *);
+	void *release_handle;
 };
 
 
@@ -37,6 +52,19 @@ struct bufferchain
 	size_t pool_fill;    /* That many buffers are there. */
 	/* A pool of buffers to re-use, if activated. It's a linked list that is worked on from the front. */
 	struct buffy *pool;
+	/* Spare bookkeeping for borrowed buffers, no data attached. */
+	struct buffy *refpool;
+	size_t refpool_fill;
+#ifdef FEED_RING
+	/* Used instead of the chain if not NULL. The ring (power-of-two size)
+	   is mapped twice in a row, so that any span of up to ringsize bytes
+	   starting inside the first mapping is contiguous in memory. */
+	unsigned char *ring;
+	size_t ringsize;
+	size_t ringstart;       /* Chain beginning as offset into the ring. */
+	unsigned char *ringold; /* Ring before growing, holding a frame body in use. */
+	size_t ringoldsize;
+#endif
 };
 
 /* Call this before any buffer chain use (even bc_init()). */
@@ -77,6 +105,10 @@ struct reader_data
 #ifndef NO_FEEDER
 	struct bufferchain buffer; /* Not dynamically allocated, these few struct bytes aren't worth the trouble. */
 #endif
+#ifdef MMAP_READER
+	unsigned char *map; /* Whole file mapped into memory, filelen bytes (plus ID3v1). */
+	off_t mapsize;
+#endif
 };
 
 /* start to use off_t to properly do LFS in future ... used to be long */
@@ -94,8 +126,19 @@ struct reader
 	off_t   (*tell)           (mpg123_handle *);
 	void    (*rewind)         (mpg123_handle *);
 	void    (*forget)         (mpg123_handle *);
+	/* Optional: point to the frame body in place instead of copying it.
+	   Returns size on success, 0 if the body has to be copied after all.
+	   The memory stays valid until the next forget() after another frame. */
+	int     (*ref_frame_body) (mpg123_handle *, unsigned char **body, int size);
+	/* Optional: shift at least one and at most max bytes into the header,
+	   stopping early when it starts with a sync word, for bulk search on
+	   resync. succ: shifted bytes, else <= 0 (FALSE or READER_MORE) */
+	ssize_t (*head_scan)      (mpg123_handle *, unsigned long *head, long max);
 };
 
+/* The bit reader may peek that many bytes past the end of a frame body. */
+#define READER_BODY_PAD 2
+
 /* Open a file by path or use an opened file descriptor. */
 int open_stream(mpg123_handle *, const char *path, int fd);
 /* Open an external handle. */
@@ -105,8 +148,14 @@ int open_stream_handle(mpg123_handle *, void *iohandle);
 int open_feed(mpg123_handle *);
 /* externally called function, returns 0 on success, -1 on error */
 int  feed_more(mpg123_handle *fr, const unsigned char *in, long count);
+/* Same, but only referencing the data until release(handle) is called. */
+int  feed_more_ref( mpg123_handle *fr, const unsigned char *in, long count,
+	void (*release)(void *), void *handle );
 void feed_forget(mpg123_handle *fr);  /* forget the data that has been read (free some buffers) */
 off_t feed_set_pos(mpg123_handle *fr, off_t pos); /* Set position (inside available data if possible), return wanted byte offset of next feed. */
+/* Go to the given byte offset for reading the next frame from there.
+   The feeder drops its buffer and expects the next input at pos. */
+int reader_set_pos(mpg123_handle *fr, off_t pos);
 
 void open_bad(mpg123_handle *);
 
@@ -116,6 +165,7 @@ void open_bad(mpg123_handle *);
 #define READER_BUFFERED  0x8
 #define READER_NONBLOCK  0x20
 #define READER_HANDLEIO  0x40
+#define READER_MAPPED    0x80
 
 #define READER_STREAM 0
 #define READER_ICY_STREAM 1
@@ -123,12 +173,14 @@ void open_bad(mpg123_handle *);
 /* These two add a little buffering to enable small seeks for peek ahead. */
 #define READER_BUF_STREAM 3
 #define READER_BUF_ICY_STREAM 4
+/* Plain file reading from a memory mapping. */
+#define READER_MAP_STREAM 5
 
 #ifdef READ_SYSTEM
-#define READER_SYSTEM 5
-#define READERS 6
+#define READER_SYSTEM 6
+#define READERS 7
 #else
-#define READERS 5
+#define READERS 6
 #endif
 
 #define READER_ERROR MPG123_ERR
@@ -9,6 +9,9 @@
 	initially written by Michael Hipp
 */
 
+/* Need ftruncate() and MAP_ANONYMOUS for the feed ring. */
+#define _DEFAULT_SOURCE
+#define _BSD_SOURCE
 #include "mpg123lib_intern.h"
 #include <sys/stat.h>
 #include <fcntl.h>
@@ -23,6 +26,9 @@
 #ifdef _MSC_VER
 #include <io.h>
 #endif
+#ifdef MMAP_READER
+#include <sys/mman.h>
+#endif
 
 #include "compat.h"
 #include "debug.h"
@@ -48,10 +54,15 @@ static int bc_append(struct bufferchain *bc, ssize_t size);
 static void bc_drop(struct bufferchain *bc);
 #endif
 static int bc_add(struct bufferchain *bc, const unsigned char *data, ssize_t size);
+static int bc_addref( struct bufferchain *bc, const unsigned char *data, ssize_t size
+,	void (*release)(void *), void *handle );
 static ssize_t bc_give(struct bufferchain *bc, unsigned char *out, ssize_t size);
 static ssize_t bc_skip(struct bufferchain *bc, ssize_t count);
 static ssize_t bc_seekback(struct bufferchain *bc, ssize_t count);
-static void bc_forget(struct bufferchain *bc);
+static void bc_forget(struct bufferchain *bc, const unsigned char *keep);
+#ifdef FEED_RING
+static void bc_ring_drop(struct bufferchain *bc);
+#endif
 #endif
 
 /* A normal read and a read with timeout. */
@@ -244,7 +255,15 @@ static void stream_close(mpg123_handle *fr)
 	fr->rdat.filept = 0;
 
 #ifndef NO_FEEDER
-	if(fr->rdat.flags & READER_BUFFERED)  bc_reset(&fr->rdat.buffer);
+	if(fr->rdat.flags & READER_BUFFERED)
+	{
+#ifdef FEED_RING
+		/* Keep the ring for the next feed only if it is still wanted. */
+		if(!(fr->p.flags & MPG123_FEED_RING))
+			bc_ring_drop(&fr->rdat.buffer);
+#endif
+		bc_reset(&fr->rdat.buffer);
+	}
 #endif
 	if(fr->rdat.flags & READER_HANDLEIO)
 	{
@@ -329,6 +348,44 @@ static int generic_head_shift(mpg123_handle *fr,unsigned long *head)
 	return TRUE;
 }
 
+/*
+	Shift at least one and at most max bytes of the given data into the
+	header, but stop as soon as it starts with the 11 sync bits. Instead
+	of looking at each possible header, memchr() looks for the first byte.
+	Returns the number of shifted bytes.
+*/
+static ssize_t sync_scan(unsigned long *head, const unsigned char *buf, ssize_t size, long max)
+{
+	const unsigned char *p, *end;
+	ssize_t k;
+
+	if(size > max) size = max;
+	/* The first shifts still involve bytes of the old header. */
+	for(k=0; k<3 && k<size;)
+	{
+		*head = ((*head << 8) | buf[k++]) & 0xffffffff;
+		if((*head & 0xffe00000) == 0xffe00000)
+			return k;
+	}
+	if(k == size)
+		return k;
+	/* Now any sync byte pair in buf, complete header included. */
+	end = buf+size-3;
+	for(p = buf; p < end && (p = memchr(p, 0xff, end-p)); ++p)
+	{
+		if((p[1] & 0xe0) == 0xe0)
+		{
+			size = p-buf+4;
+			break;
+		}
+	}
+	*head = ((unsigned long) buf[size-4] << 24) |
+	        ((unsigned long) buf[size-3] << 16) |
+	        ((unsigned long) buf[size-2] << 8)  |
+	         (unsigned long) buf[size-1];
+	return size;
+}
+
 /* returns reached position... negative ones are bad... */
 static off_t stream_skip_bytes(mpg123_handle *fr,off_t len)
 {
@@ -384,6 +441,23 @@ static int stream_back_bytes(mpg123_handle *fr, off_t bytes)
 }
 
 
+/* Read a chunk for sync_scan() and seek back over the unused part. */
+static ssize_t stream_head_scan(mpg123_handle *fr, unsigned long *head, long max)
+{
+	unsigned char buf[4096];
+	ssize_t got, k;
+
+	if(!(fr->rdat.flags & READER_SEEKABLE))
+		return generic_head_shift(fr, head);
+	got = fr->rd->fullread(fr, buf, max < (long)sizeof(buf) ? max : (long)sizeof(buf));
+	if(got <= 0)
+		return got < 0 ? READER_ERROR : FALSE;
+	k = sync_scan(head, buf, got, max);
+	if(k < got && stream_back_bytes(fr, got-k))
+		return READER_ERROR;
+	return k;
+}
+
 /* returns size on success... */
 static int generic_read_frame_body(mpg123_handle *fr,unsigned char *buf, int size)
 {
@@ -469,6 +543,105 @@ static off_t get_fileinfo(mpg123_handle *fr)
 	return len;
 }
 
+#ifdef MMAP_READER
+/*
+	Reader working on a memory mapping of the whole file. Reading is a memcpy(),
+	seeking is changing the position. Layer I/II frame bodies are used in place,
+	layer III ones still are copied to the frame buffer as the bit reservoir
+	needs to be stitched together there.
+*/
+
+static void map_close(mpg123_handle *fr)
+{
+	if(fr->rdat.flags & READER_MAPPED)
+	{
+		munmap(fr->rdat.map, (size_t)fr->rdat.mapsize);
+		fr->rdat.map = NULL;
+		fr->rdat.mapsize = 0;
+		fr->rdat.flags &= ~READER_MAPPED;
+	}
+	stream_close(fr);
+}
+
+static ssize_t map_fullread(mpg123_handle *fr, unsigned char *buf, ssize_t count)
+{
+	off_t left = fr->rdat.mapsize - fr->rdat.filepos;
+	if(left <= 0) return 0;
+	if(count > left) count = (ssize_t)left;
+	memcpy(buf, fr->rdat.map+fr->rdat.filepos, count);
+	fr->rdat.filepos += count;
+	return count;
+}
+
+static int map_head_read(mpg123_handle *fr, unsigned long *newhead)
+{
+	const unsigned char *hbuf = fr->rdat.map+fr->rdat.filepos;
+	if(fr->rdat.mapsize - fr->rdat.filepos < 4) return FALSE;
+
+	*newhead = ((unsigned long) hbuf[0] << 24) |
+	           ((unsigned long) hbuf[1] << 16) |
+	           ((unsigned long) hbuf[2] << 8)  |
+	            (unsigned long) hbuf[3];
+	fr->rdat.filepos += 4;
+	return TRUE;
+}
+
+static int map_head_shift(mpg123_handle *fr, unsigned long *head)
+{
+	if(fr->rdat.filepos >= fr->rdat.mapsize) return FALSE;
+
+	*head <<= 8;
+	*head |= fr->rdat.map[fr->rdat.filepos++];
+	*head &= 0xffffffff;
+	return TRUE;
+}
+
+static ssize_t map_head_scan(mpg123_handle *fr, unsigned long *head, long max)
+{
+	ssize_t k;
+	if(fr->rdat.filepos >= fr->rdat.mapsize) return FALSE;
+
+	k = sync_scan( head, fr->rdat.map+fr->rdat.filepos
+	,	fr->rdat.mapsize-fr->rdat.filepos > max
+		?	max : (ssize_t)(fr->rdat.mapsize-fr->rdat.filepos), max );
+	fr->rdat.filepos += k;
+	return k;
+}
+
+/* Like lseek(), this allows positions beyond the end. */
+static off_t map_skip_bytes(mpg123_handle *fr, off_t len)
+{
+	if(fr->rdat.filepos + len < 0)
+	{
+		fr->err = MPG123_LSEEK_FAILED;
+		return READER_ERROR;
+	}
+	fr->rdat.filepos += len;
+	return fr->rdat.filepos;
+}
+
+static int map_back_bytes(mpg123_handle *fr, off_t bytes)
+{
+	return map_skip_bytes(fr, -bytes) < 0 ? READER_ERROR : 0;
+}
+
+static void map_rewind(mpg123_handle *fr)
+{
+	fr->rdat.filepos = 0;
+}
+
+static int map_ref_frame_body(mpg123_handle *fr, unsigned char **body, int size)
+{
+	if(fr->rdat.filepos < 0 || fr->rdat.filepos + size + READER_BODY_PAD > fr->rdat.mapsize)
+		return 0;
+	*body = fr->rdat.map+fr->rdat.filepos;
+	fr->rdat.filepos += size;
+	return size;
+}
+
+static int default_map_init(mpg123_handle *fr);
+#endif
+
 #ifndef NO_FEEDER
 /* Methods for the buffer chain, mainly used for feed reader, but not just that. */
 
@@ -488,6 +661,9 @@ static struct buffy* buffy_new(size_t size, size_t minsize)
 	}
 	newbuf->size = 0;
 	newbuf->next = NULL;
+	newbuf->borrowed = FALSE;
+	newbuf->release = NULL;
+	newbuf->release_handle = NULL;
 	return newbuf;
 }
 
@@ -511,11 +687,134 @@ static void buffy_del_chain(struct buffy* buf)
 	}
 }
 
+#ifdef FEED_RING
+/* The smallest ring, also the unit for growing it. */
+#define RING_MINSIZE 65536
+/* Older BSDs only know the short name. */
+#if !defined(MAP_ANONYMOUS) && defined(MAP_ANON)
+#define MAP_ANONYMOUS MAP_ANON
+#endif
+
+/* Map size bytes of shared memory twice, back to back. */
+static unsigned char* ring_map(struct bufferchain *bc, size_t size)
+{
+#ifdef MAP_ANONYMOUS
+	unsigned char *mem = NULL;
+	char name[64];
+	int fd = -1;
+	int i;
+
+	/* The name is only needed until the unlink right after opening. */
+	for(i=0; fd < 0 && i < 10; ++i)
+	{
+		snprintf( name, sizeof(name), "/mpg123-%ld-%lx-%i"
+		,	(long)getpid(), (unsigned long)(size_t)bc, i );
+		fd = shm_open(name, O_RDWR|O_CREAT|O_EXCL, 0600);
+		if(fd < 0 && errno != EEXIST)
+			return NULL;
+	}
+	if(fd < 0)
+		return NULL;
+	shm_unlink(name);
+	if(ftruncate(fd, (off_t)size) == 0)
+	{
+		mem = mmap(NULL, 2*size, PROT_NONE, MAP_PRIVATE|MAP_ANONYMOUS, -1, 0);
+		if(mem == MAP_FAILED)
+			mem = NULL;
+		else if(
+			mmap( mem, size, PROT_READ|PROT_WRITE
+			,	MAP_SHARED|MAP_FIXED, fd, 0 ) == MAP_FAILED
+		||	mmap( mem+size, size, PROT_READ|PROT_WRITE
+			,	MAP_SHARED|MAP_FIXED, fd, 0 ) == MAP_FAILED )
+		{
+			munmap(mem, 2*size);
+			mem = NULL;
+		}
+	}
+	close(fd);
+	return mem;
+#else
+	/* No way to reserve the address range, stay with the chain. */
+	return NULL;
+#endif
+}
+
+static void ring_unmap(unsigned char **ring, size_t *size)
+{
+	if(*ring != NULL)
+		munmap(*ring, 2 * *size);
+	*ring = NULL;
+	*size = 0;
+}
+
+/* Back to the plain chain, the ring is only for the feeder. */
+static void bc_ring_drop(struct bufferchain *bc)
+{
+	ring_unmap(&bc->ring, &bc->ringsize);
+	ring_unmap(&bc->ringold, &bc->ringoldsize);
+}
+
+/* Switch to the ring, creating one if needed. */
+static int bc_ring_setup(struct bufferchain *bc)
+{
+	if(bc->ring == NULL)
+	{
+		size_t size = RING_MINSIZE;
+		long pagesize = sysconf(_SC_PAGESIZE);
+		while(pagesize > 0 && size < (size_t)pagesize)
+			size <<= 1;
+		if(!(bc->ring = ring_map(bc, size)))
+			return -1;
+		bc->ringsize = size;
+	}
+	bc->ringstart = 0;
+	return 0;
+}
+
+/* Move the data to a ring that can hold at least need bytes. */
+static int bc_ring_grow(struct bufferchain *bc, size_t need)
+{
+	unsigned char *ring;
+	size_t size = bc->ringsize;
+
+	while(size < need)
+	{
+		if(size > ((size_t)-1)/4)
+			return -1;
+		size <<= 1;
+	}
+	if(!(ring = ring_map(bc, size)))
+		return -1;
+	debug2("bc_ring_grow: %"SIZE_P" -> %"SIZE_P, (size_p)bc->ringsize, (size_p)size);
+	memcpy(ring, bc->ring+bc->ringstart, (size_t)bc->size);
+	/* A frame body handed out via feed_ref_frame_body() stays valid in the
+	   ring it was read from. Later ones cannot be in use yet. */
+	if(bc->ringold == NULL)
+	{
+		bc->ringold = bc->ring;
+		bc->ringoldsize = bc->ringsize;
+	}
+	else munmap(bc->ring, 2*bc->ringsize);
+	bc->ring = ring;
+	bc->ringsize = size;
+	bc->ringstart = 0;
+	return 0;
+}
+#endif
+
 void bc_prepare(struct bufferchain *bc, size_t pool_size, size_t bufblock)
 {
 	bc_poolsize(bc, pool_size, bufblock);
 	bc->pool = NULL;
 	bc->pool_fill = 0;
+	bc->refpool = NULL;
+	bc->refpool_fill = 0;
+#ifdef FEED_RING
+	bc->ring = NULL;
+	bc->ringsize = 0;
+	bc->ringold = NULL;
+	bc->ringoldsize = 0;
+#endif
 	bc_init(bc); /* Ensure that members are zeroed for read-only use. */
 }
 
@@ -535,6 +834,12 @@ void bc_cleanup(struct bufferchain *bc)
 	buffy_del_chain(bc->pool);
 	bc->pool = NULL;
 	bc->pool_fill = 0;
+	buffy_del_chain(bc->refpool);
+	bc->refpool = NULL;
+	bc->refpool_fill = 0;
+#ifdef FEED_RING
+	bc_ring_drop(bc);
+#endif
 }
 
 /* Fetch a buffer from the pool (if possible) or create one. */
@@ -560,7 +865,20 @@ static void bc_free(struct bufferchain *bc, struct buffy* buf)
 {
 	if(!buf) return;
 
-	if(bc->pool_fill < bc->pool_size)
+	if(buf->borrowed)
+	{ /* Hand the data back, keep the bookkeeping for the next one. */
+		if(buf->release != NULL)
+			buf->release(buf->release_handle);
+		buf->data = NULL;
+		if(bc->refpool_fill < bc->pool_size)
+		{
+			buf->next = bc->refpool;
+			bc->refpool = buf;
+			++bc->refpool_fill;
+		}
+		else buffy_del(buf);
+	}
+	else if(bc->pool_fill < bc->pool_size)
 	{
 		buf->next = bc->pool;
 		bc->pool = buf;
@@ -607,6 +925,9 @@ static void bc_init(struct bufferchain *bc)
 	bc->pos   = 0;
 	bc->firstpos = 0;
 	bc->fileoff  = 0;
+#ifdef FEED_RING
+	bc->ringstart = 0;
+#endif
 }
 
 static void bc_reset(struct bufferchain *bc)
@@ -618,6 +939,10 @@ static void bc_reset(struct bufferchain *bc)
 		bc->first = buf->next;
 		bc_free(bc, buf);
 	}
+#ifdef FEED_RING
+	ring_unmap(&bc->ringold, &bc->ringoldsize);
+	if(bc->ring == NULL)
+#endif
 	bc_fill_pool(bc); /* Ignoring an error here... */
 	bc_init(bc);
 }
@@ -647,6 +972,19 @@ static int bc_add(struct bufferchain *bc, const unsigned char *data, ssize_t siz
 	debug2("bc_add: adding %"SSIZE_P" bytes at %"OFF_P, (ssize_p)size, (off_p)(bc->fileoff+bc->size));
 	if(size >=4) debug4("first bytes: %02x %02x %02x %02x", data[0], data[1], data[2], data[3]);
 
+#ifdef FEED_RING
+	if(bc->ring != NULL)
+	{
+		if( (size_t)(bc->size + size) > bc->ringsize
+		&&	bc_ring_grow(bc, (size_t)(bc->size + size)) )
+			return -2;
+		/* Thanks to the second mapping, this never wraps. */
+		memcpy( bc->ring + ((bc->ringstart+bc->size) & (bc->ringsize-1))
+		,	data, size );
+		bc->size += size;
+		return 0;
+	}
+#endif
 	while(size > 0)
 	{
 		/* Try to fill up the last buffer block. */
@@ -671,6 +1009,47 @@ static int bc_add(struct bufferchain *bc, const unsigned char *data, ssize_t siz
 	return ret;
 }
 
+/* Append a block that just references the given data, no copy.
+   It is full from the start, so bc_add() never writes into it. */
+static int bc_addref( struct bufferchain *bc, const unsigned char *data, ssize_t size
+,	void (*release)(void *), void *handle )
+{
+	struct buffy *newbuf;
+	debug2("bc_addref: referencing %"SSIZE_P" bytes at %"OFF_P, (ssize_p)size, (off_p)(bc->fileoff+bc->size));
+	if(size < 1) return -1;
+#ifdef FEED_RING
+	if(bc->ring != NULL)
+	{ /* The ring wants its copy, the caller's buffer is free right away. */
+		int ret = bc_add(bc, data, size);
+		if(ret == 0 && release != NULL)
+			release(handle);
+		return ret;
+	}
+#endif
+
+	if(bc->refpool)
+	{
+		newbuf = bc->refpool;
+		bc->refpool = newbuf->next;
+		--bc->refpool_fill;
+	}
+	else if(!(newbuf = malloc(sizeof(struct buffy))))
+		return -2;
+	newbuf->data = (unsigned char*)data;
+	newbuf->size = newbuf->realsize = size;
+	newbuf->next = NULL;
+	newbuf->borrowed = TRUE;
+	newbuf->release = release;
+	newbuf->release_handle = handle;
+
+	if(bc->last != NULL)  bc->last->next = newbuf;
+	else if(bc->first == NULL) bc->first = newbuf;
+
+	bc->last  = newbuf;
+	bc->size += size;
+	return 0;
+}
+
 /* Common handler for "You want more than I can give." situation. */
 static ssize_t bc_need_more(struct bufferchain *bc)
 {
@@ -688,6 +1067,15 @@ static ssize_t bc_give(struct bufferchain *bc, unsigned char *out, ssize_t size)
 	ssize_t offset = 0;
 	if(bc->size - bc->pos < size) return bc_need_more(bc);
 
+#ifdef FEED_RING
+	if(bc->ring != NULL)
+	{
+		memcpy( out, bc->ring + ((bc->ringstart+bc->pos) & (bc->ringsize-1))
+		,	size );
+		bc->pos += size;
+		return size;
+	}
+#endif
 	/* find the current buffer */
 	while(b != NULL && (offset + b->size) <= bc->pos)
 	{
@@ -736,10 +1124,34 @@ static ssize_t bc_seekback(struct bufferchain *bc, ssize_t count)
 	else return READER_ERROR;
 }
 
-/* Throw away buffies that we passed. */
-static void bc_forget(struct bufferchain *bc)
+/* Throw away buffies that we passed, except the one containing keep
+   (and what follows) if that is given. */
+static void bc_forget(struct bufferchain *bc, const unsigned char *keep)
 {
 	struct buffy *b = bc->first;
+#ifdef FEED_RING
+	if(bc->ring != NULL)
+	{
+		ssize_t count = bc->pos;
+		if( bc->ringold != NULL && (keep == NULL || keep < bc->ringold
+		||	keep >= bc->ringold + 2*bc->ringoldsize) )
+			ring_unmap(&bc->ringold, &bc->ringoldsize);
+		/* Do not let new data overwrite a frame body that is still in use. */
+		if(keep != NULL && keep >= bc->ring && keep < bc->ring + 2*bc->ringsize)
+		{
+			ssize_t k = (ssize_t)
+				(((size_t)(keep - bc->ring) - bc->ringstart) & (bc->ringsize-1));
+			if(k < count)
+				count = k;
+		}
+		bc->ringstart = (bc->ringstart + count) & (bc->ringsize-1);
+		bc->fileoff += count;
+		bc->pos  -= count;
+		bc->size -= count;
+		bc->firstpos = bc->pos;
+		return;
+	}
+#endif
 	/* free all buffers that are def'n'tly outdated */
 	/* we have buffers until filepos... delete all buffers fully below it */
 	if(b) debug2("bc_forget: block %lu pos %lu", (unsigned long)b->size, (unsigned long)bc->pos);
@@ -747,6 +1159,8 @@ static void bc_forget(struct bufferchain *bc)
 
 	while(b != NULL && bc->pos >= b->size)
 	{
+		if(keep != NULL && keep >= b->data && keep < b->data+b->size)
+			break;
 		struct buffy *n = b->next; /* != NULL or this is indeed the end and the last cycle anyway */
 		if(n == NULL) bc->last = NULL; /* Going to delete the last buffy... */
 		bc->fileoff += b->size;
@@ -767,6 +1181,12 @@ static void bc_forget(struct bufferchain *bc)
 static int feed_init(mpg123_handle *fr)
 {
 	bc_init(&fr->rdat.buffer);
+#ifdef FEED_RING
+	/* Without the ring (also if it cannot be had), use the chain. */
+	if(!(fr->p.flags & MPG123_FEED_RING) || bc_ring_setup(&fr->rdat.buffer))
+		ring_unmap(&fr->rdat.buffer.ring, &fr->rdat.buffer.ringsize);
+	if(fr->rdat.buffer.ring == NULL)
+#endif
 	bc_fill_pool(&fr->rdat.buffer);
 	fr->rdat.filelen = 0;
 	fr->rdat.filepos = 0;
@@ -791,6 +1211,19 @@ int feed_more(mpg123_handle *fr, const unsigned char *in, long count)
 	return ret;
 }
 
+int feed_more_ref( mpg123_handle *fr, const unsigned char *in, long count
+,	void (*release)(void *), void *handle )
+{
+	int ret = 0;
+	if(VERBOSE3) debug("feed_more_ref");
+	if((ret = bc_addref(&fr->rdat.buffer, in, count, release, handle)) != 0)
+	{
+		ret = READER_ERROR;
+		if(NOQUIET) error1("Failed to add buffer reference, return: %i", ret);
+	}
+	return ret;
+}
+
 static ssize_t feed_read(mpg123_handle *fr, unsigned char *out, ssize_t count)
 {
 	ssize_t gotcount = bc_give(&fr->rdat.buffer, out, count);
@@ -818,13 +1251,94 @@ static int feed_back_bytes(mpg123_handle *fr, off_t bytes)
 
 static int feed_seek_frame(mpg123_handle *fr, off_t num){ return READER_ERROR; }
 
+/* The frame body in place, if it sits in one block with some bytes after it. */
+static int feed_ref_frame_body(mpg123_handle *fr, unsigned char **body, int size)
+{
+	struct bufferchain *bc = &fr->rdat.buffer;
+	struct buffy *b = bc->first;
+	ssize_t offset = 0;
+
+#ifdef FEED_RING
+	if(bc->ring != NULL)
+	{
+		if( bc->size - bc->pos < size
+		||	(size_t)size + READER_BODY_PAD > bc->ringsize )
+			return 0;
+		*body = bc->ring + ((bc->ringstart+bc->pos) & (bc->ringsize-1));
+		bc->pos += size;
+		return size;
+	}
+#endif
+	while(b != NULL && (offset + b->size) <= bc->pos)
+	{
+		offset += b->size;
+		b = b->next;
+	}
+	if(b == NULL || bc->pos - offset + size + READER_BODY_PAD > b->size)
+		return 0;
+	*body = b->data + (bc->pos - offset);
+	bc->pos += size;
+	return size;
+}
+
+/* Scan what is there in the current buffer, let the normal header
+   shift deal with the end of a buffer (including READER_MORE). */
+static ssize_t buffered_head_scan(mpg123_handle *fr, unsigned long *head, long max)
+{
+	struct bufferchain *bc = &fr->rdat.buffer;
+	const unsigned char *data = NULL;
+	ssize_t avail = 0;
+	ssize_t k;
+
+#ifdef FEED_RING
+	if(bc->ring != NULL)
+	{
+		data  = bc->ring + ((bc->ringstart+bc->pos) & (bc->ringsize-1));
+		avail = bc->size - bc->pos;
+	}
+	else
+#endif
+	{
+		struct buffy *b = bc->first;
+		ssize_t offset = 0;
+		while(b != NULL && (offset + b->size) <= bc->pos)
+		{
+			offset += b->size;
+			b = b->next;
+		}
+		if(b != NULL)
+		{
+			data  = b->data + (bc->pos - offset);
+			avail = b->size - (bc->pos - offset);
+		}
+	}
+	if(avail <= 0)
+		return generic_head_shift(fr, head);
+	k = sync_scan(head, data, avail, max);
+	bc->pos += k;
+	return k;
+}
+
 /* Not just for feed reader, also for self-feeding buffered reader. */
 static void buffered_forget(mpg123_handle *fr)
 {
-	bc_forget(&fr->rdat.buffer);
+	bc_forget(&fr->rdat.buffer, fr->bsref ? fr->bsbuf : NULL);
 	fr->rdat.filepos = fr->rdat.buffer.fileoff + fr->rdat.buffer.pos;
 }
 
+/* I expect to get the specific position on next feed. Forget what I have now. */
+static void feed_reset_pos(mpg123_handle *fr, off_t pos)
+{
+	struct bufferchain *bc = &fr->rdat.buffer;
+	bc_reset(bc);
+	if(fr->bsref)
+	{ /* The last frame body is gone with that. */
+		fr->bsbuf = fr->bsspace[fr->bsnum]+512;
+		fr->bsref = FALSE;
+	}
+	bc->fileoff = pos;
+}
+
 off_t feed_set_pos(mpg123_handle *fr, off_t pos)
 {
 	struct bufferchain *bc = &fr->rdat.buffer;
@@ -835,9 +1349,8 @@ off_t feed_set_pos(mpg123_handle *fr, off_t pos)
 		return bc->fileoff+bc->size; /* Next input after end of buffer... */
 	}
 	else
-	{ /* I expect to get the specific position on next feed. Forget what I have now. */
-		bc_reset(bc);
-		bc->fileoff = pos;
+	{
+		feed_reset_pos(fr, pos);
 		debug1("feed_set_pos outside, buffer reset, next feed from %"OFF_P, (off_p)pos);
 		return pos; /* Next input from exactly that position. */
 	}
@@ -893,6 +1406,12 @@ int feed_more(mpg123_handle *fr, const unsigned char *in, long count)
 	fr->err = MPG123_MISSING_FEATURE;
 	return -1;
 }
+int feed_more_ref( mpg123_handle *fr, const unsigned char *in, long count
+,	void (*release)(void *), void *handle )
+{
+	fr->err = MPG123_MISSING_FEATURE;
+	return -1;
+}
 off_t feed_set_pos(mpg123_handle *fr, off_t pos)
 {
 	fr->err = MPG123_MISSING_FEATURE;
@@ -923,6 +1442,7 @@ static void bad_rewind(mpg123_handle *mh){}
 #define READER_FEED       2
 #define READER_BUF_STREAM 3
 #define READER_BUF_ICY_STREAM 4
+#define READER_MAP_STREAM 5
 static struct reader readers[] =
 {
 	{ /* READER_STREAM */
@@ -937,7 +1457,9 @@ static struct reader readers[] =
 		stream_seek_frame,
 		generic_tell,
 		stream_rewind,
-		NULL
+		NULL,
+		NULL,
+		stream_head_scan
 	} ,
 	{ /* READER_ICY_STREAM */
 		default_init,
@@ -961,6 +1483,8 @@ static struct reader readers[] =
 #define feed_back_bytes NULL
 #define feed_skip_bytes NULL
 #define buffered_forget NULL
+#define feed_ref_frame_body NULL
+#define buffered_head_scan NULL
 #endif
 	{ /* READER_FEED */
 		feed_init,
@@ -974,7 +1498,9 @@ static struct reader readers[] =
 		feed_seek_frame,
 		generic_tell,
 		stream_rewind,
-		buffered_forget
+		buffered_forget,
+		feed_ref_frame_body,
+		buffered_head_scan
 	},
 	{ /* READER_BUF_STREAM */
 		default_init,
@@ -988,7 +1514,9 @@ static struct reader readers[] =
 		stream_seek_frame,
 		generic_tell,
 		stream_rewind,
-		buffered_forget
+		buffered_forget,
+		NULL,
+		buffered_head_scan
 	} ,
 	{ /* READER_BUF_ICY_STREAM */
 		default_init,
@@ -1002,8 +1530,28 @@ static struct reader readers[] =
 		stream_seek_frame,
 		generic_tell,
 		stream_rewind,
-		buffered_forget
+		buffered_forget,
+		NULL,
+		buffered_head_scan
 	},
+#ifdef MMAP_READER
+	{ /* READER_MAP_STREAM */
+		default_map_init,
+		map_close,
+		map_fullread,
+		map_head_read,
+		map_head_shift,
+		map_skip_bytes,
+		generic_read_frame_body,
+		map_back_bytes,
+		stream_seek_frame,
+		generic_tell,
+		map_rewind,
+		NULL,
+		map_ref_frame_body,
+		map_head_scan
+	},
+#endif
 #ifdef READ_SYSTEM
 	,{
 		system_init,
@@ -1018,6 +1566,8 @@ static struct reader readers[] =
 		NULL,
 		NULL,
 		NULL,
+		NULL,
+		NULL,
 	}
 #endif
 };
@@ -1035,6 +1585,8 @@ static struct reader bad_reader =
 	bad_seek_frame,
 	bad_tell,
 	bad_rewind,
+	NULL,
+	NULL,
 	NULL
 };
 
@@ -1121,6 +1673,45 @@ static int default_init(mpg123_handle *fr)
 	return 0;
 }
 
+#ifdef MMAP_READER
+/* Map the whole file if that is possible, else continue as plain stream. */
+static int default_map_init(mpg123_handle *fr)
+{
+	struct stat st;
+	void *map;
+
+	if( fstat(fr->rdat.filept, &st) || !S_ISREG(st.st_mode) || st.st_size < 1
+	||	(off_t)(size_t)st.st_size != st.st_size )
+		goto map_init_fallback;
+	map = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fr->rdat.filept, 0);
+	if(map == MAP_FAILED)
+	{
+		if(VERBOSE2) error1("Cannot map file, using normal reading: %s", strerror(errno));
+		goto map_init_fallback;
+	}
+	debug1("mapped %"OFF_P" bytes", (off_p)st.st_size);
+	fr->rdat.map = map;
+	fr->rdat.mapsize = st.st_size;
+	fr->rdat.flags |= READER_MAPPED|READER_SEEKABLE;
+	fr->rdat.filepos = 0;
+	/* The same ID3v1 check as in get_fileinfo(). */
+	fr->rdat.filelen = fr->rdat.mapsize;
+	if(fr->rdat.mapsize >= 128)
+	{
+		memcpy(fr->id3buf, fr->rdat.map+fr->rdat.mapsize-128, 128);
+		if(!strncmp((char*)fr->id3buf,"TAG",3))
+		{
+			fr->rdat.filelen -= 128;
+			fr->rdat.flags |= READER_ID3TAG;
+			fr->metaflags  |= MPG123_NEW_ID3;
+		}
+	}
+	return 0;
+map_init_fallback:
+	fr->rd = &readers[READER_STREAM];
+	return fr->rd->init(fr);
+}
+#endif
 
 void open_bad(mpg123_handle *mh)
 {
@@ -1162,9 +1753,30 @@ int open_feed(mpg123_handle *fr)
 #endif /* NO_FEEDER */
 }
 
+int reader_set_pos(mpg123_handle *fr, off_t pos)
+{
+#ifndef NO_FEEDER
+	if(fr->rd == &readers[READER_FEED])
+	{
+		feed_reset_pos(fr, pos);
+		return 0;
+	}
+#endif
+	if(pos < 0 || fr->rd->skip_bytes(fr, pos - fr->rd->tell(fr)) != pos)
+	{
+		if(fr->err == MPG123_OK) fr->err = MPG123_NO_SEEK;
+		return READER_ERROR;
+	}
+	return 0;
+}
+
 /* Final code common to open_stream and open_stream_handle. */
 static int open_finish(mpg123_handle *fr)
 {
+#ifdef FEED_RING
+	/* Stream readers only use the chain, a ring kept for feeding goes. */
+	bc_ring_drop(&fr->rdat.buffer);
+#endif
 #ifndef NO_ICY
 	if(fr->p.icy_interval > 0)
 	{
@@ -1174,6 +1786,21 @@ static int open_finish(mpg123_handle *fr)
 		fr->rd = &readers[READER_ICY_STREAM];
 	}
 	else
+#endif
+#ifdef MMAP_READER
+	/* Only plain descriptors with the default I/O functions qualify for mapping. */
+	if( (fr->p.flags & MPG123_MMAP) && !(fr->p.flags & MPG123_NO_PEEK_END)
+	&&	!(fr->rdat.flags & READER_HANDLEIO)
+	&&	fr->rdat.r_read == NULL && fr->rdat.r_lseek == NULL
+#ifdef TIMEOUT_READ
+	&&	fr->p.timeout <= 0
+#endif
+	)
+	{
+		fr->rd = &readers[READER_MAP_STREAM];
+		debug("map stream reader");
+	}
+	else
 #endif
 	{
 		fr->rd = &readers[READER_STREAM];
@@ -0,0 +1,114 @@
+/*
+	stats: accounting of time spent in the stages of decoding
+
+	copyright 2020 by the mpg123 project - free software under the terms of the LGPL 2.1
+	see COPYING and AUTHORS files in distribution or http://mpg123.org
+
+	The parser, layer decoder and postprocessing are timed at their call
+	sites. The synth functions are called from deep within the layer code,
+	so they are wrapped instead. Nested synth calls (the generic stereo
+	synth calling the plain one, for example) are only counted once.
+*/
+
+#include "mpg123lib_intern.h"
+#ifdef _WIN32
+#include <windows.h>
+#endif
+#include <time.h>
+
+#include "debug.h"
+
+double stats_now(void)
+{
+#if defined(HAVE_CLOCK_GETTIME) && defined(CLOCK_MONOTONIC)
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + 1e-9*ts.tv_nsec;
+#elif defined(_WIN32)
+	LARGE_INTEGER count, freq;
+	QueryPerformanceCounter(&count);
+	QueryPerformanceFrequency(&freq);
+	return (double)count.QuadPart/freq.QuadPart;
+#elif defined(HAVE_SYS_TIME_H)
+	struct timeval tv;
+	gettimeofday(&tv, NULL);
+	return tv.tv_sec + 1e-6*tv.tv_usec;
+#else
+	return (double)clock()/CLOCKS_PER_SEC;
+#endif
+}
+
+void stats_reset(mpg123_handle *fr)
+{
+	fr->stats.parse = 0.;
+	fr->stats.decode = 0.;
+	fr->stats.synth = 0.;
+	fr->stats.postprocess = 0.;
+	fr->stats.resyncs = 0;
+	fr->stats.resync_bytes = 0;
+	fr->stats.junk_bytes = 0;
+	fr->stats.zero_frames = 0;
+	fr->stats.in_synth = 0;
+}
+
+static int synth_stats(real *bandPtr, int channel, mpg123_handle *fr, int final)
+{
+	double start;
+	int ret;
+	if(fr->stats.in_synth)
+		return fr->stats.real_synth(bandPtr, channel, fr, final);
+	fr->stats.in_synth = 1;
+	start = stats_now();
+	ret = fr->stats.real_synth(bandPtr, channel, fr, final);
+	fr->stats.synth += stats_now()-start;
+	fr->stats.in_synth = 0;
+	return ret;
+}
+
+static int synth_stereo_stats(real *bandPtr_l, real *bandPtr_r, mpg123_handle *fr)
+{
+	double start;
+	int ret;
+	if(fr->stats.in_synth)
+		return fr->stats.real_synth_stereo(bandPtr_l, bandPtr_r, fr);
+	fr->stats.in_synth = 1;
+	start = stats_now();
+	ret = fr->stats.real_synth_stereo(bandPtr_l, bandPtr_r, fr);
+	fr->stats.synth += stats_now()-start;
+	fr->stats.in_synth = 0;
+	return ret;
+}
+
+static int synth_mono_stats(real *bandPtr, mpg123_handle *fr)
+{
+	double start;
+	int ret;
+	if(fr->stats.in_synth)
+		return fr->stats.real_synth_mono(bandPtr, fr);
+	fr->stats.in_synth = 1;
+	start = stats_now();
+	ret = fr->stats.real_synth_mono(bandPtr, fr);
+	fr->stats.synth += stats_now()-start;
+	fr->stats.in_synth = 0;
+	return ret;
+}
+
+void stats_wrap_synth(mpg123_handle *fr)
+{
+	/* Repeated setup must not wrap the wrappers. */
+	if(fr->synth != synth_stats)
+	{
+		fr->stats.real_synth = fr->synth;
+		fr->synth = synth_stats;
+	}
+	if(fr->synth_stereo != synth_stereo_stats)
+	{
+		fr->stats.real_synth_stereo = fr->synth_stereo;
+		fr->synth_stereo = synth_stereo_stats;
+	}
+	if(fr->synth_mono != synth_mono_stats)
+	{
+		fr->stats.real_synth_mono = fr->synth_mono;
+		fr->synth_mono = synth_mono_stats;
+	}
+}
@@ -0,0 +1,23 @@
+/*
+	stats: accounting of time spent in the stages of decoding
+
+	copyright 2020 by the mpg123 project - free software under the terms of the LGPL 2.1
+	see COPYING and AUTHORS files in distribution or http://mpg123.org
+*/
+
+#ifndef MPG123_STATS_H
+#define MPG123_STATS_H
+
+#include "frame.h"
+
+/* Monotonic time in seconds, with arbitrary origin. */
+double stats_now(void);
+/* Zero all times and counters. */
+void stats_reset(mpg123_handle *fr);
+/* Replace the active synth functions by timing wrappers, after
+   set_synth_functions() has chosen them. */
+void stats_wrap_synth(mpg123_handle *fr);
+
+#define STATS_ON(fr) ((fr)->p.flags & MPG123_STATS)
+
+#endif
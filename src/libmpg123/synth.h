@@ -17,6 +17,10 @@
 
 	Define NO_AUTOINCREMENT i386 code that shall not rely on autoincrement.
 	Actual benefit of this has to be examined; may apply to specific (old) compilers, only.
+
+	Define PLANAR_SYNTH for a variant that writes each channel into its own
+	plane, fr->planar.plane[channel], at half the fill of the frame buffer
+	(see mpg123_read_planar()).
 */
 
 
@@ -30,8 +34,13 @@ int SYNTH_NAME(real *bandPtr, int channel, mpg123_handle *fr, int final)
 #define BACKPEDAL 0x00 /* i386 code does not need that. */
 #define MY_DCT64 dct64_i386
 #endif
+#ifdef PLANAR_SYNTH
+	static const int step = 1;
+	SAMPLE_T *samples = (SAMPLE_T *) (fr->planar.plane[channel] + fr->buffer.fill/2);
+#else
 	static const int step = 2;
 	SAMPLE_T *samples = (SAMPLE_T *) (fr->buffer.data + fr->buffer.fill);
+#endif
 
 	real *b0, **buf; /* (*buf)[0x110]; */
 	int clip = 0; 
@@ -52,7 +61,9 @@ int SYNTH_NAME(real *bandPtr, int channel, mpg123_handle *fr, int final)
 		   (re)sampling the noise the same way as the original signal. */
 		fr->ditherindex -= 32;
 #endif
+#ifndef PLANAR_SYNTH
 		samples++;
+#endif
 		buf = fr->real_buffs[1];
 	}
 #ifdef USE_DITHER
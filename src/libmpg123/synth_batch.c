@@ -0,0 +1,385 @@
+/*
+	synth_batch: synthesis for several handles at once, see mpg123_decode_frames()
+
+	copyright 2020 by the mpg123 project - free software under the terms of the LGPL 2.1
+	see COPYING and AUTHORS files in distribution or http://mpg123.org
+
+	The layer decoders of the handles run as usual, but their calls of the
+	synth go to recording functions that store the subband samples and the
+	output position. Afterwards, the handles are grouped by BATCH_LANES and
+	dct64 plus windowing run once for the whole group, in struct-of-arrays
+	layout, see synth_batch.h. The history of each handle is transposed
+	into the group at the start and back after the last call of the frame.
+	A group shares the output format, so that clipping and conversion
+	also work on the vectors and only the stores are done per handle.
+
+	This works for the decoders that keep the synth history in the real
+	layout of the generic synth (generic, x86-64 and AVX, the latter two
+	with accurate rounding for 16 bit output) and window tables at unity
+	scale (MPG123_SMOOTH_VOLUME or plain volume without RVA), 1to1
+	synthesis to 16 bit, 32 bit or float. The tables then are the same
+	for all handles of a decoder family and the group can use those of
+	its first one.
+
+	For x86-64 and AVX, the kernels do the operations of the assembly
+	synths in their order, so the output bits stay the same. Rotating
+	the history to another offset would change the order of the sums,
+	so those groups need the same fr->bo. The generic synth is compiled
+	with whatever reordering the compiler does under -ffast-math, which
+	the batch does not follow; there, it is the order of the C source
+	and an even rotation of the history. That makes a difference in
+	rounding of the sums only, see mpg123_decode_frames().
+
+	The vectors are GCC vector extensions. An AVX2 variant is chosen at
+	runtime if the compiler can build it (HAVE_AVX2_TARGET). Without vector
+	extensions (or with fixed point), nothing is batched.
+*/
+
+#include "mpg123lib_intern.h"
+#include "sample.h"
+#include "stats.h"
+#include "debug.h"
+
+#if ((defined(__clang__) && __clang_major__ >= 11) || (defined(__GNUC__) && \
+	!defined(__clang__) && (__GNUC__ > 4 || (__GNUC__ == 4 && __GNUC_MINOR__ >= 7)))) \
+&&	!defined(REAL_IS_FIXED)
+#define SYNTH_BATCH
+#endif
+
+#ifdef SYNTH_BATCH
+
+/* 8 floats fill an AVX register. The transposes are written for 8. */
+#define BATCH_LANES 8
+/* Synth calls per frame: 1152 samples at 32 per call. */
+#define BATCH_CALLS 36
+
+typedef real bvec __attribute__((vector_size(BATCH_LANES*sizeof(real))));
+/* The same, for loads and stores of plain real arrays. */
+typedef real ubvec __attribute__((vector_size(BATCH_LANES*sizeof(real))
+,	aligned(sizeof(real)), may_alias));
+/* What comparisons of bvec give: integers with all bits set for true. */
+#ifdef REAL_IS_FLOAT
+typedef int32_t bmask __attribute__((vector_size(BATCH_LANES*sizeof(int32_t))));
+#else
+typedef int64_t bmask __attribute__((vector_size(BATCH_LANES*sizeof(int64_t))));
+#endif
+
+/* The transposes pick elements of a and b, those of b count from BATCH_LANES. */
+#ifdef __clang__
+#define BATCH_SHUFFLE(a, b, i0, i1, i2, i3, i4, i5, i6, i7) \
+	__builtin_shufflevector(a, b, i0, i1, i2, i3, i4, i5, i6, i7)
+#else
+#define BATCH_SHUFFLE(a, b, i0, i1, i2, i3, i4, i5, i6, i7) \
+	__builtin_shuffle(a, b, (bmask){i0, i1, i2, i3, i4, i5, i6, i7})
+#endif
+
+/* The old WRITE_SHORT_SAMPLE clips after rounding, the others before. */
+#ifndef NEWOLD_WRITE_SAMPLE
+#define BATCH_CLIP16
+/* REAL_TO_SHORT() is ftoi16(), which works on the vectors, too. */
+#if defined(ACCURATE_ROUNDING) && defined(REAL_IS_FLOAT) && defined(IEEE_FLOAT)
+#define BATCH_FTOI16
+#endif
+#endif
+
+/* WRITE_S32_SAMPLE on the vectors needs the conversion to integers. */
+#if !defined(NO_32BIT) && (defined(__clang__) || __GNUC__ >= 9)
+#define BATCH_S32
+/* A float from 2^31 on is over REAL_PLUS_S32, which it cannot hold. */
+#ifdef REAL_IS_FLOAT
+#define BATCH_OVER_S32(x, hi) ((x) >= (hi))
+#define BATCH_HI_S32 2147483648.0
+#else
+#define BATCH_OVER_S32(x, hi) ((x) > (hi))
+#define BATCH_HI_S32 REAL_PLUS_S32
+#endif
+#endif
+
+enum batch_kind { batch_stereo, batch_mono, batch_m2s };
+enum batch_format { batch_s16, batch_real, batch_s32 };
+/* Whose operations to do: those of the C synth, of the x86-64 assembly
+   (also used by AVX for mono) or of the stereo AVX assembly. */
+enum batch_order { batch_c, batch_sse, batch_avx };
+
+struct synth_batch
+{
+	func_synth_stereo keep_stereo;
+	func_synth_mono keep_mono;
+	enum batch_kind kind;
+	enum batch_format format;
+	int calls;
+	int clip;
+	int bo; /* fr->bo at the start, the grouping must not see it change */
+	enum batch_order order; /* batch_avx is for stereo only */
+	int grouped;
+	size_t offset[BATCH_CALLS]; /* position in the frame buffer */
+	real band[BATCH_CALLS][2][SBLIMIT];
+};
+
+/* Store the 32 samples of lane l. Mono to stereo writes both channels,
+   counting clipping once, as synth_mono.h does. BATCH_WRITE does it
+   sample by sample, BATCH_STORE for values clipped and scaled already. */
+#define BATCH_WRITE(type, WRITE) \
+	{ \
+		type *s = (type*)samples + ch; \
+		int clip = 0; \
+		for(j=0; j<SBLIMIT; ++j, s+=step) \
+		{ \
+			real sum = out[j][l]; \
+			WRITE(s, sum, clip); \
+		} \
+		sb->clip += clip; \
+		BATCH_M2S(type) \
+	}
+#define BATCH_STORE(type, from, CONVERT) \
+	{ \
+		type *s = (type*)samples + ch; \
+		for(j=0; j<SBLIMIT; ++j, s+=step) \
+			*s = CONVERT(from[j][l]); \
+		BATCH_M2S(type) \
+	}
+#define BATCH_M2S(type) \
+	if(sb->kind == batch_m2s) \
+	{ \
+		type *s = (type*)samples; \
+		for(j=0; j<SBLIMIT; ++j, s+=2) \
+			s[1] = s[0]; \
+	}
+
+/* The kernels have to round like the synths they stand in for:
+   no reassociation of the sums, no contraction to fused multiply-add,
+   no dropped additions of zero. */
+#ifdef __clang__
+#pragma float_control(precise, on, push)
+#else
+#pragma GCC push_options
+#pragma GCC optimize("no-fast-math", "fp-contract=off")
+#endif
+
+#define BATCH_NAME(name) name ## _plain
+#define BATCH_TARGET
+#include "synth_batch.h"
+#undef BATCH_NAME
+#undef BATCH_TARGET
+
+#if defined(__SSE2__) && defined(HAVE_AVX2_TARGET)
+#define BATCH_AVX2
+#define BATCH_NAME(name) name ## _avx2
+#define BATCH_TARGET __attribute__((target("avx2")))
+#include "synth_batch.h"
+#undef BATCH_NAME
+#undef BATCH_TARGET
+#endif
+
+#ifdef __clang__
+#pragma float_control(pop)
+#else
+#pragma GCC pop_options
+#endif
+
+static void batch_record(mpg123_handle *fr, enum batch_kind kind, int samples)
+{
+	struct synth_batch *sb = fr->batch;
+	sb->kind = kind;
+	sb->offset[sb->calls++] = fr->buffer.fill;
+	fr->buffer.fill += samples*fr->af.dec_encsize;
+}
+
+static int batch_synth_stereo(real *bandPtr_l, real *bandPtr_r, mpg123_handle *fr)
+{
+	struct synth_batch *sb = fr->batch;
+	if(sb->calls == BATCH_CALLS)
+		return 0;
+	memcpy(sb->band[sb->calls][0], bandPtr_l, sizeof(real)*SBLIMIT);
+	memcpy(sb->band[sb->calls][1], bandPtr_r, sizeof(real)*SBLIMIT);
+#ifndef NO_EQUALIZER
+	if(fr->have_eq_settings)
+	{
+		do_equalizer(sb->band[sb->calls][0],0,fr->equalizer);
+		do_equalizer(sb->band[sb->calls][1],1,fr->equalizer);
+	}
+#endif
+	batch_record(fr, batch_stereo, 2*SBLIMIT);
+	return 0;
+}
+
+static int batch_synth_mono(real *bandPtr, mpg123_handle *fr)
+{
+	struct synth_batch *sb = fr->batch;
+	if(sb->calls == BATCH_CALLS)
+		return 0;
+	memcpy(sb->band[sb->calls][0], bandPtr, sizeof(real)*SBLIMIT);
+#ifndef NO_EQUALIZER
+	if(fr->have_eq_settings)
+		do_equalizer(sb->band[sb->calls][0],0,fr->equalizer);
+#endif
+	if(fr->af.channels == 2)
+		batch_record(fr, batch_m2s, 2*SBLIMIT);
+	else
+		batch_record(fr, batch_mono, SBLIMIT);
+	return 0;
+}
+
+/* The output format, or -1 if it is nothing for batching. */
+static int batch_format(mpg123_handle *fr)
+{
+	switch(fr->cpu_opts.type)
+	{
+		case generic:
+		break;
+		/* Their 16 bit synths keep a short history otherwise. */
+		case x86_64:
+		case avx:
+#ifndef ACCURATE_ROUNDING
+			if(fr->af.dec_enc & MPG123_ENC_16)
+				return -1;
+#endif
+#ifndef BATCH_S32
+			/* No rounding as theirs. */
+			if(fr->af.dec_enc & MPG123_ENC_32 || fr->af.dec_enc & MPG123_ENC_24)
+				return -1;
+#endif
+		break;
+		default:
+			return -1;
+	}
+	if(FALSE){}
+#ifndef NO_16BIT
+	else if(fr->af.dec_enc & MPG123_ENC_16)
+		return batch_s16;
+#endif
+#ifndef NO_8BIT
+	else if(fr->af.dec_enc & MPG123_ENC_8)
+		return -1;
+#endif
+#ifndef NO_REAL
+	else if(fr->af.dec_enc & MPG123_ENC_FLOAT)
+		return batch_real;
+#endif
+#ifndef NO_32BIT
+	else if(fr->af.dec_enc & MPG123_ENC_32 || fr->af.dec_enc & MPG123_ENC_24)
+		return batch_s32;
+#endif
+	return -1;
+}
+
+int synth_batch_begin(mpg123_handle *fr)
+{
+	int format;
+	if(fr->down_sample != 0 || fr->tablescale != 1. || fr->planar.plane[0])
+		return 0;
+	if((format = batch_format(fr)) < 0)
+		return 0;
+	if(fr->batch == NULL && (fr->batch = malloc(sizeof(*fr->batch))) == NULL)
+		return 0;
+	fr->batch->format = format;
+	fr->batch->calls = 0;
+	fr->batch->clip = 0;
+	fr->batch->bo = fr->bo;
+	fr->batch->order = fr->cpu_opts.type == generic ? batch_c
+	:	(fr->cpu_opts.type == avx ? batch_avx : batch_sse);
+	fr->batch->keep_stereo = fr->synth_stereo;
+	fr->batch->keep_mono   = fr->synth_mono;
+	fr->synth_stereo = batch_synth_stereo;
+	fr->synth_mono   = batch_synth_mono;
+	return 1;
+}
+
+static void batch_group(mpg123_handle **fr, int n, int order)
+{
+	double start = 0.;
+	int stats = 0;
+	int l;
+
+	for(l=0; l<n; ++l)
+		if(STATS_ON(fr[l]))
+			stats = 1;
+	if(stats)
+		start = stats_now();
+#ifdef BATCH_AVX2
+	if(__builtin_cpu_supports("avx2"))
+		group_avx2(fr, n, order);
+	else
+#endif
+	group_plain(fr, n, order);
+	if(stats)
+	{
+		double share = (stats_now()-start)/n;
+		for(l=0; l<n; ++l)
+			if(STATS_ON(fr[l]))
+				fr[l]->stats.synth += share;
+	}
+}
+
+static int batch_order(struct synth_batch *sb)
+{
+	return sb->order == batch_avx && sb->kind != batch_stereo
+	?	batch_sse : sb->order;
+}
+
+/* A group shares the output format, the order and bo, or only the parity
+   of bo for the C order. */
+static int batch_key(struct synth_batch *sb)
+{
+	int order = batch_order(sb);
+	int bo = order == batch_c ? sb->bo & 0x1 : sb->bo;
+	return (sb->format<<6) | (order<<4) | bo;
+}
+
+void synth_batch_run(mpg123_handle **fr, int count)
+{
+	mpg123_handle *group[BATCH_LANES];
+	int key, order, i, j, n;
+
+	for(i=0; i<count; ++i)
+		fr[i]->batch->grouped = !fr[i]->batch->calls;
+	for(i=0; i<count; ++i)
+	{
+		if(fr[i]->batch->grouped)
+			continue;
+		key = batch_key(fr[i]->batch);
+		order = batch_order(fr[i]->batch);
+		n = 0;
+		for(j=i; j<count; ++j)
+		{
+			struct synth_batch *sb = fr[j]->batch;
+			if(sb->grouped || batch_key(sb) != key)
+				continue;
+			sb->grouped = 1;
+			group[n++] = fr[j];
+			if(n == BATCH_LANES)
+			{
+				batch_group(group, n, order);
+				n = 0;
+			}
+		}
+		if(n)
+			batch_group(group, n, order);
+	}
+	for(i=0; i<count; ++i)
+	{
+		fr[i]->synth_stereo = fr[i]->batch->keep_stereo;
+		fr[i]->synth_mono   = fr[i]->batch->keep_mono;
+		fr[i]->clip += fr[i]->batch->clip;
+	}
+}
+
+#else
+
+int synth_batch_begin(mpg123_handle *fr)
+{
+	return 0;
+}
+
+void synth_batch_run(mpg123_handle **fr, int count)
+{
+}
+
+#endif
+
+void synth_batch_free(mpg123_handle *fr)
+{
+	if(fr->batch != NULL)
+		free(fr->batch);
+	fr->batch = NULL;
+}
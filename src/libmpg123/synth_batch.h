@@ -0,0 +1,676 @@
+/*
+	synth_batch.h: dct64 and windowing for a group of handles at once
+
+	copyright 2020 by the mpg123 project - free software under the terms of the LGPL 2.1
+	see COPYING and AUTHORS files in distribution or http://mpg123.org
+
+	This header is used multiple times to create variants of these functions
+	for different instruction sets, see synth_batch.c.
+	Hint: BATCH_NAME() and BATCH_TARGET vary.
+
+	The operations are those of dct64() and the 1to1 synth in synth.h,
+	in the same order. Each value is a vector (bvec) that holds one
+	element for each handle of the group, so the vector units work on
+	BATCH_LANES streams side by side instead of across the samples of one.
+
+	For the x86-64 and AVX decoders (order batch_sse or batch_avx), the
+	operations and conversions are those of dct64_real_x86_64() and the
+	synths in synth_x86_64*.S or synth_stereo_avx*.S, giving the same
+	output bits.
+*/
+
+/* dct64() on bvec, see dct64.c for the layout. The sums and products of
+   dct64_real_x86_64() are the same, but it multiplies the second pair of
+   the last stage with -cos4 and adds +0 to some of the values afterwards.
+   That only matters for the sign of zeros, but those are output bits, too. */
+static BATCH_TARGET void BATCH_NAME(dct64)
+(	bvec *out0, bvec *out1, bvec *samples, int sse )
+{
+	bvec bufs[64];
+
+ {
+	register int i,j;
+	register bvec *b1,*b2,*bs;
+	register real *costab;
+
+	b1 = samples;
+	bs = bufs;
+	costab = pnts[0]+16;
+	b2 = b1 + 32;
+
+	for(i=15;i>=0;i--)
+		*bs++ = (*b1++ + *--b2);
+	for(i=15;i>=0;i--)
+		*bs++ = (*--b2 - *b1++) * *--costab;
+
+	b1 = bufs;
+	costab = pnts[1]+8;
+	b2 = b1 + 16;
+
+	{
+		for(i=7;i>=0;i--)
+			*bs++ = (*b1++ + *--b2);
+		for(i=7;i>=0;i--)
+			*bs++ = (*--b2 - *b1++) * *--costab;
+		b2 += 32;
+		costab += 8;
+		for(i=7;i>=0;i--)
+			*bs++ = (*b1++ + *--b2);
+		for(i=7;i>=0;i--)
+			*bs++ = (*b1++ - *--b2) * *--costab;
+		b2 += 32;
+	}
+
+	bs = bufs;
+	costab = pnts[2];
+	b2 = b1 + 8;
+
+	for(j=2;j;j--)
+	{
+		for(i=3;i>=0;i--)
+			*bs++ = (*b1++ + *--b2);
+		for(i=3;i>=0;i--)
+			*bs++ = (*--b2 - *b1++) * costab[i];
+		b2 += 16;
+		for(i=3;i>=0;i--)
+			*bs++ = (*b1++ + *--b2);
+		for(i=3;i>=0;i--)
+			*bs++ = (*b1++ - *--b2) * costab[i];
+		b2 += 16;
+	}
+
+	b1 = bufs;
+	costab = pnts[3];
+	b2 = b1 + 4;
+
+	for(j=4;j;j--)
+	{
+		*bs++ = (*b1++ + *--b2);
+		*bs++ = (*b1++ + *--b2);
+		*bs++ = (*--b2 - *b1++) * costab[1];
+		*bs++ = (*--b2 - *b1++) * costab[0];
+		b2 += 8;
+		*bs++ = (*b1++ + *--b2);
+		*bs++ = (*b1++ + *--b2);
+		*bs++ = (*b1++ - *--b2) * costab[1];
+		*bs++ = (*b1++ - *--b2) * costab[0];
+		b2 += 8;
+	}
+	bs = bufs;
+	costab = pnts[4];
+
+	for(j=8;j;j--)
+	{
+		bvec v0,v1;
+		v0=*b1++; v1 = *b1++;
+		*bs++ = (v0 + v1);
+		*bs++ = (v0 - v1) * (*costab);
+		v0=*b1++; v1 = *b1++;
+		*bs++ = (v0 + v1);
+		*bs++ = sse ? (v0 - v1) * -(*costab) : (v1 - v0) * (*costab);
+	}
+ }
+
+ {
+	register bvec *b1;
+	register int i;
+
+	for(b1=bufs,i=8;i;i--,b1+=4)
+	{
+		b1[2] += b1[3];
+		if(sse)
+		{
+			b1[0] += (bvec){0};
+			b1[1] += (bvec){0};
+			b1[3] += (bvec){0};
+		}
+	}
+
+	for(b1=bufs,i=4;i;i--,b1+=8)
+	{
+		b1[4] += b1[6];
+		b1[6] += b1[5];
+		b1[5] += b1[7];
+	}
+
+	for(b1=bufs,i=2;i;i--,b1+=16)
+	{
+		b1[8]  += b1[12];
+		b1[12] += b1[10];
+		b1[10] += b1[14];
+		b1[14] += b1[9];
+		b1[9]  += b1[13];
+		b1[13] += b1[11];
+		b1[11] += b1[15];
+	}
+ }
+
+	out0[0x10*16] = bufs[0];
+	out0[0x10*15] = bufs[16+0]  + bufs[16+8];
+	out0[0x10*14] = bufs[8];
+	out0[0x10*13] = bufs[16+8]  + bufs[16+4];
+	out0[0x10*12] = bufs[4];
+	out0[0x10*11] = bufs[16+4]  + bufs[16+12];
+	out0[0x10*10] = bufs[12];
+	out0[0x10* 9] = bufs[16+12] + bufs[16+2];
+	out0[0x10* 8] = bufs[2];
+	out0[0x10* 7] = bufs[16+2]  + bufs[16+10];
+	out0[0x10* 6] = bufs[10];
+	out0[0x10* 5] = bufs[16+10] + bufs[16+6];
+	out0[0x10* 4] = bufs[6];
+	out0[0x10* 3] = bufs[16+6]  + bufs[16+14];
+	out0[0x10* 2] = bufs[14];
+	out0[0x10* 1] = bufs[16+14] + bufs[16+1];
+	out0[0x10* 0] = bufs[1];
+
+	out1[0x10* 0] = bufs[1];
+	out1[0x10* 1] = bufs[16+1]  + bufs[16+9];
+	out1[0x10* 2] = bufs[9];
+	out1[0x10* 3] = bufs[16+9]  + bufs[16+5];
+	out1[0x10* 4] = bufs[5];
+	out1[0x10* 5] = bufs[16+5]  + bufs[16+13];
+	out1[0x10* 6] = bufs[13];
+	out1[0x10* 7] = bufs[16+13] + bufs[16+3];
+	out1[0x10* 8] = bufs[3];
+	out1[0x10* 9] = bufs[16+3]  + bufs[16+11];
+	out1[0x10*10] = bufs[11];
+	out1[0x10*11] = bufs[16+11] + bufs[16+7];
+	out1[0x10*12] = bufs[7];
+	out1[0x10*13] = bufs[16+7]  + bufs[16+15];
+	out1[0x10*14] = bufs[15];
+	out1[0x10*15] = bufs[16+15];
+}
+
+/* The window of the assembly synths: decwin in the layout of
+   make_decode_tables() for SSE, where the rows from 16 on are negated and
+   run backwards over b0. synth_1to1_x86_64_accurate_asm() sums the 16
+   products of a sample in 4 lanes of 4, the stereo AVX synths in 8 lanes
+   of 2, both followed by sums of pairs of lanes. */
+static BATCH_TARGET void BATCH_NAME(window_sse)
+(	bvec *b0, const real *window, bvec *out, int order )
+{
+	int i, j;
+
+	for(j=0; j<32; j++, window+=0x20)
+	{
+		bvec *b = b0 + 0x10*(j < 16 ? j : 32-j);
+		bvec lane[8];
+		if(order == batch_avx)
+		{
+			for(i=0; i<8; ++i)
+				lane[i] = window[i] * b[i] + window[i+8] * b[i+8];
+			if(j < 16)
+				out[j] = ((lane[0] + lane[2]) - (lane[1] + lane[3]))
+				+        ((lane[4] + lane[6]) - (lane[5] + lane[7]));
+			else
+				out[j] = ((lane[0] + lane[2]) + (lane[1] + lane[3]))
+				+        ((lane[4] + lane[6]) + (lane[5] + lane[7]));
+		}
+		else
+		{
+			for(i=0; i<4; ++i)
+				lane[i] = (window[i]   * b[i]   + window[i+4]  * b[i+4])
+				+         (window[i+8] * b[i+8] + window[i+12] * b[i+12]);
+			if(j < 16)
+				out[j] = (lane[2] - lane[3]) + (lane[0] - lane[1]);
+			else
+				out[j] = (lane[2] + lane[3]) + (lane[0] + lane[1]);
+		}
+	}
+}
+
+/* One synth call on the history in buf[2] at offset bo (already stepped),
+   producing the 32 samples in out. */
+static BATCH_TARGET void BATCH_NAME(synth)
+(	bvec **buf, int bo, const real *decwin, bvec *band, bvec *out, int order )
+{
+	bvec *b0;
+	const real *window;
+	int bo1, j;
+
+	if(bo & 0x1)
+	{
+		b0 = buf[0];
+		bo1 = bo;
+		BATCH_NAME(dct64)(buf[1]+((bo+1)&0xf),buf[0]+bo,band,order!=batch_c);
+	}
+	else
+	{
+		b0 = buf[1];
+		bo1 = bo+1;
+		BATCH_NAME(dct64)(buf[0]+bo,buf[1]+bo+1,band,order!=batch_c);
+	}
+
+	if(order != batch_c)
+	{
+		BATCH_NAME(window_sse)(b0, decwin + 16 - (bo1 & 0xf), out, order);
+		return;
+	}
+
+	window = decwin + 16 - bo1;
+	for(j=0; j<16; j++, b0+=0x10, window+=0x20)
+	{
+		bvec sum;
+		sum  = window[0x0] * b0[0x0];
+		sum -= window[0x1] * b0[0x1];
+		sum += window[0x2] * b0[0x2];
+		sum -= window[0x3] * b0[0x3];
+		sum += window[0x4] * b0[0x4];
+		sum -= window[0x5] * b0[0x5];
+		sum += window[0x6] * b0[0x6];
+		sum -= window[0x7] * b0[0x7];
+		sum += window[0x8] * b0[0x8];
+		sum -= window[0x9] * b0[0x9];
+		sum += window[0xA] * b0[0xA];
+		sum -= window[0xB] * b0[0xB];
+		sum += window[0xC] * b0[0xC];
+		sum -= window[0xD] * b0[0xD];
+		sum += window[0xE] * b0[0xE];
+		sum -= window[0xF] * b0[0xF];
+		out[j] = sum;
+	}
+
+	{
+		bvec sum;
+		sum  = window[0x0] * b0[0x0];
+		sum += window[0x2] * b0[0x2];
+		sum += window[0x4] * b0[0x4];
+		sum += window[0x6] * b0[0x6];
+		sum += window[0x8] * b0[0x8];
+		sum += window[0xA] * b0[0xA];
+		sum += window[0xC] * b0[0xC];
+		sum += window[0xE] * b0[0xE];
+		out[16] = sum;
+		b0-=0x10;
+		window-=0x20;
+	}
+	window += bo1<<1;
+
+	for(j=17; j<32; j++, b0-=0x10, window-=0x20)
+	{
+		bvec sum;
+		sum = -(window[-0x1] * b0[0x0]);
+		sum -= window[-0x2] * b0[0x1];
+		sum -= window[-0x3] * b0[0x2];
+		sum -= window[-0x4] * b0[0x3];
+		sum -= window[-0x5] * b0[0x4];
+		sum -= window[-0x6] * b0[0x5];
+		sum -= window[-0x7] * b0[0x6];
+		sum -= window[-0x8] * b0[0x7];
+		sum -= window[-0x9] * b0[0x8];
+		sum -= window[-0xA] * b0[0x9];
+		sum -= window[-0xB] * b0[0xA];
+		sum -= window[-0xC] * b0[0xB];
+		sum -= window[-0xD] * b0[0xC];
+		sum -= window[-0xE] * b0[0xD];
+		sum -= window[-0xF] * b0[0xE];
+		sum -= window[-0x10] * b0[0xF];
+		out[j] = sum;
+	}
+}
+
+#ifdef BATCH_CLIP16
+/* The clipping of WRITE_SHORT_SAMPLE for all lanes, leaving only the
+   rounding for the lanes. Stores the clip count of each lane. */
+static BATCH_TARGET void BATCH_NAME(clip16)(bvec *out, bmask *clipcount)
+{
+	bvec hi = (bvec){0} + (real)REAL_PLUS_32767;
+	bvec lo = (bvec){0} + (real)REAL_MINUS_32768;
+	bmask clips = {0};
+	int j;
+
+	for(j=0; j<SBLIMIT; ++j)
+	{
+		bmask over  = out[j] > hi;
+		bmask under = out[j] < lo;
+		/* The comparisons give -1 for true. */
+		clips -= over;
+		clips -= under;
+		out[j] = (bvec)( (over & (bmask)hi) | (under & (bmask)lo)
+		|	(~(over | under) & (bmask)out[j]) );
+	}
+	*clipcount = clips;
+}
+#endif
+
+#ifdef BATCH_S32
+/* WRITE_S32_SAMPLE for all lanes, to integers in iout. REAL_TO_S32()
+   adds 0.5 in double precision: a float is a whole number from 2^23 on
+   and stays as it is then. Stores the clip count of each lane. */
+static BATCH_TARGET void BATCH_NAME(s32)(bvec *out, bmask *iout, bmask *clipcount)
+{
+	bvec hi = (bvec){0} + (real)BATCH_HI_S32;
+	bvec lo = (bvec){0} + (real)REAL_MINUS_S32;
+	bmask clips = {0};
+	int j;
+
+	for(j=0; j<SBLIMIT; ++j)
+	{
+		bvec x = out[j] * (real)S32_RESCALE;
+		bmask over  = BATCH_OVER_S32(x, hi);
+		bmask under = x < lo;
+#ifdef ACCURATE_ROUNDING
+		bvec half = (bvec){0} + (real)0.5;
+		bmask pos = x > (bvec){0};
+		bvec r = x + (bvec)( (pos & (bmask)half) | (~pos & (bmask)-half) );
+#ifdef REAL_IS_FLOAT
+		bvec big = (bvec){0} + (real)8388608.0;
+		bmask whole = (x >= big) | (x <= -big);
+		r = (bvec)( (whole & (bmask)x) | (~whole & (bmask)r) );
+#endif
+#else
+		bvec r = x;
+#endif
+		clips -= over;
+		clips -= under;
+		iout[j] = (over & ((bmask){0} + 0x7fffffff))
+		|	(under & ((bmask){0} - 0x7fffffff - 1))
+		|	(~(over | under) & __builtin_convertvector(r, bmask));
+	}
+	*clipcount = clips;
+}
+#endif
+
+/* The 16 bit conversion of the assembly synths: cvtps2dq rounds to
+   nearest even and gives 0x80000000 out of range (also for NaN, which
+   counts as clipped over), packssdw saturates. The stereo AVX synth
+   counts clipping from 32767.999 on only. Stores the clip count of each
+   lane. */
+static BATCH_TARGET void BATCH_NAME(s16_sse)
+(	bvec *out, bmask *iout, bmask *clipcount, int order )
+{
+	bvec hi  = (bvec){0} + (real)32767.0;
+	bvec lo  = (bvec){0} - (real)32768.0;
+	bvec big = (bvec){0} + (real)2147483648.0;
+	bvec top = order == batch_avx ? (bvec){0} + (real)32767.998046875 : hi;
+	bmask clips = {0};
+	int j;
+
+	for(j=0; j<SBLIMIT; ++j)
+	{
+		bmask over  = ~(out[j] <= hi);
+		bmask under = out[j] < lo;
+		bmask wild  = ~((out[j] < big) & (out[j] >= -big));
+		bvec x = (bvec)( (over & (bmask)hi) | (under & (bmask)lo)
+		|	(~(over | under) & (bmask)out[j]) );
+		clips -= ~(out[j] <= top);
+		clips -= under;
+		iout[j] = (wild & ((bmask){0} - 32768))
+		|	(~wild & (bmask)(x + (real)12582912.0));
+	}
+	*clipcount = clips;
+}
+
+#ifdef BATCH_S32
+/* The same for the s32 synths, which check clipping on the sum and
+   convert it scaled by 65536, flipping 0x80000000 to 0x7fffffff for the
+   clipped over ones. */
+static BATCH_TARGET void BATCH_NAME(s32_sse)(bvec *out, bmask *iout, bmask *clipcount)
+{
+	bvec hi  = (bvec){0} + (real)32767.998046875;
+	bvec lo  = (bvec){0} - (real)32768.0;
+	bvec big = (bvec){0} + (real)8388608.0;
+	bmask clips = {0};
+	int j;
+
+	for(j=0; j<SBLIMIT; ++j)
+	{
+		bvec y = out[j] * (real)65536.0;
+		bmask over  = ~(out[j] <= hi);
+		bmask under = out[j] < lo;
+		/* Round to nearest even below 2^23, above a float is a whole number. */
+		bmask pos   = y > (bvec){0};
+		bmask whole = ~((y < big) & (y > -big));
+		bvec magic = (bvec)( (pos & (bmask)big) | (~pos & (bmask)-big) );
+		bvec r = (bvec)( (whole & (bmask)y) | (~whole & (bmask)((y + magic) - magic)) );
+		clips -= over;
+		clips -= under;
+		iout[j] = (over & ((bmask){0} + 0x7fffffff))
+		|	(under & ((bmask){0} - 0x7fffffff - 1))
+		|	(~(over | under) & __builtin_convertvector(r, bmask));
+	}
+	*clipcount = clips;
+}
+#endif
+
+/* Transpose the 8x8 block in v, v[i][j] becomes v[j][i]. */
+static inline BATCH_TARGET void BATCH_NAME(transpose)(bvec *v)
+{
+	bvec t[8], s[8];
+	int i;
+
+	for(i=0; i<8; i+=2)
+	{
+		t[i]   = BATCH_SHUFFLE(v[i], v[i+1], 0, 8, 1, 9, 4, 12, 5, 13);
+		t[i+1] = BATCH_SHUFFLE(v[i], v[i+1], 2, 10, 3, 11, 6, 14, 7, 15);
+	}
+	for(i=0; i<8; i+=4)
+	{
+		s[i]   = BATCH_SHUFFLE(t[i],   t[i+2], 0, 1, 8, 9, 4, 5, 12, 13);
+		s[i+1] = BATCH_SHUFFLE(t[i],   t[i+2], 2, 3, 10, 11, 6, 7, 14, 15);
+		s[i+2] = BATCH_SHUFFLE(t[i+1], t[i+3], 0, 1, 8, 9, 4, 5, 12, 13);
+		s[i+3] = BATCH_SHUFFLE(t[i+1], t[i+3], 2, 3, 10, 11, 6, 7, 14, 15);
+	}
+	for(i=0; i<4; ++i)
+	{
+		v[i]   = BATCH_SHUFFLE(s[i], s[i+4], 0, 1, 2, 3, 8, 9, 10, 11);
+		v[i+4] = BATCH_SHUFFLE(s[i], s[i+4], 4, 5, 6, 7, 12, 13, 14, 15);
+	}
+}
+
+/* count values of each lane (a multiple of BATCH_LANES) into vectors. */
+static BATCH_TARGET void BATCH_NAME(gather)(bvec *dst, const real **src, int count)
+{
+	bvec v[BATCH_LANES];
+	int i, l;
+
+	for(i=0; i<count; i+=BATCH_LANES)
+	{
+		for(l=0; l<BATCH_LANES; ++l)
+			v[l] = *(const ubvec*)(src[l]+i);
+		BATCH_NAME(transpose)(v);
+		for(l=0; l<BATCH_LANES; ++l)
+			dst[i+l] = v[l];
+	}
+}
+
+/* The other way round, for the lanes with dst[l] != NULL. */
+static BATCH_TARGET void BATCH_NAME(scatter)(real **dst, const bvec *src, int count)
+{
+	bvec v[BATCH_LANES];
+	int i, l;
+
+	for(i=0; i<count; i+=BATCH_LANES)
+	{
+		for(l=0; l<BATCH_LANES; ++l)
+			v[l] = src[i+l];
+		BATCH_NAME(transpose)(v);
+		for(l=0; l<BATCH_LANES; ++l)
+			if(dst[l] != NULL)
+				*(ubvec*)(dst[l]+i) = v[l];
+	}
+}
+
+/* Synthesis for the recorded calls of up to BATCH_LANES handles, which
+   all have the same parity of fr->bo (the same fr->bo for the assembly
+   orders), the same format and the same order of operations. */
+static BATCH_TARGET void BATCH_NAME(group)(mpg123_handle **fr, int n, int order)
+{
+	/* Unused lanes just compute zeros. */
+	static const real zero[0x110];
+	bvec hist[2][0x110];
+	bvec band[SBLIMIT];
+	bvec out[SBLIMIT];
+	bmask iout[SBLIMIT];
+	bmask clips;
+	real stage[BATCH_LANES][0x110];
+	const real *src[BATCH_LANES];
+	real *dst[2][BATCH_LANES];
+	bvec *buf[2];
+	int newbo[BATCH_LANES];
+	int format = fr[0]->batch->format;
+	int calls = 0;
+	int channels = 1;
+	int l, ch, c, b, j;
+
+	buf[0] = hist[0];
+	buf[1] = hist[1];
+	for(l=0; l<n; ++l)
+	{
+		if(fr[l]->batch->calls > calls)
+			calls = fr[l]->batch->calls;
+		if(fr[l]->batch->kind == batch_stereo)
+			channels = 2;
+	}
+	for(ch=0; ch<channels; ++ch)
+	{
+		int bo = fr[0]->bo;
+		/* Every history goes in with the offset of the first handle. The
+		   window repeats every 2 slots, so the even rotation does not
+		   change the result. */
+		for(b=0; b<2; ++b)
+		{
+			for(l=0; l<BATCH_LANES; ++l)
+			{
+				const real *h;
+				int rot, row;
+				if(l >= n || (ch && fr[l]->batch->kind != batch_stereo))
+				{
+					src[l] = zero;
+					continue;
+				}
+				h = fr[l]->real_buffs[ch][b];
+				rot = (bo - fr[l]->bo) & 0xf;
+				if(rot)
+				{
+					for(row=0; row<0x110; row+=0x10)
+					{
+						memcpy(stage[l]+row+rot, h+row, sizeof(real)*(0x10-rot));
+						memcpy(stage[l]+row, h+row+0x10-rot, sizeof(real)*rot);
+					}
+					h = stage[l];
+				}
+				src[l] = h;
+			}
+			BATCH_NAME(gather)(hist[b], src, 0x110);
+		}
+		for(c=0; c<calls; ++c)
+		{
+			int last = 0;
+			bo--;
+			bo &= 0xf;
+			for(l=0; l<BATCH_LANES; ++l)
+			{
+				struct synth_batch *sb = l < n ? fr[l]->batch : NULL;
+				src[l] = zero;
+				if(sb && c < sb->calls && (!ch || sb->kind == batch_stereo))
+					src[l] = sb->band[c][ch];
+			}
+			BATCH_NAME(gather)(band, src, SBLIMIT);
+			BATCH_NAME(synth)(buf, bo, fr[0]->decwin, band, out, order);
+			/* Scaling and clipping are the same for all lanes. */
+			switch(format)
+			{
+#ifndef NO_16BIT
+				case batch_s16:
+					if(order != batch_c)
+						BATCH_NAME(s16_sse)(out, iout, &clips, order);
+#ifdef BATCH_CLIP16
+					else
+					{
+						BATCH_NAME(clip16)(out, &clips);
+#ifdef BATCH_FTOI16
+						for(j=0; j<SBLIMIT; ++j)
+							iout[j] = (bmask)(out[j] + 12582912.0f);
+#endif
+					}
+#endif
+				break;
+#endif
+#ifndef NO_REAL
+				case batch_real:
+					for(j=0; j<SBLIMIT; ++j)
+						out[j] *= (real)1./SHORT_SCALE;
+				break;
+#endif
+#ifdef BATCH_S32
+				case batch_s32:
+					if(order != batch_c)
+						BATCH_NAME(s32_sse)(out, iout, &clips);
+					else
+						BATCH_NAME(s32)(out, iout, &clips);
+				break;
+#endif
+				default:
+				break;
+			}
+			for(l=0; l<n; ++l)
+			{
+				struct synth_batch *sb = fr[l]->batch;
+				unsigned char *samples;
+				int step = 2;
+				dst[0][l] = dst[1][l] = NULL;
+				if(c >= sb->calls || (ch && sb->kind != batch_stereo))
+					continue;
+				samples = fr[l]->buffer.data + sb->offset[c];
+				if(sb->kind == batch_mono)
+					step = 1;
+				switch(format)
+				{
+#ifndef NO_16BIT
+					case batch_s16:
+						if(order != batch_c)
+						{
+							BATCH_STORE(short, iout, (short))
+							sb->clip += clips[l];
+							break;
+						}
+#if defined(BATCH_FTOI16)
+						BATCH_STORE(short, iout, (short))
+						sb->clip += clips[l];
+#elif defined(BATCH_CLIP16)
+						BATCH_STORE(short, out, REAL_TO_SHORT)
+						sb->clip += clips[l];
+#else
+						BATCH_WRITE(short, WRITE_SHORT_SAMPLE)
+#endif
+					break;
+#endif
+#ifndef NO_REAL
+					case batch_real:
+						BATCH_STORE(real, out, )
+					break;
+#endif
+#ifndef NO_32BIT
+					case batch_s32:
+#ifdef BATCH_S32
+						BATCH_STORE(int32_t, iout, (int32_t))
+						sb->clip += clips[l];
+#else
+						BATCH_WRITE(int32_t, WRITE_S32_SAMPLE)
+#endif
+					break;
+#endif
+				}
+				/* Done with this one. The history stays rotated, with the
+				   offset of the group. */
+				if(c+1 == sb->calls)
+				{
+					dst[0][l] = fr[l]->real_buffs[ch][0];
+					dst[1][l] = fr[l]->real_buffs[ch][1];
+					newbo[l] = bo;
+					last = 1;
+				}
+			}
+			if(last)
+			{
+				for(l=n; l<BATCH_LANES; ++l)
+					dst[0][l] = dst[1][l] = NULL;
+				for(b=0; b<2; ++b)
+					BATCH_NAME(scatter)(dst[b], hist[b], 0x110);
+			}
+		}
+	}
+	for(l=0; l<n; ++l)
+		fr[l]->bo = newbo[l];
+}
@@ -28,6 +28,13 @@
 #include "synth.h"
 #undef SYNTH_NAME
 
+/* The same, writing to separate channel planes. */
+#define PLANAR_SYNTH
+#define SYNTH_NAME synth_1to1_s32_planar
+#include "synth.h"
+#undef SYNTH_NAME
+#undef PLANAR_SYNTH
+
 /* Mono-related synths; they wrap over _some_ synth_1to1_s32 (could be generic, could be i386). */
 #define SYNTH_NAME       fr->synths.plain[r_1to1][f_32]
 #define MONO_NAME        synth_1to1_s32_mono
@@ -96,7 +96,7 @@ void make_decode_tables_mmx(mpg123_handle *fr)
 {
 	debug("MMX decode tables");
 	/* Take care: The scale should be like before, when we didn't have float output all around. */
-	make_decode_tables_mmx_asm((long)((fr->lastscale < 0 ? fr->p.outscale : fr->lastscale)*SHORT_SCALE), fr->decwin_mmx, fr->decwins);
+	make_decode_tables_mmx_asm((long)(synth_scale(fr)*SHORT_SCALE), fr->decwin_mmx, fr->decwins);
 	debug("MMX decode tables done");
 }
 #else
@@ -114,7 +114,7 @@ void make_decode_tables_mmx(mpg123_handle *fr)
 	int idx = 0;
 	short *ptr = (short *)fr->decwins;
 	/* Scale is always based on 1.0 . */
-	double scaleval = -0.5*(fr->lastscale < 0 ? fr->p.outscale : fr->lastscale);
+	double scaleval = -0.5*synth_scale(fr);
 	debug1("MMX decode tables with scaleval %g", scaleval);
 	for(i=0,j=0;i<256;i++,j++,idx+=32)
 	{
@@ -187,7 +187,7 @@ void make_decode_tables(mpg123_handle *fr)
 	real scaleval_long;
 #endif
 	/* Scale is always based on 1.0 . */
-	scaleval = -0.5*(fr->lastscale < 0 ? fr->p.outscale : fr->lastscale);
+	scaleval = -0.5*synth_scale(fr);
 	debug1("decode tables with scaleval %g", scaleval);
 #ifdef REAL_IS_FIXED
 	scaleval_long = DOUBLE_TO_REAL_15(scaleval);
@@ -25,6 +25,12 @@
 	For more immediate concerns, you can send SIGINT. The only result is that this
 	interrupts a current device writing operation and causes the buffer to wait
 	for a following command.
+
+	With OUT123_BUFFER_THREAD, the buffer runs as a thread in the same process,
+	working on its own out123 handle, but otherwise using the same command
+	protocol. Data is handed over without any message while the buffer is busy
+	(see xfermem.h). There is no SIGINT for the thread, so pause and drop wait
+	for the current device write to finish.
 */
 
 /* Needed for kill() from signal.h. */
@@ -56,16 +62,15 @@
 #define BUF_CMD_NDRAIN   XF_CMD_CUSTOM7
 #define BUF_CMD_AUDIOFMT XF_CMD_CUSTOM8
 
-/* TODO: Dynamically allocate that to allow multiple instances. */
-int outburst = 32768;
-
-/* This is static and global for the forked buffer process.
-   Another forked buffer process will have its on value. */
-static int intflag = FALSE;
+/* The flag of the handle in a forked buffer process, for the signal
+   handler. There is only one buffer loop in that process. Buffer threads
+   get no SIGINT and leave this alone, each has the flag in its handle. */
+static volatile sig_atomic_t *catch_intflag = NULL;
 
 static void catch_interrupt (void)
 {
-	intflag = TRUE;
+	if(catch_intflag)
+		*catch_intflag = TRUE;
 }
 
 static int read_record(out123_handle *ao
@@ -83,11 +88,88 @@ static void catch_child(void)
 	Functions called from the controlling process.
 */
 
+#ifdef XFERMEM_THREAD
+static void *buffer_thread(void *arg)
+{
+	out123_handle *ao = arg; /* The thread's own handle. */
+	int ret = buffer_loop(ao);
+	if(ret && !AOQUIET)
+		error1("Buffer thread issues arose, non-zero return value %i.", ret);
+	/* Closing my end of the command channel, so that the writer notices if
+	   this happened unexpectedly. The memory is not shared with another
+	   process, so marking it as closed is fine. */
+	close(ao->buffermem->fd[XF_READER]);
+	ao->buffermem->fd[XF_READER] = -1;
+	ao->buffermem = NULL;
+	out123_del(ao);
+	return NULL;
+}
+
+/* Start a buffer thread with its own handle. The parameters are transferred
+   via the command channel, just as for updates later on. */
+static int buffer_init_thread(out123_handle *ao, size_t bytes)
+{
+	out123_handle *bao;
+	int cmd;
+
+	if(xfermem_init_thread(&ao->buffermem, bytes))
+	{
+		ao->errcode = OUT123_DOOM;
+		return -1;
+	}
+	bao = out123_new();
+	if(!bao)
+	{
+		xfermem_done(ao->buffermem);
+		ao->buffermem = NULL;
+		ao->errcode = OUT123_DOOM;
+		return -1;
+	}
+	bao->buffermem = ao->buffermem;
+	if(pthread_create(&ao->buffer_thread, NULL, buffer_thread, bao))
+	{
+		if(!AOQUIET)
+			error("cannot create buffer thread!");
+		bao->buffermem = NULL;
+		out123_del(bao);
+		xfermem_done(ao->buffermem);
+		ao->buffermem = NULL;
+		ao->errcode = OUT123_BUFFER_ERROR;
+		return -1;
+	}
+	ao->buffer_pid = 0;
+	debug("waiting for inital pong from buffer thread");
+	if( (cmd=xfermem_getcmd(ao->buffermem->fd[XF_WRITER], TRUE))
+	    != XF_CMD_PONG || buffer_sync_param(ao) )
+	{
+		if(!AOQUIET)
+			error2("Got %i instead of expected initial response %i from buffer thread."
+			,	cmd, XF_CMD_PONG);
+		buffer_exit(ao);
+		ao->errcode = OUT123_BUFFER_ERROR;
+		return -1;
+	}
+	return 0;
+}
+#endif
+
 /* Start a buffer process. */
 int buffer_init(out123_handle *ao, size_t bytes)
 {
 	buffer_exit(ao);
-	if(bytes < outburst) bytes = 2*outburst;
+	if(bytes < ao->outburst) bytes = 2*ao->outburst;
+
+	if(ao->flags & OUT123_BUFFER_THREAD)
+	{
+#ifdef XFERMEM_THREAD
+		return buffer_init_thread(ao, bytes);
+#else
+		if(!AOQUIET)
+			error("This build does not support a buffer thread.");
+		ao->errcode = OUT123_BUFFER_ERROR;
+		return -1;
+#endif
+	}
 
 #ifdef DONT_CATCH_SIGNALS
 #error I really need to catch signals here!
@@ -157,6 +239,19 @@ void buffer_exit(out123_handle *ao)
 	int status = 0;
 	if(ao->buffer_pid == -1) return;
 
+#ifdef XFERMEM_THREAD
+	if(ao->buffer_pid == 0)
+	{
+		debug("ending buffer thread");
+		buffer_stop(ao);
+		buffer_end(ao);
+		pthread_join(ao->buffer_thread, NULL);
+		xfermem_done(ao->buffermem);
+		ao->buffermem = NULL;
+		ao->buffer_pid = -1;
+		return;
+	}
+#endif
 	debug("ending buffer");
 	buffer_stop(ao); /* Puts buffer into waiting-for-command mode. */
 	buffer_end(ao);  /* Gives command to end operation. */
@@ -356,7 +451,8 @@ BUFFER_SIMPLE_CONTROL(buffer_close, BUF_CMD_CLOSE)
 #define BUFFER_SIGNAL_CONTROL(name, cmd) \
 void name(out123_handle *ao) \
 { \
-	kill(ao->buffer_pid, SIGINT); \
+	if(ao->buffer_pid > 0) \
+		kill(ao->buffer_pid, SIGINT); \
 	xfermem_putcmd(ao->buffermem->fd[XF_WRITER], cmd); \
 	xfermem_getcmd(ao->buffermem->fd[XF_WRITER], TRUE); \
 }
@@ -478,14 +574,14 @@ static void buffer_play(out123_handle *ao, size_t bytes)
 	if (bytes > xf->size - xf->readindex)
 		bytes = xf->size - xf->readindex;
 	/* Not more than configured output block. */
-	if (bytes > outburst)
-		bytes = outburst;
+	if (bytes > ao->outburst)
+		bytes = ao->outburst;
 	/* The output can only take multiples of framesize. */
 	bytes -= bytes % ao->framesize;
 	/* Actual work by out123_play to ensure logic like automatic continue. */
 	written = out123_play(ao, (unsigned char*)xf->data+xf->readindex, bytes);
 	/* Advance read pointer by the amount of written bytes. */
-	xf->readindex = (xf->readindex + written) % xf->size;
+	xfermem_set_readindex(xf, (xf->readindex + written) % xf->size);
 	/* Detect a fatal error by proxy. */
 	if(ao->errcode == OUT123_DEV_PLAY)
 		out123_close(ao);
@@ -526,7 +622,13 @@ int xfer_write_string(out123_handle *ao, int who, const char *buf)
 int xfer_read_string(out123_handle *ao, int who, char **buf)
 {
 	/* ao->errcode set in read_record() */
-	return read_record(ao, who, (void**)buf, NULL, NULL, 0, NULL)
+	return xfer_read_string_buf(ao, who, buf, NULL, NULL, 0);
+}
+
+int xfer_read_string_buf(out123_handle *ao, int who, char **buf
+,	byte *prebuf, int *preoff, int presize)
+{
+	return read_record(ao, who, (void**)buf, prebuf, preoff, presize, NULL)
 	? -1 /* read_record could return 2, normalize to -1 */
 	: 0;
 }
@@ -607,10 +709,18 @@ int buffer_loop(out123_handle *ao)
 	   but we are playing (as soon as enough data is there, the device is,
 	   too). */
 	enum playstate mystate = ao->state;
+#ifdef XFERMEM_THREAD
+	size_t seen_writes = 0;
+#endif
 
 	ao->flags &= ~OUT123_KEEP_PLAYING; /* No need for that here. */
-	/* Be prepared to use SIGINT for communication. */
-	catchsignal (SIGINT, catch_interrupt);
+	/* Be prepared to use SIGINT for communication. A thread must not
+	   meddle with the signal handling of the whole process, though. */
+	if(!xf->threaded)
+	{
+		catch_intflag = &ao->intflag;
+		catchsignal (SIGINT, catch_interrupt);
+	}
 	/* sigprocmask (SIG_SETMASK, oldsigset, NULL); */
 	/* Say hello to the writer. */
 	xfermem_putcmd(my_fd, XF_CMD_PONG);
@@ -628,7 +738,7 @@ int buffer_loop(out123_handle *ao)
 				preloading = (bytes < preload_size(ao));
 			if(!preloading)
 			{
-				if(!draining && bytes < outburst)
+				if(!draining && bytes < ao->outburst)
 					preloading = TRUE;
 				else
 				{
@@ -642,7 +752,7 @@ int buffer_loop(out123_handle *ao)
 		}
 		/* Now always check for a pending command, in a blocking way if there is
 		   no playback. */
-		debug2("Buffer cmd? (Interruped: %i) (mystate=%i)", intflag, (int)mystate);
+		debug2("Buffer cmd? (Interruped: %i) (mystate=%i)", (int)ao->intflag, (int)mystate);
 		/*
 			The writer only ever signals before sending a command and also waiting
 			for a response. So, the right place to reset the flag is any time
@@ -658,17 +768,36 @@ int buffer_loop(out123_handle *ao)
 			byte cmd[100];
 			int cmdcount;
 			int i;
+			int block = preloading || ao->intflag || (mystate != play_live);
 
-			cmdcount = xfermem_getcmds( my_fd
-			,	(preloading || intflag || (mystate != play_live))
-			,	cmd
-			,	sizeof(cmd) );
+#ifdef XFERMEM_THREAD
+			if(block && xf->threaded)
+				block = xfermem_reader_sleep(xf, seen_writes);
+#endif
+			cmdcount = xfermem_getcmds(my_fd, block, cmd, sizeof(cmd));
 			if(cmdcount < 0)
 			{
 				if(!AOQUIET)
 					error1("Reading a command set returned %i, my link is broken.", cmdcount);
 				return 1;
 			}
+#ifdef XFERMEM_THREAD
+			/* New data is not announced by XF_CMD_DATA for a busy thread,
+			   so act on it here, before any command that came later. */
+			if(xf->threaded)
+			{
+				size_t writes;
+				xf_store(xf->reader_wait, 0);
+				writes = xf_load(xf->writes);
+				if(writes != seen_writes)
+				{
+					seen_writes = writes;
+					if(mystate == play_paused)
+						mystate = play_live;
+					draining = FALSE;
+				}
+			}
+#endif
 #ifdef DEBUG
 			for(i=0; i<cmdcount; ++i)
 				debug2("cmd[%i]=%u", i, cmd[i]);
@@ -691,7 +820,7 @@ int buffer_loop(out123_handle *ao)
 					draining = FALSE;
 				break;
 				case XF_CMD_PING:
-					intflag = FALSE;
+					ao->intflag = FALSE;
 					/* Expecting ping-pong only while playing! Otherwise, the writer
 					   could get stuck waiting for free space forever. */
 					if(mystate == play_live)
@@ -706,7 +835,7 @@ int buffer_loop(out123_handle *ao)
 					}
 				break;
 				case BUF_CMD_PARAM:
-					intflag = FALSE;
+					ao->intflag = FALSE;
 					/* If that does not work, communication is broken anyway and
 					   writer will notice soon enough. */
 					read_parameters(ao, XF_READER, cmd, &i, cmdcount);
@@ -719,7 +848,7 @@ int buffer_loop(out123_handle *ao)
 					char *device  = NULL;
 					int success;
 
-					intflag = FALSE;
+					ao->intflag = FALSE;
 					success = (
 						!read_record( ao, XF_READER, (void**)&driver
 						,	cmd, &i, cmdcount, NULL )
@@ -750,7 +879,7 @@ int buffer_loop(out123_handle *ao)
 				}
 				break;
 				case BUF_CMD_CLOSE:
-					intflag = FALSE;
+					ao->intflag = FALSE;
 					out123_close(ao);
 					draining = FALSE;
 					mystate = ao->state;
@@ -760,7 +889,7 @@ int buffer_loop(out123_handle *ao)
 				{
 					int encodings;
 
-					intflag = FALSE;
+					ao->intflag = FALSE;
 					if(
 						!GOOD_READVAL_BUF(my_fd, ao->channels)
 					||	!GOOD_READVAL_BUF(my_fd, ao->rate)
@@ -833,7 +962,7 @@ int buffer_loop(out123_handle *ao)
 				}
 				break;
 				case BUF_CMD_START:
-					intflag = FALSE;
+					ao->intflag = FALSE;
 					draining = FALSE;
 					if(
 						!GOOD_READVAL_BUF(my_fd, ao->format)
@@ -857,7 +986,7 @@ int buffer_loop(out123_handle *ao)
 					}
 				break;
 				case BUF_CMD_STOP:
-					intflag = FALSE;
+					ao->intflag = FALSE;
 					if(mystate == play_live)
 					{ /* Drain is implied! */
 						size_t bytes;
@@ -870,7 +999,7 @@ int buffer_loop(out123_handle *ao)
 					xfermem_putcmd(my_fd, XF_CMD_OK);
 				break;
 				case XF_CMD_CONTINUE:
-					intflag = FALSE;
+					ao->intflag = FALSE;
 					debug("continuing");
 					mystate = play_live; /* We'll get errors reported later if that is not right. */
 					preloading = FALSE; /* It should continue without delay. */
@@ -878,13 +1007,13 @@ int buffer_loop(out123_handle *ao)
 					xfermem_putcmd(my_fd, XF_CMD_OK);
 				break;
 				case XF_CMD_IGNLOW:
-					intflag = FALSE;
+					ao->intflag = FALSE;
 					preloading = FALSE;
 					xfermem_putcmd(my_fd, XF_CMD_OK);
 				break;
 				case XF_CMD_DRAIN:
 					debug("buffer drain");
-					intflag = FALSE;
+					ao->intflag = FALSE;
 					if(mystate == play_live)
 					{
 						size_t bytes;
@@ -905,7 +1034,7 @@ int buffer_loop(out123_handle *ao)
 					size_t oldfill;
 
 					debug("buffer ndrain");
-					intflag = FALSE;
+					ao->intflag = FALSE;
 					/* Expect further calls to ndrain, avoid prebuffering. */
 					draining = TRUE;
 					preloading = FALSE;
@@ -940,22 +1069,22 @@ int buffer_loop(out123_handle *ao)
 				}
 				break;
 				case XF_CMD_TERMINATE:
-					intflag = FALSE;
+					ao->intflag = FALSE;
 					/* Will that response always reach the writer? Well, at worst,
 					   it's an ignored error on xfermem_getcmd(). */
 					xfermem_putcmd(my_fd, XF_CMD_OK);
 					return 0;
 				case XF_CMD_PAUSE:
-					intflag = FALSE;
+					ao->intflag = FALSE;
 					draining = FALSE;
 					out123_pause(ao);
 					mystate = ao->state;
 					xfermem_putcmd(my_fd, XF_CMD_OK);
 				break;
 				case XF_CMD_DROP:
-					intflag = FALSE;
+					ao->intflag = FALSE;
 					draining = FALSE;
-					xf->readindex = xf->freeindex;
+					xfermem_set_readindex(xf, xf_load(xf->freeindex));
 					out123_drop(ao);
 					xfermem_putcmd(my_fd, XF_CMD_OK);
 				break;
@@ -966,9 +1095,9 @@ int buffer_loop(out123_handle *ao)
 #undef GOOD_READVAL_BUF
 			}
 		} /* Ensure that an interrupt-giving command has been received. */
-		while(intflag);
-		if(intflag && !AOQUIET)
+		while(ao->intflag);
+		if(ao->intflag && !AOQUIET)
 			error("buffer: The intflag should not be set anymore.");
-		intflag = FALSE; /* Any possible harm by _not_ ensuring that the flag is cleared here? */
+		ao->intflag = FALSE; /* Any possible harm by _not_ ensuring that the flag is cleared here? */
 	}
 }
@@ -62,5 +62,8 @@ int read_buf(int fd, void *addr, size_t size
 /* Read/write strings from/to command channel. 0 on success. */
 int xfer_write_string(out123_handle *ao, int who, const char *buf);
 int xfer_read_string(out123_handle *ao, int who, char* *buf);
+/* Same, but taking the start from a prebuffer first, like read_buf(). */
+int xfer_read_string_buf(out123_handle *ao, int who, char* *buf
+,	byte *prebuf, int *preoff, int presize);
 
 #endif
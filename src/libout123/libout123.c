@@ -81,6 +81,7 @@ out123_handle* attribute_align_arg out123_new(void)
 	ao->buffer_fd[0] = -1;
 	ao->buffer_fd[1] = -1;
 	ao->buffermem = NULL;
+	ao->intflag = FALSE;
 #endif
 
 	out123_clear_module(ao);
@@ -100,6 +101,7 @@ out123_handle* attribute_align_arg out123_new(void)
 	ao->preload = 0.;
 	ao->verbose = 0;
 	ao->device_buffer = 0.;
+	ao->outburst = OUTBURST;
 	ao->bindir = NULL;
 	return ao;
 }
@@ -372,8 +374,8 @@ int read_parameters(out123_handle *ao
 	&&	GOOD_READVAL_BUF(fd, ao->device_buffer)
 	&&	GOOD_READVAL_BUF(fd, ao->verbose)
 	&&	GOOD_READVAL_BUF(fd, ao->propflags)
-	&& !xfer_read_string(ao, who, &ao->name)
-	&& !xfer_read_string(ao, who, &ao->bindir)
+	&& !xfer_read_string_buf(ao, who, &ao->name, prebuf, preoff, presize)
+	&& !xfer_read_string_buf(ao, who, &ao->bindir, prebuf, preoff, presize)
 	)
 		return 0;
 	else
@@ -15,7 +15,6 @@
 #include "debug.h"
 
 /* Globals */
-extern int outburst;
 int real_rate_printed = 0;
 
 
@@ -117,9 +116,9 @@ static int open_mint(out123_handle *ao)
 		error1("Can't open %s!",dev);
 		return -1;
 	}
-	ioctl(ao->fn, AIOCGBLKSIZE, &outburst);
-	if(outburst > MAXOUTBURST)
-		outburst = MAXOUTBURST;
+	ioctl(ao->fn, AIOCGBLKSIZE, &ao->outburst);
+	if(ao->outburst > MAXOUTBURST)
+		ao->outburst = MAXOUTBURST;
 	if(audio_reset_parameters(ai) < 0) {
 		close(ao->fn);
 		return -1;
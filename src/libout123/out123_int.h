@@ -18,11 +18,21 @@
 
 #ifndef NOXFERMEM
 #include "xfermem.h"
+#ifdef HAVE_SIGNAL_H
+#include <signal.h>
+#else
+#ifdef HAVE_SYS_SIGNAL_H
+#include <sys/signal.h>
+#endif
+#endif
 #endif
 
 /* 3% rate tolerance */
 #define AUDIO_RATE_TOLERANCE	  3
 
+/* Default for the largest block the buffer hands to the device at once. */
+#define OUTBURST 32768
+
 /* Keep those internally? To the outside, it's just a selection of
    driver modules. */
 enum {
@@ -52,10 +62,17 @@ struct out123_struct
 	enum out123_error errcode;
 #ifndef NOXFERMEM
 	/* If buffer_pid >= 0, there is a separate buffer process actually
-	   handling everything, this instance here is then only a proxy. */
+	   handling everything, this instance here is then only a proxy.
+	   A value of 0 means a buffer thread instead of a process. */
 	int buffer_pid;
 	int buffer_fd[2];
 	txfermem *buffermem;
+#ifdef XFERMEM_THREAD
+	pthread_t buffer_thread;
+#endif
+	/* Interrupt from the writer, for the buffer loop working on this
+	   handle. Set by the SIGINT handler in a forked buffer process. */
+	volatile sig_atomic_t intflag;
 #endif
 
 	int fn;			/* filenumber */
@@ -89,8 +106,8 @@ struct out123_struct
 	double preload;	/* buffer fraction to preload before play */
 	int verbose;	/* verbosity to stderr */
 	double device_buffer; /* device buffer in seconds */
+	int outburst;   /* largest block for one write in the buffer loop */
 	char *bindir;	/* OUT123_BINDIR */
-/* TODO int intflag;   ... is it really useful/necessary from the outside? */
 };
 
 /* Lazy. */
@@ -18,6 +18,12 @@
 #include <sys/mman.h>
 #include <sys/socket.h>
 #include <fcntl.h>
+#ifdef XFERMEM_THREAD
+#include <poll.h>
+#ifdef HAVE_SYS_EVENTFD_H
+#include <sys/eventfd.h>
+#endif
+#endif
 
 #ifndef HAVE_MMAP
 #include <sys/ipc.h>
@@ -82,12 +88,137 @@ void xfermem_init (txfermem **xf, size_t bufsize, size_t msize, size_t skipbuf)
 	(*xf)->metadata = ((char *) *xf) + sizeof(txfermem);
 	(*xf)->size = bufsize;
 	(*xf)->metasize = msize + skipbuf;
+	(*xf)->threaded = 0;
+	(*xf)->wakefd[0] = (*xf)->wakefd[1] = -1;
+	(*xf)->writes = 0;
+	(*xf)->reader_wait = (*xf)->writer_wait = 0;
+}
+
+#ifdef XFERMEM_THREAD
+
+/* How long a writer waits for free space before pinging the reader,
+   which might not be playing at all. */
+#define XF_WAIT_MS 100
+
+int xfermem_init_thread(txfermem **xf, size_t bufsize)
+{
+	txfermem *x = malloc(sizeof(txfermem) + bufsize);
+	if(!x)
+		return -1;
+	x->threaded = 1;
+	x->fd[0] = x->fd[1] = -1;
+	x->wakefd[0] = x->wakefd[1] = -1;
+	if(socketpair(AF_UNIX, SOCK_STREAM, 0, x->fd) < 0)
+		goto init_thread_bad;
+#ifdef HAVE_SYS_EVENTFD_H
+	x->wakefd[0] = x->wakefd[1] = eventfd(0, 0);
+	if(x->wakefd[0] < 0)
+		goto init_thread_bad;
+	fcntl(x->wakefd[0], F_SETFL, O_NONBLOCK);
+#else
+	if(pipe(x->wakefd) < 0)
+		goto init_thread_bad;
+	/* Wakeups are redundant, a full pipe is no reason to block. */
+	fcntl(x->wakefd[0], F_SETFL, O_NONBLOCK);
+	fcntl(x->wakefd[1], F_SETFL, O_NONBLOCK);
+#endif
+	x->freeindex = x->readindex = 0;
+	x->data = (char*)x + sizeof(txfermem);
+	x->metadata = NULL;
+	x->size = bufsize;
+	x->metasize = 0;
+	x->writes = 0;
+	x->reader_wait = x->writer_wait = 0;
+	*xf = x;
+	return 0;
+init_thread_bad:
+	perror("xfermem_init_thread()");
+	xfermem_done(x);
+	return -1;
+}
+
+static void wake_writer(txfermem *xf)
+{
+#ifdef HAVE_SYS_EVENTFD_H
+	uint64_t one = 1;
+#else
+	byte one = 1;
+#endif
+	if(write(xf->wakefd[1], &one, sizeof(one)) < 0)
+		debug1("waking writer failed: %s", strerror(errno));
+}
+
+/* Wait for the reader to give back some space. Returns like
+   xfermem_writer_block(), 0 meaning that it is worth checking again. */
+static int writer_wait(txfermem *xf, size_t bytes)
+{
+	struct pollfd pfd;
+	int ret;
+
+	xf_store(xf->writer_wait, 1);
+	xf_fence();
+	if(xfermem_get_freespace(xf) >= bytes)
+	{
+		xf_store(xf->writer_wait, 0);
+		return 0;
+	}
+	pfd.fd = xf->wakefd[0];
+	pfd.events = POLLIN;
+	ret = poll(&pfd, 1, XF_WAIT_MS);
+	xf_store(xf->writer_wait, 0);
+	if(ret > 0)
+	{
+		/* Consume the wakeup(s), nonblocking. */
+#ifdef HAVE_SYS_EVENTFD_H
+		uint64_t count;
+		if(read(xf->wakefd[0], &count, sizeof(count)) < 0)
+			debug1("eventfd read failed: %s", strerror(errno));
+#else
+		byte dummy[64];
+		while(read(xf->wakefd[0], dummy, sizeof(dummy)) > 0)
+			continue;
+#endif
+		return 0;
+	}
+	if(ret < 0 && errno == EINTR)
+		return 0;
+	/* Nothing happened, the reader may be stuck not playing. */
+	return xfermem_writer_block(xf);
 }
 
+int xfermem_reader_sleep(txfermem *xf, size_t seen_writes)
+{
+	xf_store(xf->reader_wait, 1);
+	xf_fence();
+	if(xf_load(xf->writes) != seen_writes)
+	{
+		xf_store(xf->reader_wait, 0);
+		return FALSE;
+	}
+	return TRUE;
+}
+
+#endif
+
 void xfermem_done (txfermem *xf)
 {
 	if(!xf)
 		return;
+#ifdef XFERMEM_THREAD
+	if(xf->threaded)
+	{
+		int i;
+		for(i=0; i<2; ++i)
+			if(xf->fd[i] >= 0)
+				close(xf->fd[i]);
+		if(xf->wakefd[0] >= 0)
+			close(xf->wakefd[0]);
+		if(xf->wakefd[1] >= 0 && xf->wakefd[1] != xf->wakefd[0])
+			close(xf->wakefd[1]);
+		free(xf);
+		return;
+	}
+#endif
 #ifdef HAVE_MMAP
 	/* Here was a cast to (caddr_t) ... why? Was this needed for SunOS?
 	   Casting to (void*) should silence compilers in case of funny
@@ -122,8 +253,8 @@ size_t xfermem_get_freespace (txfermem *xf)
 	if(!xf)
 		return 0;
 
-	if ((freeindex = xf->freeindex) < 0
-			|| (readindex = xf->readindex) < 0)
+	if ((freeindex = xf_load(xf->freeindex)) < 0
+			|| (readindex = xf_load(xf->readindex)) < 0)
 		return (0);
 	if (readindex > freeindex)
 		return ((readindex - freeindex) - 1);
@@ -138,8 +269,8 @@ size_t xfermem_get_usedspace (txfermem *xf)
 	if(!xf)
 		return 0;
 
-	if ((freeindex = xf->freeindex) < 0
-			|| (readindex = xf->readindex) < 0)
+	if ((freeindex = xf_load(xf->freeindex)) < 0
+			|| (readindex = xf_load(xf->readindex)) < 0)
 		return (0);
 	if (freeindex >= readindex)
 		return (freeindex - readindex);
@@ -279,7 +410,13 @@ int xfermem_write(txfermem *xf, void *buffer, size_t bytes)
 	/* You weren't so braindead not allocating enough space at all, right? */
 	while (xfermem_get_freespace(xf) < bytes)
 	{
+#ifdef XFERMEM_THREAD
+		int cmd = xf->threaded
+		?	writer_wait(xf, bytes)
+		:	xfermem_writer_block(xf);
+#else
 		int cmd = xfermem_writer_block(xf);
+#endif
 		if(cmd) /* Non-successful wait. */
 			return cmd;
 	}
@@ -295,10 +432,34 @@ int xfermem_write(txfermem *xf, void *buffer, size_t bytes)
 		memcpy(xf->data, (char*)buffer + endblock, bytes-endblock);
 	}
 	/* Advance the free space pointer, including the wrap. */
-	xf->freeindex = (xf->freeindex + bytes) % xf->size;
+	xf_store(xf->freeindex, (xf->freeindex + bytes) % xf->size);
+#ifdef XFERMEM_THREAD
+	/* A reader thread only needs a notification if it sleeps.
+	   It notices the changed count of writes otherwise. */
+	if(xf->threaded)
+	{
+		xf_store(xf->writes, xf->writes+1);
+		xf_fence();
+		if(!xf_swap(xf->reader_wait, 0))
+			return 0;
+	}
+#endif
 	/* Always notify the buffer process. */
 	debug("write waking");
 	return xfermem_putcmd(xf->fd[XF_WRITER], XF_CMD_DATA) < 0
 	?	-1
 	:	0;
 }
+
+void xfermem_set_readindex(txfermem *xf, size_t readindex)
+{
+	xf_store(xf->readindex, readindex);
+#ifdef XFERMEM_THREAD
+	if(xf->threaded)
+	{
+		xf_fence();
+		if(xf_swap(xf->writer_wait, 0))
+			wake_writer(xf);
+	}
+#endif
+}
@@ -22,6 +22,24 @@
 
 #include "compat.h"
 
+/*
+	With threads and atomic operations, the reader can also be a thread in
+	the same process. The ring indices are then handed over lock-free and
+	the command channel is only used for wakeups when the other side
+	really sleeps, not for each piece of data.
+*/
+#if defined(HAVE_PTHREAD) && defined(__ATOMIC_SEQ_CST)
+#define XFERMEM_THREAD
+#include <pthread.h>
+#define xf_load(v)     __atomic_load_n(&(v), __ATOMIC_ACQUIRE)
+#define xf_store(v, x) __atomic_store_n(&(v), (x), __ATOMIC_RELEASE)
+#define xf_swap(v, x)  __atomic_exchange_n(&(v), (x), __ATOMIC_SEQ_CST)
+#define xf_fence()     __atomic_thread_fence(__ATOMIC_SEQ_CST)
+#else
+#define xf_load(v)     (v)
+#define xf_store(v, x) ((v) = (x))
+#endif
+
 typedef struct {
 	size_t freeindex;	/* [W] next free index */
 	size_t readindex;	/* [R] next index to read */
@@ -30,6 +48,11 @@ typedef struct {
 	char *metadata;
 	size_t size;
 	size_t metasize;
+	int threaded;    /* Reader is a thread, see xfermem_init_thread(). */
+	int wakefd[2];   /* Reader wakes a writer waiting for free space. */
+	size_t writes;   /* [W] count of xfermem_write() calls */
+	int reader_wait; /* [R] set before blocking, cleared by writer's wakeup */
+	int writer_wait; /* [W] set before blocking, cleared by reader's wakeup */
 } txfermem;
 /*
  *   [W] -- May be written to by the writing process only!
@@ -38,6 +61,15 @@ typedef struct {
  */
 
 void xfermem_init (txfermem **xf, size_t bufsize, size_t msize, size_t skipbuf);
+#ifdef XFERMEM_THREAD
+/* Allocate plain memory for a reader thread in the same process.
+   Returns 0 on success, -1 on failure (no exit() here). */
+int xfermem_init_thread(txfermem **xf, size_t bufsize);
+/* Reader side: Announce that we are going to block on commands, given the
+   count of writes seen so far. Returns FALSE if there has been a write
+   in the meantime, so blocking would be wrong. */
+int xfermem_reader_sleep(txfermem *xf, size_t seen_writes);
+#endif
 void xfermem_init_writer (txfermem *xf);
 void xfermem_init_reader (txfermem *xf);
 
@@ -77,6 +109,8 @@ int xfermem_putcmd(int fd, byte cmd);
 int xfermem_writer_block(txfermem *xf);
 /* returns TRUE for being interrupted */
 int xfermem_write(txfermem *xf, void *buffer, size_t bytes);
+/* Reader side: Give back consumed space, waking up a waiting writer. */
+void xfermem_set_readindex(txfermem *xf, size_t readindex);
 
 void xfermem_done (txfermem *xf);
 #define xfermem_done_writer xfermem_init_reader
@@ -22,6 +22,15 @@
 #include "sample.h"
 #include "debug.h"
 
+/* The kernels in simd.c give the very results of the code here, so it
+   has to compute as written, also with -ffast-math: real divisions, sums
+   in order, working NaN checks. */
+#if defined(__clang__) && __clang_major__ >= 11
+#pragma float_control(precise, on)
+#elif defined(__GNUC__) && !defined(__clang__)
+#pragma GCC optimize("no-fast-math", "fp-contract=off")
+#endif
+
 /* Conversions between native byte order encodings. */
 
 #include "g711_impl.h"
@@ -488,6 +497,20 @@ syn123_conv( void * MPG123_RESTRICT dst, int dst_enc, size_t dst_size
 		return SYN123_BAD_CHOP;
 	if(samples*dstframe > dst_size)
 		return SYN123_BAD_SIZE;
+	size_t total = samples;
+	// Vectorized kernels take the bulk of common conversions without
+	// dither, the rest is handled below. Integer to integer conversion
+	// via float is only possible with a handle.
+	if( src_enc != dst_enc
+	&&	((src_enc|dst_enc) & MPG123_ENC_FLOAT || sh)
+	&&	!( sh && sh->dither && ( do_dither == 1
+		||	(do_dither == 0 && need_dither(src_enc, dst_enc)) ) ) )
+	{
+		size_t done = simd_conv(dst, dst_enc, src, src_enc, samples, &clips);
+		dst = (char*)dst + done*dstframe;
+		src = (char*)src + done*srcframe;
+		samples -= done;
+	}
 	if(src_enc == dst_enc)
 		memcpy(dst, src, samples*dstframe);
 	// Always shortcut for converting to float, not considering dither.
@@ -576,7 +599,7 @@ syn123_conv( void * MPG123_RESTRICT dst, int dst_enc, size_t dst_size
 	} else
 		return SYN123_BAD_CONV;
 	if(dst_bytes)
-		*dst_bytes = dstframe*samples;
+		*dst_bytes = dstframe*total;
 	if(clipped)
 		*clipped = clips;
 	return SYN123_OK;
@@ -847,6 +870,11 @@ static void syn123_mix_f32( float * MPG123_RESTRICT dst, int dst_channels
 ,	size_t samples )
 {
 	debug("syn123_mix_f32");
+	size_t done = simd_mix( dst, dst_channels, src, src_channels
+	,	mixmatrix, MPG123_ENC_FLOAT_32, samples );
+	dst += done*dst_channels;
+	src += done*src_channels;
+	samples -= done;
 	SYN123_MIX_FUNC(float)
 }
 
@@ -856,6 +884,11 @@ static void syn123_mix_f64( double * MPG123_RESTRICT dst, int dst_channels
 ,	size_t samples )
 {
 	debug("syn123_mix_f64");
+	size_t done = simd_mix( dst, dst_channels, src, src_channels
+	,	mixmatrix, MPG123_ENC_FLOAT_64, samples );
+	dst += done*dst_channels;
+	src += done*src_channels;
+	samples -= done;
 	SYN123_MIX_FUNC(double)
 }
 
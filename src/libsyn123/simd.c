@@ -0,0 +1,586 @@
+/*
+	simd: vectorized kernels for libsyn123
+
+	copyright 2020 by the mpg123 project
+	licensed under the terms of the LGPL 2.1
+	see COPYING and AUTHORS files in distribution or http://mpg123.org
+
+	Hot loops of sample conversion, mixing and amplification, written
+	with compiler intrinsics.
+	SSE2 is part of x86-64, so these are always used there. AVX2 variants
+	are chosen at runtime if the compiler can build them (HAVE_AVX2_TARGET).
+	Other machines use the scalar code. Define SYN123_NO_SIMD to do without.
+
+	Each kernel handles a multiple of its vector width and leaves the rest
+	to the scalar code in sampleconv.c. Results and clip counts have to be
+	identical to that, so the same operations happen in the same precision:
+	32 bit integers are converted via double, and there is a division where
+	the scalar code divides, not a multiplication with the reciprocal.
+	For 16 bit integers, the division in single precision gives the same
+	values as the scalar one in double (checked for all of them).
+*/
+
+#define NO_SMIN
+#define NO_SMAX
+#define NO_GROW_BUF
+#include "syn123_int.h"
+#include "sample.h"
+#include "debug.h"
+
+/* No reciprocals for the divisions in the intrinsics, either. */
+#if defined(__clang__) && __clang_major__ >= 11
+#pragma float_control(precise, on)
+#elif defined(__GNUC__) && !defined(__clang__)
+#pragma GCC optimize("no-fast-math", "fp-contract=off")
+#endif
+
+#ifndef SYN123_NO_SIMD
+#if defined(__SSE2__)
+#define SIMD_SSE2
+#include <emmintrin.h>
+#ifdef HAVE_AVX2_TARGET
+#define SIMD_AVX2
+#include <immintrin.h>
+#endif
+#endif
+#endif
+
+#ifdef SIMD_SSE2
+
+static unsigned int bitcount(unsigned int mask)
+{
+	unsigned int count = 0;
+	for(; mask; mask &= mask-1)
+		++count;
+	return count;
+}
+
+static size_t s16_f32_sse2(float *dst, const int16_t *src, size_t n)
+{
+	const __m128 scale = _mm_set1_ps(32767.f);
+	size_t i;
+	for(i=0; i+8<=n; i+=8)
+	{
+		__m128i s = _mm_loadu_si128((const __m128i*)(src+i));
+		// Sign extension by shifting the words back down.
+		__m128i lo = _mm_srai_epi32(_mm_unpacklo_epi16(s, s), 16);
+		__m128i hi = _mm_srai_epi32(_mm_unpackhi_epi16(s, s), 16);
+		_mm_storeu_ps(dst+i,   _mm_div_ps(_mm_cvtepi32_ps(lo), scale));
+		_mm_storeu_ps(dst+i+4, _mm_div_ps(_mm_cvtepi32_ps(hi), scale));
+	}
+	return i;
+}
+
+// See CONV() in sampleconv.c: NaN counts as clipped zero, rounding is
+// half away from zero via adding +/-0.5 and truncating.
+static size_t f32_s16_sse2(int16_t *dst, const float *src, size_t n, size_t *clips)
+{
+	const __m128 scale = _mm_set1_ps(32767.f);
+	const __m128 max   = _mm_set1_ps(32767.f);
+	const __m128 min   = _mm_set1_ps(-32768.f);
+	const __m128 half  = _mm_set1_ps(0.5f);
+	const __m128 sign  = _mm_set1_ps(-0.f);
+	const __m128 zero  = _mm_setzero_ps();
+	size_t count = 0;
+	size_t i;
+	for(i=0; i+8<=n; i+=8)
+	{
+		__m128i r[2];
+		for(int j=0; j<2; ++j)
+		{
+			__m128 x = _mm_loadu_ps(src+i+4*j);
+			__m128 nan = _mm_cmpunord_ps(x, x);
+			x = _mm_mul_ps(_mm_andnot_ps(nan, x), scale);
+			x = _mm_add_ps(x, _mm_or_ps(half, _mm_and_ps(_mm_cmplt_ps(x, zero), sign)));
+			__m128 clip = _mm_or_ps(nan
+			,	_mm_or_ps(_mm_cmpgt_ps(x, max), _mm_cmplt_ps(x, min)) );
+			count += bitcount(_mm_movemask_ps(clip));
+			r[j] = _mm_cvttps_epi32(_mm_min_ps(_mm_max_ps(x, min), max));
+		}
+		_mm_storeu_si128((__m128i*)(dst+i), _mm_packs_epi32(r[0], r[1]));
+	}
+	*clips += count;
+	return i;
+}
+
+static size_t f32_s32_sse2(int32_t *dst, const float *src, size_t n, size_t *clips)
+{
+	const __m128d scale = _mm_set1_pd(2147483647.);
+	const __m128d max   = _mm_set1_pd(2147483647.);
+	const __m128d min   = _mm_set1_pd(-2147483648.);
+	const __m128d half  = _mm_set1_pd(0.5);
+	const __m128d sign  = _mm_set1_pd(-0.);
+	const __m128d zero  = _mm_setzero_pd();
+	size_t count = 0;
+	size_t i;
+	for(i=0; i+4<=n; i+=4)
+	{
+		__m128 x = _mm_loadu_ps(src+i);
+		__m128d d[2] = { _mm_cvtps_pd(x), _mm_cvtps_pd(_mm_movehl_ps(x, x)) };
+		__m128i r[2];
+		for(int j=0; j<2; ++j)
+		{
+			__m128d nan = _mm_cmpunord_pd(d[j], d[j]);
+			__m128d v = _mm_mul_pd(_mm_andnot_pd(nan, d[j]), scale);
+			v = _mm_add_pd(v, _mm_or_pd(half, _mm_and_pd(_mm_cmplt_pd(v, zero), sign)));
+			__m128d clip = _mm_or_pd(nan
+			,	_mm_or_pd(_mm_cmpgt_pd(v, max), _mm_cmplt_pd(v, min)) );
+			count += bitcount(_mm_movemask_pd(clip));
+			r[j] = _mm_cvttpd_epi32(_mm_min_pd(_mm_max_pd(v, min), max));
+		}
+		_mm_storeu_si128((__m128i*)(dst+i), _mm_unpacklo_epi64(r[0], r[1]));
+	}
+	*clips += count;
+	return i;
+}
+
+static size_t s32_f32_sse2(float *dst, const int32_t *src, size_t n)
+{
+	const __m128d scale = _mm_set1_pd(2147483647.);
+	size_t i;
+	for(i=0; i+4<=n; i+=4)
+	{
+		__m128i s = _mm_loadu_si128((const __m128i*)(src+i));
+		__m128 lo = _mm_cvtpd_ps(_mm_div_pd(_mm_cvtepi32_pd(s), scale));
+		__m128 hi = _mm_cvtpd_ps(_mm_div_pd(
+			_mm_cvtepi32_pd(_mm_srli_si128(s, 8)), scale ));
+		_mm_storeu_ps(dst+i, _mm_movelh_ps(lo, hi));
+	}
+	return i;
+}
+
+static size_t f32_f64_sse2(double *dst, const float *src, size_t n)
+{
+	size_t i;
+	for(i=0; i+4<=n; i+=4)
+	{
+		__m128 x = _mm_loadu_ps(src+i);
+		_mm_storeu_pd(dst+i,   _mm_cvtps_pd(x));
+		_mm_storeu_pd(dst+i+2, _mm_cvtps_pd(_mm_movehl_ps(x, x)));
+	}
+	return i;
+}
+
+static size_t f64_f32_sse2(float *dst, const double *src, size_t n)
+{
+	size_t i;
+	for(i=0; i+4<=n; i+=4)
+	{
+		__m128 lo = _mm_cvtpd_ps(_mm_loadu_pd(src+i));
+		__m128 hi = _mm_cvtpd_ps(_mm_loadu_pd(src+i+2));
+		_mm_storeu_ps(dst+i, _mm_movelh_ps(lo, hi));
+	}
+	return i;
+}
+
+#endif
+
+#ifdef SIMD_AVX2
+
+#define AVX2 __attribute__((target("avx2")))
+
+static AVX2 size_t s16_f32_avx2(float *dst, const int16_t *src, size_t n)
+{
+	const __m256 scale = _mm256_set1_ps(32767.f);
+	size_t i;
+	for(i=0; i+8<=n; i+=8)
+	{
+		__m256i s = _mm256_cvtepi16_epi32(_mm_loadu_si128((const __m128i*)(src+i)));
+		_mm256_storeu_ps(dst+i, _mm256_div_ps(_mm256_cvtepi32_ps(s), scale));
+	}
+	return i;
+}
+
+static AVX2 size_t f32_s16_avx2(int16_t *dst, const float *src, size_t n, size_t *clips)
+{
+	const __m256 scale = _mm256_set1_ps(32767.f);
+	const __m256 max   = _mm256_set1_ps(32767.f);
+	const __m256 min   = _mm256_set1_ps(-32768.f);
+	const __m256 half  = _mm256_set1_ps(0.5f);
+	const __m256 sign  = _mm256_set1_ps(-0.f);
+	const __m256 zero  = _mm256_setzero_ps();
+	size_t count = 0;
+	size_t i;
+	for(i=0; i+8<=n; i+=8)
+	{
+		__m256 x = _mm256_loadu_ps(src+i);
+		__m256 nan = _mm256_cmp_ps(x, x, _CMP_UNORD_Q);
+		x = _mm256_mul_ps(_mm256_andnot_ps(nan, x), scale);
+		x = _mm256_add_ps(x, _mm256_or_ps(half
+		,	_mm256_and_ps(_mm256_cmp_ps(x, zero, _CMP_LT_OQ), sign) ));
+		__m256 clip = _mm256_or_ps(nan, _mm256_or_ps(
+			_mm256_cmp_ps(x, max, _CMP_GT_OQ), _mm256_cmp_ps(x, min, _CMP_LT_OQ) ));
+		count += bitcount(_mm256_movemask_ps(clip));
+		__m256i r = _mm256_cvttps_epi32(_mm256_min_ps(_mm256_max_ps(x, min), max));
+		_mm_storeu_si128( (__m128i*)(dst+i), _mm_packs_epi32(
+			_mm256_castsi256_si128(r), _mm256_extracti128_si256(r, 1) ) );
+	}
+	*clips += count;
+	return i;
+}
+
+static AVX2 size_t f32_s32_avx2(int32_t *dst, const float *src, size_t n, size_t *clips)
+{
+	const __m256d scale = _mm256_set1_pd(2147483647.);
+	const __m256d max   = _mm256_set1_pd(2147483647.);
+	const __m256d min   = _mm256_set1_pd(-2147483648.);
+	const __m256d half  = _mm256_set1_pd(0.5);
+	const __m256d sign  = _mm256_set1_pd(-0.);
+	const __m256d zero  = _mm256_setzero_pd();
+	size_t count = 0;
+	size_t i;
+	for(i=0; i+4<=n; i+=4)
+	{
+		__m256d v = _mm256_cvtps_pd(_mm_loadu_ps(src+i));
+		__m256d nan = _mm256_cmp_pd(v, v, _CMP_UNORD_Q);
+		v = _mm256_mul_pd(_mm256_andnot_pd(nan, v), scale);
+		v = _mm256_add_pd(v, _mm256_or_pd(half
+		,	_mm256_and_pd(_mm256_cmp_pd(v, zero, _CMP_LT_OQ), sign) ));
+		__m256d clip = _mm256_or_pd(nan, _mm256_or_pd(
+			_mm256_cmp_pd(v, max, _CMP_GT_OQ), _mm256_cmp_pd(v, min, _CMP_LT_OQ) ));
+		count += bitcount(_mm256_movemask_pd(clip));
+		_mm_storeu_si128( (__m128i*)(dst+i)
+		,	_mm256_cvttpd_epi32(_mm256_min_pd(_mm256_max_pd(v, min), max)) );
+	}
+	*clips += count;
+	return i;
+}
+
+static AVX2 size_t s32_f32_avx2(float *dst, const int32_t *src, size_t n)
+{
+	const __m256d scale = _mm256_set1_pd(2147483647.);
+	size_t i;
+	for(i=0; i+4<=n; i+=4)
+	{
+		__m256d d = _mm256_cvtepi32_pd(_mm_loadu_si128((const __m128i*)(src+i)));
+		_mm_storeu_ps(dst+i, _mm256_cvtpd_ps(_mm256_div_pd(d, scale)));
+	}
+	return i;
+}
+
+static AVX2 size_t f32_f64_avx2(double *dst, const float *src, size_t n)
+{
+	size_t i;
+	for(i=0; i+4<=n; i+=4)
+		_mm256_storeu_pd(dst+i, _mm256_cvtps_pd(_mm_loadu_ps(src+i)));
+	return i;
+}
+
+static AVX2 size_t f64_f32_avx2(float *dst, const double *src, size_t n)
+{
+	size_t i;
+	for(i=0; i+4<=n; i+=4)
+		_mm_storeu_ps(dst+i, _mm256_cvtpd_ps(_mm256_loadu_pd(src+i)));
+	return i;
+}
+
+#endif
+
+// Conversions composed of the above, going through a block on the stack.
+// Signed 16 to 32 bit goes via float like the scalar code with a handle,
+// 24 bit is 32 bit with the lowest byte dropped.
+#define COMPOSED_KERNELS(isa) \
+static size_t s16_s32_##isa(int32_t *dst, const int16_t *src, size_t n, size_t *clips) \
+{ \
+	float tmp[bufblock]; \
+	size_t done = 0; \
+	while(done < n) \
+	{ \
+		size_t block = n-done > bufblock ? bufblock : n-done; \
+		size_t got = s16_f32_##isa(tmp, src+done, block); \
+		got = f32_s32_##isa(dst+done, tmp, got, clips); \
+		done += got; \
+		if(got < block) \
+			break; \
+	} \
+	return done; \
+} \
+static size_t f32_s24_##isa(char *dst, const float *src, size_t n, size_t *clips) \
+{ \
+	int32_t tmp[bufblock]; \
+	size_t done = 0; \
+	while(done < n) \
+	{ \
+		size_t block = n-done > bufblock ? bufblock : n-done; \
+		size_t got = f32_s32_##isa(tmp, src+done, block, clips); \
+		for(size_t i=0; i<got; ++i) \
+		{ \
+			union { int32_t i; char c[4]; } s; \
+			s.i = tmp[i]; \
+			DROP4BYTE(dst+3*(done+i), s.c); \
+		} \
+		done += got; \
+		if(got < block) \
+			break; \
+	} \
+	return done; \
+}
+
+#define CONV_KERNELS(isa) \
+COMPOSED_KERNELS(isa) \
+static size_t conv_##isa( void *dst, int dst_enc, void *src, int src_enc \
+,	size_t samples, size_t *clips ) \
+{ \
+	switch(src_enc) \
+	{ \
+		case MPG123_ENC_SIGNED_16: \
+			if(dst_enc == MPG123_ENC_FLOAT_32) \
+				return s16_f32_##isa(dst, src, samples); \
+			if(dst_enc == MPG123_ENC_SIGNED_32) \
+				return s16_s32_##isa(dst, src, samples, clips); \
+		break; \
+		case MPG123_ENC_SIGNED_32: \
+			if(dst_enc == MPG123_ENC_FLOAT_32) \
+				return s32_f32_##isa(dst, src, samples); \
+		break; \
+		case MPG123_ENC_FLOAT_32: \
+			switch(dst_enc) \
+			{ \
+				case MPG123_ENC_SIGNED_16: \
+					return f32_s16_##isa(dst, src, samples, clips); \
+				case MPG123_ENC_SIGNED_24: \
+					return f32_s24_##isa(dst, src, samples, clips); \
+				case MPG123_ENC_SIGNED_32: \
+					return f32_s32_##isa(dst, src, samples, clips); \
+				case MPG123_ENC_FLOAT_64: \
+					return f32_f64_##isa(dst, src, samples); \
+			} \
+		break; \
+		case MPG123_ENC_FLOAT_64: \
+			if(dst_enc == MPG123_ENC_FLOAT_32) \
+				return f64_f32_##isa(dst, src, samples); \
+		break; \
+	} \
+	return 0; \
+}
+
+#ifdef SIMD_SSE2
+CONV_KERNELS(sse2)
+#endif
+#ifdef SIMD_AVX2
+CONV_KERNELS(avx2)
+#endif
+
+size_t simd_conv( void * MPG123_RESTRICT dst, int dst_enc
+,	void * MPG123_RESTRICT src, int src_enc, size_t samples, size_t *clips )
+{
+#ifdef SIMD_AVX2
+	if(__builtin_cpu_supports("avx2"))
+		return conv_avx2(dst, dst_enc, src, src_enc, samples, clips);
+#endif
+#ifdef SIMD_SSE2
+	return conv_sse2(dst, dst_enc, src, src_enc, samples, clips);
+#else
+	return 0;
+#endif
+}
+
+// Mixing for common channel layouts and plain amplification.
+// Operation order is that of MIX_CODE() in sampleconv.c and AMP_LOOP() in
+// volume.c: Accumulate the products of (converted) matrix coefficient and
+// source sample in order of source channels, no fused multiply-add.
+// The matrix is indexed by SYN123_IOFF(dst_channel, src_channel, src_channels).
+
+#ifdef SIMD_SSE2
+
+static size_t mix_f32_sse2( float *dst, int dst_channels
+,	const float *src, int src_channels, const double *mm, size_t samples )
+{
+	size_t i = 0;
+	if(src_channels == 1 && dst_channels == 2)
+	{
+		const __m128 m = _mm_setr_ps(mm[0], mm[1], mm[0], mm[1]);
+		for(; i+4<=samples; i+=4)
+		{
+			__m128 s = _mm_loadu_ps(src+i);
+			__m128 d0 = _mm_loadu_ps(dst+2*i);
+			__m128 d1 = _mm_loadu_ps(dst+2*i+4);
+			_mm_storeu_ps(dst+2*i,   _mm_add_ps(d0, _mm_mul_ps(m, _mm_unpacklo_ps(s, s))));
+			_mm_storeu_ps(dst+2*i+4, _mm_add_ps(d1, _mm_mul_ps(m, _mm_unpackhi_ps(s, s))));
+		}
+	}
+	else if(src_channels == 2 && dst_channels == 1)
+	{
+		const __m128 m0 = _mm_set1_ps(mm[0]);
+		const __m128 m1 = _mm_set1_ps(mm[1]);
+		for(; i+4<=samples; i+=4)
+		{
+			__m128 a = _mm_loadu_ps(src+2*i);
+			__m128 b = _mm_loadu_ps(src+2*i+4);
+			__m128 l = _mm_shuffle_ps(a, b, _MM_SHUFFLE(2,0,2,0));
+			__m128 r = _mm_shuffle_ps(a, b, _MM_SHUFFLE(3,1,3,1));
+			__m128 d = _mm_add_ps(_mm_loadu_ps(dst+i), _mm_mul_ps(m0, l));
+			_mm_storeu_ps(dst+i, _mm_add_ps(d, _mm_mul_ps(m1, r)));
+		}
+	}
+	else if(src_channels == 2 && dst_channels == 6)
+	{
+		// Two frames make three vectors of output.
+		const __m128 ml[3] =
+		{	_mm_setr_ps(mm[0], mm[2],  mm[4], mm[6])
+		,	_mm_setr_ps(mm[8], mm[10], mm[0], mm[2])
+		,	_mm_setr_ps(mm[4], mm[6],  mm[8], mm[10])
+		};
+		const __m128 mr[3] =
+		{	_mm_setr_ps(mm[1], mm[3],  mm[5], mm[7])
+		,	_mm_setr_ps(mm[9], mm[11], mm[1], mm[3])
+		,	_mm_setr_ps(mm[5], mm[7],  mm[9], mm[11])
+		};
+		for(; i+2<=samples; i+=2)
+		{
+			__m128 s = _mm_loadu_ps(src+2*i);
+			__m128 l[3] =
+			{	_mm_shuffle_ps(s, s, _MM_SHUFFLE(0,0,0,0))
+			,	_mm_shuffle_ps(s, s, _MM_SHUFFLE(2,2,0,0))
+			,	_mm_shuffle_ps(s, s, _MM_SHUFFLE(2,2,2,2))
+			};
+			__m128 r[3] =
+			{	_mm_shuffle_ps(s, s, _MM_SHUFFLE(1,1,1,1))
+			,	_mm_shuffle_ps(s, s, _MM_SHUFFLE(3,3,1,1))
+			,	_mm_shuffle_ps(s, s, _MM_SHUFFLE(3,3,3,3))
+			};
+			for(int k=0; k<3; ++k)
+			{
+				__m128 d = _mm_add_ps(_mm_loadu_ps(dst+6*i+4*k), _mm_mul_ps(ml[k], l[k]));
+				_mm_storeu_ps(dst+6*i+4*k, _mm_add_ps(d, _mm_mul_ps(mr[k], r[k])));
+			}
+		}
+	}
+	else if(src_channels == 6 && dst_channels == 2)
+	{
+		// Two frames of input in three vectors, output for both in one.
+		__m128 m[6];
+		for(int k=0; k<6; ++k)
+			m[k] = _mm_setr_ps(mm[k], mm[6+k], mm[k], mm[6+k]);
+		for(; i+2<=samples; i+=2)
+		{
+			__m128 a = _mm_loadu_ps(src+6*i);
+			__m128 b = _mm_loadu_ps(src+6*i+4);
+			__m128 c = _mm_loadu_ps(src+6*i+8);
+			__m128 s[6] =
+			{	_mm_shuffle_ps(a, b, _MM_SHUFFLE(2,2,0,0))
+			,	_mm_shuffle_ps(a, b, _MM_SHUFFLE(3,3,1,1))
+			,	_mm_shuffle_ps(a, c, _MM_SHUFFLE(0,0,2,2))
+			,	_mm_shuffle_ps(a, c, _MM_SHUFFLE(1,1,3,3))
+			,	_mm_shuffle_ps(b, c, _MM_SHUFFLE(2,2,0,0))
+			,	_mm_shuffle_ps(b, c, _MM_SHUFFLE(3,3,1,1))
+			};
+			__m128 d = _mm_loadu_ps(dst+2*i);
+			for(int k=0; k<6; ++k)
+				d = _mm_add_ps(d, _mm_mul_ps(m[k], s[k]));
+			_mm_storeu_ps(dst+2*i, d);
+		}
+	}
+	return i;
+}
+
+static size_t mix_f64_sse2( double *dst, int dst_channels
+,	const double *src, int src_channels, const double *mm, size_t samples )
+{
+	size_t i = 0;
+	if(src_channels == 1 && dst_channels == 2)
+	{
+		const __m128d m = _mm_setr_pd(mm[0], mm[1]);
+		for(; i<samples; ++i)
+			_mm_storeu_pd(dst+2*i, _mm_add_pd( _mm_loadu_pd(dst+2*i)
+			,	_mm_mul_pd(m, _mm_set1_pd(src[i])) ));
+	}
+	else if(src_channels == 2 && dst_channels == 1)
+	{
+		const __m128d m0 = _mm_set1_pd(mm[0]);
+		const __m128d m1 = _mm_set1_pd(mm[1]);
+		for(; i+2<=samples; i+=2)
+		{
+			__m128d a = _mm_loadu_pd(src+2*i);
+			__m128d b = _mm_loadu_pd(src+2*i+2);
+			__m128d d = _mm_add_pd(_mm_loadu_pd(dst+i), _mm_mul_pd(m0, _mm_unpacklo_pd(a, b)));
+			_mm_storeu_pd(dst+i, _mm_add_pd(d, _mm_mul_pd(m1, _mm_unpackhi_pd(a, b))));
+		}
+	}
+	else if(src_channels == 2 && dst_channels == 6)
+	{
+		__m128d ml[3], mr[3];
+		for(int k=0; k<3; ++k)
+		{
+			ml[k] = _mm_setr_pd(mm[4*k],   mm[4*k+2]);
+			mr[k] = _mm_setr_pd(mm[4*k+1], mm[4*k+3]);
+		}
+		for(; i<samples; ++i)
+		{
+			__m128d l = _mm_set1_pd(src[2*i]);
+			__m128d r = _mm_set1_pd(src[2*i+1]);
+			for(int k=0; k<3; ++k)
+			{
+				__m128d d = _mm_add_pd(_mm_loadu_pd(dst+6*i+2*k), _mm_mul_pd(ml[k], l));
+				_mm_storeu_pd(dst+6*i+2*k, _mm_add_pd(d, _mm_mul_pd(mr[k], r)));
+			}
+		}
+	}
+	else if(src_channels == 6 && dst_channels == 2)
+	{
+		__m128d m[6];
+		for(int k=0; k<6; ++k)
+			m[k] = _mm_setr_pd(mm[k], mm[6+k]);
+		for(; i<samples; ++i)
+		{
+			__m128d d = _mm_loadu_pd(dst+2*i);
+			for(int k=0; k<6; ++k)
+				d = _mm_add_pd(d, _mm_mul_pd(m[k], _mm_set1_pd(src[6*i+k])));
+			_mm_storeu_pd(dst+2*i, d);
+		}
+	}
+	return i;
+}
+
+static size_t amp_f32_sse2(float *buf, size_t samples, float volume, float offset)
+{
+	const __m128 v = _mm_set1_ps(volume);
+	const __m128 o = _mm_set1_ps(offset);
+	size_t i;
+	for(i=0; i+8<=samples; i+=8)
+	{
+		_mm_storeu_ps(buf+i,   _mm_mul_ps(v, _mm_add_ps(_mm_loadu_ps(buf+i),   o)));
+		_mm_storeu_ps(buf+i+4, _mm_mul_ps(v, _mm_add_ps(_mm_loadu_ps(buf+i+4), o)));
+	}
+	return i;
+}
+
+static size_t amp_f64_sse2(double *buf, size_t samples, double volume, double offset)
+{
+	const __m128d v = _mm_set1_pd(volume);
+	const __m128d o = _mm_set1_pd(offset);
+	size_t i;
+	for(i=0; i+4<=samples; i+=4)
+	{
+		_mm_storeu_pd(buf+i,   _mm_mul_pd(v, _mm_add_pd(_mm_loadu_pd(buf+i),   o)));
+		_mm_storeu_pd(buf+i+2, _mm_mul_pd(v, _mm_add_pd(_mm_loadu_pd(buf+i+2), o)));
+	}
+	return i;
+}
+
+#endif
+
+size_t simd_mix( void * MPG123_RESTRICT dst, int dst_channels
+,	void * MPG123_RESTRICT src, int src_channels
+,	const double *mixmatrix, int encoding, size_t samples )
+{
+#ifdef SIMD_SSE2
+	if(encoding == MPG123_ENC_FLOAT_32)
+		return mix_f32_sse2(dst, dst_channels, src, src_channels, mixmatrix, samples);
+	if(encoding == MPG123_ENC_FLOAT_64)
+		return mix_f64_sse2(dst, dst_channels, src, src_channels, mixmatrix, samples);
+#endif
+	return 0;
+}
+
+size_t simd_amp( void *buf, int encoding, size_t samples
+,	double volume, double offset )
+{
+#ifdef SIMD_SSE2
+	if(encoding == MPG123_ENC_FLOAT_32)
+		return amp_f32_sse2(buf, samples, volume, offset);
+	if(encoding == MPG123_ENC_FLOAT_64)
+		return amp_f64_sse2(buf, samples, volume, offset);
+#endif
+	return 0;
+}
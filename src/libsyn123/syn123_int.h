@@ -85,6 +85,17 @@ struct syn123_struct
 	struct resample_data *rd; // resampler data, if initialized
 };
 
+// Convert the leading part of the given samples with vectorized code
+// (simd.c), returning the number of samples done. No dithering.
+size_t simd_conv( void * MPG123_RESTRICT dst, int dst_enc
+,	void * MPG123_RESTRICT src, int src_enc, size_t samples, size_t *clips );
+// The same for mixing and amplification of float or double samples.
+size_t simd_mix( void * MPG123_RESTRICT dst, int dst_channels
+,	void * MPG123_RESTRICT src, int src_channels
+,	const double *mixmatrix, int encoding, size_t samples );
+size_t simd_amp( void *buf, int encoding, size_t samples
+,	double volume, double offset );
+
 #ifndef NO_SMIN
 static size_t smin(size_t a, size_t b)
 {
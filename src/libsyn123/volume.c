@@ -13,6 +13,13 @@
 #include "syn123_int.h"
 #include "debug.h"
 
+/* Amplification has to match simd_amp(): no fused multiply-add. */
+#if defined(__clang__) && __clang_major__ >= 11
+#pragma float_control(precise, on)
+#elif defined(__GNUC__) && !defined(__clang__)
+#pragma GCC optimize("no-fast-math", "fp-contract=off")
+#endif
+
 static const double db_min = -SYN123_DB_LIMIT;
 static const double db_max =  SYN123_DB_LIMIT;
 
@@ -59,8 +66,10 @@ syn123_amp( void* buf, int encoding, size_t samples
 	switch(encoding)
 	{
 		// This is close to FMA, but only that. It's FAM.
+		// Vector code does the bulk, the loop the remainder.
 		#define AMP_LOOP(type) \
-			for(size_t i=0; i<samples; ++i) \
+			for( size_t i=simd_amp(buf, encoding, samples, volume, offset) \
+			;	i<samples; ++i ) \
 				((type*)buf)[i] = (type)volume * (((type*)buf)[i] + (type)offset);
 		case MPG123_ENC_FLOAT_32:
 			AMP_LOOP(float)
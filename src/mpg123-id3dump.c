@@ -14,6 +14,9 @@
 #include "mpg123.h"
 #include "getlopt.h"
 #include <errno.h>
+#ifdef HAVE_PTHREAD
+#include <pthread.h>
+#endif
 #include <ctype.h>
 #include "debug.h"
 #include "win32_support.h"
@@ -24,10 +27,18 @@ static struct
 {
 	int store_pics;
 	int do_scan;
+	int batch;
+	int recursive;
+	long jobs;
+	char *listfile;
 } param =
 {
 	  FALSE
 	, TRUE
+	, FALSE
+	, FALSE
+	, 1
+	, NULL
 };
 
 static const char* progname;
@@ -48,6 +59,15 @@ static void usage(int err)
 	fprintf(o," -n     --no-scan           do not scan entire file (just beginning)\n");
 	fprintf(o," -p     --store-pics        write APIC frames (album art pictures) to files\n");
 	fprintf(o,"                            file names using whole input file name as prefix\n");
+	fprintf(o,"                            (in batch mode: list APIC frames, do not write them)\n");
+	fprintf(o," -b     --batch             batch mode: one line of JSON per file, reading\n");
+	fprintf(o,"                            only the head and tail of each file\n");
+	fprintf(o," -r     --recursive         in batch mode, descend into directory arguments\n");
+	fprintf(o," -l <f> --list <f>          in batch mode, read file names (one per line)\n");
+	fprintf(o,"                            from file f (- for stdin) in addition to arguments\n");
+#ifdef HAVE_PTHREAD
+	fprintf(o," -j <n> --jobs <n>          in batch mode, use n worker threads (default: 1)\n");
+#endif
 	fprintf(o,"\nNote that text output will always be in UTF-8, regardless of locale.\n");
 	exit(err);
 }
@@ -61,6 +81,12 @@ static topt opts[] =
 	 {'h', "help",         0,       want_usage, 0,                 0}
 	,{'n', "no-scan",      GLO_INT, 0,          &param.do_scan,    FALSE}
 	,{'p', "store-pics",   GLO_INT, 0,          &param.store_pics, TRUE}
+	,{'b', "batch",        GLO_INT, 0,          &param.batch,      TRUE}
+	,{'r', "recursive",    GLO_INT, 0,          &param.recursive,  TRUE}
+	,{'l', "list",         GLO_ARG | GLO_CHAR, 0, &param.listfile, 0}
+#ifdef HAVE_PTHREAD
+	,{'j', "jobs",         GLO_ARG | GLO_LONG, 0, &param.jobs,     0}
+#endif
 	,{0, 0, 0, 0, 0, 0}
 };
 
@@ -350,6 +376,685 @@ static void store_pictures(const char* prefix, mpg123_id3v2 *v2)
 	}
 }
 
+/*
+	Batch mode: For indexing large collections, opening full handles and
+	scanning whole files is way too much work. Here, only the tail of the
+	file is read directly for ID3v1 and APEv2 tags, and libmpg123 only gets
+	to see the head (ID3v2 and the first frame with its Info/Xing header),
+	via MPG123_NO_PEEK_END and an explicit file size that excludes the
+	tail tags. Without a full scan, the duration comes from the Info/Xing
+	header or is estimated from the size of the audio data and the bitrate.
+	Each file results in one line of JSON on stdout.
+*/
+
+/* Sanity limit for APE tags, which otherwise could make us read anything. */
+#define APE_MAX (16*1024*1024)
+
+/* Add a string as JSON string literal, escaping as needed. The input
+   is supposed to be UTF-8, invalid sequences are replaced by U+FFFD. */
+static void json_str(mpg123_string *sb, const char *str, size_t len)
+{
+	const unsigned char *s = (const unsigned char*)str;
+	char buf[256];
+	size_t fill = 0;
+	size_t i = 0;
+
+	buf[fill++] = '"';
+	while(i < len)
+	{
+		unsigned char c = s[i];
+		size_t n = 1;
+		/* Worst case of one iteration is 6 bytes for \u00XX. */
+		if(fill > sizeof(buf)-8)
+		{
+			mpg123_add_substring(sb, buf, 0, fill);
+			fill = 0;
+		}
+		if(c < 0x80)
+		{
+			switch(c)
+			{
+				case '"':  buf[fill++] = '\\'; buf[fill++] = '"';  break;
+				case '\\': buf[fill++] = '\\'; buf[fill++] = '\\'; break;
+				case '\n': buf[fill++] = '\\'; buf[fill++] = 'n';  break;
+				case '\r': buf[fill++] = '\\'; buf[fill++] = 'r';  break;
+				case '\t': buf[fill++] = '\\'; buf[fill++] = 't';  break;
+				default:
+					if(c < 0x20)
+						fill += sprintf(buf+fill, "\\u%04x", (unsigned int)c);
+					else
+						buf[fill++] = c;
+			}
+			++i;
+			continue;
+		}
+		/* Multibyte sequence: length and valid range of the second byte. */
+		{
+			unsigned char lo = 0x80, hi = 0xbf;
+			size_t j;
+			if(c >= 0xc2 && c <= 0xdf) n = 2;
+			else if(c >= 0xe0 && c <= 0xef) n = 3;
+			else if(c >= 0xf0 && c <= 0xf4) n = 4;
+			else n = 0;
+			if(c == 0xe0) lo = 0xa0;
+			if(c == 0xed) hi = 0x9f;
+			if(c == 0xf0) lo = 0x90;
+			if(c == 0xf4) hi = 0x8f;
+			if(n && (n > len-i || s[i+1] < lo || s[i+1] > hi))
+				n = 0;
+			for(j=2; n && j<n; ++j)
+				if(s[i+j] < 0x80 || s[i+j] > 0xbf)
+					n = 0;
+		}
+		if(n)
+		{
+			memcpy(buf+fill, s+i, n);
+			fill += n;
+			i += n;
+		}
+		else
+		{
+			memcpy(buf+fill, "\xef\xbf\xbd", 3);
+			fill += 3;
+			++i;
+		}
+	}
+	buf[fill++] = '"';
+	mpg123_add_substring(sb, buf, 0, fill);
+}
+
+/* Start a member of an object, with separating comma if needed. */
+static void json_key(mpg123_string *sb, int *members, const char *key)
+{
+	if((*members)++)
+		mpg123_add_string(sb, ",");
+	json_str(sb, key, strlen(key));
+	mpg123_add_string(sb, ":");
+}
+
+static void json_int(mpg123_string *sb, int *members, const char *key, off_t val)
+{
+	char buf[32];
+	json_key(sb, members, key);
+	snprintf(buf, sizeof(buf), "%"OFF_P, (off_p)val);
+	mpg123_add_string(sb, buf);
+}
+
+/* A libmpg123 string (UTF-8, fill including the zero byte). */
+static void json_mstr(mpg123_string *sb, int *members, const char *key, mpg123_string *val)
+{
+	if(!val || !val->fill)
+		return;
+	json_key(sb, members, key);
+	json_str(sb, val->p, strlen(val->p));
+}
+
+/* Latin-1 field of an ID3v1 tag, trailing spaces and zeros removed. */
+static void json_v1field( mpg123_string *sb, int *members, const char *key
+,	const unsigned char *field, size_t size )
+{
+	char buf[2*30];
+	size_t len, i, fill = 0;
+
+	for(len=0; len<size && field[len]; ++len);
+	while(len && field[len-1] == ' ')
+		--len;
+	if(!len)
+		return;
+	for(i=0; i<len; ++i)
+	{
+		if(field[i] < 0x80)
+			buf[fill++] = field[i];
+		else
+		{
+			buf[fill++] = 0xc0 | (field[i]>>6);
+			buf[fill++] = 0x80 | (field[i]&0x3f);
+		}
+	}
+	json_key(sb, members, key);
+	json_str(sb, buf, fill);
+}
+
+static void json_v1(mpg123_string *sb, int *members, const unsigned char *tag)
+{
+	int v1m = 0;
+	char buf[8];
+
+	json_key(sb, members, "id3v1");
+	mpg123_add_string(sb, "{");
+	json_v1field(sb, &v1m, "title",   tag+3,  30);
+	json_v1field(sb, &v1m, "artist",  tag+33, 30);
+	json_v1field(sb, &v1m, "album",   tag+63, 30);
+	json_v1field(sb, &v1m, "year",    tag+93, 4);
+	/* ID3v1.1 stores the track number in the last comment byte. */
+	if(!tag[125] && tag[126])
+	{
+		json_v1field(sb, &v1m, "comment", tag+97, 28);
+		json_int(sb, &v1m, "track", tag[126]);
+	}
+	else
+		json_v1field(sb, &v1m, "comment", tag+97, 30);
+	json_key(sb, &v1m, "genre");
+	snprintf(buf, sizeof(buf), "%i", (int)tag[127]);
+	mpg123_add_string(sb, buf);
+	mpg123_add_string(sb, "}");
+}
+
+static void json_v2(mpg123_string *sb, int *members, mpg123_id3v2 *v2)
+{
+	size_t i;
+	int v2m = 0;
+	int frames = 0;
+
+	json_key(sb, members, "id3v2");
+	mpg123_add_string(sb, "{");
+	json_int (sb, &v2m, "version", v2->version);
+	json_mstr(sb, &v2m, "title",   v2->title);
+	json_mstr(sb, &v2m, "artist",  v2->artist);
+	json_mstr(sb, &v2m, "album",   v2->album);
+	json_mstr(sb, &v2m, "year",    v2->year);
+	json_mstr(sb, &v2m, "genre",   v2->genre);
+	json_mstr(sb, &v2m, "comment", v2->comment);
+	json_key(sb, &v2m, "frames");
+	mpg123_add_string(sb, "[");
+	for(i=0; i<v2->texts; ++i)
+	{
+		int fm = 0;
+		mpg123_add_string(sb, frames++ ? ",{" : "{");
+		json_key(sb, &fm, "id");
+		json_str(sb, v2->text[i].id, 4);
+		json_mstr(sb, &fm, "description", &v2->text[i].description);
+		json_mstr(sb, &fm, "text", &v2->text[i].text);
+		mpg123_add_string(sb, "}");
+	}
+	for(i=0; i<v2->extras; ++i)
+	{
+		int fm = 0;
+		mpg123_add_string(sb, frames++ ? ",{" : "{");
+		json_key(sb, &fm, "id");
+		json_str(sb, v2->extra[i].id, 4);
+		json_mstr(sb, &fm, "description", &v2->extra[i].description);
+		json_mstr(sb, &fm, "text", &v2->extra[i].text);
+		mpg123_add_string(sb, "}");
+	}
+	for(i=0; i<v2->comments; ++i)
+	{
+		int fm = 0;
+		mpg123_add_string(sb, frames++ ? ",{" : "{");
+		json_key(sb, &fm, "id");
+		json_str(sb, v2->comment_list[i].id, 4);
+		if(v2->comment_list[i].lang[0])
+		{
+			size_t ll = 1;
+			while(ll < 3 && v2->comment_list[i].lang[ll])
+				++ll;
+			json_key(sb, &fm, "language");
+			json_str(sb, v2->comment_list[i].lang, ll);
+		}
+		json_mstr(sb, &fm, "description", &v2->comment_list[i].description);
+		json_mstr(sb, &fm, "text", &v2->comment_list[i].text);
+		mpg123_add_string(sb, "}");
+	}
+	for(i=0; i<v2->pictures; ++i)
+	{
+		int fm = 0;
+		mpg123_picture *pic = &v2->picture[i];
+		mpg123_add_string(sb, frames++ ? ",{" : "{");
+		json_key(sb, &fm, "id");
+		json_str(sb, "APIC", 4);
+		json_int(sb, &fm, "type", pic->type);
+		json_mstr(sb, &fm, "mime", &pic->mime_type);
+		json_mstr(sb, &fm, "description", &pic->description);
+		json_int(sb, &fm, "size", (off_t)pic->size);
+		mpg123_add_string(sb, "}");
+	}
+	mpg123_add_string(sb, "]}");
+}
+
+static unsigned long le32(const unsigned char *b)
+{
+	return (unsigned long)b[0] | (unsigned long)b[1]<<8
+	|	(unsigned long)b[2]<<16 | (unsigned long)b[3]<<24;
+}
+
+/* APE items: 32 bit value size, 32 bit flags, zero-terminated key, value.
+   Bits 1 and 2 of the flags say if it is UTF-8 text (0), binary (1) or
+   an external locator (2), which is text, too. */
+static void json_ape( mpg123_string *sb, int *members
+,	const unsigned char *items, size_t size, unsigned long count )
+{
+	int apem = 0;
+	size_t pos = 0;
+
+	json_key(sb, members, "ape");
+	mpg123_add_string(sb, "{");
+	while(count-- && size-pos > 8)
+	{
+		unsigned long vsize = le32(items+pos);
+		unsigned long flags = le32(items+pos+4);
+		const unsigned char *key = items+pos+8;
+		size_t klen = 0;
+
+		while(klen < size-pos-8 && key[klen])
+			++klen;
+		if(klen == size-pos-8 || vsize > size-pos-8-klen-1)
+			break;
+		if(apem++)
+			mpg123_add_string(sb, ",");
+		json_str(sb, (const char*)key, klen);
+		mpg123_add_string(sb, ":");
+		if(((flags>>1) & 3) == 1)
+		{
+			char buf[48];
+			snprintf(buf, sizeof(buf), "{\"binary\":%lu}", vsize);
+			mpg123_add_string(sb, buf);
+		}
+		else
+			json_str(sb, (const char*)key+klen+1, vsize);
+		pos += 8+klen+1+vsize;
+	}
+	mpg123_add_string(sb, "}");
+}
+
+static int read_at(int fd, off_t off, unsigned char *buf, size_t size)
+{
+	if(lseek(fd, off, SEEK_SET) != off)
+		return -1;
+	while(size)
+	{
+		ssize_t got = read(fd, buf, size);
+		if(got < 0 && errno == EINTR)
+			continue;
+		if(got <= 0)
+			return -1;
+		buf  += got;
+		size -= got;
+	}
+	return 0;
+}
+
+struct batch_worker
+{
+	mpg123_handle *mh;
+	mpg123_string line;
+#ifdef HAVE_PTHREAD
+	pthread_t thread;
+#endif
+};
+
+#ifdef HAVE_PTHREAD
+/* Bounded queue of file names between the directory walk and workers. */
+#define BATCH_QUEUE 256
+static struct
+{
+	pthread_mutex_t lock;
+	pthread_cond_t filled;
+	pthread_cond_t emptied;
+	char *path[BATCH_QUEUE];
+	size_t first;
+	size_t count;
+	int done;
+} queue =
+{
+	PTHREAD_MUTEX_INITIALIZER, PTHREAD_COND_INITIALIZER
+,	PTHREAD_COND_INITIALIZER, { NULL }, 0, 0, 0
+};
+static pthread_mutex_t outlock = PTHREAD_MUTEX_INITIALIZER;
+#endif
+
+static void batch_file(struct batch_worker *bw, const char *path)
+{
+	mpg123_string *sb = &bw->line;
+	mpg123_handle *mh = bw->mh;
+	unsigned char v1[128];
+	unsigned char *ape = NULL;
+	size_t ape_size = 0;
+	unsigned long ape_items = 0;
+	int have_v1 = 0;
+	int members = 0;
+	off_t size, end;
+	int fd;
+
+	sb->fill = 0;
+	mpg123_add_string(sb, "{");
+	json_key(sb, &members, "file");
+	json_str(sb, path, strlen(path));
+
+	errno = 0;
+	if((fd = compat_open(path, O_RDONLY)) < 0)
+	{
+		char errbuf[256];
+		const char *msg = compat_strerror(errno, errbuf, sizeof(errbuf));
+		json_key(sb, &members, "error");
+		json_str(sb, msg, strlen(msg));
+		goto batch_file_end;
+	}
+	end = size = lseek(fd, 0, SEEK_END);
+	if(size < 0)
+	{
+		json_key(sb, &members, "error");
+		json_str(sb, "not seekable", 12);
+		compat_close(fd);
+		goto batch_file_end;
+	}
+	json_int(sb, &members, "size", size);
+	if(size >= 128 && !read_at(fd, size-128, v1, 128) && !memcmp(v1, "TAG", 3))
+	{
+		have_v1 = 1;
+		end -= 128;
+	}
+	/* APEv2 (or v1) footer, either at the very end or before ID3v1. */
+	if(end >= 32)
+	{
+		unsigned char foot[32];
+		if(!read_at(fd, end-32, foot, 32) && !memcmp(foot, "APETAGEX", 8))
+		{
+			unsigned long tagsize = le32(foot+12);
+			unsigned long flags   = le32(foot+20);
+			off_t start;
+			if(tagsize >= 32 && tagsize <= APE_MAX && (off_t)tagsize <= end)
+			{
+				start = end - tagsize - ((flags & 0x80000000UL) ? 32 : 0);
+				ape_size = tagsize-32;
+				ape_items = le32(foot+16);
+				if(start >= 0 && (ape = malloc(ape_size+1))
+				&&	!read_at(fd, end-tagsize, ape, ape_size) )
+					end = start;
+				else
+				{
+					free(ape);
+					ape = NULL;
+				}
+			}
+		}
+	}
+	if(lseek(fd, 0, SEEK_SET) != 0 || mpg123_open_fd(mh, fd) != MPG123_OK)
+	{
+		json_key(sb, &members, "error");
+		json_str(sb, mpg123_strerror(mh), strlen(mpg123_strerror(mh)));
+	}
+	else
+	{
+		struct mpg123_frameinfo mi;
+		mpg123_id3v1 *dummy;
+		mpg123_id3v2 *v2;
+		long rate;
+		int channels, enc;
+
+		mpg123_set_filesize(mh, end);
+		if( mpg123_getformat(mh, &rate, &channels, &enc) == MPG123_OK
+		&&	mpg123_info(mh, &mi) == MPG123_OK )
+		{
+			static const char *versions[] = { "1", "2", "2.5" };
+			static const char *modes[] = { "stereo", "joint stereo", "dual channel", "mono" };
+			static const char *vbrs[] = { "cbr", "vbr", "abr" };
+			int mm = 0;
+			long val;
+			double fval;
+			off_t len;
+
+			json_key(sb, &members, "mpeg");
+			mpg123_add_string(sb, "{");
+			json_key(sb, &mm, "version");
+			json_str(sb, versions[mi.version], strlen(versions[mi.version]));
+			json_int(sb, &mm, "layer", mi.layer);
+			json_int(sb, &mm, "rate", mi.rate);
+			json_key(sb, &mm, "mode");
+			json_str(sb, modes[mi.mode], strlen(modes[mi.mode]));
+			json_key(sb, &mm, "vbr");
+			json_str(sb, vbrs[mi.vbr], strlen(vbrs[mi.vbr]));
+			json_int(sb, &mm, "bitrate", mi.vbr == MPG123_ABR ? mi.abr_rate : mi.bitrate);
+			mpg123_add_string(sb, "}");
+			if((len = mpg123_framelength(mh)) >= 0)
+				json_int(sb, &members, "frames", len);
+			if((len = mpg123_length(mh)) >= 0)
+			{
+				char buf[64];
+				json_int(sb, &members, "samples", len);
+				json_key(sb, &members, "duration");
+				snprintf(buf, sizeof(buf), "%.3f", (double)len/rate);
+				mpg123_add_string(sb, buf);
+			}
+			if( mpg123_getstate(mh, MPG123_ENC_DELAY, &val, &fval) == MPG123_OK
+			&&	val >= 0 )
+			{
+				int lm = 0;
+				json_key(sb, &members, "lame");
+				mpg123_add_string(sb, "{");
+				json_int(sb, &lm, "enc_delay", val);
+				if( mpg123_getstate(mh, MPG123_ENC_PADDING, &val, &fval) == MPG123_OK
+				&&	val >= 0 )
+					json_int(sb, &lm, "enc_padding", val);
+				mpg123_add_string(sb, "}");
+			}
+		}
+		else
+		{
+			json_key(sb, &members, "error");
+			json_str(sb, mpg123_strerror(mh), strlen(mpg123_strerror(mh)));
+		}
+		/* The ID3v2 tag is parsed before the first frame, if there is any. */
+		if(mpg123_meta_check(mh) & MPG123_ID3
+		&&	mpg123_id3(mh, &dummy, &v2) == MPG123_OK && v2 != NULL)
+			json_v2(sb, &members, v2);
+		mpg123_close(mh);
+	}
+	if(have_v1)
+		json_v1(sb, &members, v1);
+	if(ape)
+		json_ape(sb, &members, ape, ape_size, ape_items);
+	free(ape);
+	compat_close(fd);
+
+batch_file_end:
+	mpg123_add_string(sb, "}\n");
+#ifdef HAVE_PTHREAD
+	pthread_mutex_lock(&outlock);
+#endif
+	fwrite(sb->p, 1, sb->fill-1, stdout);
+#ifdef HAVE_PTHREAD
+	pthread_mutex_unlock(&outlock);
+#endif
+}
+
+#ifdef HAVE_PTHREAD
+static void *batch_work(void *arg)
+{
+	struct batch_worker *bw = arg;
+	for(;;)
+	{
+		char *path;
+		pthread_mutex_lock(&queue.lock);
+		while(!queue.count && !queue.done)
+			pthread_cond_wait(&queue.filled, &queue.lock);
+		if(!queue.count)
+		{
+			pthread_mutex_unlock(&queue.lock);
+			break;
+		}
+		path = queue.path[queue.first];
+		queue.first = (queue.first+1) % BATCH_QUEUE;
+		--queue.count;
+		pthread_cond_signal(&queue.emptied);
+		pthread_mutex_unlock(&queue.lock);
+
+		batch_file(bw, path);
+		free(path);
+	}
+	return NULL;
+}
+#endif
+
+/* Hand over one file name (to be freed) to a worker or process it right here. */
+static void batch_push(struct batch_worker *bw, char *path)
+{
+	if(!path)
+	{
+		error("Out of memory for file name.");
+		++errors;
+		return;
+	}
+#ifdef HAVE_PTHREAD
+	if(param.jobs > 1)
+	{
+		pthread_mutex_lock(&queue.lock);
+		while(queue.count == BATCH_QUEUE)
+			pthread_cond_wait(&queue.emptied, &queue.lock);
+		queue.path[(queue.first+queue.count) % BATCH_QUEUE] = path;
+		++queue.count;
+		pthread_cond_signal(&queue.filled);
+		pthread_mutex_unlock(&queue.lock);
+		return;
+	}
+#endif
+	batch_file(bw, path);
+	free(path);
+}
+
+/* Files first, then subdirectories. The listing has to be opened twice
+   as files and directories are taken from the same directory stream. */
+static void batch_walk(struct batch_worker *bw, char *path)
+{
+	struct compat_dir *cd;
+	char *name;
+
+	if(!(param.recursive && compat_isdir(path)))
+	{
+		batch_push(bw, compat_strdup(path));
+		return;
+	}
+	if((cd = compat_diropen(path)))
+	{
+		while((name = compat_nextfile(cd)))
+		{
+			batch_push(bw, compat_catpath(path, name));
+			free(name);
+		}
+		compat_dirclose(cd);
+	}
+	if((cd = compat_diropen(path)))
+	{
+		while((name = compat_nextdir(cd)))
+		{
+			if(strcmp(name, ".") && strcmp(name, ".."))
+			{
+				char *sub = compat_catpath(path, name);
+				if(sub)
+					batch_walk(bw, sub);
+				free(sub);
+			}
+			free(name);
+		}
+		compat_dirclose(cd);
+	}
+	else
+	{
+		error1("Cannot open directory %s.", path);
+		++errors;
+	}
+}
+
+/* Read file names from a list, one per line. */
+static void batch_list(struct batch_worker *bw, const char *listfile)
+{
+	FILE *lf;
+	char buf[1024];
+	mpg123_string name;
+
+	lf = strcmp(listfile, "-") ? compat_fopen(listfile, "r") : stdin;
+	if(!lf)
+	{
+		error2("Cannot open list %s: %s", listfile, strerror(errno));
+		++errors;
+		return;
+	}
+	mpg123_init_string(&name);
+	while(fgets(buf, sizeof(buf), lf))
+	{
+		size_t len = strlen(buf);
+		int eol = len && buf[len-1] == '\n';
+		mpg123_add_string(&name, buf);
+		if(!eol && !feof(lf))
+			continue;
+		/* Strip line end, also from DOS files. */
+		while(name.fill > 1 && (name.p[name.fill-2] == '\n' || name.p[name.fill-2] == '\r'))
+			name.p[--name.fill-1] = 0;
+		if(name.fill > 1)
+			batch_walk(bw, name.p);
+		name.fill = 0;
+	}
+	mpg123_free_string(&name);
+	if(lf != stdin)
+		compat_fclose(lf);
+}
+
+static int batch_main(int argc, char **argv)
+{
+	struct batch_worker *bw;
+	long jobs = param.jobs > 1 ? param.jobs : 1;
+	long j;
+	int i;
+
+	bw = malloc(sizeof(*bw)*jobs);
+	if(!bw)
+	{
+		error("Out of memory.");
+		return 1;
+	}
+	for(j=0; j<jobs; ++j)
+	{
+		mpg123_init_string(&bw[j].line);
+		bw[j].mh = mpg123_new(NULL, NULL);
+		if(!bw[j].mh)
+		{
+			error("Cannot create handle.");
+			exit(1);
+		}
+		mpg123_param(bw[j].mh, MPG123_ADD_FLAGS, MPG123_QUIET|MPG123_NO_PEEK_END, 0.);
+		if(param.store_pics)
+			mpg123_param(bw[j].mh, MPG123_ADD_FLAGS, MPG123_PICTURE, 0.);
+		else
+			mpg123_param(bw[j].mh, MPG123_REMOVE_FLAGS, MPG123_PICTURE, 0.);
+	}
+#ifdef HAVE_PTHREAD
+	if(jobs > 1)
+	{
+		for(j=0; j<jobs; ++j)
+		{
+			if(pthread_create(&bw[j].thread, NULL, batch_work, bw+j))
+			{
+				error("Cannot create worker thread.");
+				exit(1);
+			}
+		}
+	}
+#endif
+	for(i=loptind; i<argc; ++i)
+		batch_walk(bw, argv[i]);
+	if(param.listfile)
+		batch_list(bw, param.listfile);
+#ifdef HAVE_PTHREAD
+	if(jobs > 1)
+	{
+		pthread_mutex_lock(&queue.lock);
+		queue.done = 1;
+		pthread_cond_broadcast(&queue.filled);
+		pthread_mutex_unlock(&queue.lock);
+		for(j=0; j<jobs; ++j)
+			pthread_join(bw[j].thread, NULL);
+	}
+#endif
+	for(j=0; j<jobs; ++j)
+	{
+		mpg123_delete(bw[j].mh);
+		mpg123_free_string(&bw[j].line);
+	}
+	free(bw);
+	fflush(stdout);
+	if(errors) error1("Encountered %i errors along the way.", errors);
+	return errors != 0;
+}
+
 int main(int argc, char **argv)
 {
 	int i, result;
@@ -374,9 +1079,15 @@ int main(int argc, char **argv)
 #ifdef WIN32
 	fprintf(stderr, "WARNING: This tool is not yet adapted to run on Windows (file I/O, unicode arguments)!\n");
 #endif
-	if(loptind >= argc) usage(1);
+	if(loptind >= argc && !(param.batch && param.listfile)) usage(1);
 
 	mpg123_init();
+	if(param.batch)
+	{
+		result = batch_main(argc, argv);
+		mpg123_exit();
+		return result;
+	}
 	m = mpg123_new(NULL, NULL);
 	mpg123_param(m, MPG123_ADD_FLAGS, MPG123_PICTURE, 0.);
 
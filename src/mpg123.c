@@ -622,6 +622,7 @@ topt opts[] = {
 	{0, "fuzzy", GLO_INT,  set_frameflag, &frameflag, MPG123_FUZZY},
 	{0, "index-size", GLO_ARG|GLO_LONG, 0, &param.index_size, 0},
 	{0, "no-seekbuffer", GLO_INT, unset_frameflag, &frameflag, MPG123_SEEKBUFFER},
+	{0, "mmap", GLO_INT, set_frameflag, &frameflag, MPG123_MMAP},
 	{'e', "encoding", GLO_ARG|GLO_CHAR, 0, &param.force_encoding, 0},
 	{0, "preframes", GLO_ARG|GLO_LONG, 0, &param.preframes, 0},
 	{0, "skip-id3v2", GLO_INT, set_frameflag, &frameflag, MPG123_SKIP_ID3V2},
@@ -1518,6 +1519,7 @@ static void long_usage(int err)
 	fprintf(o,"        --ignore-mime      ignore HTTP MIME types (content-type)\n");
 #endif
 	fprintf(o,"        --no-seekbuffer    disable seek buffer\n");
+	fprintf(o,"        --mmap             map local files into memory instead of reading\n");
 	fprintf(o," -@ <f> --list <f>         play songs in playlist <f> (plain list, m3u, pls (shoutcast))\n");
 	fprintf(o," -l <n> --listentry <n>    play nth title in playlist; show whole playlist for n < 0\n");
 	fprintf(o,"        --continue         playlist continuation mode (see man page)\n");
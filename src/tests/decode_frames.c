@@ -0,0 +1,212 @@
+/*
+	decode_frames: check mpg123_decode_frames() against mpg123_decode_frame()
+
+	copyright 2020 by the mpg123 project - free software under the terms of the LGPL 2.1
+	see COPYING and AUTHORS files in distribution or http://mpg123.org
+
+	A set of handles decodes a file with mpg123_decode_frames(), another
+	set with mpg123_decode_frame(). Handle i of each set skips i frames
+	first, so that the handles are at different offsets in the synth
+	history. With the x86-64 and AVX decoders (and all that do not batch),
+	output and clip counts have to be identical. For the generic decoder,
+	the documented bound is checked: 16 bit may differ by 1, float by
+	2^-20 of the peak of the frame (here with a margin of 4). 32 bit just
+	follows from the float sums.
+*/
+
+#include "compat.h"
+#include <mpg123.h>
+#include "debug.h"
+
+#define HANDLES 12
+
+static const int encodings[] =
+{
+	MPG123_ENC_SIGNED_16
+,	MPG123_ENC_SIGNED_32
+,	MPG123_ENC_FLOAT_32
+};
+
+static mpg123_handle *open_handle(const char *path, const char *decoder, int enc, int skip)
+{
+	int err = MPG123_OK;
+	const long *rates;
+	size_t rate_count, i;
+	mpg123_handle *mh = mpg123_new(decoder, &err);
+	if(mh == NULL)
+	{
+		error1("cannot create handle: %s", mpg123_plain_strerror(err));
+		return NULL;
+	}
+	mpg123_param(mh, MPG123_ADD_FLAGS, MPG123_QUIET, 0.);
+	mpg123_format_none(mh);
+	mpg123_rates(&rates, &rate_count);
+	for(i=0; i<rate_count; ++i)
+		mpg123_format(mh, rates[i], MPG123_MONO|MPG123_STEREO, enc);
+	if(mpg123_open(mh, path) != MPG123_OK)
+	{
+		error2("cannot open %s: %s", path, mpg123_strerror(mh));
+		mpg123_delete(mh);
+		return NULL;
+	}
+	for(; skip>=0; --skip)
+	{
+		off_t num;
+		unsigned char *audio;
+		size_t bytes;
+		while(mpg123_decode_frame(mh, &num, &audio, &bytes) == MPG123_NEW_FORMAT)
+			continue;
+	}
+	mpg123_clip(mh);
+	return mh;
+}
+
+/* Returns 0 if the outputs are within the bound. */
+static int compare(int enc, int exact, unsigned char *a, unsigned char *b, size_t bytes)
+{
+	size_t i;
+
+	if(exact || enc == MPG123_ENC_SIGNED_32)
+		return (exact && memcmp(a, b, bytes)) ? -1 : 0;
+	if(enc == MPG123_ENC_SIGNED_16)
+	{
+		for(i=0; i<bytes/sizeof(short); ++i)
+		{
+			int d = ((short*)a)[i] - ((short*)b)[i];
+			if(d > 1 || d < -1)
+				return -1;
+		}
+	}
+	else
+	{
+		float peak = 0;
+		for(i=0; i<bytes/sizeof(float); ++i)
+		{
+			float x = ((float*)a)[i];
+			if(x > peak)
+				peak = x;
+			if(-x > peak)
+				peak = -x;
+		}
+		for(i=0; i<bytes/sizeof(float); ++i)
+		{
+			float d = ((float*)a)[i] - ((float*)b)[i];
+			if(d > peak/(1<<18) || -d > peak/(1<<18))
+				return -1;
+		}
+	}
+	return 0;
+}
+
+static int test_frames(const char *path, const char *decoder, int enc)
+{
+	mpg123_handle *single[HANDLES];
+	mpg123_handle *batch[HANDLES];
+	int ret[HANDLES];
+	unsigned char *audio[HANDLES];
+	size_t bytes[HANDLES];
+	int exact;
+	int live = HANDLES;
+	int err = 0;
+	int i;
+
+	memset(single, 0, sizeof(single));
+	memset(batch, 0, sizeof(batch));
+	for(i=0; i<HANDLES; ++i)
+	{
+		if( !(single[i] = open_handle(path, decoder, enc, i))
+		||  !(batch[i]  = open_handle(path, decoder, enc, i)) )
+		{
+			err = -1;
+			goto test_end;
+		}
+	}
+	/* The one actually at work, generic_dither is generic for float. */
+	exact = strcmp(mpg123_current_decoder(single[0]), "generic");
+	while(live && !err)
+	{
+		if(mpg123_decode_frames(batch, HANDLES, ret, audio, bytes) != MPG123_OK)
+		{
+			error("mpg123_decode_frames() failed");
+			err = -1;
+			break;
+		}
+		live = 0;
+		for(i=0; i<HANDLES; ++i)
+		{
+			off_t num;
+			unsigned char *ref;
+			size_t refbytes;
+			int refret;
+			/* The single handle gets over that in the next call. */
+			if(ret[i] == MPG123_NEW_FORMAT)
+			{
+				++live;
+				continue;
+			}
+			while((refret = mpg123_decode_frame(single[i], &num, &ref, &refbytes))
+				== MPG123_NEW_FORMAT)
+				continue;
+			if(refret != ret[i])
+			{
+				error3("handle %i returns %i instead of %i", i, ret[i], refret);
+				err = -1;
+				break;
+			}
+			if(refret != MPG123_OK)
+				continue;
+			++live;
+			if( refbytes != bytes[i]
+			||  compare(enc, exact, ref, audio[i], refbytes)
+			||  (exact && mpg123_clip(single[i]) != mpg123_clip(batch[i])) )
+			{
+				error2("handle %i differs in frame %"OFF_P, i, (off_p)num);
+				err = -1;
+				break;
+			}
+		}
+	}
+test_end:
+	for(i=0; i<HANDLES; ++i)
+	{
+		mpg123_delete(batch[i]);
+		mpg123_delete(single[i]);
+	}
+	return err;
+}
+
+int main(int argc, char **argv)
+{
+	const char **decoders;
+	const int *enc_list;
+	size_t enc_count;
+	int errsum = 0;
+	size_t d, e, i;
+
+	if(argc < 2)
+	{
+		printf("Gimme a MPEG file name...\n");
+		return 0;
+	}
+	mpg123_init();
+	decoders = mpg123_supported_decoders();
+	mpg123_encodings(&enc_list, &enc_count);
+	for(d=0; decoders[d] != NULL; ++d)
+	for(e=0; e<sizeof(encodings)/sizeof(*encodings); ++e)
+	{
+		int err;
+		for(i=0; i<enc_count; ++i)
+			if(enc_list[i] == encodings[e])
+				break;
+		if(i == enc_count)
+			continue;
+		printf("decoder %s, encoding 0x%x: ", decoders[d], encodings[e]);
+		err = test_frames(argv[1], decoders[d], encodings[e]);
+		printf("%s\n", err ? "FAIL" : "PASS");
+		if(err)
+			++errsum;
+	}
+	mpg123_exit();
+	printf("%s\n", errsum ? "FAIL" : "PASS");
+	return errsum;
+}
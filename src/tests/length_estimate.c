@@ -0,0 +1,147 @@
+/*
+	length_estimate: check that a leading ID3v2 tag does not count as audio
+
+	copyright 2020 by the mpg123 project - free software under the terms of the LGPL 2.1
+	see COPYING and AUTHORS files in distribution or http://mpg123.org
+
+	Without Info frame and scan, mpg123_length() and mpg123_framelength()
+	estimate from the stream size. The given file is opened as is and with
+	a big ID3v2 tag in front (all padding), both from memory. The Info
+	frame is ignored. The estimates have to be the same.
+*/
+
+#include "compat.h"
+#include <mpg123.h>
+#include "debug.h"
+
+#define TAGSIZE (1<<20)
+
+struct membuf
+{
+	unsigned char *data;
+	off_t size;
+	off_t pos;
+};
+
+static ssize_t mem_read(void *handle, void *buf, size_t count)
+{
+	struct membuf *mb = handle;
+	if(count > (size_t)(mb->size - mb->pos))
+		count = (size_t)(mb->size - mb->pos);
+	memcpy(buf, mb->data+mb->pos, count);
+	mb->pos += count;
+	return (ssize_t)count;
+}
+
+static off_t mem_lseek(void *handle, off_t offset, int whence)
+{
+	struct membuf *mb = handle;
+	off_t pos;
+	switch(whence)
+	{
+		case SEEK_SET: pos = offset; break;
+		case SEEK_CUR: pos = mb->pos + offset; break;
+		case SEEK_END: pos = mb->size + offset; break;
+		default: return -1;
+	}
+	if(pos < 0 || pos > mb->size)
+		return -1;
+	return (mb->pos = pos);
+}
+
+/* Open the memory and get the estimates after decoding the first frame. */
+static int estimate(struct membuf *mb, off_t *length, off_t *frames)
+{
+	int err = MPG123_OK;
+	off_t num;
+	unsigned char *audio;
+	size_t bytes;
+	int ret = -1;
+	mpg123_handle *mh = mpg123_new(NULL, &err);
+	if(mh == NULL)
+	{
+		error1("cannot create handle: %s", mpg123_plain_strerror(err));
+		return -1;
+	}
+	mpg123_param(mh, MPG123_ADD_FLAGS, MPG123_QUIET|MPG123_IGNORE_INFOFRAME, 0.);
+	mb->pos = 0;
+	if( mpg123_replace_reader_handle(mh, mem_read, mem_lseek, NULL) != MPG123_OK
+	||	mpg123_open_handle(mh, mb) != MPG123_OK )
+	{
+		error1("cannot open: %s", mpg123_strerror(mh));
+		goto estimate_end;
+	}
+	while((err = mpg123_decode_frame(mh, &num, &audio, &bytes)) == MPG123_NEW_FORMAT)
+		continue;
+	if(err != MPG123_OK)
+	{
+		error1("cannot decode: %s", mpg123_strerror(mh));
+		goto estimate_end;
+	}
+	*length = mpg123_length(mh);
+	*frames = mpg123_framelength(mh);
+	ret = 0;
+estimate_end:
+	mpg123_delete(mh);
+	return ret;
+}
+
+int main(int argc, char **argv)
+{
+	struct membuf plain = { NULL, 0, 0 };
+	struct membuf tagged = { NULL, 0, 0 };
+	off_t plain_length, plain_frames;
+	off_t tagged_length, tagged_frames;
+	FILE *in;
+	int ret = 1;
+
+	if(argc < 2)
+	{
+		printf("Gimme a MPEG file name...\n");
+		return 0;
+	}
+	if(!(in = compat_fopen(argv[1], "rb")))
+	{
+		error1("cannot open %s", argv[1]);
+		return 1;
+	}
+	fseek(in, 0, SEEK_END);
+	plain.size = ftell(in);
+	fseek(in, 0, SEEK_SET);
+	tagged.size = plain.size + TAGSIZE + 10;
+	if(plain.size > 0 && (tagged.data = malloc(tagged.size)))
+	{
+		plain.data = tagged.data + TAGSIZE + 10;
+		if(fread(plain.data, plain.size, 1, in) != 1)
+			plain.size = 0;
+	}
+	compat_fclose(in);
+	if(!plain.data || !plain.size)
+	{
+		error1("cannot read %s", argv[1]);
+		goto main_end;
+	}
+	/* ID3v2.4 header with synchsafe size, the rest is padding. */
+	memcpy(tagged.data, "ID3\4\0\0", 6);
+	tagged.data[6] = (TAGSIZE>>21) & 0x7f;
+	tagged.data[7] = (TAGSIZE>>14) & 0x7f;
+	tagged.data[8] = (TAGSIZE>>7)  & 0x7f;
+	tagged.data[9] =  TAGSIZE      & 0x7f;
+	memset(tagged.data+10, 0, TAGSIZE);
+
+	mpg123_init();
+	if( !estimate(&plain, &plain_length, &plain_frames)
+	&&	!estimate(&tagged, &tagged_length, &tagged_frames) )
+	{
+		printf( "length %"OFF_P" and %"OFF_P", frames %"OFF_P" and %"OFF_P"\n"
+		,	(off_p)plain_length, (off_p)tagged_length
+		,	(off_p)plain_frames, (off_p)tagged_frames );
+		if(plain_length == tagged_length && plain_frames == tagged_frames)
+			ret = 0;
+	}
+	mpg123_exit();
+main_end:
+	free(tagged.data);
+	printf("%s\n", ret ? "FAIL" : "PASS");
+	return ret;
+}
@@ -0,0 +1,402 @@
+/*
+	mpg123-bench: time all built-in decoders on the same input
+
+	copyright 2020 by the mpg123 project - free software under the terms of the LGPL 2.1
+	see COPYING and AUTHORS files in distribution or http://mpg123.org
+
+	The input is held in memory and fed to libmpg123, so no I/O is timed.
+	Without file arguments, a deterministic synthetic MPEG 1.0 Layer III
+	stream (random but valid side info, random main data) is generated.
+
+	For each decoder, output encoding (s16, s32, f32) and synth path
+	(stereo, mono mix, NtoM resampling), the whole input is decoded and
+	the time per frame is reported. The parsing stage (frame sync, header
+	and side info, without decoding) is timed separately and subtracted
+	to give the time spent in Layer decoding plus synthesis. A separate
+	run with MPG123_STATS gives the share of the synthesis filter bank.
+
+	With -s, that many independent handles decode the same input in
+	round-robin, one frame each in turn, as a server mixing many streams
+	would do. The input is fed by reference, so all handles share it.
+	With -b, the handles decode their frames together with
+	mpg123_decode_frames(), which runs the synthesis of eligible handles
+	in one batch.
+*/
+
+#include "compat.h"
+#include <mpg123.h>
+#include "debug.h"
+
+#define SYNTH_FRAMES 2000
+#define NTOM_RATE 37800
+
+struct bench_path
+{
+	const char *name;
+	long flags;
+	int channels;
+	long rate;
+};
+
+static const struct bench_path paths[] =
+{
+	{ "stereo", 0, MPG123_STEREO, 0 }
+,	{ "mono",   MPG123_MONO_MIX, MPG123_MONO, 0 }
+,	{ "ntom",   0, MPG123_STEREO, NTOM_RATE }
+};
+
+static const struct { const char *name; int enc; } encs[] =
+{
+	{ "s16", MPG123_ENC_SIGNED_16 }
+,	{ "s32", MPG123_ENC_SIGNED_32 }
+,	{ "f32", MPG123_ENC_FLOAT_32 }
+};
+
+static double now(void)
+{
+	struct timeval tv;
+	gettimeofday(&tv, NULL);
+	return tv.tv_sec + 1e-6*tv.tv_usec;
+}
+
+/* Simple deterministic generator, no need for rand() differences. */
+static unsigned long seed = 1;
+static unsigned long rnd(unsigned long range)
+{
+	seed = (seed * 1103515245UL + 12345UL) & 0x7fffffffUL;
+	return (seed >> 8) % range;
+}
+
+struct bitwriter
+{
+	unsigned char *p;
+	int bit;
+};
+
+static void putbits(struct bitwriter *bw, unsigned long val, int n)
+{
+	while(n--)
+	{
+		if(!bw->bit) *bw->p = 0;
+		if(val & (1UL<<n)) *bw->p |= 0x80 >> bw->bit;
+		if(++bw->bit == 8)
+		{
+			bw->bit = 0;
+			++bw->p;
+		}
+	}
+}
+
+/* 128 kbit/s joint stereo at 44.1 kHz, no bit reservoir. */
+static unsigned char *synth_stream(size_t frames, size_t *size)
+{
+	static const int sel_long[]  = { 0,1,2,3,5,7,9,13,15,16,20,24,28,31 };
+	static const int sel_short[] = { 0,1,2,3,5,7,9,13,15,16,24,31 };
+	unsigned char *data, *fp;
+	size_t f;
+
+	data = malloc(frames*418);
+	if(data == NULL) return NULL;
+	fp = data;
+	for(f=0; f<frames; ++f)
+	{
+		struct bitwriter bw;
+		int pad = (int)rnd(2);
+		size_t framesize = 144000*128/44100 + pad;
+		int main_bits = (int)(framesize-4-32)*8;
+		int gr, ch;
+		size_t i;
+
+		fp[0] = 0xff;
+		fp[1] = 0xfb;
+		fp[2] = 0x90 | (pad<<1);
+		fp[3] = 0x40 | (int)(rnd(4)<<4);
+		bw.p = fp+4;
+		bw.bit = 0;
+		putbits(&bw, 0, 9); /* main_data_begin */
+		putbits(&bw, 0, 3);
+		for(ch=0; ch<2; ++ch)
+			putbits(&bw, rnd(10) < 3 ? rnd(16) : 0, 4);
+		for(gr=0; gr<2; ++gr)
+		for(ch=0; ch<2; ++ch)
+		{
+			int per = main_bits/4;
+			putbits(&bw, per*3/4 + rnd(per/4), 12);
+			putbits(&bw, 10+rnd(100), 9);
+			putbits(&bw, 130+rnd(45), 8);
+			putbits(&bw, rnd(16), 4);
+			if(rnd(10) < 2)
+			{
+				int bt = 1+(int)rnd(3);
+				putbits(&bw, 1, 1);
+				putbits(&bw, bt, 2);
+				putbits(&bw, bt == 2 && rnd(10) < 3, 1);
+				for(i=0; i<2; ++i)
+					putbits(&bw, sel_short[rnd(sizeof(sel_short)/sizeof(int))], 5);
+				for(i=0; i<3; ++i)
+					putbits(&bw, rnd(3), 3);
+			}
+			else
+			{
+				putbits(&bw, 0, 1);
+				for(i=0; i<3; ++i)
+					putbits(&bw, sel_long[rnd(sizeof(sel_long)/sizeof(int))], 5);
+				putbits(&bw, rnd(16), 4);
+				putbits(&bw, rnd(8), 3);
+			}
+			putbits(&bw, rnd(2), 1);
+			putbits(&bw, rnd(2), 1);
+			putbits(&bw, rnd(2), 1);
+		}
+		for(i=4+32; i<framesize; ++i)
+			fp[i] = (unsigned char)rnd(256);
+		fp += framesize;
+	}
+	*size = fp-data;
+	return data;
+}
+
+static mpg123_handle *bench_handle(const char *decoder, const struct bench_path *path, int enc, long flags, const unsigned char *data, size_t size)
+{
+	int err;
+	mpg123_handle *mh = mpg123_new(decoder, &err);
+	if(mh == NULL)
+	{
+		error2("cannot create handle for %s: %s", decoder, mpg123_plain_strerror(err));
+		return NULL;
+	}
+	mpg123_param(mh, MPG123_ADD_FLAGS, MPG123_QUIET|path->flags|flags, 0.);
+	if(path->rate)
+		mpg123_param(mh, MPG123_FORCE_RATE, path->rate, 0.);
+	mpg123_format_none(mh);
+	if( mpg123_format2(mh, 0, path->channels, enc) != MPG123_OK
+	||	mpg123_open_feed(mh) != MPG123_OK
+	||	mpg123_feed_ref(mh, data, size, NULL, NULL) != MPG123_OK )
+	{
+		error2("cannot set up %s: %s", decoder, mpg123_strerror(mh));
+		mpg123_delete(mh);
+		return NULL;
+	}
+	return mh;
+}
+
+/* Time for parsing all frames, without decoding. */
+static double bench_parse(const unsigned char *data, size_t size, long *frames)
+{
+	double start;
+	int ret;
+	mpg123_handle *mh = bench_handle(NULL, paths, MPG123_ENC_SIGNED_16, 0, data, size);
+	if(mh == NULL) return -1;
+	*frames = 0;
+	start = now();
+	while((ret = mpg123_framebyframe_next(mh)) == MPG123_OK || ret == MPG123_NEW_FORMAT)
+		++*frames;
+	start = now()-start;
+	mpg123_delete(mh);
+	return start;
+}
+
+/* Time for decoding all frames of all streams, returns -1 if not possible.
+   With synth != NULL, the handles measure their stages and synth gets
+   the share of the synthesis filter bank in decoding. With batch, each
+   turn is one call of mpg123_decode_frames() for all active handles. */
+static double bench_decode(const char *decoder, const struct bench_path *path, int enc, const unsigned char *data, size_t size, int streams, int batch, long *frames, double *synth)
+{
+	double start;
+	int ret = MPG123_ERR;
+	off_t num;
+	unsigned char *audio;
+	size_t bytes;
+	int created, active, s;
+	mpg123_handle **mh = malloc(sizeof(*mh)*streams);
+	int *rets = malloc(sizeof(*rets)*streams);
+	if(mh == NULL || rets == NULL)
+	{
+		free(rets);
+		free(mh);
+		return -1;
+	}
+	for(created=0; created<streams; ++created)
+	{
+		mh[created] = bench_handle( decoder, path, enc
+		,	synth ? MPG123_STATS : 0, data, size );
+		if(mh[created] == NULL) break;
+	}
+	active = created == streams ? streams : 0;
+	*frames = 0;
+	start = now();
+	/* Handles at the end of the stream are swapped out of the turn. */
+	while(active > 0)
+	{
+		if(batch)
+			mpg123_decode_frames(mh, active, rets, NULL, NULL);
+		for(s=0; s<active; ++s)
+		{
+			ret = batch ? rets[s] : mpg123_decode_frame(mh[s], &num, &audio, &bytes);
+			if(ret == MPG123_OK)
+				++*frames;
+			else if(ret == MPG123_NEED_MORE)
+			{
+				mpg123_handle *done = mh[s];
+				mh[s] = mh[--active];
+				rets[s--] = rets[active];
+				mh[active] = done;
+			}
+			else if(ret != MPG123_NEW_FORMAT)
+			{
+				active = 0;
+				break;
+			}
+		}
+	}
+	start = now()-start;
+	if(synth)
+	{
+		double total = 0;
+		double part = 0;
+		double val;
+		for(s=0; s<created; ++s)
+		{
+			if(mpg123_getstate(mh[s], MPG123_STATS_DECODE, NULL, &val) == MPG123_OK)
+				total += val;
+			if(mpg123_getstate(mh[s], MPG123_STATS_SYNTH, NULL, &val) == MPG123_OK)
+			{
+				total += val;
+				part  += val;
+			}
+		}
+		*synth = total > 0 ? part/total : -1;
+	}
+	for(s=0; s<created; ++s)
+		mpg123_delete(mh[s]);
+	free(rets);
+	free(mh);
+	return ret == MPG123_NEED_MORE ? start : -1;
+}
+
+static int bench(const char *name, const unsigned char *data, size_t size, int repeat, int streams, int batch)
+{
+	const char **decoders = mpg123_supported_decoders();
+	int ntom = mpg123_feature(MPG123_FEATURE_DECODE_NTOM);
+	long frames = 0;
+	double parse = -1;
+	int d, e, p, r;
+
+	for(r=0; r<repeat; ++r)
+	{
+		double t = bench_parse(data, size, &frames);
+		if(t >= 0 && (parse < 0 || t < parse)) parse = t;
+	}
+	if(parse < 0 || frames < 1)
+	{
+		error1("%s: no frames", name);
+		return -1;
+	}
+	printf( "%s: %ld frames, parsing %.0f ns/frame, %d stream%s%s\n", name, frames
+	,	1e9*parse/frames, streams, streams > 1 ? "s" : "", batch ? ", batched" : "" );
+	printf("%-16s %-4s %-7s %12s %12s %12s %7s\n"
+	,	"decoder", "enc", "path", "frames/s", "ns/frame", "decode+synth", "synth");
+	for(d=0; decoders[d] != NULL; ++d)
+	for(e=0; e<sizeof(encs)/sizeof(*encs); ++e)
+	for(p=0; p<sizeof(paths)/sizeof(*paths); ++p)
+	{
+		double best = -1;
+		double synth = -1;
+		long dframes = 0;
+		long sframes = 0;
+		if(paths[p].rate && !ntom) continue;
+		for(r=0; r<repeat; ++r)
+		{
+			double t = bench_decode( decoders[d], paths+p, encs[e].enc
+			,	data, size, streams, batch, &dframes, NULL );
+			if(t >= 0 && (best < 0 || t < best)) best = t;
+		}
+		if(best > 0)
+			bench_decode( decoders[d], paths+p, encs[e].enc
+			,	data, size, 1, 0, &sframes, &synth );
+		if(best <= 0 || dframes < 1)
+		{
+			printf("%-16s %-4s %-7s %12s\n", decoders[d], encs[e].name, paths[p].name, "n/a");
+			continue;
+		}
+		printf( "%-16s %-4s %-7s %12.0f %12.0f %12.0f", decoders[d], encs[e].name
+		,	paths[p].name, dframes/best, 1e9*best/dframes
+		,	1e9*(best/dframes-parse/frames) );
+		if(synth >= 0)
+			printf(" %6.1f%%\n", 100*synth);
+		else
+			printf(" %7s\n", "n/a");
+	}
+	return 0;
+}
+
+int main(int argc, char **argv)
+{
+	int repeat = 3;
+	int streams = 1;
+	int batch = 0;
+	int ret = 0;
+	int i = 1;
+
+	for(; i+1 < argc && argv[i][0] == '-'; i += 2)
+	{
+		if(!strcmp(argv[i], "-r"))
+			repeat = atoi(argv[i+1]);
+		else if(!strcmp(argv[i], "-s"))
+			streams = atoi(argv[i+1]);
+		else if(!strcmp(argv[i], "-b"))
+		{
+			streams = atoi(argv[i+1]);
+			batch = 1;
+		}
+		else
+			break;
+	}
+	if(repeat < 1) repeat = 1;
+	if(streams < 1) streams = 1;
+	if(i < argc && argv[i][0] == '-')
+	{
+		fprintf(stderr, "usage: %s [-r repeats] [-s streams | -b streams] [file ...]\n", argv[0]);
+		return 1;
+	}
+	mpg123_init();
+	if(i == argc)
+	{
+		size_t size;
+		unsigned char *data = synth_stream(SYNTH_FRAMES, &size);
+		if(data == NULL)
+		{
+			error("out of memory");
+			return 1;
+		}
+		ret = bench("synthetic", data, size, repeat, streams, batch);
+		free(data);
+	}
+	for(; i<argc; ++i)
+	{
+		FILE *in = fopen(argv[i], "rb");
+		unsigned char *data = NULL;
+		size_t size = 0;
+		size_t got;
+
+		if(in == NULL)
+		{
+			error1("cannot open %s", argv[i]);
+			ret = -1;
+			continue;
+		}
+		do
+		{
+			unsigned char *nd = realloc(data, size+65536);
+			if(nd == NULL) break;
+			data = nd;
+			got = fread(data+size, 1, 65536, in);
+			size += got;
+		} while(got == 65536);
+		fclose(in);
+		if(data == NULL || size == 0 || bench(argv[i], data, size, repeat, streams, batch))
+			ret = -1;
+		free(data);
+	}
+	return ret ? 1 : 0;
+}
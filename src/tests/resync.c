@@ -0,0 +1,348 @@
+/*
+	resync: feed damaged streams and check that decoding recovers
+
+	copyright 2020 by the mpg123 project - free software under the terms of the LGPL 2.1
+	see COPYING and AUTHORS files in distribution or http://mpg123.org
+
+	The given file is decoded as is, noting the position of each frame.
+	Then a copy is damaged: junk without sync words is put in front of some
+	frames, the main data of others is overwritten with random bytes. The
+	latter drives dequantization, stereo processing and alias reduction
+	with values far from sane audio. Both are fed in odd-sized chunks.
+	Every frame has to come out with the right size and, some
+	frames after the damage (bit reservoir, overlap and synth history),
+	with the same samples as from the intact stream. A damaged frame that
+	fails dequantization skips synthesis of the rest of its granules,
+	which shifts the synth buffer offset for good. The sums are rounded
+	differently then, so samples may still differ a bit, but not by a
+	16 bit step (of the frame peak, if that goes beyond full scale, as
+	in streams with broken frames). Float output is used if available,
+	keeping dither out of the picture. This is done for each decoder.
+	The given file itself has to be intact, this does not tell apart
+	damage that is already there.
+*/
+
+#include "compat.h"
+#include <mpg123.h>
+#include "debug.h"
+
+/* Every DAMAGE_STEP frames, alternating junk and main data damage. */
+#define DAMAGE_START 10
+#define DAMAGE_STEP 37
+#define JUNK 517
+#define SMASH 64
+/* Frames after damage that may differ. */
+#define SETTLE 6
+#define CHUNK 1153
+
+static uint32_t rng_state = 2463534242UL;
+
+/* xorshift32, good enough for test data */
+static uint32_t rng(void)
+{
+	rng_state ^= rng_state << 13;
+	rng_state ^= rng_state >> 17;
+	rng_state ^= rng_state << 5;
+	return rng_state;
+}
+
+struct decoded
+{
+	unsigned char *data;
+	size_t fill;
+	size_t size;
+	size_t *frame_bytes;
+	off_t *frame_pos;
+	size_t frames;
+	size_t frames_size;
+};
+
+static void decoded_free(struct decoded *d)
+{
+	free(d->data);
+	free(d->frame_bytes);
+	free(d->frame_pos);
+	memset(d, 0, sizeof(*d));
+}
+
+static int decoded_add(struct decoded *d, unsigned char *audio, size_t bytes, off_t pos)
+{
+	if(d->fill + bytes > d->size)
+	{
+		size_t size = 2*(d->fill+bytes);
+		unsigned char *data = realloc(d->data, size);
+		if(!data)
+			return -1;
+		d->data = data;
+		d->size = size;
+	}
+	if(d->frames == d->frames_size)
+	{
+		size_t size = d->frames_size ? 2*d->frames_size : 1024;
+		size_t *fb = realloc(d->frame_bytes, size*sizeof(*fb));
+		off_t *fp;
+		if(!fb)
+			return -1;
+		d->frame_bytes = fb;
+		if(!(fp = realloc(d->frame_pos, size*sizeof(*fp))))
+			return -1;
+		d->frame_pos = fp;
+		d->frames_size = size;
+	}
+	memcpy(d->data+d->fill, audio, bytes);
+	d->fill += bytes;
+	d->frame_bytes[d->frames] = bytes;
+	d->frame_pos[d->frames++] = pos;
+	return 0;
+}
+
+static int encoding = MPG123_ENC_SIGNED_16;
+
+static mpg123_handle *new_handle(const char *decoder)
+{
+	int err = MPG123_OK;
+	mpg123_handle *mh = mpg123_new(decoder, &err);
+	if(mh == NULL)
+	{
+		error1("cannot create handle: %s", mpg123_plain_strerror(err));
+		return NULL;
+	}
+	mpg123_param(mh, MPG123_ADD_FLAGS, MPG123_QUIET, 0.);
+	/* One fixed format for both runs. */
+	mpg123_format_none(mh);
+	mpg123_format(mh, 44100, MPG123_MONO|MPG123_STEREO, encoding);
+	mpg123_format(mh, 48000, MPG123_MONO|MPG123_STEREO, encoding);
+	mpg123_format(mh, 32000, MPG123_MONO|MPG123_STEREO, encoding);
+	return mh;
+}
+
+/* Feed the stream in chunks and decode all of it, storing output and
+   position of each frame. */
+static int decode_feed( const char *decoder, unsigned char *stream, size_t size
+,	struct decoded *d )
+{
+	mpg123_handle *mh = new_handle(decoder);
+	size_t fed = 0;
+	unsigned char *audio;
+	size_t bytes;
+	off_t num;
+	int ret;
+
+	if(!mh)
+		return -1;
+	if(mpg123_open_feed(mh) != MPG123_OK)
+	{
+		error1("cannot open feed: %s", mpg123_strerror(mh));
+		mpg123_delete(mh);
+		return -1;
+	}
+	do
+	{
+		ret = mpg123_decode_frame(mh, &num, &audio, &bytes);
+		if(ret == MPG123_NEED_MORE && fed < size)
+		{
+			size_t chunk = size-fed > CHUNK ? CHUNK : size-fed;
+			ret = mpg123_feed(mh, stream+fed, chunk);
+			fed += chunk;
+		}
+		else if(ret == MPG123_OK && decoded_add(d, audio, bytes, mpg123_framepos(mh)))
+			ret = MPG123_ERR;
+	} while(ret == MPG123_OK || ret == MPG123_NEW_FORMAT);
+	if(ret != MPG123_NEED_MORE)
+		error1("decoding failed: %s", mpg123_strerror(mh));
+	mpg123_delete(mh);
+	return ret == MPG123_NEED_MORE ? 0 : -1;
+}
+
+/* Copy the stream with damage at the frames noted in clean, marking them. */
+static unsigned char *damage( const unsigned char *stream, size_t size
+,	struct decoded *clean, char *damaged, size_t *damaged_size )
+{
+	unsigned char *out = malloc(size + clean->frames/DAMAGE_STEP*JUNK + JUNK);
+	size_t in = 0;
+	size_t fill = 0;
+	size_t f;
+	int junk = 1;
+
+	if(!out)
+		return NULL;
+	for(f=DAMAGE_START; f+1<clean->frames; f+=DAMAGE_STEP)
+	{
+		size_t pos = (size_t)clean->frame_pos[f];
+		size_t next = (size_t)clean->frame_pos[f+1];
+		size_t i;
+		/* Only frames with room for the damage behind header and side info. */
+		if(next-pos < 40+SMASH)
+			continue;
+		memcpy(out+fill, stream+in, pos-in);
+		fill += pos-in;
+		in = pos;
+		if(junk)
+		{
+			/* Seven bits per byte cannot form a sync word. */
+			for(i=0; i<JUNK; ++i)
+				out[fill++] = rng() & 0x7f;
+		}
+		else
+		{
+			memcpy(out+fill, stream+in, next-pos);
+			for(i=0; i<SMASH; ++i)
+				out[fill+next-pos-SMASH+i] = rng() & 0xff;
+			fill += next-pos;
+			in = next;
+		}
+		damaged[f] = 1;
+		junk = !junk;
+	}
+	memcpy(out+fill, stream+in, size-in);
+	*damaged_size = fill+size-in;
+	return out;
+}
+
+/* Returns 0 if a is within a 16 bit step of b. */
+static int compare(const unsigned char *a, const unsigned char *b, size_t bytes)
+{
+	float bound = 1.f;
+	size_t i;
+	if(encoding == MPG123_ENC_SIGNED_16)
+	{
+		for(i=0; i<bytes/sizeof(short); ++i)
+		{
+			int d = ((const short*)a)[i] - ((const short*)b)[i];
+			if(d > 1 || d < -1)
+				return -1;
+		}
+		return 0;
+	}
+	for(i=0; i<bytes/sizeof(float); ++i)
+	{
+		float x = ((const float*)b)[i];
+		if(x > bound)
+			bound = x;
+		if(-x > bound)
+			bound = -x;
+	}
+	bound /= 32768;
+	for(i=0; i<bytes/sizeof(float); ++i)
+	{
+		float d = ((const float*)a)[i] - ((const float*)b)[i];
+		if(d > bound || d < -bound)
+			return -1;
+	}
+	return 0;
+}
+
+static int test_resync(const char *decoder, unsigned char *stream, size_t size)
+{
+	struct decoded clean;
+	struct decoded broken;
+	unsigned char *damaged_stream = NULL;
+	size_t damaged_size = 0;
+	char *damaged = NULL;
+	size_t f, off;
+	size_t settle = 0;
+	size_t checked = 0;
+	int err = -1;
+
+	memset(&clean, 0, sizeof(clean));
+	memset(&broken, 0, sizeof(broken));
+	if(decode_feed(decoder, stream, size, &clean))
+		goto test_end;
+	if( clean.frames < DAMAGE_START+DAMAGE_STEP
+	||	!(damaged = calloc(clean.frames, 1))
+	||	!(damaged_stream = damage(stream, size, &clean, damaged, &damaged_size)) )
+	{
+		error("file too short or out of memory");
+		goto test_end;
+	}
+	if(decode_feed(decoder, damaged_stream, damaged_size, &broken))
+		goto test_end;
+	if(broken.frames != clean.frames)
+	{
+		error2("%"SIZE_P" frames instead of %"SIZE_P
+		,	(size_p)broken.frames, (size_p)clean.frames);
+		goto test_end;
+	}
+	for(f=0, off=0; f<clean.frames; off+=clean.frame_bytes[f++])
+	{
+		if(damaged[f])
+			settle = SETTLE;
+		if(broken.frame_bytes[f] != clean.frame_bytes[f])
+		{
+			error1("frame %"SIZE_P" has wrong size", (size_p)f);
+			goto test_end;
+		}
+		if(settle)
+		{
+			--settle;
+			continue;
+		}
+		if(compare(broken.data+off, clean.data+off, clean.frame_bytes[f]))
+		{
+			error1("frame %"SIZE_P" differs after damage", (size_p)f);
+			goto test_end;
+		}
+		++checked;
+	}
+	err = checked ? 0 : -1;
+test_end:
+	free(damaged);
+	free(damaged_stream);
+	decoded_free(&broken);
+	decoded_free(&clean);
+	return err;
+}
+
+int main(int argc, char **argv)
+{
+	const char **decoders;
+	const int *enc_list;
+	size_t enc_count;
+	unsigned char *stream = NULL;
+	long size = 0;
+	FILE *in;
+	int errsum = 0;
+	size_t d, i;
+
+	if(argc < 2)
+	{
+		printf("Gimme a MPEG file name...\n");
+		return 0;
+	}
+	if(!(in = compat_fopen(argv[1], "rb")))
+	{
+		error1("cannot open %s", argv[1]);
+		return 1;
+	}
+	fseek(in, 0, SEEK_END);
+	size = ftell(in);
+	fseek(in, 0, SEEK_SET);
+	if(size > 0 && (stream = malloc(size)) && fread(stream, size, 1, in) != 1)
+		size = 0;
+	compat_fclose(in);
+	if(!stream || size <= 0)
+	{
+		error1("cannot read %s", argv[1]);
+		free(stream);
+		return 1;
+	}
+	mpg123_init();
+	mpg123_encodings(&enc_list, &enc_count);
+	for(i=0; i<enc_count; ++i)
+		if(enc_list[i] == MPG123_ENC_FLOAT_32)
+			encoding = MPG123_ENC_FLOAT_32;
+	decoders = mpg123_supported_decoders();
+	for(d=0; decoders[d] != NULL; ++d)
+	{
+		int err;
+		printf("decoder %s: ", decoders[d]);
+		err = test_resync(decoders[d], stream, (size_t)size);
+		printf("%s\n", err ? "FAIL" : "PASS");
+		if(err)
+			++errsum;
+	}
+	mpg123_exit();
+	free(stream);
+	printf("%s\n", errsum ? "FAIL" : "PASS");
+	return errsum;
+}
@@ -0,0 +1,212 @@
+/*
+	smooth_volume: check MPG123_SMOOTH_VOLUME against the plain volume
+
+	copyright 2020 by the mpg123 project - free software under the terms of the LGPL 2.1
+	see COPYING and AUTHORS files in distribution or http://mpg123.org
+
+	Three handles decode the same file: one with the volume in the
+	synthesis tables, one with MPG123_SMOOTH_VOLUME and one at unity
+	volume. After some frames, the volume changes. The smooth handle ramps
+	over the next frame, after that its output has to be within the
+	documented bound of the plain volume: 1 for 16 bit, 2^-18 of full
+	scale for 32 bit and float (of the frame peak at unity volume if that
+	is beyond full scale). Integer frames that the synthesis clips at
+	unity volume are not compared, the smooth volume applies after that
+	clipping.
+*/
+
+#include "compat.h"
+#include <mpg123.h>
+#include "debug.h"
+
+/* Frames before the volume change. */
+#define PREROLL 5
+
+static const int encodings[] =
+{
+	MPG123_ENC_SIGNED_16
+,	MPG123_ENC_SIGNED_32
+,	MPG123_ENC_FLOAT_32
+};
+
+static mpg123_handle *open_handle(const char *path, int enc, long flags)
+{
+	int err = MPG123_OK;
+	const long *rates;
+	size_t rate_count, i;
+	mpg123_handle *mh = mpg123_new(NULL, &err);
+	if(mh == NULL)
+	{
+		error1("cannot create handle: %s", mpg123_plain_strerror(err));
+		return NULL;
+	}
+	mpg123_param(mh, MPG123_ADD_FLAGS, MPG123_QUIET|flags, 0.);
+	mpg123_format_none(mh);
+	mpg123_rates(&rates, &rate_count);
+	for(i=0; i<rate_count; ++i)
+		mpg123_format(mh, rates[i], MPG123_MONO|MPG123_STEREO, enc);
+	if(mpg123_open(mh, path) != MPG123_OK)
+	{
+		error2("cannot open %s: %s", path, mpg123_strerror(mh));
+		mpg123_delete(mh);
+		return NULL;
+	}
+	return mh;
+}
+
+static int decode(mpg123_handle *mh, unsigned char **audio, size_t *bytes)
+{
+	off_t num;
+	int ret;
+	while((ret = mpg123_decode_frame(mh, &num, audio, bytes)) == MPG123_NEW_FORMAT)
+		continue;
+	return ret;
+}
+
+/*
+	Returns 0 if smooth is within the bound of plain. Frames that the
+	synthesis clips at unity volume are skipped for integer output.
+*/
+#define COMPARE_INT(type, min, max, bound) \
+{ \
+	type *u = (type*)unity; \
+	type *p = (type*)plain; \
+	type *s = (type*)smooth; \
+	for(i=0; i<bytes/sizeof(type); ++i) \
+		if(u[i] == min || u[i] == max) \
+			return 0; \
+	for(i=0; i<bytes/sizeof(type); ++i) \
+		if( (int64_t)s[i]-p[i] > (bound) || (int64_t)p[i]-s[i] > (bound) ) \
+			return -1; \
+}
+
+static int compare( int enc, unsigned char *plain, unsigned char *smooth
+,	unsigned char *unity, size_t bytes )
+{
+	size_t i;
+
+	switch(enc)
+	{
+		case MPG123_ENC_SIGNED_16:
+			COMPARE_INT(int16_t, -32768, 32767, 1)
+		break;
+		case MPG123_ENC_SIGNED_32:
+			COMPARE_INT(int32_t, -2147483647-1, 2147483647, 1<<13)
+		break;
+		case MPG123_ENC_FLOAT_32:
+		{
+			float *u = (float*)unity;
+			float *p = (float*)plain;
+			float *s = (float*)smooth;
+			float bound = 1.f;
+			for(i=0; i<bytes/sizeof(float); ++i)
+			{
+				if(u[i] > bound)
+					bound = u[i];
+				if(-u[i] > bound)
+					bound = -u[i];
+			}
+			bound /= 1<<18;
+			for(i=0; i<bytes/sizeof(float); ++i)
+				if(s[i]-p[i] > bound || p[i]-s[i] > bound)
+					return -1;
+		}
+		break;
+	}
+	return 0;
+}
+
+static int test_volume(const char *path, int enc, double volume)
+{
+	mpg123_handle *plain = NULL;
+	mpg123_handle *smooth = NULL;
+	mpg123_handle *unity = NULL;
+	unsigned char *audio[3];
+	size_t bytes[3];
+	int frame = 0;
+	int err = -1;
+	int ret;
+
+	if( !(plain  = open_handle(path, enc, 0))
+	||	!(smooth = open_handle(path, enc, MPG123_SMOOTH_VOLUME))
+	||	!(unity  = open_handle(path, enc, 0)) )
+		goto test_end;
+	while(1)
+	{
+		if(frame == PREROLL)
+		{
+			mpg123_volume(plain, volume);
+			mpg123_volume(smooth, volume);
+		}
+		ret = decode(plain, &audio[0], &bytes[0]);
+		if( decode(smooth, &audio[1], &bytes[1]) != ret
+		||	decode(unity, &audio[2], &bytes[2]) != ret )
+		{
+			error1("decoders disagree at frame %i", frame);
+			goto test_end;
+		}
+		if(ret == MPG123_DONE)
+			break;
+		if(ret != MPG123_OK)
+		{
+			error1("decoding failed: %s", mpg123_strerror(plain));
+			goto test_end;
+		}
+		if(bytes[1] != bytes[0] || bytes[2] != bytes[0])
+		{
+			error1("different output size at frame %i", frame);
+			goto test_end;
+		}
+		/* Before the change, both are at unity, then one frame of ramp. */
+		if( frame != PREROLL
+		&&	compare(enc, audio[0], audio[1], audio[2], bytes[0]) )
+		{
+			error1("output differs at frame %i", frame);
+			goto test_end;
+		}
+		++frame;
+	}
+	err = frame > PREROLL+1 ? 0 : -1;
+test_end:
+	mpg123_delete(unity);
+	mpg123_delete(smooth);
+	mpg123_delete(plain);
+	return err;
+}
+
+int main(int argc, char **argv)
+{
+	static const double volumes[] = { 0.5, 0.3, 1.7 };
+	const int *enc_list;
+	size_t enc_count;
+	int errsum = 0;
+	size_t e, i, v;
+
+	if(argc < 2)
+	{
+		printf("Gimme a MPEG file name...\n");
+		return 0;
+	}
+	mpg123_init();
+	mpg123_encodings(&enc_list, &enc_count);
+	for(e=0; e<sizeof(encodings)/sizeof(*encodings); ++e)
+	{
+		for(i=0; i<enc_count; ++i)
+			if(enc_list[i] == encodings[e])
+				break;
+		if(i == enc_count)
+			continue;
+		for(v=0; v<sizeof(volumes)/sizeof(*volumes); ++v)
+		{
+			int err;
+			printf("encoding 0x%x, volume %g: ", encodings[e], volumes[v]);
+			err = test_volume(argv[1], encodings[e], volumes[v]);
+			printf("%s\n", err ? "FAIL" : "PASS");
+			if(err)
+				++errsum;
+		}
+	}
+	mpg123_exit();
+	printf("%s\n", errsum ? "FAIL" : "PASS");
+	return errsum;
+}
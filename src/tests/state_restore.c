@@ -0,0 +1,138 @@
+/*
+	state_restore: check mpg123_state_save() and mpg123_state_restore()
+
+	copyright 2020 by the mpg123 project - free software under the terms of the LGPL 2.1
+	see COPYING and AUTHORS files in distribution or http://mpg123.org
+
+	One handle decodes some output, stores its state and then decodes the
+	rest. A second handle restores that state and has to produce the very
+	same bytes. The reads use an odd block size so that the state includes
+	decoded output not returned yet. This is done at several positions,
+	with native rate and with NtoM resampling.
+*/
+
+#include "compat.h"
+#include <mpg123.h>
+#include "debug.h"
+
+#define BLOCK 1000
+#define NTOM_RATE 37800
+
+static mpg123_handle *open_handle(const char *path, long rate)
+{
+	int err = MPG123_OK;
+	mpg123_handle *mh = mpg123_new(NULL, &err);
+	if(mh == NULL)
+	{
+		error1("cannot create handle: %s", mpg123_plain_strerror(err));
+		return NULL;
+	}
+	mpg123_param(mh, MPG123_ADD_FLAGS, MPG123_QUIET|MPG123_GAPLESS, 0.);
+	if(rate)
+		mpg123_param(mh, MPG123_FORCE_RATE, rate, 0.);
+	if(mpg123_open(mh, path) != MPG123_OK)
+	{
+		error2("cannot open %s: %s", path, mpg123_strerror(mh));
+		mpg123_delete(mh);
+		return NULL;
+	}
+	return mh;
+}
+
+/* Fill a block, returns bytes read or -1 at the end.
+   A read can stop short to announce the format, so keep going. */
+static long read_block(mpg123_handle *mh, unsigned char *buf)
+{
+	size_t fill = 0;
+	size_t done;
+	int ret;
+	do
+	{
+		ret = mpg123_read(mh, buf+fill, BLOCK-fill, &done);
+		fill += done;
+	} while(fill < BLOCK && (ret == MPG123_OK || ret == MPG123_NEW_FORMAT));
+	return fill ? (long)fill : -1;
+}
+
+/* Returns 0 on success, 1 if the track is shorter than skip, -1 on failure. */
+static int test_state(const char *path, long rate, long skip)
+{
+	mpg123_handle *a = NULL;
+	mpg123_handle *b = NULL;
+	unsigned char *blob = NULL;
+	size_t size = 0;
+	unsigned char bufa[BLOCK];
+	unsigned char bufb[BLOCK];
+	long total = 0;
+	long got;
+	int ret = -1;
+
+	if(!(a = open_handle(path, rate)) || !(b = open_handle(path, rate)))
+		goto test_end;
+	while(total < skip)
+	{
+		if((got = read_block(a, bufa)) < 0)
+		{
+			ret = 1;
+			goto test_end;
+		}
+		total += got;
+	}
+	if(mpg123_state_save(a, &blob, &size) != MPG123_OK)
+	{
+		error1("saving failed: %s", mpg123_strerror(a));
+		goto test_end;
+	}
+	if(mpg123_state_restore(b, blob, size) != MPG123_OK)
+	{
+		error1("restoring failed: %s", mpg123_strerror(b));
+		goto test_end;
+	}
+	do
+	{
+		got = read_block(a, bufa);
+		if(read_block(b, bufb) != got || (got > 0 && memcmp(bufa, bufb, got)))
+		{
+			error1("output differs after %li bytes", total);
+			goto test_end;
+		}
+		if(got > 0)
+			total += got;
+	} while(got >= 0);
+	ret = 0;
+test_end:
+	mpg123_free(blob);
+	mpg123_delete(b);
+	mpg123_delete(a);
+	return ret;
+}
+
+int main(int argc, char **argv)
+{
+	static const long skips[] = { 0, 7*BLOCK, 100*BLOCK+1, 1000*BLOCK };
+	static const long rates[] = { 0, NTOM_RATE };
+	int errsum = 0;
+	size_t r, s;
+
+	if(argc < 2)
+	{
+		printf("Gimme a MPEG file name...\n");
+		return 0;
+	}
+	mpg123_init();
+	for(r=0; r<sizeof(rates)/sizeof(*rates); ++r)
+	for(s=0; s<sizeof(skips)/sizeof(*skips); ++s)
+	{
+		int err;
+		if(rates[r] && !mpg123_feature(MPG123_FEATURE_DECODE_NTOM))
+			continue;
+		printf("restore after %li bytes, rate %li: ", skips[s], rates[r]);
+		err = test_state(argv[1], rates[r], skips[s]);
+		printf("%s\n", err == 0 ? "PASS" : (err > 0 ? "SKIP" : "FAIL"));
+		if(err < 0)
+			++errsum;
+	}
+	mpg123_exit();
+	printf("%s\n", errsum ? "FAIL" : "PASS");
+	return errsum;
+}
@@ -0,0 +1,214 @@
+/*
+	syn123_simd: check the vectorized libsyn123 kernels against the plain code
+
+	copyright 2020 by the mpg123 project - free software under the terms of the LGPL 2.1
+	see COPYING and AUTHORS files in distribution or http://mpg123.org
+
+	The SSE2/AVX2 kernels (AVX2 if the CPU has it) only take blocks of
+	their vector width, the scalar code does the rest. So, calls for one
+	sample at a time use the scalar code only, while one call for the
+	whole buffer uses the kernels.
+	Conversion, mixing and amplification have to give the same bytes
+	and clip counts both ways, also for extreme values, infinity and NaN.
+*/
+
+#include "compat.h"
+#include <syn123.h>
+#include "debug.h"
+
+#define SAMPLES 1003
+#define MAXCHANNELS 6
+
+static uint32_t rng_state = 2463534242UL;
+
+/* xorshift32, good enough for test data */
+static uint32_t rng(void)
+{
+	rng_state ^= rng_state << 13;
+	rng_state ^= rng_state >> 17;
+	rng_state ^= rng_state << 5;
+	return rng_state;
+}
+
+/* Mostly full scale, sometimes far beyond or special. */
+static double random_value(void)
+{
+	static const double special[] =
+	{
+		0., -0., 1., -1., 32767./32768., -32769./32768., 2., -2., 1e30, -1e30
+	,	0x1p-30, 1./0., -1./0., 0./0.
+	};
+	uint32_t r = rng();
+	if(r % 16 == 0)
+		return special[(r>>4) % (sizeof(special)/sizeof(*special))];
+	return ((double)(int32_t)rng() / 2147483648.) * (r % 16 == 1 ? 1.5 : 1.);
+}
+
+static void fill(void *buf, int enc, size_t count)
+{
+	size_t i;
+	for(i=0; i<count; ++i) switch(enc)
+	{
+		case MPG123_ENC_SIGNED_16:
+			((int16_t*)buf)[i] = (int16_t)rng();
+		break;
+		case MPG123_ENC_SIGNED_32:
+			((int32_t*)buf)[i] = (int32_t)rng();
+		break;
+		case MPG123_ENC_FLOAT_32:
+			((float*)buf)[i] = (float)random_value();
+		break;
+		case MPG123_ENC_FLOAT_64:
+			((double*)buf)[i] = random_value();
+		break;
+	}
+}
+
+/* Returns 0 if bulk and single-sample conversion agree. */
+static int test_conv(syn123_handle *sh, int src_enc, int dst_enc)
+{
+	double src[SAMPLES];
+	double bulk[SAMPLES];
+	double single[SAMPLES];
+	size_t srcsize = MPG123_SAMPLESIZE(src_enc);
+	size_t dstsize = MPG123_SAMPLESIZE(dst_enc);
+	size_t bulk_clips = 0;
+	size_t single_clips = 0;
+	size_t bytes, clips, i;
+
+	fill(src, src_enc, SAMPLES);
+	memset(bulk, 0, sizeof(bulk));
+	memset(single, 0, sizeof(single));
+	if(syn123_conv( bulk, dst_enc, sizeof(bulk), src, src_enc
+	,	SAMPLES*srcsize, &bytes, &bulk_clips, sh ))
+	{
+		error("bulk conversion failed");
+		return -1;
+	}
+	for(i=0; i<SAMPLES; ++i)
+	{
+		if(syn123_conv( (char*)single+i*dstsize, dst_enc, dstsize
+		,	(char*)src+i*srcsize, src_enc, srcsize, &bytes, &clips, sh ))
+		{
+			error("single conversion failed");
+			return -1;
+		}
+		single_clips += clips;
+	}
+	return (memcmp(bulk, single, SAMPLES*dstsize) || bulk_clips != single_clips)
+	?	-1 : 0;
+}
+
+static int test_mix(int enc, int src_channels, int dst_channels)
+{
+	double src[SAMPLES*MAXCHANNELS];
+	double bulk[SAMPLES*MAXCHANNELS];
+	double single[SAMPLES*MAXCHANNELS];
+	double mixmatrix[MAXCHANNELS*MAXCHANNELS];
+	size_t size = MPG123_SAMPLESIZE(enc);
+	int i;
+
+	fill(src, enc, SAMPLES*src_channels);
+	fill(bulk, enc, SAMPLES*dst_channels);
+	memcpy(single, bulk, sizeof(single));
+	for(i=0; i<src_channels*dst_channels; ++i)
+		mixmatrix[i] = (double)(rng() % 2000) / 1000. - 1.;
+	if(syn123_mix( bulk, enc, dst_channels, src, enc, src_channels
+	,	mixmatrix, SAMPLES, 0, NULL, NULL ))
+	{
+		error("bulk mixing failed");
+		return -1;
+	}
+	for(i=0; i<SAMPLES; ++i)
+	{
+		if(syn123_mix( (char*)single+i*dst_channels*size, enc, dst_channels
+		,	(char*)src+i*src_channels*size, enc, src_channels
+		,	mixmatrix, 1, 0, NULL, NULL ))
+		{
+			error("single mixing failed");
+			return -1;
+		}
+	}
+	return memcmp(bulk, single, SAMPLES*dst_channels*size) ? -1 : 0;
+}
+
+static int test_amp(int enc)
+{
+	double bulk[SAMPLES];
+	double single[SAMPLES];
+	size_t size = MPG123_SAMPLESIZE(enc);
+	size_t i;
+
+	fill(bulk, enc, SAMPLES);
+	memcpy(single, bulk, sizeof(single));
+	if(syn123_amp(bulk, enc, SAMPLES, 0.7, 0.01, NULL, NULL))
+	{
+		error("bulk amplification failed");
+		return -1;
+	}
+	for(i=0; i<SAMPLES; ++i)
+	{
+		if(syn123_amp((char*)single+i*size, enc, 1, 0.7, 0.01, NULL, NULL))
+		{
+			error("single amplification failed");
+			return -1;
+		}
+	}
+	return memcmp(bulk, single, SAMPLES*size) ? -1 : 0;
+}
+
+int main()
+{
+	static const int conv[][2] =
+	{
+		{ MPG123_ENC_SIGNED_16, MPG123_ENC_FLOAT_32 }
+	,	{ MPG123_ENC_SIGNED_16, MPG123_ENC_SIGNED_32 }
+	,	{ MPG123_ENC_SIGNED_32, MPG123_ENC_FLOAT_32 }
+	,	{ MPG123_ENC_FLOAT_32,  MPG123_ENC_SIGNED_16 }
+	,	{ MPG123_ENC_FLOAT_32,  MPG123_ENC_SIGNED_24 }
+	,	{ MPG123_ENC_FLOAT_32,  MPG123_ENC_SIGNED_32 }
+	,	{ MPG123_ENC_FLOAT_32,  MPG123_ENC_FLOAT_64 }
+	,	{ MPG123_ENC_FLOAT_64,  MPG123_ENC_FLOAT_32 }
+	};
+	static const int layouts[][2] = { {1,2}, {2,1}, {2,2}, {2,6}, {6,2} };
+	static const int floats[] = { MPG123_ENC_FLOAT_32, MPG123_ENC_FLOAT_64 };
+	syn123_handle *sh;
+	int errsum = 0;
+	int err;
+	size_t i, j;
+
+	sh = syn123_new(44100, 1, MPG123_ENC_FLOAT_32, 0, &err);
+	if(!sh)
+	{
+		error1("cannot create handle: %s", syn123_strerror(err));
+		return 1;
+	}
+	for(i=0; i<sizeof(conv)/sizeof(*conv); ++i)
+	{
+		printf("conversion 0x%x to 0x%x: ", conv[i][0], conv[i][1]);
+		err = test_conv(sh, conv[i][0], conv[i][1]);
+		printf("%s\n", err ? "FAIL" : "PASS");
+		if(err)
+			++errsum;
+	}
+	for(i=0; i<sizeof(floats)/sizeof(*floats); ++i)
+	{
+		for(j=0; j<sizeof(layouts)/sizeof(*layouts); ++j)
+		{
+			printf( "mixing 0x%x from %i to %i channels: "
+			,	floats[i], layouts[j][0], layouts[j][1] );
+			err = test_mix(floats[i], layouts[j][0], layouts[j][1]);
+			printf("%s\n", err ? "FAIL" : "PASS");
+			if(err)
+				++errsum;
+		}
+		printf("amplification 0x%x: ", floats[i]);
+		err = test_amp(floats[i]);
+		printf("%s\n", err ? "FAIL" : "PASS");
+		if(err)
+			++errsum;
+	}
+	syn123_del(sh);
+	printf("%s\n", errsum ? "FAIL" : "PASS");
+	return errsum;
+}